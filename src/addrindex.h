@@ -9,32 +9,48 @@
 
 #include <serialize.h>
 #include <amount.h>
+#include <hash.h>
+#include <script/script.h>
 #include <uint256.h>
 
+/**
+ * Address index rows are keyed by the hash of the output script instead of the
+ * address string : a fixed 20 byte prefix, and no address encoding per output.
+ * Heights and indexes are big endian so the rows of an address sort by height.
+ */
+inline uint160 GetAddrIndexHash(const CScript &script) {
+    return Hash160(script.begin(), script.end());
+}
+
 struct CAddrIndexKey {
-    std::string addr;
+    uint160 hashBytes;
     int32_t blockHeight;
     uint32_t txindex;
     uint256 txhash;
-    int32_t index;
+    uint32_t index;
     bool spending;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream> void Serialize(Stream &s) const {
+        hashBytes.Serialize(s);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+        txhash.Serialize(s);
+        ser_writedata32be(s, index);
+        ser_writedata8(s, spending);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream &s, Operation ser_action) {
-        READWRITE(addr);
-        READWRITE(blockHeight);
-        READWRITE(txindex);
-        READWRITE(txhash);
-        READWRITE(index);
-        READWRITE(spending);
+    template <typename Stream> void Unserialize(Stream &s) {
+        hashBytes.Unserialize(s);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+        txhash.Unserialize(s);
+        index = ser_readdata32be(s);
+        spending = ser_readdata8(s);
     }
 
-    CAddrIndexKey(const std::string &address, int32_t height,
-                  int32_t blockindex, const uint256 &txid, int32_t indexValue,
-                  bool isSpending) {
-        addr = address;
+    CAddrIndexKey(const uint160 &hash, int32_t height, uint32_t blockindex,
+                  const uint256 &txid, uint32_t indexValue, bool isSpending) {
+        hashBytes = hash;
         blockHeight = height;
         txindex = blockindex;
         txhash = txid;
@@ -45,7 +61,7 @@ struct CAddrIndexKey {
     CAddrIndexKey() { SetNull(); }
 
     void SetNull() {
-        addr = "";
+        hashBytes.SetNull();
         blockHeight = 0;
         txindex = 0;
         txhash.SetNull();
@@ -55,47 +71,129 @@ struct CAddrIndexKey {
 };
 
 struct CAddrIndexIteratorKey {
-    std::string addr;
+    uint160 hashBytes;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream> void Serialize(Stream &s) const {
+        hashBytes.Serialize(s);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream &s, Operation ser_action) {
-        READWRITE(addr);
+    template <typename Stream> void Unserialize(Stream &s) {
+        hashBytes.Unserialize(s);
     }
 
-    CAddrIndexIteratorKey(const std::string &content) { addr = content; }
+    CAddrIndexIteratorKey(const uint160 &hash) { hashBytes = hash; }
 
     CAddrIndexIteratorKey() { SetNull(); }
 
-    void SetNull() { addr = ""; }
+    void SetNull() { hashBytes.SetNull(); }
 };
 
 struct CAddrIndexIteratorHeightKey {
-    std::string addr;
+    uint160 hashBytes;
     int32_t blockHeight;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream> void Serialize(Stream &s) const {
+        hashBytes.Serialize(s);
+        ser_writedata32be(s, blockHeight);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream &s, Operation ser_action) {
-        READWRITE(addr);
-        READWRITE(blockHeight);
+    template <typename Stream> void Unserialize(Stream &s) {
+        hashBytes.Unserialize(s);
+        blockHeight = ser_readdata32be(s);
     }
 
-    CAddrIndexIteratorHeightKey(const std::string &content, int32_t height) {
-        addr = content;
+    CAddrIndexIteratorHeightKey(const uint160 &hash, int32_t height) {
+        hashBytes = hash;
         blockHeight = height;
     }
 
     CAddrIndexIteratorHeightKey() { SetNull(); }
 
     void SetNull() {
-        addr = "";
+        hashBytes.SetNull();
         blockHeight = 0;
     }
 };
 
+/**
+ * Bounds of one page of the history of an address. Rows are visited in key
+ * order (height, position in block, txid, index, spending) or in reverse, and
+ * the iteration never leaves the rows of the address.
+ */
+struct CAddrIndexQuery {
+    uint160 hashBytes;
+    int32_t nStartHeight; // 0 for no lower bound
+    int32_t nEndHeight;   // 0 for no upper bound
+    bool fDescending;
+    // Count transactions instead of rows for offset and limit, pages then
+    // never split the rows of a transaction
+    bool fDistinctTx;
+    size_t nOffset;
+    size_t nLimit; // 0 for no limit
+    // Resume at this key (included), as returned in CAddrIndexPage::next
+    bool fHasCursor;
+    CAddrIndexKey cursor;
+
+    explicit CAddrIndexQuery(const uint160 &hash)
+        : hashBytes(hash), nStartHeight(0), nEndHeight(0), fDescending(false),
+          fDistinctTx(false), nOffset(0), nLimit(0), fHasCursor(false) {}
+};
+
+struct CAddrIndexPage {
+    std::vector<std::pair<CAddrIndexKey, Amount> > rows;
+    // Set with the first key of the next page if the limit was reached
+    bool fMore = false;
+    CAddrIndexKey next;
+};
+
+/** Running totals of an address, updated with its index rows */
+struct CAddrBalance {
+    Amount balance;
+    Amount received;
+    uint64_t nTxCount;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(VARINT(nTxCount));
+    }
+
+    CAddrBalance() { SetNull(); }
+
+    void SetNull() {
+        balance = Amount();
+        received = Amount();
+        nTxCount = 0;
+    }
+
+    bool IsNull() const { return nTxCount == 0; }
+};
+
+/** Key of the former index layout (address string first), only read to drop it */
+struct CLegacyAddrIndexKey {
+    std::string addr;
+    int32_t blockHeight;
+    uint32_t txindex;
+    uint256 txhash;
+    int32_t index;
+    bool spending;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(addr);
+        READWRITE(blockHeight);
+        READWRITE(txindex);
+        READWRITE(txhash);
+        READWRITE(index);
+        READWRITE(spending);
+    }
+};
+
 struct CMempoolAddrDelta {
     int64_t time;
     Amount amount;
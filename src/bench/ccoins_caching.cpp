@@ -5,8 +5,10 @@
 #include <bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
+#include <unordered_map>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -88,3 +90,80 @@ static void CCoinsCaching(benchmark::State &state) {
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// The coins cache map, compared to the std::unordered_map it replaced.
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>
+    UnorderedCoinsMap;
+
+static const size_t MAP_COINS = 100000;
+
+static std::vector<COutPoint> RandomOutpoints(size_t count) {
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        outpoints.emplace_back(TxId(rng.rand256()), rng.randrange(4));
+    }
+    return outpoints;
+}
+
+template <typename Map>
+static void FillCoinsMap(Map &map, const std::vector<COutPoint> &outpoints) {
+    for (const COutPoint &outpoint : outpoints) {
+        CCoinsCacheEntry &entry = map[outpoint];
+        entry.coin = Coin(CTxOut(50 * CENT, CScript() << OP_TRUE), 1, false);
+        entry.flags = CCoinsCacheEntry::DIRTY;
+    }
+}
+
+// Fill a map and clear it, as the cache is filled and flushed. The map of the
+// cache also uses less memory per coin, checked here as well.
+template <typename Map> static void CoinsMapFill(benchmark::State &state) {
+    const std::vector<COutPoint> outpoints = RandomOutpoints(MAP_COINS);
+    {
+        Map map;
+        UnorderedCoinsMap unordered;
+        FillCoinsMap(map, outpoints);
+        FillCoinsMap(unordered, outpoints);
+        assert(memusage::DynamicUsage(map) <=
+               memusage::DynamicUsage(unordered));
+    }
+    while (state.KeepRunning()) {
+        Map map;
+        FillCoinsMap(map, outpoints);
+        map.clear();
+    }
+}
+
+// Look up coins of the map, half of them missing.
+template <typename Map> static void CoinsMapLookup(benchmark::State &state) {
+    const std::vector<COutPoint> outpoints = RandomOutpoints(2 * MAP_COINS);
+    Map map;
+    FillCoinsMap(map, std::vector<COutPoint>(outpoints.begin(),
+                                             outpoints.begin() + MAP_COINS));
+    size_t found = 0;
+    while (state.KeepRunning()) {
+        for (const COutPoint &outpoint : outpoints) {
+            found += map.find(outpoint) != map.end();
+        }
+    }
+    assert(found % MAP_COINS == 0);
+}
+
+static void CCoinsMapFill(benchmark::State &state) {
+    CoinsMapFill<CCoinsMap>(state);
+}
+static void CCoinsUnorderedMapFill(benchmark::State &state) {
+    CoinsMapFill<UnorderedCoinsMap>(state);
+}
+static void CCoinsMapLookup(benchmark::State &state) {
+    CoinsMapLookup<CCoinsMap>(state);
+}
+static void CCoinsUnorderedMapLookup(benchmark::State &state) {
+    CoinsMapLookup<UnorderedCoinsMap>(state);
+}
+
+BENCHMARK(CCoinsMapFill, 20);
+BENCHMARK(CCoinsUnorderedMapFill, 20);
+BENCHMARK(CCoinsMapLookup, 20);
+BENCHMARK(CCoinsUnorderedMapLookup, 20);
@@ -4,6 +4,7 @@
 
 #include <checkqueue.h>
 #include <bench.h>
+#include <crypto/sha256.h>
 #include <prevector.h>
 #include <random.h>
 #include <util.h>
@@ -52,7 +53,72 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State &state) {
         // for clarity
         control.Wait();
     }
-    tg.interrupt_all();
-    tg.join_all();
+    queue.Interrupt();
+    for (auto &t : tg) {
+        t.join();
+    }
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+// Checks costing a few microseconds each, in the batches of a large block, to
+// show how the queue scales with the number of script check threads.
+static const size_t SCALING_BATCHES = 2000;
+static const size_t SCALING_BATCH_SIZE = 10;
+static const int SCALING_HASHES = 16;
+
+static void CCheckQueueScaling(benchmark::State &state, int nThreads) {
+    struct HashJob {
+        uint8_t data[32] = {};
+        bool operator()() {
+            for (int i = 0; i < SCALING_HASHES; i++) {
+                CSHA256().Write(data, sizeof(data)).Finalize(data);
+            }
+            return true;
+        }
+        void swap(HashJob &x) { std::swap(data, x.data); }
+    };
+    CCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE};
+    std::vector<std::thread> tg;
+    // The master is one of the threads.
+    for (int x = 1; x < nThreads; ++x) {
+        tg.emplace_back(std::thread([&] { queue.Thread(); }));
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        for (size_t b = 0; b < SCALING_BATCHES; ++b) {
+            std::vector<HashJob> vChecks(SCALING_BATCH_SIZE);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    queue.Interrupt();
+    for (auto &t : tg) {
+        t.join();
+    }
+}
+
+static void CCheckQueueScaling1(benchmark::State &state) {
+    CCheckQueueScaling(state, 1);
+}
+static void CCheckQueueScaling2(benchmark::State &state) {
+    CCheckQueueScaling(state, 2);
+}
+static void CCheckQueueScaling4(benchmark::State &state) {
+    CCheckQueueScaling(state, 4);
+}
+static void CCheckQueueScaling8(benchmark::State &state) {
+    CCheckQueueScaling(state, 8);
+}
+static void CCheckQueueScaling16(benchmark::State &state) {
+    CCheckQueueScaling(state, 16);
+}
+static void CCheckQueueScaling32(benchmark::State &state) {
+    CCheckQueueScaling(state, 32);
+}
+
+BENCHMARK(CCheckQueueScaling1, 20);
+BENCHMARK(CCheckQueueScaling2, 20);
+BENCHMARK(CCheckQueueScaling4, 20);
+BENCHMARK(CCheckQueueScaling8, 20);
+BENCHMARK(CCheckQueueScaling16, 20);
+BENCHMARK(CCheckQueueScaling32, 20);
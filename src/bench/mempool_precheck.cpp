@@ -0,0 +1,115 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench.h>
+
+#include <checkqueue.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <policy/policy.h>
+#include <random.h>
+#include <script/scriptcache.h>
+#include <script/sigcache.h>
+#include <script/sighashtype.h>
+#include <script/standard.h>
+#include <validation.h>
+
+#include <cassert>
+#include <thread>
+#include <vector>
+
+// How many transactions a second get through the checks run before
+// AcceptToMemoryPool takes cs_main, which is where the time goes, depending on
+// the number of threads: each run checks PRECHECK_TXS transactions, so the
+// rate is PRECHECK_TXS divided by the time per run.
+static const size_t PRECHECK_TXS = 1000;
+
+struct PreCheckTxs {
+    std::vector<CTransactionRef> txs;
+    //! The coins spent by each transaction, as the snapshot has them
+    std::vector<std::vector<Coin>> coins;
+
+    PreCheckTxs() {
+        static bool fCachesInit = false;
+        if (!fCachesInit) {
+            InitSignatureCache();
+            InitScriptExecutionCache();
+            fCachesInit = true;
+        }
+
+        FastRandomContext rng(true);
+        CKey key;
+        key.MakeNewKey();
+        const CScript scriptPubKey =
+            GetScriptForDestination(key.GetPubKey().GetID());
+        for (size_t i = 0; i < PRECHECK_TXS; i++) {
+            const Amount amount = 50 * COIN;
+            CMutableTransaction tx;
+            tx.nVersion = 1;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(TxId(rng.rand256()), 0);
+            tx.vout.emplace_back(amount - 10 * CENT, scriptPubKey);
+
+            std::vector<uint8_t> vchSig;
+            uint256 hash = SignatureHash(scriptPubKey, CTransaction(tx), 0,
+                                         SigHashType().withForkId(), amount);
+            key.SignECDSA(hash, vchSig);
+            vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+            tx.vin[0].scriptSig << vchSig << ToByteVector(key.GetPubKey());
+
+            txs.push_back(MakeTransactionRef(tx));
+            coins.push_back({Coin(CTxOut(amount, scriptPubKey), 1, false)});
+        }
+    }
+};
+
+static void MempoolPreCheck(benchmark::State &state, int nThreads) {
+    const PreCheckTxs data;
+    CCheckQueue<CTxPreCheck> queue(1);
+    std::vector<std::thread> tg;
+    // The master is one of the threads.
+    for (int x = 1; x < nThreads; ++x) {
+        tg.emplace_back(std::thread([&] { queue.Thread(); }));
+    }
+    while (state.KeepRunning()) {
+        std::vector<CValidationState> states(data.txs.size());
+        std::vector<CTxPreCheck> checks;
+        for (size_t i = 0; i < data.txs.size(); i++) {
+            // Nothing is cached, so that every run checks the signatures
+            // again
+            checks.emplace_back(data.txs[i], data.coins[i],
+                                STANDARD_SCRIPT_VERIFY_FLAGS, false,
+                                &states[i]);
+        }
+        CCheckQueueControl<CTxPreCheck> control(&queue);
+        control.Add(checks);
+        control.Wait();
+        for (const CValidationState &txState : states) {
+            assert(txState.IsValid());
+        }
+    }
+    queue.Interrupt();
+    for (auto &t : tg) {
+        t.join();
+    }
+}
+
+static void MempoolPreCheck1(benchmark::State &state) {
+    MempoolPreCheck(state, 1);
+}
+static void MempoolPreCheck2(benchmark::State &state) {
+    MempoolPreCheck(state, 2);
+}
+static void MempoolPreCheck4(benchmark::State &state) {
+    MempoolPreCheck(state, 4);
+}
+static void MempoolPreCheck8(benchmark::State &state) {
+    MempoolPreCheck(state, 8);
+}
+
+BENCHMARK(MempoolPreCheck1, 5);
+BENCHMARK(MempoolPreCheck2, 5);
+BENCHMARK(MempoolPreCheck4, 5);
+BENCHMARK(MempoolPreCheck8, 5);
@@ -0,0 +1,142 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench.h>
+
+#include <compat.h>
+#include <netbase.h>
+#include <netpoller.h>
+#include <random.h>
+#include <util.h>
+
+#include <vector>
+
+#ifndef WIN32
+
+// How the wait for peer sockets scales with the number of connections when
+// only a few of the peers send something each time: select() goes over every
+// socket on each wakeup, epoll only reports the ones that got ready.
+static const int ACTIVE_PEERS = 8;
+
+class Connections {
+public:
+    //! The ends the node waits on, and the ends its peers write to
+    std::vector<SOCKET> vNode, vPeer;
+
+    explicit Connections(int nPeers) {
+        RaiseFileDescriptorLimit(2 * nPeers + 64);
+        for (int i = 0; i < nPeers; i++) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+                break;
+            }
+            vNode.push_back(fds[0]);
+            vPeer.push_back(fds[1]);
+            SetSocketNonBlocking(vNode.back(), true);
+        }
+    }
+
+    ~Connections() {
+        for (size_t i = 0; i < vNode.size(); i++) {
+            CloseSocket(vNode[i]);
+            CloseSocket(vPeer[i]);
+        }
+    }
+
+    void Send(FastRandomContext &rng) {
+        for (int i = 0; i < ACTIVE_PEERS; i++) {
+            const char c = 0;
+            if (send(vPeer[rng.randrange(vPeer.size())], &c, 1, 0) < 0) {
+                return;
+            }
+        }
+    }
+};
+
+static void Drain(SOCKET hSocket) {
+    char buf[256];
+    while (recv(hSocket, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+    }
+}
+
+static void SocketSelect(benchmark::State &state, int nPeers) {
+    Connections conns(nPeers);
+    FastRandomContext rng(true);
+    while (state.KeepRunning()) {
+        conns.Send(rng);
+
+        fd_set fdsetRecv;
+        FD_ZERO(&fdsetRecv);
+        SOCKET hSocketMax = 0;
+        for (SOCKET hSocket : conns.vNode) {
+            FD_SET(hSocket, &fdsetRecv);
+            hSocketMax = std::max(hSocketMax, hSocket);
+        }
+        struct timeval timeout = MillisToTimeval(50);
+        if (select(hSocketMax + 1, &fdsetRecv, nullptr, nullptr, &timeout) <=
+            0) {
+            continue;
+        }
+        for (SOCKET hSocket : conns.vNode) {
+            if (FD_ISSET(hSocket, &fdsetRecv)) {
+                Drain(hSocket);
+            }
+        }
+    }
+}
+
+static void SocketEpoll(benchmark::State &state, int nPeers) {
+    Connections conns(nPeers);
+    FastRandomContext rng(true);
+    NetPoller poller;
+    if (!poller.Open()) {
+        return;
+    }
+    for (size_t i = 0; i < conns.vNode.size(); i++) {
+        poller.Add(conns.vNode[i], i);
+    }
+    // Every socket is writable when added, get these edges out of the way
+    std::vector<NetPoller::Event> events;
+    while (poller.Wait(events, 0) && !events.empty()) {
+    }
+
+    while (state.KeepRunning()) {
+        conns.Send(rng);
+
+        if (!poller.Wait(events, 50)) {
+            continue;
+        }
+        for (const NetPoller::Event &event : events) {
+            if (event.fRecv) {
+                Drain(conns.vNode[event.key]);
+            }
+        }
+    }
+}
+
+// select() can't go beyond FD_SETSIZE, and both ends of each connection are
+// in this process
+static void SocketSelect100(benchmark::State &state) {
+    SocketSelect(state, 100);
+}
+static void SocketSelect400(benchmark::State &state) {
+    SocketSelect(state, 400);
+}
+static void SocketEpoll100(benchmark::State &state) {
+    SocketEpoll(state, 100);
+}
+static void SocketEpoll400(benchmark::State &state) {
+    SocketEpoll(state, 400);
+}
+static void SocketEpoll4000(benchmark::State &state) {
+    SocketEpoll(state, 4000);
+}
+
+BENCHMARK(SocketSelect100, 50 * 1000);
+BENCHMARK(SocketSelect400, 30 * 1000);
+BENCHMARK(SocketEpoll100, 50 * 1000);
+BENCHMARK(SocketEpoll400, 50 * 1000);
+BENCHMARK(SocketEpoll4000, 30 * 1000);
+
+#endif // WIN32
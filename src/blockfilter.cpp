@@ -9,6 +9,9 @@
 #include <script/script.h>
 #include <streams.h>
 
+#include <map>
+#include <mutex>
+
 /// SerType used to serialize parameters in GCS filter encoding.
 static constexpr int GCS_SER_TYPE = SER_NETWORK;
 
@@ -194,6 +197,58 @@ bool GCSFilter::MatchAny(const ElementSet &elements) const {
     return MatchInternal(queries.data(), queries.size());
 }
 
+static const std::map<BlockFilterType, std::string> g_filter_types = {
+    {BlockFilterType::BASIC, "basic"},
+};
+
+const std::string &BlockFilterTypeName(BlockFilterType filter_type) {
+    static std::string unknown_retval = "";
+    auto it = g_filter_types.find(filter_type);
+    return it != g_filter_types.end() ? it->second : unknown_retval;
+}
+
+bool BlockFilterTypeByName(const std::string &name,
+                           BlockFilterType &filter_type) {
+    for (const auto &entry : g_filter_types) {
+        if (entry.second == name) {
+            filter_type = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::set<BlockFilterType> &AllBlockFilterTypes() {
+    static std::set<BlockFilterType> types;
+
+    static std::once_flag flag;
+    std::call_once(flag, []() {
+        for (const auto &entry : g_filter_types) {
+            types.insert(entry.first);
+        }
+    });
+
+    return types;
+}
+
+const std::string &ListBlockFilterTypes() {
+    static std::string type_list;
+
+    static std::once_flag flag;
+    std::call_once(flag, []() {
+        bool first = true;
+        for (const auto &entry : g_filter_types) {
+            if (!first) {
+                type_list += ", ";
+            }
+            type_list += entry.second;
+            first = false;
+        }
+    });
+
+    return type_list;
+}
+
 static GCSFilter::ElementSet BasicFilterElements(const CBlock &block,
                                                  const CBlockUndo &block_undo) {
     GCSFilter::ElementSet elements;
@@ -12,6 +12,8 @@
 #include <util/bytevectorhash.h>
 
 #include <cstdint>
+#include <set>
+#include <string>
 #include <unordered_set>
 #include <vector>
 
@@ -87,6 +89,20 @@ enum class BlockFilterType : uint8_t {
     INVALID = 255,
 };
 
+/** Get the human-readable name for a filter type. Returns empty string for
+ * unknown types. */
+const std::string &BlockFilterTypeName(BlockFilterType filter_type);
+
+/** Find a filter type by its human-readable name. */
+bool BlockFilterTypeByName(const std::string &name,
+                           BlockFilterType &filter_type);
+
+/** Get a list of known filter types. */
+const std::set<BlockFilterType> &AllBlockFilterTypes();
+
+/** Get a comma-separated list of known filter type names. */
+const std::string &ListBlockFilterTypes();
+
 /**
  * Complete block filter struct as defined in BIP 157. Serialization matches
  * payload of "cfilter" messages.
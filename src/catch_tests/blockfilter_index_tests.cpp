@@ -0,0 +1,195 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilter.h>
+#include <chain.h>
+#include <config.h>
+#include <index/blockfilterindex.h>
+#include <script/standard.h>
+#include <test/test_bitcoin.h>
+#include <undo.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include "catch_unit.h"
+
+// BOOST_FIXTURE_TEST_SUITE(blockfilter_index_tests, BasicTestingSetup)
+
+static bool ComputeFilter(BlockFilterType filter_type,
+                          const CBlockIndex *block_index,
+                          BlockFilter &filter) {
+  CBlock block;
+  if (!ReadBlockFromDisk(block, block_index, GetConfig())) {
+    return false;
+  }
+
+  CBlockUndo block_undo;
+  if (block_index->nHeight > 0 && !UndoReadFromDisk(block_undo, block_index)) {
+    return false;
+  }
+
+  filter = BlockFilter(filter_type, block, block_undo);
+  return true;
+}
+
+static bool CheckFilterLookups(BlockFilterIndex &filter_index,
+                               const CBlockIndex *block_index,
+                               uint256 &last_header) {
+  BlockFilter expected_filter;
+  if (!ComputeFilter(filter_index.GetFilterType(), block_index, expected_filter)) {
+    BOOST_ERROR("ComputeFilter failed on block " + std::to_string(block_index->nHeight));
+    return false;
+  }
+
+  BlockFilter filter;
+  uint256 filter_header;
+  std::vector<BlockFilter> filters;
+  std::vector<uint256> filter_hashes;
+
+  BOOST_CHECK(filter_index.LookupFilter(block_index, filter));
+  BOOST_CHECK(filter_index.LookupFilterHeader(block_index, filter_header));
+  BOOST_CHECK(filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
+  BOOST_CHECK(filter_index.LookupFilterHashRange(block_index->nHeight, block_index, filter_hashes));
+
+  BOOST_CHECK_EQUAL(filters.size(), 1);
+  BOOST_CHECK_EQUAL(filter_hashes.size(), 1);
+
+  BOOST_CHECK(filter.GetHash() == expected_filter.GetHash());
+  BOOST_CHECK(filter_header == expected_filter.ComputeHeader(last_header));
+  BOOST_CHECK(filters[0].GetHash() == expected_filter.GetHash());
+  BOOST_CHECK(filter_hashes[0] == expected_filter.GetHash());
+
+  last_header = filter_header;
+  return true;
+}
+
+TEST_CASE("blockfilter_index_initial_sync") {
+  TestChain100Setup setup;
+  BlockFilterIndex filter_index(BlockFilterType::BASIC, 1 << 20, true);
+
+  uint256 last_header;
+
+  // Filter should not be found in the index before it is started.
+  {
+    LOCK(cs_main);
+
+    BlockFilter filter;
+    uint256 filter_header;
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_hashes;
+
+    for (const CBlockIndex *block_index = chainActive.Genesis();
+         block_index != nullptr; block_index = chainActive.Next(block_index)) {
+      BOOST_CHECK(!filter_index.LookupFilter(block_index, filter));
+      BOOST_CHECK(!filter_index.LookupFilterHeader(block_index, filter_header));
+      BOOST_CHECK(!filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
+      BOOST_CHECK(!filter_index.LookupFilterHashRange(block_index->nHeight, block_index, filter_hashes));
+    }
+  }
+
+  // BlockUntilSyncedToCurrentChain should return false before index is
+  // started.
+  BOOST_CHECK(!filter_index.BlockUntilSyncedToCurrentChain());
+
+  filter_index.Start();
+
+  // Allow filter index to catch up with the block index.
+  constexpr int64_t timeout_ms = 10 * 1000;
+  int64_t time_start = GetTimeMillis();
+  while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+    BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+    MilliSleep(100);
+  }
+
+  // Check that filter index has all blocks that were in the chain before it
+  // started.
+  {
+    LOCK(cs_main);
+    const CBlockIndex *block_index;
+    for (block_index = chainActive.Genesis(); block_index != nullptr;
+         block_index = chainActive.Next(block_index)) {
+      CheckFilterLookups(filter_index, block_index, last_header);
+    }
+  }
+
+  // Check that new blocks make it into the index.
+  CScript coinbase_script_pub_key = GetScriptForDestination(setup.coinbaseKey.GetPubKey().GetID());
+  std::vector<CMutableTransaction> no_txns;
+  for (int i = 0; i < 10; i++) {
+    const CBlock &block = setup.CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+    BOOST_CHECK(filter_index.BlockUntilSyncedToCurrentChain());
+
+    const CBlockIndex *block_index;
+    {
+      LOCK(cs_main);
+      block_index = LookupBlockIndex(block.GetHash());
+    }
+    BOOST_REQUIRE(block_index != nullptr);
+    CheckFilterLookups(filter_index, block_index, last_header);
+  }
+
+  // Ranges span the whole chain, in height order.
+  {
+    LOCK(cs_main);
+    const CBlockIndex *tip = chainActive.Tip();
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_hashes;
+    BOOST_CHECK(filter_index.LookupFilterRange(0, tip, filters));
+    BOOST_CHECK(filter_index.LookupFilterHashRange(0, tip, filter_hashes));
+    BOOST_CHECK_EQUAL(filters.size(), size_t(tip->nHeight + 1));
+    BOOST_CHECK_EQUAL(filter_hashes.size(), size_t(tip->nHeight + 1));
+    for (size_t i = 0; i < filters.size(); i++) {
+      BOOST_CHECK(filters[i].GetBlockHash() == chainActive[i]->GetBlockHash());
+      BOOST_CHECK(filters[i].GetHash() == filter_hashes[i]);
+    }
+
+    // Bad ranges are rejected.
+    BOOST_CHECK(!filter_index.LookupFilterRange(-1, tip, filters));
+    BOOST_CHECK(!filter_index.LookupFilterRange(tip->nHeight + 1, tip, filters));
+  }
+
+  // shutdown sequence (c.f. Shutdown() in init.cpp)
+  filter_index.Stop();
+
+  // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+TEST_CASE("blockfilter_index_init_destroy") {
+  BasicTestingSetup setup;
+  BlockFilterIndex *filter_index;
+
+  filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+  BOOST_CHECK(filter_index == nullptr);
+
+  BOOST_CHECK(InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true, false));
+
+  filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+  BOOST_CHECK(filter_index != nullptr);
+  BOOST_CHECK(filter_index->GetFilterType() == BlockFilterType::BASIC);
+
+  // Initialize returns false if index already exists.
+  BOOST_CHECK(!InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true, false));
+
+  int iter_count = 0;
+  ForEachBlockFilterIndex([&iter_count](BlockFilterIndex &_index) { iter_count++; });
+  BOOST_CHECK_EQUAL(iter_count, 1);
+
+  BOOST_CHECK(DestroyBlockFilterIndex(BlockFilterType::BASIC));
+
+  // Destroy returns false because index was already destroyed.
+  BOOST_CHECK(!DestroyBlockFilterIndex(BlockFilterType::BASIC));
+
+  filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+  BOOST_CHECK(filter_index == nullptr);
+
+  // Reinitialize index.
+  BOOST_CHECK(InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true, false));
+
+  DestroyAllBlockFilterIndexes();
+
+  filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+  BOOST_CHECK(filter_index == nullptr);
+}
+
+// BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <coinstats.h>
+#include <ecmultiset.h>
+#include <index/coinstatsindex.h>
+#include <script/interpreter.h>
+#include <script/sighashtype.h>
+#include <script/standard.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include "catch_unit.h"
+
+// BOOST_FIXTURE_TEST_SUITE(coinstatsindex_tests, BasicTestingSetup)
+
+static void CheckStatsAtTip(const CoinStatsIndex &coin_stats_index) {
+  CCoinsStats expected;
+  FlushStateToDisk();
+  BOOST_REQUIRE(GetUTXOStats(pcoinsdbview.get(), expected, CoinStatsHashType::ECMH, nullptr, false));
+  BOOST_CHECK(!expected.index_used);
+
+  CCoinsStats stats;
+  {
+    LOCK(cs_main);
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(chainActive.Tip(), stats));
+  }
+  BOOST_CHECK(stats.index_used);
+  BOOST_CHECK_EQUAL(stats.nHeight, expected.nHeight);
+  BOOST_CHECK(stats.hashBlock == expected.hashBlock);
+  BOOST_CHECK(stats.hashSerialized == expected.hashSerialized);
+  BOOST_CHECK_EQUAL(stats.nTransactionOutputs, expected.nTransactionOutputs);
+  BOOST_CHECK_EQUAL(stats.nBogoSize, expected.nBogoSize);
+  BOOST_CHECK(stats.nTotalAmount == expected.nTotalAmount);
+}
+
+TEST_CASE("ecmultiset_order_independent") {
+  BasicTestingSetup setup;
+  const std::vector<uint8_t> a{1, 2, 3}, b{4, 5}, c{6};
+
+  ECMultiSet empty;
+  BOOST_CHECK(empty.GetHash().IsNull());
+
+  ECMultiSet ab, ba;
+  ab.Insert(a).Insert(b);
+  ba.Insert(b).Insert(a);
+  BOOST_CHECK(!ab.GetHash().IsNull());
+  BOOST_CHECK(ab.GetHash() == ba.GetHash());
+
+  // Removing an element gives back the set without it
+  ECMultiSet abc_c;
+  abc_c.Insert(c).Insert(a).Insert(b).Remove(c);
+  BOOST_CHECK(abc_c.GetHash() == ab.GetHash());
+  abc_c.Remove(a).Remove(b);
+  BOOST_CHECK(abc_c.GetHash().IsNull());
+
+  // Sets combine into their union
+  ECMultiSet sa, sb;
+  sa.Insert(a);
+  sb.Insert(b);
+  sa += sb;
+  BOOST_CHECK(sa.GetHash() == ab.GetHash());
+
+  // The state survives serialization
+  CDataStream ss(SER_DISK, 0);
+  ss << ab;
+  ECMultiSet read;
+  ss >> read;
+  BOOST_CHECK(read.GetHash() == ab.GetHash());
+}
+
+TEST_CASE("coinstatsindex_initial_sync") {
+  TestChain100Setup setup;
+  CoinStatsIndex coin_stats_index(1 << 20, true);
+
+  // Nothing is indexed before the index is started.
+  {
+    LOCK(cs_main);
+    CCoinsStats stats;
+    BOOST_CHECK(!coin_stats_index.LookUpStats(chainActive.Tip(), stats));
+  }
+  BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+  coin_stats_index.Start();
+
+  // Allow the index to catch up with the block index.
+  constexpr int64_t timeout_ms = 10 * 1000;
+  int64_t time_start = GetTimeMillis();
+  while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+    BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+    MilliSleep(100);
+  }
+
+  // The genesis block leaves the set empty.
+  {
+    LOCK(cs_main);
+    CCoinsStats stats;
+    BOOST_CHECK(coin_stats_index.LookUpStats(chainActive.Genesis(), stats));
+    BOOST_CHECK(stats.hashSerialized.IsNull());
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0);
+  }
+
+  CheckStatsAtTip(coin_stats_index);
+
+  // New blocks make it into the index.
+  CScript coinbase_script_pub_key = GetScriptForDestination(setup.coinbaseKey.GetPubKey().GetID());
+  std::vector<CMutableTransaction> no_txns;
+  for (int i = 0; i < 5; i++) {
+    setup.CreateAndProcessBlock(no_txns, coinbase_script_pub_key);
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckStatsAtTip(coin_stats_index);
+  }
+
+  // A spend takes its coin out of the set, the value sent to an unspendable
+  // output is counted apart.
+  CScript scriptPubKey = CScript() << ToByteVector(setup.coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+  CMutableTransaction spend;
+  spend.nVersion = 1;
+  spend.vin.resize(1);
+  spend.vin[0].prevout = COutPoint(setup.coinbaseTxns[0].GetId(), 0);
+  spend.vout.resize(2);
+  spend.vout[0].nValue = 11 * CENT;
+  spend.vout[0].scriptPubKey = scriptPubKey;
+  spend.vout[1].nValue = 1 * CENT;
+  spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+  std::vector<uint8_t> vchSig;
+  // Replay protection is active from the start of the regtest chain
+  uint256 hash = SignatureHash(scriptPubKey, CTransaction(spend), 0, SigHashType().withForkId(),
+                               setup.coinbaseTxns[0].vout[0].nValue, nullptr,
+                               SCRIPT_ENABLE_SIGHASH_FORKID | SCRIPT_ENABLE_REPLAY_PROTECTION);
+  BOOST_CHECK(setup.coinbaseKey.SignECDSA(hash, vchSig));
+  vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+  spend.vin[0].scriptSig << vchSig;
+
+  const CBlock &block = setup.CreateAndProcessBlock({spend}, coinbase_script_pub_key);
+  BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+  {
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    CCoinsStats stats;
+    BOOST_CHECK(coin_stats_index.LookUpStats(chainActive.Tip(), stats));
+    BOOST_CHECK(stats.nTotalUnspendableAmount == 1 * CENT);
+  }
+  CheckStatsAtTip(coin_stats_index);
+
+  // shutdown sequence (c.f. Shutdown() in init.cpp)
+  coin_stats_index.Stop();
+
+  // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+// BOOST_AUTO_TEST_SUITE_END()
@@ -168,6 +168,21 @@ TEST_CASE("key_test1") {
     BOOST_CHECK(!pubkey3.VerifySchnorr(hashMsg, ssign2));
     BOOST_CHECK(pubkey3.VerifySchnorr(hashMsg, ssign3));
 
+    // Batches of Schnorr signatures
+    CSchnorrBatch batch;
+    BOOST_CHECK(batch.Verify());
+    BOOST_CHECK(batch.Add(pubkey1, hashMsg, ssign1));
+    BOOST_CHECK(batch.Add(pubkey2, hashMsg, ssign2));
+    BOOST_CHECK(batch.Add(pubkey3, hashMsg, ssign3));
+    BOOST_CHECK(batch.Verify());
+    BOOST_CHECK(!batch.Add(pubkey1, hashMsg, sign1));
+    BOOST_CHECK_EQUAL(batch.size(), 3U);
+    BOOST_CHECK(batch.Add(pubkey1, hashMsg, ssign2));
+    BOOST_CHECK(!batch.Verify());
+    batch.clear();
+    BOOST_CHECK(batch.Add(pubkey2, hashMsg, ssign2));
+    BOOST_CHECK(batch.Verify());
+
     // Extract r value from ECDSA and Schnorr. Make sure they are
     // distinct (nonce reuse would be dangerous and can leak private key).
     std::vector<uint8_t> rE1 = get_r_ECDSA(sign1);
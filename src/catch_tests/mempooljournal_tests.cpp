@@ -0,0 +1,184 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <config.h>
+#include <consensus/validation.h>
+#include <fs_util.h>
+#include <key.h>
+#include <mempooljournal.h>
+#include <script/interpreter.h>
+#include <test/test_bitcoin.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include "catch_unit.h"
+
+// BOOST_FIXTURE_TEST_SUITE(mempooljournal_tests, TestingSetup)
+
+//! A transaction spending a random outpoint
+static CTransactionRef RandomTx() {
+  CMutableTransaction tx;
+  tx.vin.resize(1);
+  tx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+  tx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+  return MakeTransactionRef(tx);
+}
+
+static std::vector<uint256> ReadTxids(std::map<uint256, Amount> &mapDeltas) {
+  std::vector<CMempoolJournal::Entry> entries;
+  BOOST_CHECK(CMempoolJournal::Read(entries, mapDeltas));
+  std::vector<uint256> txids;
+  for (const CMempoolJournal::Entry &entry : entries) { txids.push_back(entry.tx->GetId()); }
+  return txids;
+}
+
+TEST_CASE("mempooljournal_replay") {
+  TestingSetup setup;
+  CTxMemPool pool;
+  TestMemPoolEntryHelper entry;
+  double dummy = 0;
+  const CTransactionRef tx1 = RandomTx(), tx2 = RandomTx(), tx3 = RandomTx(), tx4 = RandomTx();
+  const uint256 other = InsecureRand256();
+  pool.addUnchecked(tx1->GetId(), entry.Time(100).FromTx(*tx1));
+  pool.addUnchecked(tx2->GetId(), entry.Time(200).FromTx(*tx2));
+
+  // Starting writes a snapshot
+  CMempoolJournal journal(pool);
+  journal.Start();
+  std::map<uint256, Amount> mapDeltas;
+  BOOST_CHECK(ReadTxids(mapDeltas) == std::vector<uint256>({tx1->GetId(), tx2->GetId()}));
+  BOOST_CHECK(mapDeltas.empty());
+  const uintmax_t nSnapshotSize = fs::file_size(GetDataDir() / "mempool.dat");
+
+  // Changes only go to the journal
+  pool.addUnchecked(tx3->GetId(), entry.Time(300).FromTx(*tx3));
+  pool.removeRecursive(*tx1);
+  pool.PrioritiseTransaction(tx2->GetId(), dummy, 5 * COIN);
+  pool.PrioritiseTransaction(other, dummy, COIN);
+  BOOST_CHECK(journal.Flush(true));
+  std::vector<CMempoolJournal::Entry> entries;
+  BOOST_CHECK(CMempoolJournal::Read(entries, mapDeltas));
+  BOOST_REQUIRE_EQUAL(entries.size(), 2U);
+  BOOST_CHECK(entries[0].tx->GetId() == tx2->GetId());
+  BOOST_CHECK_EQUAL(entries[0].nTime, 200);
+  BOOST_CHECK(entries[1].tx->GetId() == tx3->GetId());
+  BOOST_CHECK_EQUAL(entries[1].nTime, 300);
+  BOOST_CHECK_EQUAL(mapDeltas.size(), 2U);
+  BOOST_CHECK(mapDeltas[tx2->GetId()] == 5 * COIN);
+  BOOST_CHECK(mapDeltas[other] == COIN);
+  BOOST_CHECK_EQUAL(fs::file_size(GetDataDir() / "mempool.dat"), nSnapshotSize);
+
+  // Stopping writes what is left
+  pool.ClearPrioritisation(other);
+  pool.addUnchecked(tx4->GetId(), entry.Time(400).FromTx(*tx4));
+  journal.Stop();
+  const std::vector<uint256> expected = {tx2->GetId(), tx3->GetId(), tx4->GetId()};
+  BOOST_CHECK(ReadTxids(mapDeltas) == expected);
+  BOOST_CHECK_EQUAL(mapDeltas.size(), 1U);
+
+  // A record cut short ends the journal
+  FILE *file = fsbridge::fopen(GetDataDir() / "mempool.journal", "ab");
+  BOOST_REQUIRE(file);
+  fputc(0, file);
+  fclose(file);
+  BOOST_CHECK(ReadTxids(mapDeltas) == expected);
+
+  // A journal is only replayed over its own snapshot
+  const fs::path saved = GetDataDir() / "mempool.journal.saved";
+  fs::copy_file(GetDataDir() / "mempool.journal", saved);
+  pool.removeRecursive(*tx4);
+  BOOST_CHECK(journal.Compact());
+  BOOST_CHECK(RenameOver(saved, GetDataDir() / "mempool.journal"));
+  BOOST_CHECK(ReadTxids(mapDeltas) == std::vector<uint256>({tx2->GetId(), tx3->GetId()}));
+}
+
+TEST_CASE("mempooljournal_load") {
+  TestChain100Setup setup;
+  // A coinbase spend and its child, so the child's script checks need the
+  // outputs of a transaction loaded before it
+  CScript scriptPubKey = CScript() << ToByteVector(setup.coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+  std::vector<CMutableTransaction> txs(2);
+  CTransactionRef prev = MakeTransactionRef(setup.coinbaseTxns[0]);
+  for (CMutableTransaction &tx : txs) {
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(prev->GetId(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = prev->vout[0].nValue - 10 * CENT;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<uint8_t> vchSig;
+    uint256 hash =
+        SignatureHash(scriptPubKey, CTransaction(tx), 0, SigHashType().withForkId(), prev->vout[0].nValue);
+    BOOST_CHECK(setup.coinbaseKey.SignECDSA(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    tx.vin[0].scriptSig << vchSig;
+
+    CValidationState state;
+    LOCK(cs_main);
+    BOOST_CHECK(AcceptToMemoryPool(GetConfig(), g_mempool, state, MakeTransactionRef(tx), false, nullptr, true,
+                                   Amount::zero()));
+    prev = MakeTransactionRef(tx);
+  }
+  BOOST_CHECK_EQUAL(g_mempool.size(), 2U);
+
+  BOOST_CHECK(DumpMempool());
+  g_mempool.clear();
+  BOOST_CHECK(LoadMempool(GetConfig()));
+  BOOST_CHECK_EQUAL(g_mempool.size(), 2U);
+  BOOST_CHECK(g_mempool.exists(txs[0].GetId()));
+  BOOST_CHECK(g_mempool.exists(txs[1].GetId()));
+}
+
+TEST_CASE("mempooljournal_reorg_readd") {
+  TestChain100Setup setup;
+  // A coinbase spend and its child
+  CScript scriptPubKey = CScript() << ToByteVector(setup.coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+  std::vector<CTransactionRef> txs;
+  CTransactionRef prev = MakeTransactionRef(setup.coinbaseTxns[0]);
+  for (int i = 0; i < 2; i++) {
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(prev->GetId(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = prev->vout[0].nValue - 10 * CENT;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<uint8_t> vchSig;
+    uint256 hash =
+        SignatureHash(scriptPubKey, CTransaction(tx), 0, SigHashType().withForkId(), prev->vout[0].nValue);
+    BOOST_CHECK(setup.coinbaseKey.SignECDSA(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    tx.vin[0].scriptSig << vchSig;
+    prev = MakeTransactionRef(tx);
+    txs.push_back(prev);
+  }
+  const CTransactionRef &parent = txs[0], &child = txs[1];
+
+  CMempoolJournal journal(g_mempool);
+  journal.Start();
+  for (const CTransactionRef &tx : txs) {
+    CValidationState state;
+    LOCK(cs_main);
+    BOOST_CHECK(AcceptToMemoryPool(GetConfig(), g_mempool, state, tx, false, nullptr, true, Amount::zero()));
+  }
+
+  // The parent is mined, then its block is disconnected by a reorg, which
+  // puts it back after its child
+  g_mempool.removeForBlock({parent}, chainActive.Height() + 1);
+  BOOST_CHECK_EQUAL(g_mempool.size(), 1U);
+  TestMemPoolEntryHelper entry;
+  g_mempool.addUnchecked(parent->GetId(), entry.Fee(10 * CENT).Time(GetTime()).FromTx(*parent));
+  journal.Stop();
+
+  std::map<uint256, Amount> mapDeltas;
+  BOOST_CHECK(ReadTxids(mapDeltas) == std::vector<uint256>({parent->GetId(), child->GetId()}));
+
+  g_mempool.clear();
+  BOOST_CHECK(LoadMempool(GetConfig()));
+  BOOST_CHECK_EQUAL(g_mempool.size(), 2U);
+  BOOST_CHECK(g_mempool.exists(parent->GetId()));
+  BOOST_CHECK(g_mempool.exists(child->GetId()));
+}
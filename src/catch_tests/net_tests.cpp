@@ -195,6 +195,180 @@ TEST_CASE("cnode_simple_test") {
   BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+//! A network message as it comes over the wire
+static std::vector<char> MakeNetMessage(const char *pszCommand, const std::vector<char> &payload) {
+  CMessageHeader hdr(Params().NetMagic(), pszCommand, payload.size());
+  uint256 hash = Hash(payload.begin(), payload.end());
+  memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+  CDataStream ss(SER_NETWORK, INIT_PROTO_VERSION);
+  ss << hdr;
+  std::vector<char> msg(ss.begin(), ss.end());
+  msg.insert(msg.end(), payload.begin(), payload.end());
+  return msg;
+}
+
+TEST_CASE("cnode_receive_in_place") {
+  BasicTestingSetup setup;
+  const Config &config = GetConfig();
+  in_addr ipv4Addr;
+  ipv4Addr.s_addr = 0xa0b0c001;
+  CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+  CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", false);
+
+  std::vector<char> payload(300 * 1024);
+  for (size_t i = 0; i < payload.size(); i++) {
+    payload[i] = char(i * 7);
+  }
+  const std::vector<char> large = MakeNetMessage(NetMsgType::BLOCK, payload);
+  const std::vector<char> small = MakeNetMessage(NetMsgType::PING, std::vector<char>(8, 1));
+
+  // The header goes through ReceiveMsgBytes, then most of the data is
+  // received straight into the message
+  bool complete = false;
+  uint32_t nSize;
+  BOOST_CHECK(node.GetRecvBuffer(nSize) == nullptr);
+  size_t nPos = CMessageHeader::HEADER_SIZE + 1000;
+  BOOST_CHECK(node.ReceiveMsgBytes(config, large.data(), nPos, complete));
+  BOOST_CHECK(!complete);
+  size_t nInPlace = 0;
+  while (char *pch = node.GetRecvBuffer(nSize)) {
+    BOOST_CHECK((nSize > 0 && nSize <= 256 * 1024));
+    nSize = std::min<size_t>(nSize, 50000);
+    memcpy(pch, large.data() + nPos, nSize);
+    node.ReceiveMsgBytesInPlace(nSize, complete);
+    nPos += nSize;
+    nInPlace += nSize;
+  }
+  BOOST_CHECK(nInPlace >= 250000);
+  BOOST_CHECK(!complete);
+
+  // The end of it comes along with the next message
+  std::vector<char> rest(large.begin() + nPos, large.end());
+  rest.insert(rest.end(), small.begin(), small.end());
+  BOOST_CHECK(node.ReceiveMsgBytes(config, rest.data(), rest.size(), complete));
+  BOOST_CHECK(complete);
+  BOOST_CHECK_EQUAL(node.QueueReceivedMessages(DEFAULT_MAXRECEIVEBUFFER * 1000), large.size() + small.size());
+  BOOST_CHECK(!node.fPauseRecv);
+
+  std::list<CNetMessage> msgs;
+  msgs.splice(msgs.end(), node.vProcessMsg);
+  BOOST_REQUIRE_EQUAL(msgs.size(), 2U);
+  const CNetMessage &msg = msgs.front();
+  BOOST_CHECK_EQUAL(msg.hdr.GetCommand(), NetMsgType::BLOCK);
+  BOOST_CHECK(std::vector<char>(msg.vRecv.begin(), msg.vRecv.end()) == payload);
+  BOOST_CHECK(memcmp(msg.GetMessageHash().begin(), msg.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) == 0);
+  BOOST_CHECK_EQUAL(msgs.back().hdr.GetCommand(), NetMsgType::PING);
+
+  // Only the small message is kept to receive into
+  node.RecycleMessages(msgs);
+  BOOST_CHECK_EQUAL(msgs.size(), 1U);
+  BOOST_CHECK_EQUAL(node.vRecvPool.size(), 1U);
+  BOOST_CHECK(node.ReceiveMsgBytes(config, small.data(), small.size(), complete));
+  BOOST_CHECK(complete);
+  BOOST_CHECK(node.vRecvPool.empty());
+  node.QueueReceivedMessages(DEFAULT_MAXRECEIVEBUFFER * 1000);
+  BOOST_REQUIRE_EQUAL(node.vProcessMsg.size(), 1U);
+  const CNetMessage &reused = node.vProcessMsg.front();
+  BOOST_CHECK_EQUAL(reused.hdr.GetCommand(), NetMsgType::PING);
+  BOOST_CHECK(std::vector<char>(reused.vRecv.begin(), reused.vRecv.end()) == std::vector<char>(8, 1));
+  BOOST_CHECK(memcmp(reused.GetMessageHash().begin(), reused.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) == 0);
+}
+
+TEST_CASE("cnode_recv_pool_limits") {
+  BasicTestingSetup setup;
+  const Config &config = GetConfig();
+  in_addr ipv4Addr;
+  ipv4Addr.s_addr = 0xa0b0c001;
+  CAddress addr = CAddress(CService(ipv4Addr, 7777), NODE_NETWORK);
+  CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", false);
+
+  // A 100 KiB message, then eight of 48 KiB
+  std::vector<char> data = MakeNetMessage(NetMsgType::TX, std::vector<char>(100 * 1024, 1));
+  for (int i = 0; i < 8; i++) {
+    const std::vector<char> msg = MakeNetMessage(NetMsgType::TX, std::vector<char>(48 * 1024, 2));
+    data.insert(data.end(), msg.begin(), msg.end());
+  }
+  bool complete = false;
+  BOOST_CHECK(node.ReceiveMsgBytes(config, data.data(), data.size(), complete));
+  BOOST_CHECK(complete);
+  node.QueueReceivedMessages(DEFAULT_MAXRECEIVEBUFFER * 1000);
+  std::list<CNetMessage> msgs;
+  msgs.splice(msgs.end(), node.vProcessMsg);
+  BOOST_REQUIRE_EQUAL(msgs.size(), 9U);
+
+  // The large buffer is not kept, nor more than 256 KiB of the others
+  node.RecycleMessages(msgs);
+  BOOST_CHECK(!msgs.empty());
+  BOOST_CHECK_EQUAL(msgs.front().hdr.nMessageSize, 100U * 1024);
+  BOOST_CHECK(!node.vRecvPool.empty());
+  BOOST_CHECK(node.vRecvPool.size() < 8);
+  size_t nBytes = 0;
+  for (const CNetMessage &msg : node.vRecvPool) { nBytes += msg.vRecv.capacity(); }
+  BOOST_CHECK_EQUAL(node.nRecvPoolBytes, nBytes);
+  BOOST_CHECK((nBytes >= 48 * 1024 && nBytes <= 256 * 1024));
+
+  // Taking a message out of the pool gives its bytes back
+  const std::vector<char> ping = MakeNetMessage(NetMsgType::PING, std::vector<char>(8, 1));
+  const size_t nPool = node.vRecvPool.size();
+  BOOST_CHECK(node.ReceiveMsgBytes(config, ping.data(), ping.size(), complete));
+  BOOST_CHECK_EQUAL(node.vRecvPool.size(), nPool - 1);
+  BOOST_CHECK(node.nRecvPoolBytes < nBytes);
+
+  // An idle peer keeps nothing
+  node.ReleaseRecvPool();
+  BOOST_CHECK(node.vRecvPool.empty());
+  BOOST_CHECK_EQUAL(node.nRecvPoolBytes, 0U);
+}
+
+TEST_CASE("shared_net_msg_cache") {
+  BasicTestingSetup setup;
+  CSharedNetMsgCache cache(2, 1000);
+  int nMade = 0;
+  auto make = [&nMade](size_t nSize) {
+    return [&nMade, nSize]() {
+      nMade++;
+      CSerializedNetMsg msg;
+      msg.command = NetMsgType::TX;
+      msg.data.assign(nSize, uint8_t(nSize));
+      return msg;
+    };
+  };
+  const uint256 a = InsecureRand256(), b = InsecureRand256(), c = InsecureRand256();
+
+  // Made once, then shared
+  CSharedNetMsgRef msgA = cache.Get(NetMsgType::TX, a, make(100));
+  BOOST_CHECK(cache.Get(NetMsgType::TX, a, make(100)) == msgA);
+  BOOST_CHECK_EQUAL(nMade, 1);
+  BOOST_CHECK_EQUAL(msgA->command, NetMsgType::TX);
+  BOOST_CHECK(msgA->hash == Hash(msgA->data.data(), msgA->data.data() + msgA->data.size()));
+
+  // The same hash under another command is another message
+  BOOST_CHECK(cache.Get(NetMsgType::BLOCK, a, make(100)) != msgA);
+  BOOST_CHECK_EQUAL(nMade, 2);
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+
+  // The least recently used message goes first
+  BOOST_CHECK(cache.Get(NetMsgType::TX, a, make(100)) == msgA);
+  cache.Get(NetMsgType::TX, b, make(200));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+  BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 300U);
+  BOOST_CHECK(cache.Get(NetMsgType::TX, a, make(100)) == msgA);
+  BOOST_CHECK_EQUAL(nMade, 3);
+
+  // So do they when there are too many bytes
+  cache.Get(NetMsgType::TX, c, make(800));
+  BOOST_CHECK_EQUAL(cache.size(), 2U);
+  BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 900U);
+  cache.Get(NetMsgType::TX, b, make(200));
+  BOOST_CHECK_EQUAL(nMade, 5);
+
+  // A message larger than the whole cache isn't kept
+  CSharedNetMsgRef large = cache.Get(NetMsgType::BLOCK, c, make(2000));
+  BOOST_CHECK_EQUAL(large->data.size(), 2000U);
+  BOOST_CHECK(cache.Get(NetMsgType::BLOCK, c, make(2000)) != large);
+  BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), 1000U);
+}
+
 TEST_CASE("test_getSubVersionEB") {
   BasicTestingSetup setup;
   BOOST_CHECK_EQUAL(getSubVersionEB(13800000000), "13800.0");
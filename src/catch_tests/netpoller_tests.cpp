@@ -0,0 +1,244 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <netbase.h>
+#include <netpoller.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+
+#include <cerrno>
+#include <vector>
+
+#include "catch_unit.h"
+
+// BOOST_FIXTURE_TEST_SUITE(netpoller_tests, BasicTestingSetup)
+
+TEST_CASE("netpoller_open") {
+  // Where epoll isn't available, callers keep to select()
+  NetPoller poller;
+  BOOST_CHECK(!poller.IsOpen());
+  BOOST_CHECK_EQUAL(poller.Open(), NetPoller::Available());
+  BOOST_CHECK_EQUAL(poller.IsOpen(), NetPoller::Available());
+  std::vector<NetPoller::Event> events;
+  BOOST_CHECK_EQUAL(poller.Wait(events, 0), NetPoller::Available());
+  BOOST_CHECK(events.empty());
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+
+//! Long enough for a socket to get ready, only reached on failure
+static const int WAIT_MILLIS = 1000;
+
+//! A connected pair of non-blocking sockets
+static void MakeSocketPair(SOCKET (&hSockets)[2]) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  hSockets[0] = fds[0];
+  hSockets[1] = fds[1];
+  BOOST_REQUIRE(SetSocketNonBlocking(hSockets[0], true));
+  BOOST_REQUIRE(SetSocketNonBlocking(hSockets[1], true));
+}
+
+//! The event reported for key, if any
+static const NetPoller::Event *FindEvent(const std::vector<NetPoller::Event> &events, uint64_t key) {
+  for (const NetPoller::Event &event : events) {
+    if (event.key == key) {
+      return &event;
+    }
+  }
+  return nullptr;
+}
+
+static void SendBytes(SOCKET hSocket, size_t nBytes) {
+  const std::vector<char> data(nBytes, 'x');
+  BOOST_REQUIRE_EQUAL(send(hSocket, data.data(), nBytes, MSG_NOSIGNAL), ssize_t(nBytes));
+}
+
+//! Read until the socket would block, returns the number of bytes read
+static size_t DrainRecv(SOCKET hSocket) {
+  char buf[4096];
+  size_t nTotal = 0;
+  ssize_t nBytes;
+  while ((nBytes = recv(hSocket, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+    nTotal += nBytes;
+  }
+  BOOST_CHECK((nBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)));
+  return nTotal;
+}
+
+//! Write until the send buffer is full
+static void FillSend(SOCKET hSocket) {
+  const std::vector<char> data(4096, 'x');
+  while (send(hSocket, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT) > 0) {
+  }
+  BOOST_CHECK((errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
+TEST_CASE("netpoller_add_and_close") {
+  NetPoller poller;
+  BOOST_REQUIRE(poller.Open());
+  SOCKET hSockets[2];
+  MakeSocketPair(hSockets);
+  BOOST_CHECK(poller.Add(hSockets[0], 1));
+  // A socket is only registered once
+  BOOST_CHECK(!poller.Add(hSockets[0], 2));
+
+  // Registering reports the socket as writable right away
+  std::vector<NetPoller::Event> events;
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE_EQUAL(events.size(), 1U);
+  BOOST_CHECK_EQUAL(events[0].key, 1U);
+  BOOST_CHECK(events[0].fSend);
+  BOOST_CHECK(!events[0].fRecv);
+  BOOST_CHECK(!events[0].fError);
+
+  SendBytes(hSockets[1], 10);
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE_EQUAL(events.size(), 1U);
+  BOOST_CHECK_EQUAL(events[0].key, 1U);
+  BOOST_CHECK(events[0].fRecv);
+  BOOST_CHECK_EQUAL(DrainRecv(hSockets[0]), 10U);
+
+  // Closing the socket unregisters it
+  BOOST_CHECK(CloseSocket(hSockets[0]));
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+
+  // Closing the peer reports a hang up on the sockets still registered
+  SOCKET hOthers[2];
+  MakeSocketPair(hOthers);
+  BOOST_CHECK(poller.Add(hOthers[0], 3));
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_CHECK(CloseSocket(hOthers[1]));
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE_EQUAL(events.size(), 1U);
+  BOOST_CHECK_EQUAL(events[0].key, 3U);
+  BOOST_CHECK(events[0].fRecv);
+  BOOST_CHECK(events[0].fError);
+
+  CloseSocket(hOthers[0]);
+  CloseSocket(hSockets[1]);
+}
+
+TEST_CASE("netpoller_edge_triggered_recv") {
+  NetPoller poller;
+  BOOST_REQUIRE(poller.Open());
+  SOCKET hSockets[2];
+  MakeSocketPair(hSockets);
+  BOOST_REQUIRE(poller.Add(hSockets[0], 1));
+  std::vector<NetPoller::Event> events;
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+
+  SendBytes(hSockets[1], 100);
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE(FindEvent(events, 1));
+  BOOST_CHECK(FindEvent(events, 1)->fRecv);
+
+  // The data is still there, but it was reported once already
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+
+  // Reading part of it doesn't report the rest again: the socket must be read until it would block
+  char buf[10];
+  BOOST_CHECK_EQUAL(recv(hSockets[0], buf, sizeof(buf), 0), 10);
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+  BOOST_CHECK_EQUAL(DrainRecv(hSockets[0]), 90U);
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+
+  // Once drained, new data is reported again
+  SendBytes(hSockets[1], 20);
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE(FindEvent(events, 1));
+  BOOST_CHECK(FindEvent(events, 1)->fRecv);
+  BOOST_CHECK_EQUAL(DrainRecv(hSockets[0]), 20U);
+
+  CloseSocket(hSockets[0]);
+  CloseSocket(hSockets[1]);
+}
+
+TEST_CASE("netpoller_writable_after_eagain") {
+  NetPoller poller;
+  BOOST_REQUIRE(poller.Open());
+  SOCKET hSockets[2];
+  MakeSocketPair(hSockets);
+  BOOST_REQUIRE(poller.Add(hSockets[0], 1));
+  std::vector<NetPoller::Event> events;
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE(FindEvent(events, 1));
+  BOOST_CHECK(FindEvent(events, 1)->fSend);
+
+  // Nothing is reported while the send buffer is full
+  FillSend(hSockets[0]);
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+
+  // The peer reading makes room, which is reported
+  BOOST_CHECK(DrainRecv(hSockets[1]) > 0);
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE(FindEvent(events, 1));
+  BOOST_CHECK(FindEvent(events, 1)->fSend);
+  BOOST_CHECK(!FindEvent(events, 1)->fRecv);
+
+  // And only once
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+
+  CloseSocket(hSockets[0]);
+  CloseSocket(hSockets[1]);
+}
+
+TEST_CASE("netpoller_close_with_pending_events") {
+  NetPoller poller;
+  BOOST_REQUIRE(poller.Open());
+  SOCKET hSockets[2];
+  MakeSocketPair(hSockets);
+  BOOST_REQUIRE(poller.Add(hSockets[0], 1));
+
+  // The socket is writable and has data to read, but goes away before the events are collected
+  SendBytes(hSockets[1], 10);
+  BOOST_CHECK(CloseSocket(hSockets[0]));
+  std::vector<NetPoller::Event> events;
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+  CloseSocket(hSockets[1]);
+
+  // A new socket may get the same descriptor, it is only reported under its own key
+  MakeSocketPair(hSockets);
+  BOOST_REQUIRE(poller.Add(hSockets[0], 2));
+  SendBytes(hSockets[1], 10);
+  BOOST_CHECK(poller.Wait(events, WAIT_MILLIS));
+  BOOST_REQUIRE_EQUAL(events.size(), 1U);
+  BOOST_CHECK_EQUAL(events[0].key, 2U);
+  BOOST_CHECK(events[0].fRecv);
+  BOOST_CHECK(events[0].fSend);
+
+  CloseSocket(hSockets[0]);
+  CloseSocket(hSockets[1]);
+}
+
+TEST_CASE("netpoller_wake") {
+  NetPoller poller;
+  BOOST_REQUIRE(poller.Open());
+
+  // A pending wakeup makes Wait() return without an event, once
+  poller.Wake();
+  poller.Wake();
+  const int64_t nStart = GetTimeMillis();
+  std::vector<NetPoller::Event> events;
+  BOOST_CHECK(poller.Wait(events, 60 * 1000));
+  BOOST_CHECK(events.empty());
+  BOOST_CHECK(GetTimeMillis() - nStart < 60 * 1000);
+  BOOST_CHECK(poller.Wait(events, 0));
+  BOOST_CHECK(events.empty());
+}
+
+#endif // HAVE_SYS_EPOLL_H
+
+// BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,122 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <memusage.h>
+#include <openhashmap.h>
+
+#include <test/test_bitcoin.h>
+
+#include "catch_unit.h"
+
+#include <map>
+#include <string>
+
+// BOOST_FIXTURE_TEST_SUITE(openhashmap_tests, BasicTestingSetup)
+
+// Few distinct hashes, so that keys share probe sequences and erasing shifts
+// slots back.
+struct CollidingHasher {
+  size_t operator()(int key) const { return key % 7; }
+};
+
+typedef openhashmap<int, std::string, CollidingHasher> TestMap;
+
+static void CheckSameContent(const TestMap &map,
+                             const std::map<int, std::string> &expected) {
+  BOOST_CHECK_EQUAL(map.size(), expected.size());
+  std::map<int, std::string> content;
+  for (const auto &it : map) {
+    BOOST_CHECK(content.emplace(it.first, it.second).second);
+  }
+  BOOST_CHECK(content == expected);
+  for (const auto &it : expected) {
+    auto found = map.find(it.first);
+    BOOST_CHECK(found != map.end());
+    if (found != map.end()) {
+      BOOST_CHECK(found->second == it.second);
+    }
+  }
+}
+
+TEST_CASE("openhashmap_random") {
+  TestMap map;
+  std::map<int, std::string> expected;
+  for (int i = 0; i < 20000; i++) {
+    const int key = InsecureRandRange(300);
+    switch (InsecureRandRange(3)) {
+    case 0: {
+      const std::string value = std::to_string(i);
+      auto ret = map.emplace(key, value);
+      auto ret2 = expected.emplace(key, value);
+      BOOST_CHECK_EQUAL(ret.second, ret2.second);
+      BOOST_CHECK(ret.first->second == ret2.first->second);
+      break;
+    }
+    case 1:
+      map[key] += "x";
+      expected[key] += "x";
+      break;
+    case 2:
+      BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+      break;
+    }
+    BOOST_CHECK_EQUAL(map.count(key), expected.count(key));
+    if (i % 1000 == 0) {
+      CheckSameContent(map, expected);
+    }
+  }
+  CheckSameContent(map, expected);
+
+  map.clear();
+  BOOST_CHECK(map.empty());
+  BOOST_CHECK(map.begin() == map.end());
+  BOOST_CHECK(map.find(1) == map.end());
+  BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0);
+}
+
+TEST_CASE("openhashmap_stable_entries") {
+  TestMap map;
+  std::string &first = map[1];
+  first = "one";
+  auto it = map.find(1);
+  // Growing the table doesn't move the entries.
+  for (int i = 2; i < 1000; i++) {
+    map[i] = std::to_string(i);
+  }
+  BOOST_CHECK(&first == &map.find(1)->second);
+  BOOST_CHECK(it == map.find(1));
+  BOOST_CHECK(it->second == "one");
+
+  // Erase while iterating, as BatchWrite does.
+  std::map<int, std::string> expected;
+  for (auto iter = map.begin(); iter != map.end();) {
+    if (iter->first % 3 == 0) {
+      map.erase(iter++);
+    } else {
+      expected.emplace(iter->first, iter->second);
+      ++iter;
+    }
+  }
+  CheckSameContent(map, expected);
+
+  // Erased entries are reused before the arena grows.
+  const size_t usage = memusage::DynamicUsage(map);
+  for (int i = 3; i < 1000; i += 3) {
+    map[i] = std::to_string(i);
+  }
+  BOOST_CHECK_EQUAL(map.size(), 999);
+  BOOST_CHECK(memusage::DynamicUsage(map) <= usage);
+
+  // Shrinking gives the memory of the erased entries back.
+  for (int i = 100; i < 1000; i++) {
+    map.erase(i);
+  }
+  expected.clear();
+  for (int i = 1; i < 100; i++) {
+    expected.emplace(i, i == 1 ? "one" : std::to_string(i));
+  }
+  map.shrink_to_fit();
+  CheckSameContent(map, expected);
+  BOOST_CHECK(memusage::DynamicUsage(map) < usage);
+}
@@ -111,7 +111,8 @@ TestingSetup::TestingSetup(const std::string &chainName) : BasicTestingSetup(cha
   pcoinsdbview = std::make_unique<CCoinsViewDB>(1 << 23, true);
   pcoinsTip = std::make_unique<CCoinsViewCache>(pcoinsdbview.get());
   prewardsdb = std::make_unique<CRewardsViewDB>("rewards", 1 << 23, true);
-  prewards = std::make_unique<CColdRewards>(chainparams.GetConsensus(), prewardsdb.get());
+  prewardsTip = std::make_unique<CRewardsViewCache>(prewardsdb.get());
+  prewards = std::make_unique<CColdRewards>(chainparams.GetConsensus(), prewardsTip.get());
   pbudget = std::make_unique<CBudget>(config);
   if (!LoadGenesisBlock(chainparams)) { throw std::runtime_error("LoadGenesisBlock failed."); }
   {
@@ -146,6 +147,7 @@ TestingSetup::~TestingSetup() {
   pcoinsdbview.reset();
   pblocktree.reset();
   prewards.reset();
+  prewardsTip.reset();
   prewardsdb.reset();
   fs::remove_all(pathTemp);
 }
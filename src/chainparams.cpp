@@ -169,6 +169,12 @@ public:
 
         // Data as of block 9825
         chainTxData = ChainTxData{1562814205, 27210, 0.1};
+
+        // Snapshots accepted by -loadsnapshot, from the output of dumptxoutset
+        // at the base block: {base block hash, {snapshot hash, nchaintx}}
+        // None is pinned yet, on this or any other network, so -loadsnapshot
+        // refuses every snapshot until one is added here.
+        mapAssumeutxo = {};
     }
 };
 
@@ -12,6 +12,7 @@
 #include <primitives/block.h>
 #include <protocol.h>
 
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -27,6 +28,17 @@ struct ChainTxData {
     double dTxRate;
 };
 
+/** A UTXO snapshot that -loadsnapshot accepts, as reported by dumptxoutset. */
+struct AssumeutxoData {
+    //! Hash of the coins and rewards in the snapshot
+    uint256 hashSnapshot;
+    //! Transactions in the chain up to and including the base block
+    uint64_t nChainTx;
+};
+
+//! Pinned snapshots by the hash of their base block
+typedef std::map<uint256, AssumeutxoData> MapAssumeutxo;
+
 /**
  * CChainParams defines various tweakable parameters of a given instance of the
  * Bitcoin system. There are three: the main network on which people trade goods
@@ -62,6 +74,7 @@ public:
     const std::string &CashAddrSecretPrefix() const { return cashaddrSecretPrefix; }
     const CCheckpointData &Checkpoints() const { return checkpointData; }
     const ChainTxData &TxData() const { return chainTxData; }
+    const MapAssumeutxo &Assumeutxo() const { return mapAssumeutxo; }
 
 protected:
     CChainParams() = default;
@@ -82,6 +95,7 @@ protected:
     bool fMineBlocksOnDemand;
     CCheckpointData checkpointData;
     ChainTxData chainTxData;
+    MapAssumeutxo mapAssumeutxo;
 };
 
 /**
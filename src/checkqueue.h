@@ -8,6 +8,9 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <condition_variable>
@@ -15,6 +18,126 @@
 
 template <typename T> class CCheckQueueControl;
 
+/**
+ * Deque of ranges of checks, in the manner of Chase and Lev: its owner pushes
+ * and pops ranges at the bottom, other threads steal them from the top, all
+ * without locks. A range [begin, end) is packed in 64 bits.
+ */
+class CCheckDeque {
+private:
+    struct Array {
+        const int64_t size;
+        std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+        explicit Array(int64_t sizeIn)
+            : size(sizeIn), slots(new std::atomic<uint64_t>[sizeIn]) {}
+        uint64_t Get(int64_t i) const {
+            return slots[i & (size - 1)].load(std::memory_order_relaxed);
+        }
+        void Put(int64_t i, uint64_t range) {
+            slots[i & (size - 1)].store(range, std::memory_order_relaxed);
+        }
+    };
+
+    std::atomic<int64_t> top{0};
+    std::atomic<int64_t> bottom{0};
+    std::atomic<Array *> array;
+
+    //! Every array used, as thieves may still read the ones replaced when the
+    //! deque grew. Only touched by the owner.
+    std::vector<std::unique_ptr<Array>> arrays;
+
+public:
+    CCheckDeque() {
+        arrays.emplace_back(new Array(64));
+        array.store(arrays.back().get());
+    }
+
+    static uint64_t Pack(uint32_t begin, uint32_t end) {
+        return (uint64_t(begin) << 32) | end;
+    }
+    static void Unpack(uint64_t range, uint32_t &begin, uint32_t &end) {
+        begin = uint32_t(range >> 32);
+        end = uint32_t(range);
+    }
+
+    //! Owner only.
+    void Push(uint64_t range) {
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        const int64_t t = top.load(std::memory_order_acquire);
+        Array *a = array.load(std::memory_order_relaxed);
+        if (b - t > a->size - 1) {
+            Array *grown = new Array(a->size * 2);
+            for (int64_t i = t; i < b; i++) {
+                grown->Put(i, a->Get(i));
+            }
+            arrays.emplace_back(grown);
+            array.store(grown, std::memory_order_release);
+            a = grown;
+        }
+        a->Put(b, range);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    //! Owner only, takes the range pushed last.
+    bool Pop(uint64_t &range) {
+        const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Array *a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        range = a->Get(b);
+        if (t < b) {
+            return true;
+        }
+        // Last range, race the thieves for it.
+        const bool fWon = top.compare_exchange_strong(
+            t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return fWon;
+    }
+
+    //! Any thread, takes the range pushed first. Only fails if empty.
+    bool Steal(uint64_t &range) {
+        while (true) {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return false;
+            }
+            range = array.load(std::memory_order_acquire)->Get(t);
+            if (top.compare_exchange_strong(t, t + 1,
+                                            std::memory_order_seq_cst,
+                                            std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    //! Only a hint when called by other threads than the owner.
+    bool Empty() const {
+        return top.load(std::memory_order_relaxed) >=
+               bottom.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * Checks of a type T can defer part of their work to a batch, completed at
+ * once for many checks, by specializing this. Open is called before a batch
+ * of at most MAX_CHECKS checks is run on a thread, and Close after it. If
+ * Close fails, the checks are run again with no batch open.
+ */
+template <typename T> struct CCheckBatch {
+    static constexpr uint32_t MAX_CHECKS = 1;
+    static void Open() {}
+    static bool Close() { return true; }
+};
+
 /**
  * Queue for verifications that have to be performed.
  * The verifications are represented by a type T, which must provide an
@@ -24,114 +147,136 @@ template <typename T> class CCheckQueueControl;
  * queue, where they are processed by N-1 worker threads. When the master is
  * done adding work, it temporarily joins the worker pool as an N'th worker,
  * until all jobs are done.
+ *
+ * The checks are stored in the queue in the order they are added, and
+ * scheduled as ranges of them. Every thread has its own deque of ranges: the
+ * master pushes each batch on its deque, and a thread out of work steals a
+ * range from the deque of another. While a thread runs a range, it pushes
+ * half of what's left on its own deque whenever that one is empty, so that
+ * there is always work to steal. The lock is only taken by idle workers going
+ * to sleep, and to wake them up.
  */
 template <typename T> class CCheckQueue {
 private:
-    //! Mutex to protect the inner state
-    std::mutex mutex;
+    //! Checks are stored in blocks of this many checks, allocated once.
+    static const uint32_t CHECKS_PER_BLOCK = 4096;
+    //! Maximum number of blocks, beyond which the master runs the checks
+    //! itself.
+    static const uint32_t MAX_BLOCKS = 4096;
+    //! Threads with a deque (the master and the first workers), any other
+    //! worker only steals.
+    static const int MAX_DEQUES = 128;
+    //! Attempts to steal before a worker goes to sleep.
+    static const int STEAL_SPINS = 64;
 
-    //! Worker threads block on this when out of work
-    std::condition_variable condWorker;
-
-    //! Master thread blocks on this when out of work
-    std::condition_variable condMaster;
+    //! Storage of the checks of the current round. Only the master allocates
+    //! blocks and adds checks, before publishing them in a range.
+    std::vector<std::unique_ptr<T[]>> vBlocks;
+    uint32_t nStored;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! Deque 0 is the master's.
+    std::unique_ptr<CCheckDeque[]> deques;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Number of workers which called Thread().
+    std::atomic<int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Number of checks added and not yet completed.
+    std::atomic<uint64_t> nTodo;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     //! Whether we are shutting done
-    bool fQuit;
+    std::atomic<bool> fQuit;
+
+    //! Ranges larger than this are always split.
+    const uint32_t nBatchSize;
+
+    //! Bumped whenever ranges are published, for workers going to sleep.
+    std::atomic<uint64_t> nEpoch;
+    std::atomic<int> nSleeping;
+    std::mutex mutex;
+    std::condition_variable condWorker;
+
+    T &Check(uint32_t i) {
+        return vBlocks[i / CHECKS_PER_BLOCK][i % CHECKS_PER_BLOCK];
+    }
+
+    //! Wake sleeping workers up after ranges were published.
+    void Notify() {
+        nEpoch.fetch_add(1, std::memory_order_seq_cst);
+        if (nSleeping.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            condWorker.notify_all();
+        }
+    }
+
+    //! Steal a range from the deque of another thread, starting at a random
+    //! victim.
+    bool Steal(int id, uint32_t &seed, uint64_t &range) {
+        const int nDeques =
+            std::min(MAX_DEQUES, nWorkers.load(std::memory_order_relaxed) + 1);
+        seed = seed * 1103515245 + 12345;
+        const int start = (seed >> 16) % nDeques;
+        for (int i = 0; i < nDeques; i++) {
+            const int victim = (start + i) % nDeques;
+            if (victim != id && deques[victim].Steal(range)) {
+                return true;
+            }
+        }
+        return false;
+    }
 
     /**
-     * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * Run a range of checks. Half of the remaining range is given away
+     * whenever the deque of the thread is empty or the range is too large.
+     * The checks are run in batches of CCheckBatch<T>::MAX_CHECKS, again one
+     * at a time if the batch fails, and destroyed right after.
      */
-    unsigned int nTodo;
-
-    //! The maximum number of elements to be processed in one batch
-    unsigned int nBatchSize;
-
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false) {
-        std::condition_variable &cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                std::unique_lock<std::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us
-                // to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster) {
-                        // We processed the last element; inform the master it
-                        // can exit and return the result
-                        condMaster.notify_one();
-                    }
-                } else {
-                    // first iteration
-                    nTotal++;
+    void Run(uint64_t range, CCheckDeque *own) {
+        uint32_t begin, end;
+        CCheckDeque::Unpack(range, begin, end);
+        uint32_t nDone = 0;
+        bool fOk = fAllOk.load(std::memory_order_relaxed);
+        while (begin < end) {
+            if (own && end - begin > 1 &&
+                (end - begin > nBatchSize || own->Empty())) {
+                const uint32_t mid = begin + (end - begin) / 2;
+                own->Push(CCheckDeque::Pack(mid, end));
+                Notify();
+                end = mid;
+            }
+            const uint32_t nMaxChecks = CCheckBatch<T>::MAX_CHECKS;
+            const uint32_t first = begin;
+            const uint32_t last = begin + std::min(end - begin, nMaxChecks);
+            const bool fFirstOk = fOk;
+            CCheckBatch<T>::Open();
+            for (; begin < last; begin++) {
+                if (fOk) {
+                    fOk = Check(begin)() &&
+                          fAllOk.load(std::memory_order_relaxed);
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster) {
-                            fAllOk = true;
-                        }
-                        // return the current status
-                        return fRet;
+            }
+            if (!CCheckBatch<T>::Close()) {
+                fOk = fFirstOk;
+                for (uint32_t i = first; i < last; i++) {
+                    if (fOk) {
+                        fOk = Check(i)() &&
+                              fAllOk.load(std::memory_order_relaxed);
                     }
-                    nIdle++;
-                    cond.wait(lock, [this, fMaster] { return !queue.empty() || ((fMaster || fQuit) && nTodo == 0); });
-                    nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for
-                // increasingly smaller batches so all workers finish
-                // approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start
-                // helping.
-                // * Don't do batches smaller than 1 (duh), or larger than
-                // nBatchSize.
-                nNow = std::max(
-                    1U, std::min(nBatchSize, (unsigned int)queue.size() /
-                                                 (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible,
-                    // so swap jobs from the global queue to the local batch
-                    // vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
             }
-            // execute work
-            for (T &check : vChecks) {
-                if (fOk) {
-                    fOk = check();
-                }
+            for (uint32_t i = first; i < last; i++) {
+                T tmp;
+                tmp.swap(Check(i));
             }
-            vChecks.clear();
-        } while (true);
+            nDone += last - first;
+        }
+        if (!fOk) {
+            fAllOk.store(false, std::memory_order_relaxed);
+        }
+        // The ranges given away are counted by the threads running them.
+        nTodo.fetch_sub(nDone, std::memory_order_acq_rel);
     }
 
 public:
@@ -140,10 +285,42 @@ public:
 
     //! Create a new check queue
     explicit CCheckQueue(unsigned int nBatchSizeIn)
-        : nIdle(0), nTotal(0), fAllOk(true), fQuit(false), nTodo(0),nBatchSize(nBatchSizeIn) {}
+        : vBlocks(MAX_BLOCKS), nStored(0), deques(new CCheckDeque[MAX_DEQUES]),
+          nWorkers(0), nTodo(0), fAllOk(true), fQuit(false),
+          nBatchSize(std::max(1U, nBatchSizeIn)), nEpoch(0), nSleeping(0) {}
 
     //! Worker thread
-    void Thread() { Loop(); }
+    void Thread() {
+        const int id = nWorkers.fetch_add(1) + 1;
+        CCheckDeque *own = id < MAX_DEQUES ? &deques[id] : nullptr;
+        uint32_t seed = id;
+        uint64_t range;
+        while (true) {
+            const uint64_t nLastEpoch = nEpoch.load(std::memory_order_seq_cst);
+            bool fFound = own && own->Pop(range);
+            for (int i = 0; i < STEAL_SPINS && !fFound; i++) {
+                fFound = Steal(id, seed, range);
+                if (!fFound) {
+                    std::this_thread::yield();
+                }
+            }
+            if (fFound) {
+                Run(range, own);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            if (fQuit) {
+                return;
+            }
+            nSleeping++;
+            condWorker.wait(lock, [&] {
+                return fQuit ||
+                       nEpoch.load(std::memory_order_seq_cst) != nLastEpoch;
+            });
+            nSleeping--;
+        }
+    }
 
     void Interrupt() {
         {
@@ -151,27 +328,50 @@ public:
             fQuit = true;
         }
         condWorker.notify_all();
-        condMaster.notify_all();
     }
 
-
     //! Wait until execution finishes, and return whether all evaluations were
     //! successful.
-    bool Wait() { return Loop(true); }
+    bool Wait() {
+        uint32_t seed = 0;
+        uint64_t range;
+        while (nTodo.load(std::memory_order_acquire) > 0) {
+            if (deques[0].Pop(range) || Steal(0, seed, range)) {
+                Run(range, &deques[0]);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+        // Every check is complete and destroyed, start the next round.
+        nStored = 0;
+        return fAllOk.exchange(true);
+    }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T> &vChecks) {
-        std::unique_lock<std::mutex> lock(mutex);
-        for (T &check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty()) {
+            return;
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1) {
-            condWorker.notify_one();
-        } else if (vChecks.size() > 1) {
-            condWorker.notify_all();
+        if (vChecks.size() > CHECKS_PER_BLOCK * MAX_BLOCKS - nStored) {
+            // Out of storage, which no block comes close to.
+            for (T &check : vChecks) {
+                if (fAllOk.load(std::memory_order_relaxed) && !check()) {
+                    fAllOk.store(false, std::memory_order_relaxed);
+                }
+            }
+            return;
+        }
+        const uint32_t begin = nStored;
+        for (T &check : vChecks) {
+            std::unique_ptr<T[]> &block = vBlocks[nStored / CHECKS_PER_BLOCK];
+            if (!block) {
+                block.reset(new T[CHECKS_PER_BLOCK]);
+            }
+            Check(nStored++).swap(check);
         }
+        nTodo.fetch_add(vChecks.size(), std::memory_order_relaxed);
+        deques[0].Push(CCheckDeque::Pack(begin, nStored));
+        Notify();
     }
 
     ~CCheckQueue() = default;
@@ -9,6 +9,7 @@
 #include <random.h>
 
 #include <cassert>
+#include <map>
 
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return false;
@@ -22,7 +23,8 @@ uint256 CCoinsView::GetBestBlock() const {
 std::vector<uint256> CCoinsView::GetHeadBlocks() const {
     return std::vector<uint256>();
 }
-bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                            bool erase) {
     return false;
 }
 CCoinsViewCursor *CCoinsView::Cursor() const {
@@ -46,8 +48,8 @@ void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) {
     base = &viewIn;
 }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins,
-                                  const uint256 &hashBlock) {
-    return base->BatchWrite(mapCoins, hashBlock);
+                                  const uint256 &hashBlock, bool erase) {
+    return base->BatchWrite(mapCoins, hashBlock, erase);
 }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const {
     return base->Cursor();
@@ -61,7 +63,7 @@ SaltedOutpointHasher::SaltedOutpointHasher()
       k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn)
-    : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+    : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), currentEpoch(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -71,6 +73,7 @@ CCoinsMap::iterator
 CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     auto it = cacheCoins.find(outpoint);
     if (it != cacheCoins.end()) {
+        it->second.epoch = currentEpoch;
         return it;
     }
     Coin tmp;
@@ -87,6 +90,7 @@ CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
         // our version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
+    ret->second.epoch = currentEpoch;
     cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
     return ret;
 }
@@ -125,6 +129,7 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin coin,
     it->second.coin = std::move(coin);
     it->second.flags |=
         CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    it->second.epoch = currentEpoch;
     cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
 }
 
@@ -181,6 +186,18 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     return it != cacheCoins.end();
 }
 
+void CCoinsViewCache::AddPrefetchedCoin(const COutPoint &outpoint,
+                                        Coin &&coin) {
+    assert(!coin.IsSpent());
+    auto ret = cacheCoins.emplace(std::piecewise_construct,
+                                  std::forward_as_tuple(outpoint),
+                                  std::forward_as_tuple(std::move(coin)));
+    if (ret.second) {
+        ret.first->second.epoch = currentEpoch;
+        cachedCoinsUsage += ret.first->second.coin.DynamicMemoryUsage();
+    }
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock.IsNull()) {
         hashBlock = base->GetBestBlock();
@@ -190,10 +207,15 @@ uint256 CCoinsViewCache::GetBestBlock() const {
 
 void CCoinsViewCache::SetBestBlock(const uint256 &hashBlockIn) {
     hashBlock = hashBlockIn;
+    currentEpoch++;
 }
 
 bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
-                                 const uint256 &hashBlockIn) {
+                                 const uint256 &hashBlockIn, bool erase) {
+    // Coins are moved out of the child, unless it keeps its entries.
+    auto takeCoin = [erase](Coin &coin) {
+        return erase ? std::move(coin) : Coin(coin);
+    };
     for (auto& it : mapCoins) {
         // Ignore non-dirty entries (optimization).
         if (it.second.flags & CCoinsCacheEntry::DIRTY) {
@@ -206,9 +228,10 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                     // Otherwise we will need to create it in the parent and
                     // move the data up and mark it as dirty
                     CCoinsCacheEntry &entry = cacheCoins[it.first];
-                    entry.coin = std::move(it.second.coin);
+                    entry.coin = takeCoin(it.second.coin);
                     cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
+                    entry.epoch = currentEpoch;
                     // We can mark it FRESH in the parent if it was FRESH in the
                     // child. Otherwise it might have just been flushed from the
                     // parent's cache and already exist in the grandparent
@@ -237,9 +260,10 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                 } else {
                     // A normal modification.
                     cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                    itUs->second.coin = std::move(it.second.coin);
+                    itUs->second.coin = takeCoin(it.second.coin);
                     cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                    itUs->second.epoch = currentEpoch;
                     // NOTE: It is possible the child has a FRESH flag here in
                     // the event the entry we found in the parent is pruned. But
                     // we must not copy that FRESH flag to the parent as that
@@ -249,18 +273,81 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
             }
         }
     }
-    mapCoins.clear();
+    if (erase) {
+        mapCoins.clear();
+    }
     hashBlock = hashBlockIn;
+    currentEpoch++;
     return true;
 }
 
 bool CCoinsViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, hashBlock);
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, true);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    bool fOk = base->BatchWrite(cacheCoins, hashBlock, false);
+    // The usage of the coins is recomputed as they are all visited anyway,
+    // spent coins may still hold the memory of their script.
+    cachedCoinsUsage = 0;
+    for (auto it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent()) {
+            cacheCoins.erase(it++);
+        } else {
+            it->second.flags = 0;
+            cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+            ++it;
+        }
+    }
+    return fOk;
+}
+
+void CCoinsViewCache::Trim(size_t nTargetUsage) {
+    const size_t nUsage = DynamicMemoryUsage();
+    if (nUsage <= nTargetUsage || cacheCoins.empty()) {
+        return;
+    }
+
+    // Memory freed by evicting the clean coins of each epoch, counting an
+    // even share of the map for every entry.
+    const size_t nEntryUsage =
+        memusage::DynamicUsage(cacheCoins) / cacheCoins.size();
+    std::map<uint32_t, size_t> usageByEpoch;
+    for (const auto &it : cacheCoins) {
+        if (it.second.flags == 0) {
+            usageByEpoch[it.second.epoch] +=
+                nEntryUsage + it.second.coin.DynamicMemoryUsage();
+        }
+    }
+
+    // Evict whole epochs, the oldest first, until enough memory is freed.
+    size_t nFreed = 0;
+    auto itLast = usageByEpoch.end();
+    for (auto it = usageByEpoch.begin();
+         it != usageByEpoch.end() && nFreed < nUsage - nTargetUsage; ++it) {
+        nFreed += it->second;
+        itLast = it;
+    }
+    if (itLast == usageByEpoch.end()) {
+        return;
+    }
+
+    const uint32_t nLastEpoch = itLast->first;
+    for (auto it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.flags == 0 && it->second.epoch <= nLastEpoch) {
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            cacheCoins.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    // Give the memory of the evicted entries back.
+    cacheCoins.shrink_to_fit();
+}
+
 void CCoinsViewCache::Uncache(const COutPoint &outpoint) {
     auto it = cacheCoins.find(outpoint);
     if (it != cacheCoins.end() && it->second.flags == 0) {
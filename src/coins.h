@@ -10,6 +10,7 @@
 #include <core_memusage.h>
 #include <hash.h>
 #include <memusage.h>
+#include <openhashmap.h>
 #include <serialize.h>
 #include <uint256.h>
 #include <crypto/siphash.h>
@@ -95,6 +96,9 @@ struct CCoinsCacheEntry {
     // The actual cached data.
     Coin coin;
     uint8_t flags;
+    // Epoch of the cache when the entry was last used, to evict the coldest
+    // clean entries first (see CCoinsViewCache::Trim).
+    uint32_t epoch;
 
     enum Flags {
         // This cache entry is potentially different from the version in the
@@ -108,12 +112,12 @@ struct CCoinsCacheEntry {
            that condition is not guaranteed. */
     };
 
-    CCoinsCacheEntry() : flags(0) {}
+    CCoinsCacheEntry() : flags(0), epoch(0) {}
     explicit CCoinsCacheEntry(Coin coinIn)
-        : coin(std::move(coinIn)), flags(0) {}
+        : coin(std::move(coinIn)), flags(0), epoch(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>
+typedef openhashmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>
     CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
@@ -157,8 +161,11 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified, and is emptied if erase is true.
+    //! Otherwise its entries are left in place, only their coins may have
+    //! been copied.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                            bool erase);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -182,7 +189,8 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    bool erase) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -202,6 +210,9 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Advanced with the best block, entries keep the epoch of their last use. */
+    uint32_t currentEpoch;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -216,7 +227,8 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    bool erase) override;
     CCoinsViewCursor *Cursor() const override {
         throw std::logic_error(
             "CCoinsViewCache cursor iteration not supported.");
@@ -229,6 +241,13 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Add a coin read from the backing view ahead of time, as FetchCoin would
+     * have. If the cache has an entry for the outpoint already it is kept, as
+     * it may be more recent than the backing view.
+     */
+    void AddPrefetchedCoin(const COutPoint &outpoint, Coin &&coin);
+
     /**
      * Return a reference to a Coin in the cache, or a pruned one if not found.
      * This is more efficient than GetCoin. Modifications to other cache entries
@@ -258,6 +277,20 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush,
+     * but keep the unspent coins in the cache as clean entries. The spent
+     * ones are dropped, as the base now knows they are spent.
+     */
+    bool Sync();
+
+    /**
+     * Evict the least recently used clean coins until the memory usage is
+     * under nTargetUsage, or no clean coin is left. Modified coins are never
+     * evicted, call Sync first to make them clean.
+     */
+    void Trim(size_t nTargetUsage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is not
      * modified.
@@ -0,0 +1,151 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coinstats.h>
+
+#include <chain.h>
+#include <coins.h>
+#include <ecmultiset.h>
+#include <hash.h>
+#include <index/coinstatsindex.h>
+#include <init.h> // for ShutdownRequested
+#include <serialize.h>
+#include <streams.h>
+#include <util.h>
+#include <validation.h>
+
+#include <map>
+
+bool CoinStatsHashTypeFromName(const std::string &name,
+                               CoinStatsHashType &hash_type) {
+    if (name == "hash_serialized") {
+        hash_type = CoinStatsHashType::HASH_SERIALIZED;
+    } else if (name == "ecmh") {
+        hash_type = CoinStatsHashType::ECMH;
+    } else if (name == "none") {
+        hash_type = CoinStatsHashType::NONE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint64_t GetBogoSize(const CScript &script_pub_key) {
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ +
+           8 /* amount */ + 2 /* scriptPubKey len */ +
+           script_pub_key.size() /* scriptPubKey */;
+}
+
+std::vector<uint8_t> TxOutSer(const COutPoint &outpoint, const Coin &coin) {
+    std::vector<uint8_t> data;
+    CVectorWriter ss(SER_DISK, PROTOCOL_VERSION, data, 0);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.GetHeight() * 2 + coin.IsCoinBase());
+    ss << coin.GetTxOut();
+    return data;
+}
+
+static void ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash,
+                       const std::map<uint32_t, Coin> &outputs) {
+    assert(!outputs.empty());
+    ss << hash;
+    ss << VARINT(outputs.begin()->second.GetHeight() * 2 +
+                 outputs.begin()->second.IsCoinBase());
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.GetTxOut().scriptPubKey;
+        ss << VARINT(output.second.GetTxOut().nValue.toInt());
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.GetTxOut().nValue;
+        stats.nBogoSize += GetBogoSize(output.second.GetTxOut().scriptPubKey);
+    }
+    ss << VARINT(0);
+}
+
+//! Scan the whole view, the serialized hash can only be computed this way
+static bool ComputeUTXOStats(CCoinsView *view, CCoinsStats &stats,
+                             CoinStatsHashType hash_type) {
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    assert(pcursor);
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ECMultiSet ecmh;
+    stats.hashBlock = pcursor->GetBestBlock();
+    {
+        LOCK(cs_main);
+        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
+    }
+    ss << stats.hashBlock;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (pcursor->Valid()) {
+        interruption_point(ShutdownRequested());
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (hash_type == CoinStatsHashType::ECMH) {
+                ecmh.Insert(TxOutSer(key, coin));
+            }
+            if (!outputs.empty() && key.GetTxId() != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.GetTxId();
+            outputs[key.GetN()] = std::move(coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    if (!outputs.empty()) {
+        ApplyStats(stats, ss, prevkey, outputs);
+    }
+    switch (hash_type) {
+        case CoinStatsHashType::HASH_SERIALIZED:
+            stats.hashSerialized = ss.GetHash();
+            break;
+        case CoinStatsHashType::ECMH:
+            stats.hashSerialized = ecmh.GetHash();
+            break;
+        case CoinStatsHashType::NONE:
+            break;
+    }
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
+
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats,
+                  CoinStatsHashType hash_type, const CBlockIndex *pindex,
+                  bool index_requested) {
+    const bool use_index = index_requested && g_coin_stats_index &&
+                           hash_type != CoinStatsHashType::HASH_SERIALIZED;
+    if (use_index) {
+        if (!pindex) {
+            LOCK(cs_main);
+            pindex = LookupBlockIndex(view->GetBestBlock());
+        }
+        if (pindex && g_coin_stats_index->LookUpStats(pindex, stats)) {
+            if (hash_type == CoinStatsHashType::NONE) {
+                stats.hashSerialized.SetNull();
+            }
+            return true;
+        }
+        // The index is behind the view, scan it if that's what was asked for
+        LOCK(cs_main);
+        if (!pindex || pindex->GetBlockHash() != view->GetBestBlock()) {
+            return false;
+        }
+    } else if (pindex) {
+        LOCK(cs_main);
+        if (pindex->GetBlockHash() != view->GetBestBlock()) {
+            return error("%s: only the coin stats index has the statistics "
+                         "of past blocks",
+                         __func__);
+        }
+    }
+    return ComputeUTXOStats(view, stats, hash_type);
+}
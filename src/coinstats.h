@@ -0,0 +1,76 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COINSTATS_H
+#define BITCOIN_COINSTATS_H
+
+#include <amount.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class CBlockIndex;
+class CCoinsView;
+class COutPoint;
+class CScript;
+class Coin;
+
+enum class CoinStatsHashType {
+    //! SHA256 of the serialized set, in chainstate order (full scan only)
+    HASH_SERIALIZED,
+    //! Elliptic curve multiset hash of the coins, see ECMultiSet
+    ECMH,
+    NONE,
+};
+
+/** Parse a hash type name as taken by gettxoutsetinfo. */
+bool CoinStatsHashTypeFromName(const std::string &name,
+                               CoinStatsHashType &hash_type);
+
+struct CCoinsStats {
+    int nHeight;
+    uint256 hashBlock;
+    //! Only known from a full scan of the chainstate
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    //! Only known from a full scan of the chainstate
+    uint64_t nDiskSize;
+    Amount nTotalAmount;
+
+    //! Whether the stats were read from the coin stats index
+    bool index_used;
+    //! Only known from the coin stats index: value of the unspendable outputs
+    //! (OP_RETURN), which never make it into the chainstate
+    Amount nTotalUnspendableAmount;
+
+    CCoinsStats()
+        : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0),
+          nDiskSize(0), nTotalAmount(), index_used(false),
+          nTotalUnspendableAmount() {}
+};
+
+/** Database-independent metric of the size of a coin. */
+uint64_t GetBogoSize(const CScript &script_pub_key);
+
+/** The serialization of a coin hashed into the ECMH commitment. */
+std::vector<uint8_t> TxOutSer(const COutPoint &outpoint, const Coin &coin);
+
+/**
+ * Calculate statistics about the unspent transaction output set. Unless a
+ * serialized hash is asked for, they are read from the coin stats index when
+ * it runs and index_requested is set, at pindex (default: the best block of
+ * view). Otherwise the whole view is scanned, and pindex must be null.
+ */
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats,
+                  CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED,
+                  const CBlockIndex *pindex = nullptr,
+                  bool index_requested = true);
+
+#endif // BITCOIN_COINSTATS_H
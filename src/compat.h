@@ -45,6 +45,13 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+// Peer sockets are served with epoll, single sockets waited on with poll(),
+// so that sockets aren't limited to FD_SETSIZE
+#include <poll.h>
+#define USE_POLL
+#endif
+
 #ifndef WIN32
 typedef unsigned int SOCKET;
 #include <cerrno>
@@ -6,14 +6,17 @@
 
 #include <random.h>
 #include <fs_util.h>
+#include <sync.h>
 
 #include <algorithm>
 #include <cstdint>
+#include <set>
 
 #ifdef USE_ROCKSDB
 #include <rocksdb/cache.h>
 #include <rocksdb/env.h>
 #include <rocksdb/filter_policy.h>
+#include <rocksdb/table.h>
 #include <rocksdb/utilities/leveldb_options.h>
 #else
 #include <leveldb/cache.h>
@@ -80,27 +83,168 @@ public:
     }
 };
 
-static datadb::Options GetOptions(size_t nCacheSize) {
+// clang-format off
+static const DBProfile dbProfiles[] = {
+    // name           cache  bloom  block size  compress  universal  threads  preset
+    // The settings every database had before profiles
+    {"default",       50,    10,    4 * 1024,   -1,       false,     16,      true},
+    // Random reads of small values: most of the memory for the block cache,
+    // and enough bloom bits that lookups of missing keys rarely touch disk
+    {"pointlookup",   75,    16,    4 * 1024,   -1,       false,     16,      false},
+    // Range scans: bloom filters don't help them, large and compressed
+    // blocks mean fewer reads
+    {"scan",          50,    0,     64 * 1024,  2,        false,     4,       false},
+    // Written once and seldom read, kept small
+    {"archive",       25,    10,    64 * 1024,  0,        true,      4,       false},
+};
+
+//! Profile of each database unless -dbprofile says otherwise
+static const std::pair<const char *, const char *> dbDefaultProfiles[] = {
+    {"chainstate",      "pointlookup"},
+    {"blockindex",      "default"},
+    {"rewards",         "pointlookup"},
+    {"txindex",         "pointlookup"},
+    {"addrindex",       "scan"},
+    {"timestampindex",  "scan"},
+    {"blockfilter",     "scan"},
+    {"coinstatsindex",  "default"},
+};
+// clang-format on
+
+const DBProfile *GetDBProfile(const std::string &name) {
+    for (const DBProfile &profile : dbProfiles) {
+        if (name == profile.name) {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+std::string DBProfileNames() {
+    std::string names;
+    for (const DBProfile &profile : dbProfiles) {
+        names += (names.empty() ? "" : ", ") + std::string(profile.name);
+    }
+    return names;
+}
+
+static bool IsKnownDB(const std::string &name) {
+    for (const auto &db : dbDefaultProfiles) {
+        if (name == db.first) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CheckDBProfileArgs(std::string &error) {
+    for (const std::string &arg : gArgs.GetArgs("-dbprofile")) {
+        size_t colon = arg.find(':');
+        if (colon == std::string::npos || !IsKnownDB(arg.substr(0, colon)) ||
+            !GetDBProfile(arg.substr(colon + 1))) {
+            error = strprintf("Invalid -dbprofile=%s, the databases are "
+                              "chainstate, blockindex, rewards, txindex, "
+                              "addrindex, timestampindex, blockfilter and "
+                              "coinstatsindex, the profiles are %s",
+                              arg, DBProfileNames());
+            return false;
+        }
+    }
+    return true;
+}
+
+/** Pick the profile of a database, the last -dbprofile for it wins. */
+static const DBProfile *SelectDBProfile(const std::string &name) {
+    const DBProfile *profile = GetDBProfile("default");
+    for (const auto &db : dbDefaultProfiles) {
+        if (name == db.first) {
+            profile = GetDBProfile(db.second);
+        }
+    }
+    for (const std::string &arg : gArgs.GetArgs("-dbprofile")) {
+        size_t colon = arg.find(':');
+        if (colon != std::string::npos && arg.substr(0, colon) == name &&
+            GetDBProfile(arg.substr(colon + 1))) {
+            profile = GetDBProfile(arg.substr(colon + 1));
+        }
+    }
+    return profile;
+}
+
+static datadb::Options GetOptions(size_t nCacheSize,
+                                  const DBProfile &profile) {
+  const size_t nBlockCache = nCacheSize * profile.block_cache_percent / 100;
+  const size_t nWriteBuffers = nCacheSize - nBlockCache;
 #ifdef USE_ROCKSDB
-  datadb::LevelDBOptions opt;
-  // opt.block_cache = datadb::NewLRUCache(nCacheSize / 2);
-  opt.write_buffer_size = nCacheSize / 4;  // up to two write buffers may be held in memory simultaneously
-  opt.filter_policy = datadb::NewBloomFilterPolicy(10);
-  opt.compression = datadb::kNoCompression;
-  opt.max_open_files = 64;
-  datadb::Options datadb_options = ConvertOptions(opt);
+  if (profile.rocksdb_preset) {
+    datadb::LevelDBOptions opt;
+    opt.write_buffer_size = nCacheSize / 4;
+    opt.filter_policy = datadb::NewBloomFilterPolicy(profile.bloom_bits);
+    opt.compression = datadb::kNoCompression;
+    opt.max_open_files = 64;
+    datadb::Options datadb_options = ConvertOptions(opt);
+    datadb_options.avoid_flush_during_shutdown = true;
+    datadb_options.enable_thread_tracking = true;
+    datadb_options.IncreaseParallelism(profile.parallelism);
+    datadb_options.OptimizeLevelStyleCompaction();
+    return datadb_options;
+  }
+
+  datadb::Options datadb_options;
+  // This also picks the best supported compression for the lower levels
+  if (profile.universal_compaction) {
+    datadb_options.OptimizeUniversalStyleCompaction(nWriteBuffers);
+  } else {
+    datadb_options.OptimizeLevelStyleCompaction(nWriteBuffers);
+  }
+  // up to two write buffers may be held in memory simultaneously
+  datadb_options.write_buffer_size = nWriteBuffers / 2;
+  datadb_options.max_write_buffer_number = 2;
+  datadb_options.min_write_buffer_number_to_merge = 1;
+
+  const datadb::CompressionType compression =
+      datadb_options.compression_per_level.empty()
+          ? datadb_options.compression
+          : datadb_options.compression_per_level.back();
+  if (profile.compress_from_level < 0) {
+    datadb_options.compression = datadb::kNoCompression;
+    datadb_options.compression_per_level.clear();
+  } else if (!profile.universal_compaction) {
+    datadb_options.compression_per_level.resize(datadb_options.num_levels);
+    for (int i = 0; i < datadb_options.num_levels; i++) {
+      datadb_options.compression_per_level[i] =
+          i < profile.compress_from_level ? datadb::kNoCompression
+                                          : compression;
+    }
+  }
+
+  datadb::BlockBasedTableOptions table_options;
+  table_options.block_cache = datadb::NewLRUCache(nBlockCache);
+  table_options.block_size = profile.block_size;
+  if (profile.bloom_bits > 0) {
+    table_options.filter_policy.reset(
+        datadb::NewBloomFilterPolicy(profile.bloom_bits, false));
+  }
+  datadb_options.table_factory.reset(
+      datadb::NewBlockBasedTableFactory(table_options));
+
+  datadb_options.max_open_files = 64;
   datadb_options.avoid_flush_during_shutdown = true;
   datadb_options.enable_thread_tracking = true;
-  datadb_options.IncreaseParallelism();
-  datadb_options.OptimizeLevelStyleCompaction();
+  datadb_options.IncreaseParallelism(profile.parallelism);
   return datadb_options;
 #else
   datadb::Options options;
-  options.block_cache = datadb::NewLRUCache(nCacheSize / 2);
+  options.block_cache = datadb::NewLRUCache(nBlockCache);
   // up to two write buffers may be held in memory simultaneously
-  options.write_buffer_size = nCacheSize / 4;
-  options.filter_policy = datadb::NewBloomFilterPolicy(10);
-  options.compression = datadb::kNoCompression;
+  options.write_buffer_size = nWriteBuffers / 2;
+  options.block_size = profile.block_size;
+  if (profile.bloom_bits > 0) {
+    options.filter_policy = datadb::NewBloomFilterPolicy(profile.bloom_bits);
+  }
+  options.compression = profile.compress_from_level < 0
+                            ? datadb::kNoCompression
+                            : datadb::kSnappyCompression;
   options.max_open_files = 64;
   options.info_log = new CBitcoinLevelDBLogger();
   if (datadb::kMajorVersion > 1 ||
@@ -113,14 +257,28 @@ static datadb::Options GetOptions(size_t nCacheSize) {
 #endif
 }
 
+//! Open databases, for getdbstats
+static CCriticalSection cs_dbwrappers;
+static std::set<const CDBWrapper *> setDBWrappers GUARDED_BY(cs_dbwrappers);
+
+std::vector<DBStats> GetDBStats() {
+    LOCK(cs_dbwrappers);
+    std::vector<DBStats> stats;
+    for (const CDBWrapper *db : setDBWrappers) {
+        stats.push_back(db->GetStats());
+    }
+    return stats;
+}
+
 CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory,
-                       bool fWipe, bool obfuscate) {
+                       bool fWipe, bool obfuscate, const std::string &name)
+    : name(name), profile(SelectDBProfile(name)), path(path) {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, *profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = datadb::NewMemEnv(datadb::Env::Default());
@@ -132,7 +290,8 @@ CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory,
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectories(path);
-        LogPrintf("Opening DataDB in %s\n", path.string());
+        LogPrintf("Opening DataDB in %s with the %s profile\n", path.string(),
+                  profile->name);
     }
     datadb::Status status = datadb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -173,9 +332,16 @@ CDBWrapper::CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory,
 
     LogPrintf("Using obfuscation key for %s: %s\n", path.string(),
               HexStr(obfuscate_key));
+
+    LOCK(cs_dbwrappers);
+    setDBWrappers.insert(this);
 }
 
 CDBWrapper::~CDBWrapper() {
+    {
+        LOCK(cs_dbwrappers);
+        setDBWrappers.erase(this);
+    }
     delete pdb;
     pdb = nullptr;
 #ifdef USE_ROCKSDB
@@ -216,6 +382,35 @@ std::vector<uint8_t> CDBWrapper::CreateObfuscateKey() const {
     return std::vector<uint8_t>(&buff[0], &buff[OBFUSCATE_KEY_NUM_BYTES]);
 }
 
+DBStats CDBWrapper::GetStats() const {
+#ifdef USE_ROCKSDB
+    static const char *const propertyNames[] = {
+        "rocksdb.estimate-num-keys",
+        "rocksdb.total-sst-files-size",
+        "rocksdb.block-cache-usage",
+        "rocksdb.cur-size-all-mem-tables",
+        "rocksdb.num-running-compactions",
+        "rocksdb.stats",
+    };
+#else
+    static const char *const propertyNames[] = {
+        "leveldb.approximate-memory-usage",
+        "leveldb.stats",
+    };
+#endif
+    DBStats stats;
+    stats.name = name;
+    stats.path = path.string();
+    stats.profile = profile->name;
+    for (const char *property : propertyNames) {
+        std::string value;
+        if (pdb->GetProperty(property, &value)) {
+            stats.properties.emplace_back(property, value);
+        }
+    }
+    return stats;
+}
+
 bool CDBWrapper::IsEmpty() {
     std::unique_ptr<CDBIterator> it(NewIterator());
     it->SeekToFirst();
@@ -231,9 +426,15 @@ bool CDBIterator::Valid() const {
 void CDBIterator::SeekToFirst() {
     piter->SeekToFirst();
 }
+void CDBIterator::SeekToLast() {
+    piter->SeekToLast();
+}
 void CDBIterator::Next() {
     piter->Next();
 }
+void CDBIterator::Prev() {
+    piter->Prev();
+}
 
 namespace dbwrapper_private {
 
@@ -14,6 +14,10 @@
 #include <utilstrencodings.h>
 #include <version.h>
 
+#include <string>
+#include <utility>
+#include <vector>
+
 #ifdef USE_ROCKSDB
 #include <rocksdb/db.h>
 #include <rocksdb/write_batch.h>
@@ -27,6 +31,53 @@ namespace datadb = leveldb;
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
 
+/**
+ * Storage engine settings of a database. Every database has a default profile
+ * suited to how it is used, which -dbprofile=<database>:<profile> overrides.
+ */
+struct DBProfile {
+    const char *name;
+    //! Share of the database cache given to the block cache, in percent. The
+    //! rest is for the two write buffers.
+    int block_cache_percent;
+    //! Bits per key of the bloom filters, 0 for none
+    int bloom_bits;
+    //! Size of the data blocks, larger ones suit range scans
+    size_t block_size;
+    //! First level which is compressed, -1 for none. LevelDB compresses all
+    //! levels or none.
+    int compress_from_level;
+    //! RocksDB only: universal rather than level compaction. Switching an
+    //! existing database to it needs the database to be rebuilt.
+    bool universal_compaction;
+    //! RocksDB only: threads for background flushes and compactions
+    int parallelism;
+    //! RocksDB only: ignore the above and open the database as before there
+    //! were profiles, with RocksDB's own block cache and the level compaction
+    //! preset (512 MiB of memtables, levels compressed from 2)
+    bool rocksdb_preset;
+};
+
+/** The profile called name, or nullptr if there is none. */
+const DBProfile *GetDBProfile(const std::string &name);
+
+/** The profiles a database can be given, for the help text. */
+std::string DBProfileNames();
+
+/** Check the -dbprofile options name known databases and profiles. */
+bool CheckDBProfileArgs(std::string &error);
+
+/** Storage engine properties of an open database, for getdbstats. */
+struct DBStats {
+    std::string name;
+    std::string path;
+    std::string profile;
+    std::vector<std::pair<std::string, std::string>> properties;
+};
+
+/** Get the properties of all open databases. */
+std::vector<DBStats> GetDBStats();
+
 class dbwrapper_error : public std::runtime_error {
 public:
     explicit dbwrapper_error(const std::string &msg)
@@ -147,8 +198,26 @@ public:
         piter->Seek(slKey);
     }
 
+    /** Position at the last key <= key, for reverse iteration */
+    template <typename K> void SeekForPrev(const K &key) {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey << key;
+        datadb::Slice slKey(ssKey.data(), ssKey.size());
+        piter->Seek(slKey);
+        if (!piter->Valid()) {
+            piter->SeekToLast();
+        } else if (piter->key().compare(slKey) > 0) {
+            piter->Prev();
+        }
+    }
+
+    void SeekToLast();
+
     void Next();
 
+    void Prev();
+
     template <typename K> bool GetKey(K &key) {
         datadb::Slice slKey = piter->key();
         try {
@@ -204,6 +273,15 @@ private:
     //! the database itself
     datadb::DB *pdb;
 
+    //! name of the database, which picks its profile
+    std::string name;
+
+    //! storage engine settings the database was opened with
+    const DBProfile *profile;
+
+    //! where the database is
+    fs::path path;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<uint8_t> obfuscate_key;
 
@@ -225,9 +303,12 @@ public:
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If
      * false, XOR
      *                        with a zero'd byte array.
+     * @param[in] name        Name of the database for -dbprofile, which also
+     *                        picks its default profile.
      */
     CDBWrapper(const fs::path &path, size_t nCacheSize, bool fMemory = false,
-               bool fWipe = false, bool obfuscate = false);
+               bool fWipe = false, bool obfuscate = false,
+               const std::string &name = "");
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper &) = delete;
@@ -297,6 +378,9 @@ public:
         return WriteBatch(batch, true);
     }
 
+    /** Get the properties of the storage engine reported by getdbstats. */
+    DBStats GetStats() const;
+
     CDBIterator *NewIterator() {
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
@@ -8,6 +8,7 @@
 // No longer dependent on txdb.h, but some stuff copied/used
 
 #pragma once
+#include <compressor.h>
 #include <primitives/transaction.h>
 
 // For ToString()
@@ -15,6 +16,10 @@
 #include <cashaddrenc.h>
 
 static const char DB_REWARD = 'R';
+// Secondary key : Height a reward was paid at -> outpoint of the reward
+static const char DB_REWARD_HEIGHT = 'H';
+// Single key : running reward totals (CRewardStats)
+static const char DB_REWARD_STATS = 'S';
 
 // This is the Key for CColdReward DB iterator
 struct CRewardKey {
@@ -97,3 +102,67 @@ struct CRewardValue {
   }
  
 };
+
+// Running reward totals, so that getrewardinfo doesn't need to scan the chain
+// Only the cumulative totals are stored in the DB, the active ones are rebuilt from the rewards at startup
+struct CRewardStats {
+  int32_t nHeight = -1; // Last block included in the totals, -1 if unknown (needs to be seeded)
+  Amount nMiningRewards;
+  Amount nBudgetRewards;
+  Amount nColdRewards;
+  // Active rewards
+  int64_t nCount = 0;
+  Amount nSum;
+  int64_t nPayouts = 0;
+
+  bool IsKnown() const { return nHeight >= 0; }
+  Amount GetTotalSupply() const { return nMiningRewards + nBudgetRewards + nColdRewards; }
+
+  template <typename Stream> void Serialize(Stream &s) const {
+    s << nHeight;
+    s << nMiningRewards;
+    s << nBudgetRewards;
+    s << nColdRewards;
+  }
+
+  template <typename Stream> void Unserialize(Stream &s) {
+    s >> nHeight;
+    s >> nMiningRewards;
+    s >> nBudgetRewards;
+    s >> nColdRewards;
+  }
+};
+
+// Compact form of a reward for binary dumps (getrewards), compressed TxOut and VARINTs for the rest
+struct CRewardDumpRecord {
+  COutPoint outpoint;
+  CRewardValue reward;
+
+  CRewardDumpRecord() {}
+  CRewardDumpRecord(const COutPoint &o, const CRewardValue &r) : outpoint(o), reward(r) {}
+
+  template <typename Stream> void Serialize(Stream &s) const {
+    s << outpoint.GetTxId();
+    s << VARINT(outpoint.GetN());
+    s << CTxOutCompressor(REF(reward.txout));
+    s << VARINT(reward.creationHeight);
+    s << VARINT(reward.OldHeight);
+    s << VARINT(reward.height);
+    s << VARINT(reward.payCount);
+    s << reward.active;
+  }
+
+  template <typename Stream> void Unserialize(Stream &s) {
+    TxId txid;
+    uint32_t n = 0;
+    s >> txid;
+    s >> VARINT(n);
+    outpoint = COutPoint(txid, n);
+    s >> CTxOutCompressor(reward.txout);
+    s >> VARINT(reward.creationHeight);
+    s >> VARINT(reward.OldHeight);
+    s >> VARINT(reward.height);
+    s >> VARINT(reward.payCount);
+    s >> reward.active;
+  }
+};
@@ -0,0 +1,80 @@
+// Copyright (c) 2019 The DeVault developers
+// Copyright (c) 2019 Jon Spock
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <devault/rewardcandidates.h>
+#include <devault/rewards_calculation.h>
+
+#include <clientversion.h>
+#include <streams.h>
+
+COutPoint GetRewardTieBreakKey(const COutPoint &outpoint) {
+  if (outpoint.GetN() < 0x80) return outpoint;
+  CDataStream ss(SER_DISK, CLIENT_VERSION);
+  ss << std::make_pair(DB_REWARD, outpoint);
+  COutPoint key;
+  CRewardKey entry(&key);
+  ss >> entry;
+  return key;
+}
+
+void CRewardCandidates::Add(const COutPoint &outpoint, const CRewardValue &val) {
+  if (!val.active) return;
+  if (setCandidates.emplace(val.height, val.txout.nValue, outpoint).second) {
+    nSum += val.txout.nValue;
+    nPayouts += val.payCount;
+  }
+}
+
+void CRewardCandidates::Remove(const COutPoint &outpoint, const CRewardValue &val) {
+  if (setCandidates.erase(CRewardCandidate(val.height, val.txout.nValue, outpoint))) {
+    nSum -= val.txout.nValue;
+    nPayouts -= val.payCount;
+  }
+}
+
+void CRewardCandidates::Clear() {
+  setCandidates.clear();
+  nSum = Amount();
+  nPayouts = 0;
+}
+
+bool CRewardCandidates::Find(const Consensus::Params &consensusParams, int Height, int64_t nMinBlocks,
+                             const Amount &nMinReward, const Amount &nMaxReward, COutPoint &key,
+                             Amount &reward) const {
+  auto it = setCandidates.begin();
+  while (it != setCandidates.end()) {
+    int nHeight = it->height;
+    int HeightDiff = Height - nHeight;
+    // Everything after this is younger, so can't be eligible either
+    if (HeightDiff <= nMinBlocks) break;
+
+    // 1st entry at a Height has the largest balance, so the largest reward at that Height.
+    // Reward can't increase with a smaller balance, so if it's below min, skip the whole Height
+    Amount topReward = CalculateReward(consensusParams, nHeight, HeightDiff, it->value);
+    if (topReward < nMinReward) {
+      it = setCandidates.upper_bound(it->height);
+      continue;
+    }
+    if (topReward > nMaxReward) topReward = nMaxReward;
+
+    // Same reward at Same Height => Select the 'smallest' key, as the DB cursor used to read it
+    COutPoint minKey = it->outpoint;
+    COutPoint minTieBreak = GetRewardTieBreakKey(minKey);
+    for (++it; it != setCandidates.end() && int(it->height) == nHeight; ++it) {
+      Amount r = CalculateReward(consensusParams, nHeight, HeightDiff, it->value);
+      if (r > nMaxReward) r = nMaxReward;
+      if (r < topReward) break;
+      COutPoint tieBreak = GetRewardTieBreakKey(it->outpoint);
+      if (tieBreak < minTieBreak) {
+        minKey = it->outpoint;
+        minTieBreak = tieBreak;
+      }
+    }
+    key = minKey;
+    reward = topReward;
+    return true;
+  }
+  return false;
+}
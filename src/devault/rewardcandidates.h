@@ -0,0 +1,85 @@
+// Copyright (c) 2019 The DeVault developers
+// Copyright (c) 2019 Jon Spock
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include <amount.h>
+#include <consensus/params.h>
+#include <devault/coinreward.h>
+#include <primitives/transaction.h>
+
+#include <set>
+
+// What CRewardKey reads back from the DB key of a reward written under outpoint : the fixed size index read as a
+// VARINT, so not outpoint when n >= 128. Only the order between equal rewards, which has to stay the one reward
+// selection always had, uses it.
+COutPoint GetRewardTieBreakKey(const COutPoint &outpoint);
+
+// Entry of the in-memory candidate index, one per active reward in the DB
+struct CRewardCandidate {
+  uint32_t height; // Height of last payment (or creation)
+  Amount value;
+  COutPoint outpoint;
+  CRewardCandidate(uint32_t h, const Amount &v, const COutPoint &o) : height(h), value(v), outpoint(o) {}
+
+  // Used as listrewards cursor
+  template <typename Stream> void Serialize(Stream &s) const {
+    s << height;
+    s << value;
+    s << outpoint;
+  }
+
+  template <typename Stream> void Unserialize(Stream &s) {
+    s >> height;
+    s >> value;
+    s >> outpoint;
+  }
+};
+
+// Order by (last paid height ascending, value descending, outpoint ascending)
+// so that the first entry of each height is the one with the largest reward
+struct CRewardCandidateCompare {
+  using is_transparent = void;
+  bool operator()(const CRewardCandidate &a, const CRewardCandidate &b) const {
+    if (a.height != b.height) return a.height < b.height;
+    if (a.value != b.value) return a.value > b.value;
+    return a.outpoint < b.outpoint;
+  }
+  // Height only lookups, used to jump to the next height
+  bool operator()(const CRewardCandidate &a, uint32_t h) const { return a.height < h; }
+  bool operator()(uint32_t h, const CRewardCandidate &b) const { return h < b.height; }
+};
+
+/**
+ * Ordered set of active rewards, kept in sync with CRewardsViewDB by CColdRewards,
+ * so that reward selection does not need to walk the whole rewards DB every block.
+ */
+class CRewardCandidates {
+  private:
+  std::set<CRewardCandidate, CRewardCandidateCompare> setCandidates;
+  Amount nSum;          // sum of the values of the candidates
+  int64_t nPayouts = 0; // sum of the payCounts of the candidates
+
+  public:
+  // Only active rewards are candidates, inactive values are ignored
+  void Add(const COutPoint &outpoint, const CRewardValue &val);
+  void Remove(const COutPoint &outpoint, const CRewardValue &val);
+  void Clear();
+  size_t Size() const { return setCandidates.size(); }
+  Amount GetSum() const { return nSum; }
+  int64_t GetPayouts() const { return nPayouts; }
+
+  // Visit candidates in index order from *pstart (or the first one) until fn returns false
+  template <typename Callback> void ForEach(const CRewardCandidate *pstart, Callback fn) const {
+    auto it = pstart ? setCandidates.lower_bound(*pstart) : setCandidates.begin();
+    for (; it != setCandidates.end(); ++it) {
+      if (!fn(*it)) break;
+    }
+  }
+
+  // Same selection rule as the former full DB scan : oldest height with a reward >= nMinReward,
+  // then the largest (capped) reward, then the smallest GetRewardTieBreakKey
+  bool Find(const Consensus::Params &consensusParams, int Height, int64_t nMinBlocks, const Amount &nMinReward,
+            const Amount &nMaxReward, COutPoint &key, Amount &reward) const;
+};
@@ -8,16 +8,21 @@
 #include <chain.h>
 #include <cashaddrenc.h> // GetAddrFromTxOut for debug
 #include <chainparams.h>
+#include <clientversion.h>
 #include <config.h>
 #include <consensus/consensus.h>
+#include <devault/budget.h>
 #include <devault/rewards_calculation.h>
 #include <init.h> // for Shutdown
 #include <logging.h>
 #include <script/standard.h>
+#include <streams.h>
 #include <validation.h>
 
 #include <fs.h> // for Dump debug stuff
+#include <fs_util.h>
 #include <fstream>
+#include <unordered_set>
 
 using namespace std;
 
@@ -31,9 +36,10 @@ bool IsSuperBlock(int nBlockHeight) {
 
 //
 
-CColdRewards::CColdRewards(const Consensus::Params &consensusParams, CRewardsViewDB *prdb) : pdb(prdb) {
+CColdRewards::CColdRewards(const Consensus::Params &consensusParams, CRewardsViewCache *prdb) : pdb(prdb) {
   LOCK(cs_rewardsdb);
   Setup(consensusParams);
+  LoadCandidatesFromDB();
   // viable_utxos = 0;
 }
 
@@ -44,12 +50,15 @@ void CColdRewards::Setup(const Consensus::Params &consensusParams) {
   nMinReward = consensusParams.nMinReward;
 }
 
-bool CColdRewards::UpdateWithBlock(const Config &config, CBlockIndex *pindexNew) {
+bool CColdRewards::UpdateWithBlock(const CBlock &block, int nHeight) {
 
-  const Consensus::Params consensusParams = config.GetChainParams().GetConsensus();
-  CBlock block;
-  int nHeight = pindexNew->nHeight;
-  ReadBlockFromDisk(block, pindexNew, config);
+  // Outputs spent within this same block never become rewards
+  std::unordered_set<COutPoint, SaltedOutpointHasher> spentInBlock;
+  for (auto &tx : block.vtx) {
+    if (!tx->IsCoinBase()) {
+      for (const CTxIn &in : tx->vin) spentInBlock.insert(in.prevout);
+    }
+  }
 
   // Loop through block
   std::vector<std::pair<COutPoint, CRewardValue>> rewardAdditions;
@@ -66,7 +75,7 @@ bool CColdRewards::UpdateWithBlock(const Config &config, CBlockIndex *pindexNew)
         Amount balance = out.nValue;
         // LogPrintf("Found spend to %d COINS at height %d\n", balance/COIN, nHeight);
         COutPoint outpoint(TxId, n); // Unique
-        if (balance >= nMinBalance) {
+        if (balance >= nMinBalance && spentInBlock.count(outpoint) == 0) {
           LogPrint(BCLog::COLD, "CR: %s : Writing to Rewards db, addr %s, Value of %d at Height %d\n", __func__,
                    GetAddrFromTxOut(out), balance.toIntCoins(), nHeight);
           CRewardValue e(out, nHeight, nHeight, nHeight);
@@ -81,37 +90,29 @@ bool CColdRewards::UpdateWithBlock(const Config &config, CBlockIndex *pindexNew)
     if (!tx->IsCoinBase()) {
       // Loop through inputs
       for (const CTxIn &in : tx->vin) {
-        // Since input is a previous output, delete it from the database if it's in there
+        // Since input is a previous output, inactivate it in the database if it's in there
         // could be if > nMinBalance, but don't need to check
-        COutPoint outpoint(in.prevout);
-        if (pdb->HaveReward(outpoint)) {
-          // will erase
-          // first get Value for now
-          CRewardValue coinr; // Don't need this expect for log/checking
-          if (!pdb->GetReward(outpoint, coinr)) {
-              LogPrint(BCLog::COLD, "CR: %s : Problem getting coin from Rewards db at Height %d, value %d\n", __func__,
-                       nHeight, coinr.GetValue().toIntCoins());
-          }
+        const COutPoint &outpoint = in.prevout;
+        CRewardValue coinr;
+        if (pdb->GetReward(outpoint, coinr)) {
           cachedInactives.insert(std::make_pair(outpoint, nHeight));
           rewardErasures.emplace_back(outpoint, coinr);
           // viable_utxos--;
         }
-        
-        // If Input is an output in this same block, remove it from Additions array also
-        for (auto it = rewardAdditions.begin(); it != rewardAdditions.end(); ) {
-          if (it->first == outpoint) {
-            rewardAdditions.erase(it);
-            break;
-          }
-          it++;
-        }
       }
     }
   }
-  
-  // Batch Write/Erase
-  if (rewardAdditions.size() > 0) pdb->Add(rewardAdditions);
-  if (rewardErasures.size() > 0) pdb->InActivate(rewardErasures);
+
+  // Height keys are only needed to undo blocks within re-org depth
+  const int32_t maxreorgdepth = gArgs.GetArg("-maxreorgdepth", DEFAULT_MAX_REORG_DEPTH);
+  int nPruneHeight = (maxreorgdepth >= 0 && nHeight > maxreorgdepth) ? nHeight - maxreorgdepth - 1 : -1;
+
+  // Single Batch Write/Erase for the whole block
+  if (!pdb->UpdateWithBlock(rewardAdditions, rewardErasures, nPruneHeight)) return false;
+
+  for (const auto &it : rewardAdditions) candidates.Add(it.first, it.second);
+  for (const auto &it : rewardErasures) candidates.Remove(it.first, it.second);
+  UpdateActiveStats();
 
   return true;
 }
@@ -133,9 +134,10 @@ bool CColdRewards::UndoBlock(const CBlock &block, const CBlockIndex *pindex, boo
         COutPoint out(in.prevout);
         // Inputs for Rewards means that they'd become invalid due to being spent
         // so we must revert this 
-        if (prewardsdb->HaveReward(out)) {
+        if (pdb->HaveReward(out)) {
           CRewardValue val;
-          prewardsdb->GetReward(out, val);
+          pdb->GetReward(out, val);
+          candidates.Remove(out, val);
           // if inactive, make inactive
           if (!val.IsActive()) {
             val.SetActive(true);
@@ -168,12 +170,11 @@ bool CColdRewards::UndoBlock(const CBlock &block, const CBlockIndex *pindex, boo
         COutPoint outpoint(TxId, n); // Unique
 
         // 2. means possibly new candidates that should be removed by DB
-        if (prewardsdb->HaveReward(outpoint)) {
-          {
-            CRewardValue val;
-            prewardsdb->GetReward(outpoint, val);
-            LogPrint(BCLog::COLD, "CR: %s : Add to rewardRemovals %s\n", __func__, val.ToString());
-          }
+        if (pdb->HaveReward(outpoint)) {
+          CRewardValue val;
+          pdb->GetReward(outpoint, val);
+          LogPrint(BCLog::COLD, "CR: %s : Add to rewardRemovals %s\n", __func__, val.ToString());
+          candidates.Remove(outpoint, val);
           rewardRemovals.push_back(outpoint);
         }            
         n++;
@@ -194,6 +195,18 @@ bool CColdRewards::UndoBlock(const CBlock &block, const CBlockIndex *pindex, boo
   if (rewardUpdates.size() > 0) pdb->Add(rewardUpdates);
   if (rewardRemovals.size() > 0) pdb->Erase(rewardRemovals);
 
+  for (const auto &it : rewardUpdates) candidates.Add(it.first, it.second);
+  UpdateActiveStats();
+
+  // Take the rewards of this block out of the totals, same amounts as checked in ConnectBlock
+  auto &consensusParams = GetConfig().GetChainParams().GetConsensus();
+  Amount nBlockSubsidy = GetBlockSubsidy(nHeight, consensusParams);
+  Amount nBudgetReward = pbudget->CalculateSuperBlockRewards(nHeight, nBlockSubsidy);
+  Amount nColdReward;
+  const auto &txCoinbase = block.vtx[0];
+  if ((txCoinbase->vout.size() > 1) && !IsSuperBlock(nHeight)) nColdReward = txCoinbase->vout[1].nValue;
+  UpdateStats(nHeight, nBlockSubsidy, nBudgetReward, nColdReward, false);
+
   return true;
 }
 
@@ -207,102 +220,132 @@ void CColdRewards::FillPayments(const Consensus::Params &consensusParams, CMutab
 // Determine which coin gets reward and how much
 //
 bool CColdRewards::FindReward(const Consensus::Params &consensusParams, int Height, CTxOut &rewardPayment) {
-  CRewardValue the_reward;
-  CRewardValue sel_reward;
-  COutPoint key;
   COutPoint minKey;
-  int minHeight = Height;
-  int HeightDiff = 0;
-  Amount balance;
   Amount selAmount;
-  Amount minHReward;
-  bool found = false;
-  int64_t count = 0;
+  bool found = candidates.Find(consensusParams, Height, nMinBlocks, nMinReward, nMaxReward, minKey, selAmount);
+
+  if (found) {
+    // Use this coin
+    CRewardValue sel_reward;
+    if (!pdb->GetReward(minKey, sel_reward)) {
+      LogPrint(BCLog::COLD, "CR: %s: candidate %s missing from Rewards db\n", __func__, minKey.ToString());
+    }
+    rewardPayment = GetPayment(sel_reward, selAmount);
+    rewardKey = minKey;
+  }
+
+  // For very old in-active entires we should remove from the db,
   const int32_t maxreorgdepth = gArgs.GetArg("-maxreorgdepth", DEFAULT_MAX_REORG_DEPTH);
   std::vector<COutPoint> cacheRemovals;
-    
+  for (auto el = cachedInactives.begin(); el != cachedInactives.end();) {
+    int HeightDiff = Height - el->second;
+    CRewardValue the_reward;
+    // Entries re-activated by a re-org stay in the cache but must not be purged
+    if (HeightDiff > maxreorgdepth && pdb->GetReward(el->first, the_reward) && !the_reward.IsActive()) {
+      cacheRemovals.push_back(el->first);
+      el = cachedInactives.erase(el);
+    } else {
+      el++;
+    }
+  }
+
+  if (cacheRemovals.size() > 0) pdb->Erase(cacheRemovals);
+  
+  nNumCandidates = candidates.Size();
+  return found;
+}
+
+// Build the candidate index from the DB, at startup (and once a snapshot is loaded)
+void CColdRewards::LoadCandidatesFromDB() {
+  CRewardValue the_reward;
+  COutPoint key;
+  bool fEmptyDB = true;
+
+  candidates.Clear();
   std::unique_ptr<CRewardsViewDBCursor> pcursor(pdb->Cursor());
   while (pcursor->Valid()) {
     interruption_point(ShutdownRequested());
     if (!pcursor->GetKey(key)) { break; }
     if (!pcursor->GetValue(the_reward)) { LogPrint(BCLog::COLD, "CR: %s: cannot parse CCoins record", __func__); }
-
-    int nHeight = the_reward.GetHeight();
-
-    // get Height (last reward)
-    if (the_reward.IsActive()) {
-      count++; // just count active ones
-      if (nHeight <= minHeight) { // same Height OK to check for bigger rewards
-        HeightDiff = Height - nHeight;
-        if (HeightDiff > nMinBlocks) { 
-          balance = the_reward.GetValue();
-          // change 1.0.2 : use nHeight as basis for % reward instead of current Height
-          Amount reward = CalculateReward(consensusParams, nHeight, HeightDiff, balance);
-          //LogPrint(BCLog::COLD, "CR: %s : Candidate : %s, Reward %d\n", __func__, coinreward.ToString(), reward);
-          // Check reward amount to make sure it's > min
-          if (reward >= nMinReward) {
-            // This is one of the oldest unrewarded UTXO with a + reward value
-            // But there could be other valid UTXOs at same Height and same RewardValue
-            if (reward < nMaxReward)
-              minHReward = reward;
-            else
-              minHReward = nMaxReward;
-            
-            // if older than previous solutions and passed other checks, reset the mins
-            if (nHeight < minHeight) {
-              selAmount = minHReward;
-              minHeight = nHeight;
-              minKey = key;
-              sel_reward = the_reward;
-            } else {
-              // Heigher reward at same Height => choose it
-              if (minHReward > selAmount) {
-                  selAmount = minHReward;
-                  minHeight = nHeight;
-                  minKey = key;
-                  sel_reward = the_reward;
-                  //LogPrint(BCLog::COLD, "CR: %s : Candidate : %s, Reward %d\n", __func__, coinreward.ToString(), reward);
-              // Same reward at Same Height => Select the 'smallest' key
-              } else if (minHReward == selAmount) {
-                  if (key < minKey) {
-                    selAmount = minHReward;
-                    minHeight = nHeight;
-                    minKey = key;
-                    sel_reward = the_reward;
-                    //LogPrint(BCLog::COLD, "CR: %s : Candidate : %s, Reward %d\n", __func__, coinreward.ToString(), reward);
-                  }
-              }
-            }
-            found = true;
-          }
-        }
-      }
-    } else {
-      // For very old in-active entires we should remove from the db,
-      auto el = cachedInactives.find(key);
-      if (el != cachedInactives.end()) {
-          nHeight = cachedInactives[key];
-          HeightDiff = Height - nHeight;
-          if (HeightDiff > maxreorgdepth) {
-              cachedInactives.erase(el);
-              cacheRemovals.push_back(key);
-          }
-      }
-    }
-    //
+    candidates.Add(key, the_reward);
+    fEmptyDB = false;
     pcursor->Next();
   }
+  nNumCandidates = candidates.Size();
+  LoadStatsFromDB(fEmptyDB);
+}
 
-  if (found) {
-    // Use this coin
-    rewardPayment = GetPayment(sel_reward, selAmount);
-    rewardKey = minKey;
+// Cumulative totals come from the DB, active ones from the candidate index
+void CColdRewards::LoadStatsFromDB(bool fEmptyDB) {
+  LOCK(cs_stats);
+  stats = CRewardStats();
+  if (!pdb->GetStats(stats)) {
+    // New DB (or -reindex) starts from the Genesis block, otherwise totals have to be seeded
+    if (fEmptyDB) stats.nHeight = 0;
+    LogPrint(BCLog::COLD, "CR: %s : No reward totals in DB, %s\n", __func__,
+             stats.IsKnown() ? "starting from 0" : "to be seeded");
   }
+  stats.nCount = candidates.Size();
+  stats.nSum = candidates.GetSum();
+  stats.nPayouts = candidates.GetPayouts();
+}
 
-  if (cacheRemovals.size() > 0) pdb->Erase(cacheRemovals);
-  
-  nNumCandidates = count;
-  return found;
+void CColdRewards::UpdateActiveStats() {
+  LOCK(cs_stats);
+  stats.nCount = candidates.Size();
+  stats.nSum = candidates.GetSum();
+  stats.nPayouts = candidates.GetPayouts();
+}
+
+void CColdRewards::UpdateStats(int nHeight, const Amount &nMining, const Amount &nBudget, const Amount &nCold,
+                               bool fConnect) {
+  LOCK(cs_stats);
+  if (!stats.IsKnown()) return;
+  // Connecting must follow the last block in the totals and disconnecting must remove it
+  if (stats.nHeight != (fConnect ? nHeight - 1 : nHeight)) {
+    LogPrint(BCLog::COLD, "CR: %s : Reward totals at Height %d don't match block %d, to be seeded again\n", __func__,
+             stats.nHeight, nHeight);
+    stats.nHeight = -1;
+  } else if (fConnect) {
+    stats.nHeight = nHeight;
+    stats.nMiningRewards += nMining;
+    stats.nBudgetRewards += nBudget;
+    stats.nColdRewards += nCold;
+  } else {
+    stats.nHeight = nHeight - 1;
+    stats.nMiningRewards -= nMining;
+    stats.nBudgetRewards -= nBudget;
+    stats.nColdRewards -= nCold;
+  }
+  pdb->PutStats(stats);
+}
+
+void CColdRewards::ConnectBlockStats(int nHeight, const Amount &nMining, const Amount &nBudget, const Amount &nCold) {
+  UpdateStats(nHeight, nMining, nBudget, nCold, true);
+}
+
+void CColdRewards::SeedStats(int nHeight, const Amount &nMining, const Amount &nBudget, const Amount &nCold) {
+  LOCK(cs_stats);
+  stats.nHeight = nHeight;
+  stats.nMiningRewards = nMining;
+  stats.nBudgetRewards = nBudget;
+  stats.nColdRewards = nCold;
+  pdb->PutStats(stats);
+  LogPrint(BCLog::COLD, "CR: %s : Reward totals seeded at Height %d\n", __func__, nHeight);
+}
+
+CRewardStats CColdRewards::GetStats() const {
+  LOCK(cs_stats);
+  return stats;
+}
+
+// Write a reward and keep the candidate index in sync
+bool CColdRewards::PutReward(const COutPoint &outpoint, const CRewardValue &oldValue, const CRewardValue &newValue,
+                             bool fPaid) {
+  candidates.Remove(outpoint, oldValue);
+  candidates.Add(outpoint, newValue);
+  if (fPaid) return pdb->PutPaidReward(outpoint, newValue);
+  return pdb->PutReward(outpoint, newValue);
 }
 
 // Should run at startup, gets inactive rewards (only)
@@ -328,7 +371,15 @@ void CColdRewards::GetInActivesFromDB(int Height) {
 bool CColdRewards::RestoreRewardAtHeight(int Height) {
   CRewardValue the_reward;
   COutPoint key;
-  
+
+  // Point lookup via the Height key
+  if (pdb->GetRewardAtHeight(Height, key) && pdb->GetReward(key, the_reward) && int(the_reward.GetHeight()) == Height) {
+    RestoreReward(key, the_reward, Height);
+    pdb->EraseRewardAtHeight(Height);
+    return true;
+  }
+
+  // Rewards paid before the Height key existed (or older than re-org depth) need a full scan
   std::unique_ptr<CRewardsViewDBCursor> pcursor(pdb->Cursor());
   while (pcursor->Valid()) {
     interruption_point(ShutdownRequested());
@@ -337,11 +388,7 @@ bool CColdRewards::RestoreRewardAtHeight(int Height) {
 
     int nHeight = the_reward.GetHeight();
     if (nHeight == Height) { // Bingo!
-      // Restore previous height
-      the_reward.SetHeight(the_reward.GetOldHeight());
-      the_reward.payCount--;
-      pdb->PutReward(key, the_reward);
-      LogPrint(BCLog::COLD, "CR: %s : Restore Reward At %s Height %d\n", __func__, the_reward.ToString(), Height);
+      RestoreReward(key, the_reward, Height);
       return true;
     }
     //
@@ -349,6 +396,15 @@ bool CColdRewards::RestoreRewardAtHeight(int Height) {
   }
   return false;
 }
+
+// Restore previous height of a reward paid at Height
+void CColdRewards::RestoreReward(const COutPoint &key, const CRewardValue &the_reward, int Height) {
+  CRewardValue restored(the_reward);
+  restored.SetHeight(restored.GetOldHeight());
+  restored.payCount--;
+  PutReward(key, the_reward, restored);
+  LogPrint(BCLog::COLD, "CR: %s : Restore Reward At %s Height %d\n", __func__, restored.ToString(), Height);
+}
 //
 // Effectively update the "Height" for a coin
 //
@@ -364,7 +420,8 @@ void CColdRewards::UpdateRewardsDB(int nNewHeight) {
   newReward.SetOldHeight(newReward.GetHeight()); // Move Height of creation Height or last payment to OldHeight
   newReward.SetHeight(nNewHeight);
   newReward.payCount++;
-  pdb->PutReward(rewardKey, newReward);
+  PutReward(rewardKey, coinreward, newReward, true);
+  UpdateActiveStats();
 }
 
 // Create CTxOut based on coin and reward
@@ -404,22 +461,74 @@ bool CColdRewards::Validate(const Consensus::Params &consensusParams, const CBlo
   }
 }
 //
-std::map<COutPoint, CRewardValue> CColdRewards::GetRewards() {
-  std::map<COutPoint, CRewardValue> vals;
+void CColdRewards::ForEachReward(const std::function<bool(const COutPoint &, CRewardValue &)> &fn,
+                                 const COutPoint *pstart) {
   CRewardValue the_reward;
   COutPoint key;
-  
-  std::unique_ptr<CRewardsViewDBCursor> pcursor(pdb->Cursor());
+
+  std::unique_ptr<CRewardsViewDBCursor> pcursor(pstart ? pdb->Cursor(*pstart) : pdb->Cursor());
   while (pcursor->Valid()) {
-      interruption_point(ShutdownRequested());
-      if (!pcursor->GetKey(key)) { break; }
-      if (!pcursor->GetValue(the_reward)) { LogPrint(BCLog::COLD, "CR: %s: cannot parse CCoins record", __func__); }
-      vals.insert(std::make_pair(key,the_reward));
-      pcursor->Next();
+    interruption_point(ShutdownRequested());
+    if (!pcursor->GetKey(key)) { break; }
+    if (!pcursor->GetValue(the_reward)) {
+      LogPrint(BCLog::COLD, "CR: %s: cannot parse CCoins record", __func__);
+    } else if (!fn(key, the_reward)) {
+      break;
+    }
+    pcursor->Next();
   }
-  
-  return vals;
 }
+
+void CColdRewards::ForEachCandidate(const std::function<bool(const CRewardCandidate &)> &fn,
+                                    const CRewardCandidate *pstart) const {
+  candidates.ForEach(pstart, fn);
+}
+
+// Binary format : version, number of rewards, then the CRewardDumpRecords
+static const uint64_t REWARDS_DUMP_VERSION = 1;
+
+bool CColdRewards::DumpRewards(const fs::path &filepath, bool fBinary, uint64_t &nWritten) {
+  nWritten = 0;
+  if (!fBinary) {
+    std::ofstream file;
+    file.open(filepath.string().c_str());
+    if (!file.is_open()) return false;
+    ForEachReward([&](const COutPoint &, CRewardValue &val) {
+      file << "Value " << val.GetValue().ToString() << " ";
+      file << "active " << val.IsActive() << " ";
+      file << "creationHeight " << val.GetCreationHeight() << " ";
+      file << "OldHeight " << val.GetOldHeight() << " ";
+      file << "Height " << val.GetHeight() << " ";
+      file << "addr " << GetAddrFromTxOut(val.GetTxOut()) << " ";
+      file << "payCount " << val.GetPayCount() << "\n";
+      nWritten++;
+      return true;
+    });
+    file.close();
+    return !file.fail();
+  }
+
+  FILE *filestr = fsbridge::fopen(filepath, "wb");
+  if (!filestr) return false;
+  CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+  try {
+    file << REWARDS_DUMP_VERSION;
+    file << nWritten; // Count isn't known until the end, rewritten below
+    ForEachReward([&](const COutPoint &key, CRewardValue &val) {
+      file << CRewardDumpRecord(key, val);
+      nWritten++;
+      return true;
+    });
+    if (fseek(file.Get(), sizeof(REWARDS_DUMP_VERSION), SEEK_SET) != 0) return false;
+    file << nWritten;
+    FileCommit(file.Get());
+  } catch (const std::exception &e) {
+    LogPrintf("%s: Failed to dump rewards: %s\n", __func__, e.what());
+    return false;
+  }
+  return true;
+}
+
 std::vector<CRewardValue> CColdRewards::GetOrderedRewards() {
   std::vector<CRewardValue> vals;
   CRewardValue the_reward;
@@ -7,7 +7,11 @@
 #include <amount.h>
 #include <chain.h>
 #include <config/bitcoin-config.h>
+#include <devault/rewardcandidates.h>
 #include <devault/rewardsview.h>
+#include <fs.h>
+
+#include <functional>
 // for now
 #include <validation.h>
 
@@ -16,10 +20,10 @@ extern CCriticalSection cs_rewardsdb;
 class CColdRewards {
 
   public:
-  CColdRewards(const Consensus::Params &consensusParams, CRewardsViewDB *prdb);
+  CColdRewards(const Consensus::Params &consensusParams, CRewardsViewCache *prdb);
 
   private:
-  CRewardsViewDB *pdb;
+  CRewardsViewCache *pdb;
   COutPoint rewardKey;
   int64_t nMinBlocks;
   Amount nMinBalance;
@@ -27,9 +31,21 @@ class CColdRewards {
   Amount nMinReward;
   int32_t nNumCandidates = 0; // num of reward candidates (that are active)
   std::map<COutPoint, int> cachedInactives; // cache map on Inactive rewards that are still needed in case of re-org
+  CRewardCandidates candidates; // ordered index of the active rewards in the DB
+  CRewardStats stats;           // running totals, also stored in the DB
+  mutable CCriticalSection cs_stats; // so that stats can be read without cs_main
+
+  void LoadStatsFromDB(bool fEmptyDB);
+  void UpdateActiveStats();
+  void UpdateStats(int nHeight, const Amount &nMining, const Amount &nBudget, const Amount &nCold, bool fConnect);
+  bool PutReward(const COutPoint &outpoint, const CRewardValue &oldValue, const CRewardValue &newValue,
+                 bool fPaid = false);
+  void RestoreReward(const COutPoint &key, const CRewardValue &the_reward, int Height);
 
   public:
-  bool UpdateWithBlock(const Config &config, CBlockIndex *pindexNew);
+  // Rebuild the candidate index and the totals, when the DB was filled from elsewhere (snapshot)
+  void LoadCandidatesFromDB();
+  bool UpdateWithBlock(const CBlock &block, int nHeight);
   void Setup(const Consensus::Params &consensusParams);
 
   CTxOut GetPayment(const CRewardValue &coin, Amount reward);
@@ -39,10 +55,24 @@ class CColdRewards {
   void UpdateRewardsDB(int nNewHeight);
   bool UndoBlock(const CBlock &block, const CBlockIndex *pindex, bool undoReward = true);
   bool RestoreRewardAtHeight(int Height);
-  std::map<COutPoint, CRewardValue> GetRewards();
+  bool GetReward(const COutPoint &outpoint, CRewardValue &val) const { return pdb->GetReward(outpoint, val); }
+  // Rewards in DB order from *pstart (or the first one) until fn returns false, read straight from the DB cursor
+  // and keyed by the outpoint they were written under
+  void ForEachReward(const std::function<bool(const COutPoint &, CRewardValue &)> &fn,
+                     const COutPoint *pstart = nullptr);
+  // Active rewards in payment order (oldest last paid height first) from *pstart until fn returns false
+  void ForEachCandidate(const std::function<bool(const CRewardCandidate &)> &fn,
+                        const CRewardCandidate *pstart = nullptr) const;
+  // Write all rewards to a file, one text line or one CRewardDumpRecord per reward
+  bool DumpRewards(const fs::path &filepath, bool fBinary, uint64_t &nWritten);
   std::vector<CRewardValue> GetOrderedRewards();
   void DumpOrderedRewards(const std::string &filename = "");
   int32_t GetNumberOfCandidates() { return nNumCandidates; }
+  // Block connected by ConnectBlock, with the rewards it paid
+  void ConnectBlockStats(int nHeight, const Amount &nMining, const Amount &nBudget, const Amount &nCold);
+  // Set the cumulative totals at nHeight, when they are unknown (DB from an older version)
+  void SeedStats(int nHeight, const Amount &nMining, const Amount &nBudget, const Amount &nCold);
+  CRewardStats GetStats() const;
   void GetInActivesFromDB(int Height);
     
 };
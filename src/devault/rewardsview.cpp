@@ -9,16 +9,19 @@
 
 #include <devault/rewardsview.h>
 #include <chainparams.h>
+#include <core_memusage.h>
 #include <init.h>
 #include <random.h>
 #include <uint256.h>
 #include <fs_util.h>
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 
 using namespace std; // for make_pair
 
 CRewardsViewDB::CRewardsViewDB(const std::string &dbname, size_t nCacheSize, bool fMemory, bool fWipe)
-    : db(GetDataDir() / dbname, nCacheSize, fMemory, fWipe, true) {}
+    : db(GetDataDir() / dbname, nCacheSize, fMemory, fWipe, true, "rewards") {}
 
 bool CRewardsViewDB::Flush() {
     CDBBatch batch(db);
@@ -44,6 +47,30 @@ bool CRewardsViewDB::InActivate(std::vector<std::pair<COutPoint, CRewardValue> >
     return db.WriteBatch(batch);
 }
 
+bool CRewardsViewDB::UpdateWithBlock(const std::vector<std::pair<COutPoint, CRewardValue> >& additions,
+                                     std::vector<std::pair<COutPoint, CRewardValue> >& inactivations,
+                                     int nPruneHeight) {
+    CDBBatch batch(db);
+    for (const auto& it : additions) {
+        batch.Write(std::make_pair(DB_REWARD, it.first), it.second);
+    }
+    for (auto& it : inactivations) {
+      it.second.SetActive(false);
+      batch.Write(std::make_pair(DB_REWARD, it.first), it.second);
+    }
+    if (nPruneHeight >= 0) {
+        batch.Erase(std::make_pair(DB_REWARD_HEIGHT, uint32_t(nPruneHeight)));
+    }
+    return db.WriteBatch(batch);
+}
+
+bool CRewardsViewDB::PutPaidReward(const COutPoint &outpoint, const CRewardValue &coin) {
+    CDBBatch batch(db);
+    batch.Write(std::make_pair(DB_REWARD, outpoint), coin);
+    batch.Write(std::make_pair(DB_REWARD_HEIGHT, coin.height), outpoint);
+    return db.WriteBatch(batch);
+}
+
 bool CRewardsViewDB::Add(const std::vector<std::pair<COutPoint, CRewardValue> >& vect) {
     CDBBatch batch(db);
     for (const auto& it : vect) {
@@ -52,6 +79,26 @@ bool CRewardsViewDB::Add(const std::vector<std::pair<COutPoint, CRewardValue> >&
     return db.WriteBatch(batch);
 }
 
+bool CRewardsViewDB::GetRewardHeights(std::vector<std::pair<uint32_t, COutPoint> >& vect) const {
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper &>(db).NewIterator());
+    std::pair<char, uint32_t> key;
+    for (pcursor->Seek(DB_REWARD_HEIGHT); pcursor->Valid(); pcursor->Next()) {
+        if (!pcursor->GetKey(key) || key.first != DB_REWARD_HEIGHT) break;
+        COutPoint outpoint;
+        if (!pcursor->GetValue(outpoint)) return false;
+        vect.emplace_back(key.second, outpoint);
+    }
+    return true;
+}
+
+bool CRewardsViewDB::AddRewardHeights(const std::vector<std::pair<uint32_t, COutPoint> >& vect) {
+    CDBBatch batch(db);
+    for (const auto& it : vect) {
+        batch.Write(std::make_pair(DB_REWARD_HEIGHT, it.first), it.second);
+    }
+    return db.WriteBatch(batch);
+}
+
 CRewardsViewDBCursor *CRewardsViewDB::Cursor() const {
     CRewardsViewDBCursor *i = new CRewardsViewDBCursor(const_cast<CDBWrapper &>(db).NewIterator()); //, GetBestBlock());
   // It seems that there are no "const iterators" for LevelDB. Since we only
@@ -59,19 +106,61 @@ CRewardsViewDBCursor *CRewardsViewDB::Cursor() const {
   // restriction.
   i->pcursor->Seek(DB_REWARD);
   // Cache key of first record
-  if (i->pcursor->Valid()) {
-    CRewardKey entry(&i->keyTmp.second);
-    i->pcursor->GetKey(entry);
-    i->keyTmp.first = entry.key;
-  } else {
-    // Make sure Valid() and GetKey() return false
-    i->keyTmp.first = 0;
-  }
+  i->CacheKey();
+  return i;
+}
+
+CRewardsViewDBCursor *CRewardsViewDB::Cursor(const COutPoint &start) const {
+  CRewardsViewDBCursor *i = new CRewardsViewDBCursor(const_cast<CDBWrapper &>(db).NewIterator());
+  i->pcursor->Seek(std::make_pair(DB_REWARD, start));
+  i->CacheKey();
   return i;
 }
+bool CRewardsViewDB::BatchWrite(CRewardsMap &mapRewards, CRewardHeightsMap &mapHeights, const CRewardStats *pstats) {
+    CDBBatch batch(db);
+    size_t count = 0;
+    for (auto it = mapRewards.begin(); it != mapRewards.end(); it = mapRewards.erase(it)) {
+        if (!(it->second.flags & CRewardsCacheEntry::DIRTY)) continue;
+        if (it->second.IsErased()) {
+            batch.Erase(std::make_pair(DB_REWARD, it->first));
+        } else {
+            batch.Write(std::make_pair(DB_REWARD, it->first), it->second.reward);
+        }
+        count++;
+    }
+    for (const auto &it : mapHeights) {
+        if (it.second.IsNull()) {
+            batch.Erase(std::make_pair(DB_REWARD_HEIGHT, it.first));
+        } else {
+            batch.Write(std::make_pair(DB_REWARD_HEIGHT, it.first), it.second);
+        }
+    }
+    if (pstats) batch.Write(DB_REWARD_STATS, *pstats);
+    LogPrint(BCLog::COLD, "CR: %s : Committing %u changed rewards and %u height keys to rewards db\n", __func__,
+             (unsigned int)count, (unsigned int)mapHeights.size());
+    mapHeights.clear();
+    return db.WriteBatch(batch, true);
+}
+
 size_t CRewardsViewDB::EstimateSize() const { return db.EstimateSize(DB_REWARD, char(DB_REWARD + 1)); }
 
+// Order of the serialized DB keys : txid bytes, then n little endian
+static bool RewardKeyLess(const COutPoint &a, const COutPoint &b) {
+  int cmp = memcmp(a.GetTxId().begin(), b.GetTxId().begin(), a.GetTxId().size());
+  if (cmp != 0) return cmp < 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    uint8_t x = a.GetN() >> shift;
+    uint8_t y = b.GetN() >> shift;
+    if (x != y) return x < y;
+  }
+  return false;
+}
+
 bool CRewardsViewDBCursor::GetKey(COutPoint &key) const {
+  if (fDirty) {
+    key = vDirty[nDirty].first;
+    return true;
+  }
   // Return cached key
   if (keyTmp.first == DB_REWARD) {
     key = keyTmp.second;
@@ -80,14 +169,184 @@ bool CRewardsViewDBCursor::GetKey(COutPoint &key) const {
   return false;
 }
 
+bool CRewardsViewDBCursor::GetValue(CRewardValue &coin) const {
+  if (!fDirty) return pcursor->GetValue(coin);
+  coin = vDirty[nDirty].second.reward;
+  return true;
+}
+
+unsigned int CRewardsViewDBCursor::GetValueSize() const {
+  if (!fDirty) return pcursor->GetValueSize();
+  return GetSerializeSize(vDirty[nDirty].second.reward, SER_DISK, CLIENT_VERSION);
+}
+
 void CRewardsViewDBCursor::Next() {
-  pcursor->Next();
-  CRewardKey entry(&keyTmp.second);
-  if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
+  if (fDirty) {
+    nDirty++;
+  } else {
+    pcursor->Next();
+    CacheKey();
+  }
+  Merge();
+}
+
+// Position on the lowest of the DB and dirty keys, the dirty entry hiding the DB one when both are equal
+void CRewardsViewDBCursor::Merge() {
+  fDirty = false;
+  while (nDirty < vDirty.size()) {
+    const COutPoint &key = vDirty[nDirty].first;
+    if (keyTmp.first == DB_REWARD) {
+      if (RewardKeyLess(keyTmp.second, key)) return;
+      if (keyTmp.second == key) {
+        pcursor->Next();
+        CacheKey();
+      }
+    }
+    if (!vDirty[nDirty].second.IsErased()) {
+      fDirty = true;
+      return;
+    }
+    nDirty++;
+  }
+}
+
+void CRewardsViewDBCursor::CacheKey() {
+  if (!pcursor->Valid() || !pcursor->GetKey(keyTmp)) {
     // Invalidate cached key after last record so that Valid() and GetKey()
     // return false
     keyTmp.first = 0;
+  }
+}
+
+size_t CRewardsCacheEntry::DynamicMemoryUsage() const { return RecursiveDynamicUsage(reward.txout); }
+
+CRewardsMap::iterator CRewardsViewCache::FetchReward(const COutPoint &outpoint) const {
+  CRewardsMap::iterator it = cacheRewards.find(outpoint);
+  if (it != cacheRewards.end()) return it;
+  CRewardsCacheEntry entry;
+  // Misses are cached too since most inputs are not rewards
+  if (!base->GetReward(outpoint, entry.reward)) entry.flags = CRewardsCacheEntry::ERASED;
+  it = cacheRewards.emplace(outpoint, std::move(entry)).first;
+  cachedRewardsUsage += it->second.DynamicMemoryUsage();
+  return it;
+}
+
+void CRewardsViewCache::SetReward(const COutPoint &outpoint, const CRewardValue *pcoin) {
+  // Blind write, no need to fetch the DB version
+  auto inserted = cacheRewards.emplace(outpoint, CRewardsCacheEntry());
+  CRewardsCacheEntry &entry = inserted.first->second;
+  if (!inserted.second) cachedRewardsUsage -= entry.DynamicMemoryUsage();
+  if (pcoin) {
+    entry.reward = *pcoin;
+    entry.flags = CRewardsCacheEntry::DIRTY;
   } else {
-    keyTmp.first = entry.key;
+    entry.reward = CRewardValue();
+    entry.flags = CRewardsCacheEntry::DIRTY | CRewardsCacheEntry::ERASED;
+  }
+  cachedRewardsUsage += entry.DynamicMemoryUsage();
+}
+
+bool CRewardsViewCache::GetReward(const COutPoint &outpoint, CRewardValue &coin) const {
+  CRewardsMap::const_iterator it = FetchReward(outpoint);
+  if (it->second.IsErased()) return false;
+  coin = it->second.reward;
+  return true;
+}
+
+bool CRewardsViewCache::PutReward(const COutPoint &outpoint, const CRewardValue &coin) {
+  SetReward(outpoint, &coin);
+  return true;
+}
+
+bool CRewardsViewCache::EraseReward(const COutPoint &outpoint) {
+  SetReward(outpoint, nullptr);
+  return true;
+}
+
+bool CRewardsViewCache::Add(const std::vector<std::pair<COutPoint, CRewardValue> >& vect) {
+  for (const auto& it : vect) SetReward(it.first, &it.second);
+  return true;
+}
+
+bool CRewardsViewCache::InActivate(std::vector<std::pair<COutPoint, CRewardValue> >& vect) {
+  for (auto& it : vect) {
+    it.second.SetActive(false);
+    SetReward(it.first, &it.second);
   }
+  return true;
+}
+
+bool CRewardsViewCache::Erase(const std::vector<COutPoint>& vect) {
+  for (const auto& it : vect) SetReward(it, nullptr);
+  return true;
+}
+
+bool CRewardsViewCache::UpdateWithBlock(const std::vector<std::pair<COutPoint, CRewardValue> >& additions,
+                                        std::vector<std::pair<COutPoint, CRewardValue> >& inactivations,
+                                        int nPruneHeight) {
+  Add(additions);
+  InActivate(inactivations);
+  if (nPruneHeight >= 0) EraseRewardAtHeight(nPruneHeight);
+  return true;
+}
+
+bool CRewardsViewCache::PutPaidReward(const COutPoint &outpoint, const CRewardValue &coin) {
+  SetReward(outpoint, &coin);
+  cacheHeights[coin.height] = outpoint;
+  return true;
+}
+
+bool CRewardsViewCache::GetRewardAtHeight(uint32_t nHeight, COutPoint &outpoint) const {
+  auto it = cacheHeights.find(nHeight);
+  if (it == cacheHeights.end()) return base->GetRewardAtHeight(nHeight, outpoint);
+  if (it->second.IsNull()) return false;
+  outpoint = it->second;
+  return true;
+}
+
+bool CRewardsViewCache::EraseRewardAtHeight(uint32_t nHeight) {
+  cacheHeights[nHeight] = COutPoint();
+  return true;
+}
+
+bool CRewardsViewCache::GetStats(CRewardStats &stats) const {
+  if (!fStatsDirty) return base->GetStats(stats);
+  stats = cacheStats;
+  return true;
+}
+
+bool CRewardsViewCache::PutStats(const CRewardStats &stats) {
+  cacheStats = stats;
+  fStatsDirty = true;
+  return true;
+}
+
+CRewardsViewDBCursor *CRewardsViewCache::MergeDirty(CRewardsViewDBCursor *i, const COutPoint *pstart) const {
+  for (const auto &it : cacheRewards) {
+    if (!(it.second.flags & CRewardsCacheEntry::DIRTY)) continue;
+    if (pstart && RewardKeyLess(it.first, *pstart)) continue;
+    i->vDirty.emplace_back(it.first, it.second);
+  }
+  std::sort(i->vDirty.begin(), i->vDirty.end(),
+            [](const auto &a, const auto &b) { return RewardKeyLess(a.first, b.first); });
+  i->Merge();
+  return i;
+}
+
+CRewardsViewDBCursor *CRewardsViewCache::Cursor() const { return MergeDirty(base->Cursor(), nullptr); }
+
+CRewardsViewDBCursor *CRewardsViewCache::Cursor(const COutPoint &start) const {
+  return MergeDirty(base->Cursor(start), &start);
+}
+
+bool CRewardsViewCache::Flush() {
+  bool fOk = base->BatchWrite(cacheRewards, cacheHeights, fStatsDirty ? &cacheStats : nullptr);
+  fStatsDirty = false;
+  cacheRewards.clear();
+  cachedRewardsUsage = 0;
+  return fOk;
+}
+
+size_t CRewardsViewCache::DynamicMemoryUsage() const {
+  return memusage::DynamicUsage(cacheRewards) + memusage::DynamicUsage(cacheHeights) + cachedRewardsUsage;
 }
@@ -10,28 +10,63 @@
 #pragma once
 #include <devault/coinreward.h>
 #include <chain.h>
+#include <coins.h>
 #include <config/bitcoin-config.h>
 #include <dbwrapper.h>
 #include <validation.h>
 
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+//! -rewardscache default (MiB)
+static const int64_t nDefaultRewardsCache = 32;
+
+// Entry of CRewardsViewCache, like CCoinsCacheEntry
+struct CRewardsCacheEntry {
+  CRewardValue reward; // only meaningful when not ERASED
+  uint8_t flags = 0;
+
+  enum Flags {
+    DIRTY = (1 << 0),  // differs from the version in the DB
+    ERASED = (1 << 1), // not in the DB (or to be erased from it if DIRTY)
+  };
+
+  bool IsErased() const { return flags & ERASED; }
+  size_t DynamicMemoryUsage() const;
+};
+
+typedef std::unordered_map<COutPoint, CRewardsCacheEntry, SaltedOutpointHasher> CRewardsMap;
+// Dirty Height keys, a null outpoint means erased
+typedef std::map<uint32_t, COutPoint> CRewardHeightsMap;
+
 class CRewardsViewDBCursor {
   public:
+  // Outpoint the reward was written under
   bool GetKey(COutPoint &key) const;
-  bool GetValue(CRewardValue &coin) const { return pcursor->GetValue(coin); }
-  unsigned int GetValueSize() const { return pcursor->GetValueSize(); }
+  bool GetValue(CRewardValue &coin) const;
+  unsigned int GetValueSize() const;
 
-  bool Valid() const { return keyTmp.first == DB_REWARD; }
+  bool Valid() const { return fDirty || keyTmp.first == DB_REWARD; }
   void Next();
 
   private:
   CRewardsViewDBCursor(CDBIterator *pcursorIn) : pcursor(pcursorIn) {}
+  void CacheKey();
+  void Merge();
   std::unique_ptr<CDBIterator> pcursor;
   std::pair<char, COutPoint> keyTmp;
+  // Dirty entries of a CRewardsViewCache in DB key order, read in step with pcursor
+  std::vector<std::pair<COutPoint, CRewardsCacheEntry> > vDirty;
+  size_t nDirty = 0;
+  // Current entry is vDirty[nDirty] rather than the DB one
+  bool fDirty = false;
 
   friend class CRewardsViewDB;
+  friend class CRewardsViewCache;
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** Rewards view backed by the rewards database (rewards/) */
 class CRewardsViewDB {
   protected:
   CDBWrapper db;
@@ -46,6 +81,9 @@ class CRewardsViewDB {
   bool Add(const std::vector<std::pair<COutPoint, CRewardValue> >& vect);
   bool InActivate(std::vector<std::pair<COutPoint, CRewardValue> >& vect);
   bool Erase(const std::vector<COutPoint>& vect);
+  // Additions, inactivations and Height key pruning (if nPruneHeight >= 0) of a connected block
+  bool UpdateWithBlock(const std::vector<std::pair<COutPoint, CRewardValue> >& additions,
+                       std::vector<std::pair<COutPoint, CRewardValue> >& inactivations, int nPruneHeight);
 
   // Extra parameter Height
   bool PutReward(const COutPoint &outpoint, const CRewardValue &coin) {    return db.Write(std::pair(DB_REWARD, outpoint), coin);  }
@@ -53,8 +91,77 @@ class CRewardsViewDB {
     return db.Read(std::pair(DB_REWARD, outpoint), coin);
   }
 
+  // Reward paid at a given Height, also writes the Height key
+  bool PutPaidReward(const COutPoint &outpoint, const CRewardValue &coin);
+  bool GetRewardAtHeight(uint32_t nHeight, COutPoint &outpoint) const {
+    return db.Read(std::pair(DB_REWARD_HEIGHT, nHeight), outpoint);
+  }
+  bool EraseRewardAtHeight(uint32_t nHeight) { return db.Erase(std::pair(DB_REWARD_HEIGHT, nHeight)); }
+  // All Height keys, in DB order
+  bool GetRewardHeights(std::vector<std::pair<uint32_t, COutPoint> >& vect) const;
+  bool AddRewardHeights(const std::vector<std::pair<uint32_t, COutPoint> >& vect);
+
+  // Cumulative reward totals, false if never written
+  bool GetStats(CRewardStats &stats) const { return db.Read(DB_REWARD_STATS, stats); }
+  bool PutStats(const CRewardStats &stats) { return db.Write(DB_REWARD_STATS, stats); }
+
   CRewardsViewDBCursor *Cursor() const;
+  // Cursor positioned at the first reward >= start
+  CRewardsViewDBCursor *Cursor(const COutPoint &start) const;
 
+  // Write dirty entries of a CRewardsViewCache (and the totals if pstats != nullptr) in one batch and clear the maps
+  bool BatchWrite(CRewardsMap &mapRewards, CRewardHeightsMap &mapHeights, const CRewardStats *pstats = nullptr);
   bool Flush();
   size_t EstimateSize() const;
 };
+
+/**
+ * Write-back cache over CRewardsViewDB, in the same way CCoinsViewCache sits over CCoinsViewDB.
+ * Writes stay in memory until Flush(), which is done from FlushStateToDisk together with the chainstate.
+ */
+class CRewardsViewCache {
+  protected:
+  CRewardsViewDB *base;
+  mutable CRewardsMap cacheRewards;
+  CRewardHeightsMap cacheHeights;
+  CRewardStats cacheStats;
+  bool fStatsDirty = false;
+  // Cached dynamic memory usage for the scripts of the cached rewards
+  mutable size_t cachedRewardsUsage = 0;
+
+  CRewardsMap::iterator FetchReward(const COutPoint &outpoint) const;
+  void SetReward(const COutPoint &outpoint, const CRewardValue *pcoin);
+  // Hand the dirty entries from *pstart on to a DB cursor
+  CRewardsViewDBCursor *MergeDirty(CRewardsViewDBCursor *i, const COutPoint *pstart) const;
+
+  public:
+  explicit CRewardsViewCache(CRewardsViewDB *baseIn) : base(baseIn) {}
+  CRewardsViewCache(const CRewardsViewCache &) = delete;
+
+  bool HaveReward(const COutPoint &outpoint) const { return !FetchReward(outpoint)->second.IsErased(); }
+  bool GetReward(const COutPoint &outpoint, CRewardValue &coin) const;
+  bool PutReward(const COutPoint &outpoint, const CRewardValue &coin);
+  bool EraseReward(const COutPoint &outpoint);
+
+  // Same ops as CRewardsViewDB, but only written out on Flush
+  bool Add(const std::vector<std::pair<COutPoint, CRewardValue> >& vect);
+  bool InActivate(std::vector<std::pair<COutPoint, CRewardValue> >& vect);
+  bool Erase(const std::vector<COutPoint>& vect);
+  bool UpdateWithBlock(const std::vector<std::pair<COutPoint, CRewardValue> >& additions,
+                       std::vector<std::pair<COutPoint, CRewardValue> >& inactivations, int nPruneHeight);
+
+  bool PutPaidReward(const COutPoint &outpoint, const CRewardValue &coin);
+  bool GetRewardAtHeight(uint32_t nHeight, COutPoint &outpoint) const;
+  bool EraseRewardAtHeight(uint32_t nHeight);
+
+  bool GetStats(CRewardStats &stats) const;
+  bool PutStats(const CRewardStats &stats);
+
+  // DB cursors with the dirty entries merged in, nothing is flushed
+  CRewardsViewDBCursor *Cursor() const;
+  CRewardsViewDBCursor *Cursor(const COutPoint &start) const;
+
+  bool Flush();
+  size_t GetCacheSize() const { return cacheRewards.size(); }
+  size_t DynamicMemoryUsage() const;
+};
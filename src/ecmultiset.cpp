@@ -0,0 +1,44 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <ecmultiset.h>
+
+#include <secp256k1.h>
+
+namespace {
+/**
+ * The multiset functions don't use any of the precomputed tables, an empty
+ * context is enough and cheap to create.
+ */
+const secp256k1_context *GetMultiSetContext() {
+    static const secp256k1_context *ctx =
+        secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+    return ctx;
+}
+} // namespace
+
+ECMultiSet::ECMultiSet() {
+    secp256k1_multiset_init(GetMultiSetContext(), &m_set);
+}
+
+ECMultiSet &ECMultiSet::Insert(const uint8_t *data, size_t len) {
+    secp256k1_multiset_add(GetMultiSetContext(), &m_set, data, len);
+    return *this;
+}
+
+ECMultiSet &ECMultiSet::Remove(const uint8_t *data, size_t len) {
+    secp256k1_multiset_remove(GetMultiSetContext(), &m_set, data, len);
+    return *this;
+}
+
+ECMultiSet &ECMultiSet::operator+=(const ECMultiSet &other) {
+    secp256k1_multiset_combine(GetMultiSetContext(), &m_set, &other.m_set);
+    return *this;
+}
+
+uint256 ECMultiSet::GetHash() const {
+    uint256 hash;
+    secp256k1_multiset_finalize(GetMultiSetContext(), hash.begin(), &m_set);
+    return hash;
+}
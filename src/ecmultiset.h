@@ -0,0 +1,56 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ECMULTISET_H
+#define BITCOIN_ECMULTISET_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <secp256k1_multiset.h>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Elliptic curve multiset hash (ECMH), backed by the secp256k1 multiset
+ * module. Each element maps to a point of the curve and the set is the sum of
+ * its points, so elements can be added and removed in any order and sets can
+ * be combined, and the hash of the set doesn't depend on how it was built.
+ *
+ * The state serializes to 96 bytes, the commitment (GetHash) to 32.
+ */
+class ECMultiSet {
+private:
+    secp256k1_multiset m_set;
+
+public:
+    /** The empty set. */
+    ECMultiSet();
+
+    ECMultiSet &Insert(const uint8_t *data, size_t len);
+    ECMultiSet &Insert(const std::vector<uint8_t> &data) {
+        return Insert(data.data(), data.size());
+    }
+
+    ECMultiSet &Remove(const uint8_t *data, size_t len);
+    ECMultiSet &Remove(const std::vector<uint8_t> &data) {
+        return Remove(data.data(), data.size());
+    }
+
+    /** Add all the elements of another set. */
+    ECMultiSet &operator+=(const ECMultiSet &other);
+
+    /** The commitment to the set, zero for the empty set. */
+    uint256 GetHash() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(FLATDATA(m_set.d));
+    }
+};
+
+#endif // BITCOIN_ECMULTISET_H
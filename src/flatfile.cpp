@@ -0,0 +1,172 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <flatfile.h>
+
+#include <fs_util.h>
+#include <logging.h>
+#include <tinyformat.h>
+#include <util.h>
+
+#include <stdexcept>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FlatFileSeq::FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size)
+    : m_dir(std::move(dir)), m_prefix(prefix), m_chunk_size(chunk_size) {
+    if (chunk_size == 0) {
+        throw std::invalid_argument("chunk_size must be positive");
+    }
+}
+
+fs::path FlatFileSeq::FileName(const CDiskBlockPos &pos) const {
+    return m_dir / strprintf("%s%05u.dat", m_prefix, pos.nFile);
+}
+
+FILE *FlatFileSeq::Open(const CDiskBlockPos &pos, bool read_only) {
+    if (pos.IsNull()) {
+        return nullptr;
+    }
+    fs::path path = FileName(pos);
+    fs::create_directories(path.parent_path());
+    FILE *file = fsbridge::fopen(path, read_only ? "rb" : "rb+");
+    if (!file && !read_only) {
+        file = fsbridge::fopen(path, "wb+");
+    }
+    if (!file) {
+        LogPrintf("Unable to open file %s\n", path.string());
+        return nullptr;
+    }
+    if (pos.nPos && fseek(file, pos.nPos, SEEK_SET)) {
+        LogPrintf("Unable to seek to position %u of %s\n", pos.nPos,
+                  path.string());
+        fclose(file);
+        return nullptr;
+    }
+    return file;
+}
+
+size_t FlatFileSeq::Allocate(const CDiskBlockPos &pos, size_t add_size,
+                             bool &out_of_space) {
+    out_of_space = false;
+
+    unsigned int n_old_chunks = (pos.nPos + m_chunk_size - 1) / m_chunk_size;
+    unsigned int n_new_chunks =
+        (pos.nPos + add_size + m_chunk_size - 1) / m_chunk_size;
+    if (n_new_chunks > n_old_chunks) {
+        size_t old_size = pos.nPos;
+        size_t new_size = n_new_chunks * m_chunk_size;
+        size_t inc_size = new_size - old_size;
+
+        // Keep the same 50MB margin as the block store.
+        if (fs::space(m_dir).available >= inc_size + 50 * 1024 * 1024) {
+            FILE *file = Open(pos);
+            if (file) {
+                LogPrintf("Pre-allocating up to position 0x%x in %s%05u.dat\n",
+                          new_size, m_prefix, pos.nFile);
+                AllocateFileRange(file, pos.nPos, inc_size);
+                fclose(file);
+                return inc_size;
+            }
+        } else {
+            out_of_space = true;
+        }
+    }
+    return 0;
+}
+
+bool FlatFileSeq::Flush(const CDiskBlockPos &pos, bool finalize) {
+    // Avoid fseek to nPos
+    FILE *file = Open(CDiskBlockPos(pos.nFile, 0));
+    if (!file) {
+        return error("%s: failed to open file %d", __func__, pos.nFile);
+    }
+    if (finalize && !TruncateFile(file, pos.nPos)) {
+        fclose(file);
+        return error("%s: failed to truncate file %d", __func__, pos.nFile);
+    }
+    FileCommit(file);
+    fclose(file);
+    return true;
+}
+
+FlatFileMap::MappedFile::~MappedFile() {
+#ifndef WIN32
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+}
+
+FlatFileMap::FlatFileMap(size_t max_files)
+    : m_max_files(max_files), m_use_counter(0) {
+    if (max_files == 0) {
+        throw std::invalid_argument("max_files must be positive");
+    }
+}
+
+std::shared_ptr<const FlatFileMap::MappedFile>
+FlatFileMap::Get(const fs::path &path, size_t min_size) {
+    LOCK(m_mutex);
+    auto it = m_files.find(path.string());
+    if (it != m_files.end()) {
+        it->second.last_use = ++m_use_counter;
+        if (it->second.file->size() >= min_size) {
+            return it->second.file;
+        }
+        // The file grew since it was mapped. Readers of the old mapping keep
+        // it until they are done.
+        m_files.erase(it);
+    }
+
+#ifdef WIN32
+    return nullptr;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < min_size ||
+        st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    // A shared mapping sees the pages the block writer puts in the page cache
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("Unable to map file %s\n", path.string());
+        return nullptr;
+    }
+    auto file = std::make_shared<const MappedFile>(
+        static_cast<const uint8_t *>(data), st.st_size);
+
+    if (m_files.size() >= m_max_files) {
+        auto oldest = m_files.begin();
+        for (auto jt = m_files.begin(); jt != m_files.end(); ++jt) {
+            if (jt->second.last_use < oldest->second.last_use) {
+                oldest = jt;
+            }
+        }
+        m_files.erase(oldest);
+    }
+    m_files[path.string()] = Entry{file, ++m_use_counter};
+    return file;
+#endif
+}
+
+void FlatFileMap::Forget(const fs::path &path) {
+    LOCK(m_mutex);
+    m_files.erase(path.string());
+}
+
+void FlatFileMap::Clear() {
+    LOCK(m_mutex);
+    m_files.clear();
+}
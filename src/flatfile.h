@@ -0,0 +1,127 @@
+// Copyright (c) 2009-2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_FLATFILE_H
+#define BITCOIN_FLATFILE_H
+
+#include <diskblockpos.h>
+#include <fs.h>
+
+#include <sync.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <string>
+
+/**
+ * FlatFileSeq represents a sequence of numbered files storing raw data. This
+ * class facilitates access to and efficient allocation of these files, like
+ * the blk?????.dat and rev?????.dat files of the block store.
+ */
+class FlatFileSeq {
+private:
+    const fs::path m_dir;
+    const char *const m_prefix;
+    const size_t m_chunk_size;
+
+public:
+    /**
+     * Constructor
+     *
+     * @param dir The base directory that all files live in.
+     * @param prefix A short prefix given to all file names.
+     * @param chunk_size Disk space is pre-allocated in multiples of this
+     * amount.
+     */
+    FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size);
+
+    /** Get the name of the file at the given position. */
+    fs::path FileName(const CDiskBlockPos &pos) const;
+
+    /** Open a handle to the file at the given position. */
+    FILE *Open(const CDiskBlockPos &pos, bool read_only = false);
+
+    /**
+     * Allocate additional space in a file after the given starting position.
+     * The amount allocated will be the minimum multiple of the sequence chunk
+     * size greater than add_size.
+     *
+     * @param[in] pos The starting position that bytes will be allocated after.
+     * @param[in] add_size The minimum number of bytes to be allocated.
+     * @param[out] out_of_space Whether the allocation failed due to
+     * insufficient disk space.
+     * @return The number of bytes successfully allocated.
+     */
+    size_t Allocate(const CDiskBlockPos &pos, size_t add_size,
+                    bool &out_of_space);
+
+    /**
+     * Commit a file to disk, and optionally truncate off extra pre-allocated
+     * bytes if final.
+     *
+     * @param[in] pos The first unwritten position in the file to be flushed.
+     * @param[in] finalize True if no more data will be written to this file.
+     * @return true on success, false on failure.
+     */
+    bool Flush(const CDiskBlockPos &pos, bool finalize = false);
+};
+
+/**
+ * FlatFileMap keeps read-only memory maps of flat files, so that data stored
+ * in them can be handed out without reading it through a FILE. Only the least
+ * recently used max_files files stay mapped. Files are expected to only be
+ * appended to: a mapping is extended when asked for bytes past its end.
+ */
+class FlatFileMap {
+public:
+    /** A mapped file, unmapped once the last reference to it is gone. */
+    class MappedFile {
+    private:
+        const uint8_t *m_data;
+        size_t m_size;
+
+    public:
+        MappedFile(const uint8_t *data, size_t size)
+            : m_data(data), m_size(size) {}
+        ~MappedFile();
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        const uint8_t *data() const { return m_data; }
+        size_t size() const { return m_size; }
+    };
+
+private:
+    struct Entry {
+        std::shared_ptr<const MappedFile> file;
+        uint64_t last_use;
+    };
+
+    Mutex m_mutex;
+    const size_t m_max_files;
+    uint64_t m_use_counter GUARDED_BY(m_mutex);
+    std::map<std::string, Entry> m_files GUARDED_BY(m_mutex);
+
+public:
+    explicit FlatFileMap(size_t max_files);
+
+    /**
+     * Get a mapping of the file at path which covers at least its first
+     * min_size bytes. Returns nullptr if the file is shorter than that or
+     * can't be mapped, in which case it should be read the usual way.
+     */
+    std::shared_ptr<const MappedFile> Get(const fs::path &path,
+                                          size_t min_size);
+
+    /** Drop the mapping of a file, before it gets deleted. */
+    void Forget(const fs::path &path);
+
+    /** Drop all mappings. */
+    void Clear();
+};
+
+#endif // BITCOIN_FLATFILE_H
@@ -0,0 +1,301 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/addrindex.h>
+
+#include <chain.h>
+#include <config.h>
+#include <init.h>
+#include <txdb.h>
+#include <undo.h>
+#include <util.h>
+#include <fs_util.h>
+#include <validation.h>
+
+#include <limits>
+#include <map>
+#include <set>
+
+constexpr char DB_ADDRESSINDEX = 'A';
+constexpr char DB_ADDRESSBALANCE = 'Y';
+constexpr char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<AddrIndex> g_addrindex;
+
+AddrIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "addrindex", n_cache_size,
+                    f_memory, f_wipe, false, "addrindex") {}
+
+bool AddrIndex::DB::UpdateAddrBalances(
+    CDBBatch &batch, const std::vector<std::pair<CAddrIndexKey, Amount>> &vect,
+    bool fErase) const {
+    std::map<uint160, CAddrBalance> deltas;
+    std::set<std::pair<uint160, uint256>> txs;
+    for (const auto &it : vect) {
+        CAddrBalance &delta = deltas[it.first.hashBytes];
+        delta.balance += it.second;
+        if (!it.first.spending) delta.received += it.second;
+        if (txs.emplace(it.first.hashBytes, it.first.txhash).second) delta.nTxCount++;
+    }
+
+    for (const auto &it : deltas) {
+        CAddrBalance balance;
+        Read(std::make_pair(DB_ADDRESSBALANCE, it.first), balance);
+        if (fErase) {
+            balance.balance -= it.second.balance;
+            balance.received -= it.second.received;
+            if (balance.nTxCount < it.second.nTxCount) {
+                return error("%s: address index totals inconsistent", __func__);
+            }
+            balance.nTxCount -= it.second.nTxCount;
+        } else {
+            balance.balance += it.second.balance;
+            balance.received += it.second.received;
+            balance.nTxCount += it.second.nTxCount;
+        }
+        if (balance.IsNull()) {
+            batch.Erase(std::make_pair(DB_ADDRESSBALANCE, it.first));
+        } else {
+            batch.Write(std::make_pair(DB_ADDRESSBALANCE, it.first), balance);
+        }
+    }
+    return true;
+}
+
+bool AddrIndex::DB::WriteAddrIndex(
+    const std::vector<std::pair<CAddrIndexKey, Amount>> &vect,
+    const CBlockLocator &locator) {
+    CDBBatch batch(*this);
+    for (const auto &it : vect) {
+        batch.Write(std::make_pair(DB_ADDRESSINDEX, it.first), it.second);
+    }
+    if (!UpdateAddrBalances(batch, vect, false)) return false;
+    if (!locator.IsNull()) batch.Write(DB_BEST_BLOCK, locator);
+    return WriteBatch(batch);
+}
+
+bool AddrIndex::DB::EraseAddrIndex(
+    const std::vector<std::pair<CAddrIndexKey, Amount>> &vect,
+    const CBlockLocator &locator) {
+    CDBBatch batch(*this);
+    for (const auto &it : vect) {
+        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it.first));
+    }
+    if (!UpdateAddrBalances(batch, vect, true)) return false;
+    if (!locator.IsNull()) batch.Write(DB_BEST_BLOCK, locator);
+    return WriteBatch(batch);
+}
+
+bool AddrIndex::DB::ReadAddrIndex(
+    const uint160 &hashBytes,
+    std::vector<std::pair<CAddrIndexKey, Amount>> &addressIndex, int start,
+    int end) {
+    CAddrIndexQuery query(hashBytes);
+    if (start > 0 && end > 0) {
+        query.nStartHeight = start;
+        query.nEndHeight = end;
+    }
+    CAddrIndexPage page;
+    if (!ReadAddrIndex(query, page)) return false;
+    addressIndex.insert(addressIndex.end(), page.rows.begin(), page.rows.end());
+    return true;
+}
+
+bool AddrIndex::DB::ReadAddrIndex(const CAddrIndexQuery &query,
+                                  CAddrIndexPage &page) {
+    page.rows.clear();
+    page.fMore = false;
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    // Position on the first row of the page, the rows of the address are
+    // contiguous so every bound is a single seek
+    if (query.fHasCursor) {
+        if (query.cursor.hashBytes != query.hashBytes) {
+            return error("address index cursor doesn't match the address");
+        }
+        if (query.fDescending) {
+            pcursor->SeekForPrev(std::make_pair(DB_ADDRESSINDEX, query.cursor));
+        } else {
+            pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, query.cursor));
+        }
+    } else if (query.fDescending) {
+        // Height keys are prefixes of the rows, so this lands after the last
+        // row at nEndHeight (or of the address) and SeekForPrev steps back
+        const int32_t nAfter = query.nEndHeight > 0 ? query.nEndHeight + 1 : std::numeric_limits<int32_t>::max();
+        pcursor->SeekForPrev(std::make_pair(DB_ADDRESSINDEX, CAddrIndexIteratorHeightKey(query.hashBytes, nAfter)));
+    } else if (query.nStartHeight > 0) {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddrIndexIteratorHeightKey(query.hashBytes, query.nStartHeight)));
+    } else {
+        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddrIndexIteratorKey(query.hashBytes)));
+    }
+
+    size_t nSkipped = 0;
+    size_t nTaken = 0;
+    uint256 lastTx;
+    bool fFirst = true;
+    while (pcursor->Valid()) {
+        interruption_point(ShutdownRequested());
+        std::pair<char, CAddrIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.hashBytes != query.hashBytes) {
+            break;
+        }
+        if (query.nEndHeight > 0 && key.second.blockHeight > query.nEndHeight) {
+            // Only possible in ascending order, past the upper bound
+            if (!query.fDescending) break;
+        } else if (query.nStartHeight > 0 && key.second.blockHeight < query.nStartHeight) {
+            // Only possible in descending order, past the lower bound
+            if (query.fDescending) break;
+        } else {
+            // A new unit starts with each row, or with each transaction
+            const bool fNewUnit = !query.fDistinctTx || fFirst || key.second.txhash != lastTx;
+            fFirst = false;
+            lastTx = key.second.txhash;
+            if (fNewUnit) {
+                if (nSkipped < query.nOffset) {
+                    nSkipped++;
+                } else if (query.nLimit > 0 && nTaken == query.nLimit) {
+                    page.fMore = true;
+                    page.next = key.second;
+                    break;
+                } else {
+                    nTaken++;
+                }
+            }
+            if (nSkipped == query.nOffset && nTaken > 0) {
+                Amount nValue;
+                if (!pcursor->GetValue(nValue)) {
+                    return error("failed to get address index value");
+                }
+                page.rows.emplace_back(key.second, nValue);
+            }
+        }
+        if (query.fDescending) {
+            pcursor->Prev();
+        } else {
+            pcursor->Next();
+        }
+    }
+    return true;
+}
+
+bool AddrIndex::DB::ReadAddrBalance(const uint160 &hashBytes,
+                                    CAddrBalance &balance) const {
+    balance.SetNull();
+    return Read(std::make_pair(DB_ADDRESSBALANCE, hashBytes), balance);
+}
+
+/**
+ * Rows of a block : every output (coinbase included), then the spent output
+ * of every input, taken from the undo data of the block.
+ */
+static bool GetBlockRows(const CBlock &block, const CBlockIndex *pindex,
+                         std::vector<std::pair<CAddrIndexKey, Amount>> &rows) {
+    CBlockUndo blockUndo;
+    if (!UndoReadFromDisk(blockUndo, pindex)) {
+        return error("%s: Failed to read undo data of block %s", __func__,
+                     pindex->GetBlockHash().ToString());
+    }
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block and undo data inconsistent", __func__);
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *(block.vtx[i]);
+        const uint256 txhash = tx.GetHash();
+        for (uint32_t k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+            rows.emplace_back(CAddrIndexKey(GetAddrIndexHash(out.scriptPubKey), pindex->nHeight, i, txhash, k, false), out.nValue);
+        }
+        if (i == 0) {
+            continue;
+        }
+        const CTxUndo &txundo = blockUndo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction and undo data inconsistent", __func__);
+        }
+        for (uint32_t j = 0; j < tx.vin.size(); j++) {
+            const CTxOut &prevout = txundo.vprevout[j].GetTxOut();
+            rows.emplace_back(CAddrIndexKey(GetAddrIndexHash(prevout.scriptPubKey), pindex->nHeight, i, txhash, j, true), -prevout.nValue);
+        }
+    }
+    return true;
+}
+
+AddrIndex::AddrIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<AddrIndex::DB>(n_cache_size, f_memory, f_wipe)) {}
+
+AddrIndex::~AddrIndex() {}
+
+bool AddrIndex::Init() {
+    // The former index lived in the block tree DB and was written by
+    // ConnectBlock, this one is rebuilt from the blocks instead.
+    if (pblocktree && !pblocktree->DropAddrIndex()) {
+        return false;
+    }
+    return BaseIndex::Init();
+}
+
+bool AddrIndex::WriteBlock(const CBlock &block, const CBlockIndex *pindex) {
+    // The genesis block has no undo data, and its outputs can't be spent.
+    if (pindex->nHeight == 0) {
+        return true;
+    }
+
+    std::vector<std::pair<CAddrIndexKey, Amount>> rows;
+    if (!GetBlockRows(block, pindex, rows)) {
+        return false;
+    }
+
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindex);
+    }
+    return m_db->WriteAddrIndex(rows, locator);
+}
+
+bool AddrIndex::Rewind(const CBlockIndex *current_tip,
+                       const CBlockIndex *new_tip) {
+    const Config &config = GetConfig();
+    for (const CBlockIndex *pindex = current_tip; pindex != new_tip;
+         pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, config)) {
+            return error("%s: Failed to read block %s from disk", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+
+        std::vector<std::pair<CAddrIndexKey, Amount>> rows;
+        if (!GetBlockRows(block, pindex, rows)) {
+            return false;
+        }
+
+        CBlockLocator locator;
+        {
+            LOCK(cs_main);
+            locator = chainActive.GetLocator(pindex->pprev);
+        }
+        if (!m_db->EraseAddrIndex(rows, locator)) {
+            return error("%s: Failed to erase block %s from the index",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB &AddrIndex::GetDB() const {
+    return *m_db;
+}
+
+bool AddrIndex::FindAddrIndex(const CAddrIndexQuery &query,
+                              CAddrIndexPage &page) const {
+    return m_db->ReadAddrIndex(query, page);
+}
+
+bool AddrIndex::FindAddrBalance(const uint160 &hashBytes,
+                                CAddrBalance &balance) const {
+    return m_db->ReadAddrBalance(hashBytes, balance);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRINDEX_H
+#define BITCOIN_INDEX_ADDRINDEX_H
+
+#include <addrindex.h>
+#include <index/base.h>
+
+/**
+ * AddrIndex keeps the history and the running totals of each output script
+ * (see addrindex.h). It is built from the blocks and their undo data, in the
+ * background, instead of in ConnectBlock.
+ */
+class AddrIndex final : public BaseIndex {
+public:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    /// Override base class init to remove the rows of the former index.
+    bool Init() override;
+
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+
+    /// The rows of the blocks leaving the chain are erased, and the totals
+    /// updated, one block at a time.
+    bool Rewind(const CBlockIndex *current_tip,
+                const CBlockIndex *new_tip) override;
+
+    /// The locator is written with the rows of each block instead, as the
+    /// totals can't be written twice for a block.
+    void ChainStateFlushed(const CBlockLocator &locator) override {}
+
+    BaseIndex::DB &GetDB() const override;
+
+    const char *GetName() const override { return "addrindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddrIndex(size_t n_cache_size, bool f_memory = false,
+                       bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an
+    // incomplete type.
+    virtual ~AddrIndex() override;
+
+    /// Read one page of the history of an address.
+    bool FindAddrIndex(const CAddrIndexQuery &query,
+                       CAddrIndexPage &page) const;
+
+    /// Read the running totals of an address, false if it has no rows.
+    bool FindAddrBalance(const uint160 &hashBytes,
+                         CAddrBalance &balance) const;
+};
+
+/**
+ * Access to the address index database (indexes/addrindex/)
+ *
+ * Each block is written in a single batch with its rows, the totals of their
+ * addresses and the locator of the block, so an interrupted sync never counts
+ * a block twice.
+ */
+class AddrIndex::DB : public BaseIndex::DB {
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false,
+                bool f_wipe = false);
+
+    /// Add the rows of a block, and the block locator if not null.
+    bool WriteAddrIndex(const std::vector<std::pair<CAddrIndexKey, Amount>> &vect,
+                        const CBlockLocator &locator = CBlockLocator());
+
+    /// Take the rows of a block out, and write the locator if not null.
+    bool EraseAddrIndex(const std::vector<std::pair<CAddrIndexKey, Amount>> &vect,
+                        const CBlockLocator &locator = CBlockLocator());
+
+    bool ReadAddrIndex(const uint160 &hashBytes,
+                       std::vector<std::pair<CAddrIndexKey, Amount>> &addressIndex,
+                       int start = 0, int end = 0);
+
+    bool ReadAddrIndex(const CAddrIndexQuery &query, CAddrIndexPage &page);
+
+    bool ReadAddrBalance(const uint160 &hashBytes, CAddrBalance &balance) const;
+
+private:
+    /// Add (or take out) the rows of a block to the totals of their addresses.
+    bool UpdateAddrBalances(CDBBatch &batch,
+                            const std::vector<std::pair<CAddrIndexKey, Amount>> &vect,
+                            bool fErase) const;
+};
+
+/// The global address index, used by the address RPCs. May be null.
+extern std::unique_ptr<AddrIndex> g_addrindex;
+
+#endif // BITCOIN_INDEX_ADDRINDEX_H
@@ -29,8 +29,8 @@ static void FatalError(const char *fmt, const Args &... args) {
 }
 
 BaseIndex::DB::DB(const fs::path &path, size_t n_cache_size, bool f_memory,
-                  bool f_wipe, bool f_obfuscate)
-    : CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate) {}
+                  bool f_wipe, bool f_obfuscate, const std::string &name)
+    : CDBWrapper(path, n_cache_size, f_memory, f_wipe, f_obfuscate, name) {}
 
 bool BaseIndex::DB::ReadBestBlock(CBlockLocator &locator) const {
     bool success = Read(DB_BEST_BLOCK, locator);
@@ -40,8 +40,9 @@ bool BaseIndex::DB::ReadBestBlock(CBlockLocator &locator) const {
     return success;
 }
 
-bool BaseIndex::DB::WriteBestBlock(const CBlockLocator &locator) {
-    return Write(DB_BEST_BLOCK, locator);
+void BaseIndex::DB::WriteBestBlock(CDBBatch &batch,
+                                   const CBlockLocator &locator) {
+    batch.Write(DB_BEST_BLOCK, locator);
 }
 
 BaseIndex::~BaseIndex() {
@@ -59,7 +60,19 @@ bool BaseIndex::Init() {
     if (locator.IsNull()) {
         m_best_block_index = nullptr;
     } else {
-        m_best_block_index = FindForkInGlobalIndex(chainActive, locator);
+        const CBlockIndex *fork = FindForkInGlobalIndex(chainActive, locator);
+        m_best_block_index = fork;
+        // The index may have stopped on a branch that was reorganized away
+        // while it was not running, take its blocks out first.
+        const CBlockIndex *locator_tip =
+            LookupBlockIndex(locator.vHave.front());
+        if (fork && locator_tip && locator_tip != fork &&
+            locator_tip->GetAncestor(fork->nHeight) == fork) {
+            m_best_block_index = locator_tip;
+            if (!Rewind(locator_tip, fork)) {
+                return false;
+            }
+        }
     }
     m_synced = m_best_block_index.load() == chainActive.Tip();
     return true;
@@ -102,6 +115,13 @@ void BaseIndex::ThreadSync() {
                     m_synced = true;
                     break;
                 }
+                if (pindex_next->pprev != pindex &&
+                    !Rewind(pindex, pindex_next->pprev)) {
+                    FatalError("%s: Failed to rewind index %s to a previous "
+                               "chain tip",
+                               __func__, GetName());
+                    return;
+                }
                 pindex = pindex_next;
             }
 
@@ -112,12 +132,6 @@ void BaseIndex::ThreadSync() {
                 last_log_time = current_time;
             }
 
-            if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL <
-                current_time) {
-                WriteBestBlock(pindex);
-                last_locator_write_time = current_time;
-            }
-
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, config)) {
                 FatalError("%s: Failed to read block %s from disk", __func__,
@@ -129,6 +143,15 @@ void BaseIndex::ThreadSync() {
                            __func__, pindex->GetBlockHash().ToString());
                 return;
             }
+            m_best_block_index = pindex;
+
+            // Only once the block is written, so the locator never points
+            // past the indexed blocks.
+            if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL <
+                current_time) {
+                WriteBestBlock(pindex);
+                last_locator_write_time = current_time;
+            }
         }
     }
 
@@ -139,11 +162,40 @@ void BaseIndex::ThreadSync() {
     }
 }
 
+bool BaseIndex::Rewind(const CBlockIndex *current_tip,
+                       const CBlockIndex *new_tip) {
+    assert(current_tip == m_best_block_index);
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // Keep the persisted locator off the stale branch.
+    if (!WriteBestBlock(new_tip)) {
+        return false;
+    }
+    m_best_block_index = new_tip;
+    return true;
+}
+
 bool BaseIndex::WriteBestBlock(const CBlockIndex *block_index) {
-    LOCK(cs_main);
-    if (!GetDB().WriteBestBlock(chainActive.GetLocator(block_index))) {
-        return error("%s: Failed to write locator to disk", __func__);
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(block_index);
     }
+    return Commit(locator);
+}
+
+bool BaseIndex::Commit(const CBlockLocator &locator) {
+    CDBBatch batch(GetDB());
+    if (!CommitInternal(batch, locator) || !GetDB().WriteBatch(batch)) {
+        return error("%s: Failed to commit latest %s state", __func__,
+                     GetName());
+    }
+    return true;
+}
+
+bool BaseIndex::CommitInternal(CDBBatch &batch,
+                               const CBlockLocator &locator) {
+    GetDB().WriteBestBlock(batch, locator);
     return true;
 }
 
@@ -178,6 +230,14 @@ void BaseIndex::BlockConnected(
                       best_block_index->GetBlockHash().ToString());
             return;
         }
+        // After a reorg, the first block of the new branch connects to an
+        // ancestor of the best block: take the stale blocks out first.
+        if (best_block_index != pindex->pprev &&
+            !Rewind(best_block_index, pindex->pprev)) {
+            FatalError("%s: Failed to rewind index %s to a previous chain tip",
+                       __func__, GetName());
+            return;
+        }
     }
 
     if (WriteBlock(*block, pindex)) {
@@ -223,9 +283,7 @@ void BaseIndex::ChainStateFlushed(const CBlockLocator &locator) {
         return;
     }
 
-    if (!GetDB().WriteBestBlock(locator)) {
-        error("%s: Failed to write locator to disk", __func__);
-    }
+    Commit(locator);
 }
 
 bool BaseIndex::BlockUntilSyncedToCurrentChain() {
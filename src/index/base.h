@@ -24,13 +24,14 @@ protected:
     class DB : public CDBWrapper {
     public:
         DB(const fs::path &path, size_t n_cache_size, bool f_memory = false,
-           bool f_wipe = false, bool f_obfuscate = false);
+           bool f_wipe = false, bool f_obfuscate = false,
+           const std::string &name = "");
 
         /// Read block locator of the chain that the txindex is in sync with.
         bool ReadBestBlock(CBlockLocator &locator) const;
 
         /// Write block locator of the chain that the txindex is in sync with.
-        bool WriteBestBlock(const CBlockLocator &locator);
+        void WriteBestBlock(CDBBatch &batch, const CBlockLocator &locator);
     };
 
 private:
@@ -55,6 +56,9 @@ private:
     /// Write the current chain block locator to the DB.
     bool WriteBestBlock(const CBlockIndex *block_index);
 
+    /// Write the locator, and the state committed with it, in one batch.
+    bool Commit(const CBlockLocator &locator);
+
 protected:
     void
     BlockConnected(const std::shared_ptr<const CBlock> &block,
@@ -66,11 +70,26 @@ protected:
     /// Initialize internal state from the database and block index.
     virtual bool Init();
 
+    /// Add the locator to the batch, with any index state that must be
+    /// persisted along with it.
+    virtual bool CommitInternal(CDBBatch &batch, const CBlockLocator &locator);
+
     /// Write update index entries for a newly connected block.
     virtual bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) {
         return true;
     }
 
+    /// Rewind the index from current_tip back to new_tip, one of its
+    /// ancestors, when the blocks in between left the active chain. The base
+    /// version only moves the best block, for indexes that keep the entries of
+    /// stale blocks.
+    virtual bool Rewind(const CBlockIndex *current_tip,
+                        const CBlockIndex *new_tip);
+
+    /// The last block the index is in sync with, null before the genesis
+    /// block is indexed.
+    const CBlockIndex *CurrentIndex() const { return m_best_block_index.load(); }
+
     virtual DB &GetDB() const = 0;
 
     /// Get the name of the index for display in logs.
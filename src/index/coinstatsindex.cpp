@@ -0,0 +1,265 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <chain.h>
+#include <coins.h>
+#include <coinstats.h>
+#include <dbwrapper.h>
+#include <fs_util.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+/* Like the block filter index, entries of the blocks of the active chain are
+ * keyed by height [DB_BLOCK_HEIGHT, uint32 (BE)] along with the block hash,
+ * and the entries of the blocks reorganized out of it are copied to the hash
+ * index [DB_BLOCK_HASH, uint256] so they can still be looked up.
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+namespace {
+
+struct DBVal {
+    ECMultiSet ecmh;
+    uint64_t transaction_output_count;
+    uint64_t bogo_size;
+    Amount total_amount;
+    Amount total_unspendable_amount;
+
+    DBVal()
+        : transaction_output_count(0), bogo_size(0), total_amount(),
+          total_unspendable_amount() {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(ecmh);
+        READWRITE(transaction_output_count);
+        READWRITE(bogo_size);
+        READWRITE(total_amount);
+        READWRITE(total_unspendable_amount);
+    }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure(
+                "Invalid format for coin stats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256 &hash_in) : hash(hash_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure(
+                "Invalid format for coin stats index DB hash key");
+        }
+
+        READWRITE(hash);
+    }
+};
+
+}; // namespace
+
+static bool LookupOne(const CDBWrapper &db, const CBlockIndex *block_index,
+                      DBVal &result) {
+    // The entry of a block of the active chain is under its height, those of
+    // stale blocks under their hash.
+    std::pair<uint256, DBVal> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator &db_it, CDBBatch &batch,
+                                       const std::string &index_name,
+                                       int start_height, int stop_height) {
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, DBVal> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory,
+                               bool f_wipe)
+    : m_transaction_output_count(0), m_bogo_size(0), m_total_amount(),
+      m_total_unspendable_amount() {
+    fs::path path = GetDataDir() / "indexes" / "coinstats";
+    fs::create_directories(path);
+
+    m_db = std::make_unique<BaseIndex::DB>(path / "db", n_cache_size, f_memory,
+                                           f_wipe, false, "coinstatsindex");
+}
+
+bool CoinStatsIndex::LoadState(const CBlockIndex *pindex) {
+    DBVal entry;
+    if (pindex && !LookupOne(*m_db, pindex, entry)) {
+        return error("%s: Cannot read the %s entry of block %s", __func__,
+                     GetName(), pindex->GetBlockHash().ToString());
+    }
+    m_ecmh = entry.ecmh;
+    m_transaction_output_count = entry.transaction_output_count;
+    m_bogo_size = entry.bogo_size;
+    m_total_amount = entry.total_amount;
+    m_total_unspendable_amount = entry.total_unspendable_amount;
+    return true;
+}
+
+bool CoinStatsIndex::Init() {
+    if (!BaseIndex::Init()) {
+        return false;
+    }
+    return LoadState(CurrentIndex());
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock &block,
+                                const CBlockIndex *pindex) {
+    // The outputs of the genesis block are not part of the UTXO set, its entry
+    // is the empty set.
+    if (pindex->nHeight > 0) {
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: Failed to read undo data of block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+        if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block and undo data inconsistent", __func__);
+        }
+
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction &tx = *(block.vtx[i]);
+            for (uint32_t k = 0; k < tx.vout.size(); k++) {
+                const CTxOut &out = tx.vout[k];
+                // Unspendable outputs never enter the chainstate
+                if (out.scriptPubKey.IsUnspendable()) {
+                    m_total_unspendable_amount += out.nValue;
+                    continue;
+                }
+                const Coin coin(out, pindex->nHeight, i == 0);
+                m_ecmh.Insert(TxOutSer(COutPoint(tx.GetId(), k), coin));
+                m_transaction_output_count++;
+                m_bogo_size += GetBogoSize(out.scriptPubKey);
+                m_total_amount += out.nValue;
+            }
+            if (i == 0) {
+                continue;
+            }
+
+            const CTxUndo &tx_undo = block_undo.vtxundo[i - 1];
+            if (tx_undo.vprevout.size() != tx.vin.size()) {
+                return error("%s: transaction and undo data inconsistent",
+                             __func__);
+            }
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                const Coin &coin = tx_undo.vprevout[j];
+                m_ecmh.Remove(TxOutSer(tx.vin[j].prevout, coin));
+                m_transaction_output_count--;
+                m_bogo_size -= GetBogoSize(coin.GetTxOut().scriptPubKey);
+                m_total_amount -= coin.GetTxOut().nValue;
+            }
+        }
+    }
+
+    std::pair<uint256, DBVal> value;
+    value.first = pindex->GetBlockHash();
+    value.second.ecmh = m_ecmh;
+    value.second.transaction_output_count = m_transaction_output_count;
+    value.second.bogo_size = m_bogo_size;
+    value.second.total_amount = m_total_amount;
+    value.second.total_unspendable_amount = m_total_unspendable_amount;
+    return m_db->Write(DBHeightKey(pindex->nHeight), value);
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex *current_tip,
+                            const CBlockIndex *new_tip) {
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+
+    // The entries of the blocks leaving the chain move to the hash index
+    // before their heights get written again.
+    if (!CopyHeightIndexToHashIndex(*db_it, batch, GetName(),
+                                    new_tip->nHeight, current_tip->nHeight)) {
+        return false;
+    }
+    if (!m_db->WriteBatch(batch)) {
+        return false;
+    }
+
+    if (!LoadState(new_tip)) {
+        return false;
+    }
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex *block_index,
+                                 CCoinsStats &stats) const {
+    DBVal entry;
+    if (!LookupOne(*m_db, block_index, entry)) {
+        return false;
+    }
+
+    stats.nHeight = block_index->nHeight;
+    stats.hashBlock = block_index->GetBlockHash();
+    stats.hashSerialized = entry.ecmh.GetHash();
+    stats.nTransactionOutputs = entry.transaction_output_count;
+    stats.nBogoSize = entry.bogo_size;
+    stats.nTotalAmount = entry.total_amount;
+    stats.nTotalUnspendableAmount = entry.total_unspendable_amount;
+    stats.index_used = true;
+    return true;
+}
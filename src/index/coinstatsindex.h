@@ -0,0 +1,66 @@
+// Copyright (c) 2020-2021 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COINSTATSINDEX_H
+#define BITCOIN_INDEX_COINSTATSINDEX_H
+
+#include <amount.h>
+#include <ecmultiset.h>
+#include <index/base.h>
+
+struct CCoinsStats;
+
+static const bool DEFAULT_COINSTATSINDEX = false;
+
+/**
+ * CoinStatsIndex keeps, for each block, the statistics of the UTXO set once
+ * the block is connected : the ECMH commitment to the set (see ECMultiSet) and
+ * the running totals of the outputs, so gettxoutsetinfo needs no scan of the
+ * chainstate, at the tip or at any indexed block.
+ *
+ * Each entry holds the whole multiset state, so a block is taken out of the
+ * index by going back to the entry of its parent, without reading the block.
+ */
+class CoinStatsIndex final : public BaseIndex {
+private:
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    /// State of the UTXO set at the best block of the index
+    ECMultiSet m_ecmh;
+    uint64_t m_transaction_output_count;
+    uint64_t m_bogo_size;
+    Amount m_total_amount;
+    Amount m_total_unspendable_amount;
+
+    /// Reset the state to the entry of a block, or to the empty set.
+    bool LoadState(const CBlockIndex *pindex);
+
+protected:
+    bool Init() override;
+
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+
+    bool Rewind(const CBlockIndex *current_tip,
+                const CBlockIndex *new_tip) override;
+
+    BaseIndex::DB &GetDB() const override { return *m_db; }
+
+    const char *GetName() const override { return "coinstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false,
+                            bool f_wipe = false);
+
+    /// Look up the statistics of the UTXO set once block_index is connected.
+    /// The hash is the ECMH commitment, the transaction count and the disk
+    /// size are left zero.
+    bool LookUpStats(const CBlockIndex *block_index, CCoinsStats &stats) const;
+};
+
+/// The global coin stats index, used by gettxoutsetinfo. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // BITCOIN_INDEX_COINSTATSINDEX_H
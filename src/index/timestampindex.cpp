@@ -0,0 +1,136 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/timestampindex.h>
+
+#include <chain.h>
+#include <init.h>
+#include <util.h>
+#include <fs_util.h>
+#include <validation.h>
+
+constexpr char DB_TIMESTAMPINDEX = 's';
+constexpr char DB_BLOCKHASHINDEX = 'z';
+
+std::unique_ptr<TimestampIndex> g_timestampindex;
+
+/**
+ * Access to the timestamp index database (indexes/timestampindex/)
+ *
+ * Rows are (logical timestamp, block hash) for range queries, and block hash
+ * to logical timestamp to chain the timestamps of the next block.
+ */
+class TimestampIndex::DB : public BaseIndex::DB {
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false,
+                bool f_wipe = false);
+
+    /// Write both rows of a block in one batch.
+    bool WriteTimestamp(const uint256 &hash, uint32_t ltimestamp);
+
+    bool ReadTimestamp(const uint256 &hash, uint32_t &ltimestamp) const;
+
+    bool ReadTimestampRange(uint32_t high, uint32_t low,
+                            std::vector<std::pair<uint256, uint32_t>> &hashes);
+};
+
+TimestampIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "timestampindex", n_cache_size,
+                    f_memory, f_wipe, false, "timestampindex") {}
+
+bool TimestampIndex::DB::WriteTimestamp(const uint256 &hash,
+                                        uint32_t ltimestamp) {
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_TIMESTAMPINDEX,
+                               CTimestampIndexKey(ltimestamp, hash)),
+                0);
+    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(hash)),
+                CTimestampBlockIndexValue(ltimestamp));
+    return WriteBatch(batch);
+}
+
+bool TimestampIndex::DB::ReadTimestamp(const uint256 &hash,
+                                       uint32_t &ltimestamp) const {
+    CTimestampBlockIndexValue lts;
+    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(hash)),
+              lts)) {
+        return false;
+    }
+    ltimestamp = lts.ltimestamp;
+    return true;
+}
+
+bool TimestampIndex::DB::ReadTimestampRange(
+    uint32_t high, uint32_t low,
+    std::vector<std::pair<uint256, uint32_t>> &hashes) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX,
+                                 CTimestampIndexIteratorKey(low)));
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        interruption_point(ShutdownRequested());
+        std::pair<char, CTimestampIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TIMESTAMPINDEX ||
+            key.second.timestamp >= high) {
+            break;
+        }
+        hashes.emplace_back(key.second.blockHash, key.second.timestamp);
+    }
+    return true;
+}
+
+TimestampIndex::TimestampIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<TimestampIndex::DB>(n_cache_size, f_memory,
+                                                f_wipe)) {}
+
+TimestampIndex::~TimestampIndex() {}
+
+bool TimestampIndex::WriteBlock(const CBlock &block,
+                                const CBlockIndex *pindex) {
+    uint32_t ltimestamp = pindex->nTime;
+    if (pindex->pprev) {
+        uint32_t prev_ltimestamp = 0;
+        if (!m_db->ReadTimestamp(pindex->pprev->GetBlockHash(),
+                                 prev_ltimestamp)) {
+            return error("%s: Failed to read the logical timestamp of block %s",
+                         __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+        if (ltimestamp <= prev_ltimestamp) {
+            ltimestamp = prev_ltimestamp + 1;
+        }
+    }
+    return m_db->WriteTimestamp(pindex->GetBlockHash(), ltimestamp);
+}
+
+BaseIndex::DB &TimestampIndex::GetDB() const {
+    return *m_db;
+}
+
+bool TimestampIndex::FindBlockHashes(
+    uint32_t high, uint32_t low, bool fActiveOnly,
+    std::vector<std::pair<uint256, uint32_t>> &hashes) const {
+    std::vector<std::pair<uint256, uint32_t>> found;
+    if (!m_db->ReadTimestampRange(high, low, found)) {
+        return false;
+    }
+    if (!fActiveOnly) {
+        hashes.insert(hashes.end(), found.begin(), found.end());
+        return true;
+    }
+
+    LOCK(cs_main);
+    for (const auto &it : found) {
+        const CBlockIndex *pindex = LookupBlockIndex(it.first);
+        if (pindex && chainActive.Contains(pindex)) {
+            hashes.push_back(it);
+        }
+    }
+    return true;
+}
+
+bool TimestampIndex::FindLogicalTimestamp(const uint256 &hash,
+                                          uint32_t &ltimestamp) const {
+    return m_db->ReadTimestamp(hash, ltimestamp);
+}
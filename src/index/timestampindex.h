@@ -0,0 +1,55 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_TIMESTAMPINDEX_H
+#define BITCOIN_INDEX_TIMESTAMPINDEX_H
+
+#include <index/base.h>
+#include <timestampindex.h>
+
+static const bool DEFAULT_TIMESTAMPINDEX = false;
+
+/**
+ * TimestampIndex is used to look up block hashes by a range of timestamps.
+ * Each block gets a logical timestamp, its time or one more than the logical
+ * timestamp of its parent, so that the timestamps grow along a chain. Rows of
+ * stale blocks are kept, queries can filter them out.
+ */
+class TimestampIndex final : public BaseIndex {
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+
+    BaseIndex::DB &GetDB() const override;
+
+    const char *GetName() const override { return "timestampindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit TimestampIndex(size_t n_cache_size, bool f_memory = false,
+                            bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an
+    // incomplete type.
+    virtual ~TimestampIndex() override;
+
+    /// Look up the blocks with a logical timestamp in [low, high), in
+    /// timestamp order, only those of the active chain if fActiveOnly.
+    bool FindBlockHashes(uint32_t high, uint32_t low, bool fActiveOnly,
+                         std::vector<std::pair<uint256, uint32_t>> &hashes) const;
+
+    /// Look up the logical timestamp of a block.
+    bool FindLogicalTimestamp(const uint256 &hash, uint32_t &ltimestamp) const;
+};
+
+/// The global timestamp index, used by getblockhashes. May be null.
+extern std::unique_ptr<TimestampIndex> g_timestampindex;
+
+#endif // BITCOIN_INDEX_TIMESTAMPINDEX_H
@@ -19,6 +19,10 @@
 #include <diskblockpos.h>
 #include <httprpc.h>
 #include <httpserver.h>
+#include <index/addrindex.h>
+#include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
+#include <index/timestampindex.h>
 #include <index/txindex.h>
 #include <key.h>
 #include <miner.h>
@@ -33,6 +37,7 @@
 #include <script/scriptcache.h>
 #include <script/sigcache.h>
 #include <script/standard.h>
+#include <snapshot.h>
 #include <timedata.h>
 #include <torcontrol.h>
 #include <txdb.h>
@@ -53,6 +58,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <memory>
+#include <set>
 #include <thread>
 
 #ifndef WIN32
@@ -71,6 +77,9 @@ static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 
+/** Filter types selected with -blockfilterindex */
+static std::set<BlockFilterType> g_enabled_filter_types;
+
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
@@ -152,6 +161,8 @@ static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
 static std::thread scheduler_thread;
 static std::vector<std::thread> script_check_threads;
+static std::vector<std::thread> coin_prefetch_threads;
+static std::vector<std::thread> tx_precheck_threads;
 static std::thread import_thread;
 
 
@@ -166,12 +177,24 @@ void Interrupt() {
     InterruptMapPort();
     scheduler.interrupt(false);
     InterruptThreadScriptCheck();
+    InterruptThreadCoinPrefetch();
+    InterruptThreadTxPreCheck();
     if (g_connman) {
         g_connman->Interrupt();
     }
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_addrindex) {
+        g_addrindex->Interrupt();
+    }
+    if (g_timestampindex) {
+        g_timestampindex->Interrupt();
+    }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Interrupt();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex &index) { index.Interrupt(); });
 }
 
 void Shutdown() {
@@ -209,6 +232,16 @@ void Shutdown() {
     if (g_txindex) {
         g_txindex->Stop();
     }
+    if (g_addrindex) {
+        g_addrindex->Stop();
+    }
+    if (g_timestampindex) {
+        g_timestampindex->Stop();
+    }
+    if (g_coin_stats_index) {
+        g_coin_stats_index->Stop();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex &index) { index.Stop(); });
 
     StopTorControl();
 
@@ -218,6 +251,10 @@ void Shutdown() {
     if (scheduler_thread.joinable()) scheduler_thread.join();
     for (auto&& thread : script_check_threads) thread.join();
     script_check_threads.clear();
+    for (auto&& thread : coin_prefetch_threads) thread.join();
+    coin_prefetch_threads.clear();
+    for (auto&& thread : tx_precheck_threads) thread.join();
+    tx_precheck_threads.clear();
     if (import_thread.joinable()) import_thread.join();
 
     // After the threads that potentially access these pointers have been
@@ -225,11 +262,13 @@ void Shutdown() {
     peerLogic.reset();
     g_connman.reset();
     g_txindex.reset();
+    g_addrindex.reset();
+    g_timestampindex.reset();
+    g_coin_stats_index.reset();
+    DestroyAllBlockFilterIndexes();
 
-    if (g_is_mempool_loaded &&
-        gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool();
-    }
+    // Only started once the mempool was loaded with -persistmempool
+    StopMempoolJournal();
 
     // FlushStateToDisk generates a ChainStateFlushed callback, which we should
     // avoid missing
@@ -256,8 +295,9 @@ void Shutdown() {
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
-        prewardsdb.reset();
         prewards.reset();
+        prewardsTip.reset();
+        prewardsdb.reset();
         pbudget.reset();
     }
     g_wallet_init_interface.Stop();
@@ -391,6 +431,22 @@ void SetupServerArgs() {
             _("Set database cache size in megabytes (%d to %d, default: %d)"),
             nMinDbCache, nMaxDbCache, nDefaultDbCache),
         false, OptionsCategory::OPTIONS);
+    gArgs.AddArg(
+        "-dbprofile=<db>:<profile>",
+        strprintf(_("Open a database with other storage engine settings. "
+                    "The databases are chainstate, blockindex, rewards, "
+                    "txindex, addrindex, timestampindex, blockfilter and "
+                    "coinstatsindex, the profiles are %s. Can be specified "
+                    "multiple times"),
+                  DBProfileNames()),
+        false, OptionsCategory::OPTIONS);
+    gArgs.AddArg(
+        "-rewardscache=<n>",
+        strprintf(_("Set in-memory cache size of pending cold reward updates "
+                    "in megabytes, written out with the chainstate "
+                    "(default: %d)"),
+                  nDefaultRewardsCache),
+        false, OptionsCategory::OPTIONS);
     gArgs.AddArg(
         "-debuglogfile=<file>",
         strprintf(
@@ -423,6 +479,20 @@ void SetupServerArgs() {
     gArgs.AddArg("-loadblock=<file>",
                  _("Imports blocks from external blk000??.dat file on startup"),
                  false, OptionsCategory::OPTIONS);
+    gArgs.AddArg(
+        "-importthreads=<n>",
+        strprintf(_("Set the number of threads reading and checking blocks "
+                    "for -reindex and -loadblock (0 = auto, default: %d)"),
+                  DEFAULT_IMPORT_THREADS),
+        false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadsnapshot=<file>",
+                 _("On a node without a chainstate, load it from a UTXO "
+                   "snapshot written by dumptxoutset at a block pinned for "
+                   "the network, instead of validating the chain up to that "
+                   "block. The blocks below it are not kept, so indexes can't "
+                   "be built on such a chainstate. No snapshot is pinned yet, "
+                   "so until one is every snapshot is refused"),
+                 false, OptionsCategory::OPTIONS);
   
     gArgs.AddArg(
                  "-keeplogfiles=<days>",
@@ -460,9 +530,15 @@ void SetupServerArgs() {
                   -GetNumCores(), MAX_SCRIPTCHECK_THREADS,
                   DEFAULT_SCRIPTCHECK_THREADS),
         false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinprefetch",
+                 strprintf(_("Read the inputs of each block from the chainstate "
+                             "in parallel before connecting it, with as many "
+                             "threads as for script verification (default: %u)"),
+                           DEFAULT_COIN_PREFETCH),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool",
-                 strprintf(_("Whether to save the mempool on shutdown "
-                             "and load on restart (default: %u)"),
+                 strprintf(_("Whether to save the mempool to disk as it "
+                             "changes and load it on restart (default: %u)"),
                            DEFAULT_PERSIST_MEMPOOL),
                  false, OptionsCategory::OPTIONS);
 #ifndef WIN32
@@ -478,7 +554,8 @@ void SetupServerArgs() {
               "old blocks. This allows the pruneblockchain RPC to be called to "
               "delete specific blocks, and enables automatic pruning of old "
               "blocks if a target size in MiB is provided. This mode is "
-              "incompatible with -txindex and -rescan. "
+              "incompatible with -txindex, -blockfilterindex, -coinstatsindex "
+              "and -rescan. "
               "Warning: Reverting this setting requires re-downloading the "
               "entire blockchain. "
               "(default: 0 = disable pruning blocks, 1 = allow manual pruning "
@@ -514,6 +591,19 @@ void SetupServerArgs() {
                              "getrawtransaction rpc call (default: %d)"),
                            DEFAULT_TXINDEX),
                  false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockfilterindex=<type>",
+                 strprintf(_("Maintain an index of compact filters by block "
+                             "(default: %s, values: %s)."),
+                           DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
+                     " " +
+                     _("If <type> is not supplied or if <type> = 1, indexes "
+                       "for all known types are enabled."),
+                 false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinstatsindex",
+                 strprintf(_("Maintain coinstats index used by the "
+                             "gettxoutsetinfo RPC (default: %u)"),
+                           DEFAULT_COINSTATSINDEX),
+                 false, OptionsCategory::OPTIONS);
 
     gArgs.AddArg(
         "-addnode=<ip>",
@@ -591,6 +681,13 @@ void SetupServerArgs() {
                     "backward by this amount. (default: %u seconds)"),
                   DEFAULT_MAX_TIME_ADJUSTMENT),
         false, OptionsCategory::CONNECTION);
+    gArgs.AddArg(
+        "-netthreads=<n>",
+        strprintf(_("Number of threads serving peer sockets with epoll, where "
+                    "available (0 = one per core, up to %d; -1 = serve them "
+                    "all from one thread with select(); default: %d)"),
+                  MAX_NET_THREADS, DEFAULT_NET_THREADS),
+        false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onion=<ip:port>",
                  strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor "
                              "hidden services (default: %s)"),
@@ -605,6 +702,11 @@ void SetupServerArgs() {
                              "bloom filters (default: %d)"),
                            DEFAULT_PEERBLOOMFILTERS),
                  false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-peerblockfilters",
+                 strprintf(_("Serve compact block filters to peers per BIP "
+                             "157 (default: %d)"),
+                           DEFAULT_PEERBLOCKFILTERS),
+                 false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-permitbaremultisig",
                  strprintf(_("Relay non-P2SH multisig (default: %d)"),
                            DEFAULT_PERMIT_BAREMULTISIG),
@@ -1115,25 +1217,24 @@ void ThreadImport(const Config &config, std::vector<fs::path> vImportFiles) {
     {
         CImportingNow imp;
 
+        int nImportThreads =
+            gArgs.GetArg("-importthreads", DEFAULT_IMPORT_THREADS);
+        if (nImportThreads <= 0) {
+            nImportThreads = GetNumCores();
+        }
+
         // -reindex
         if (fReindex) {
-            int nFile = 0;
+            std::vector<fs::path> vBlockFiles;
             while (true) {
-                CDiskBlockPos pos(nFile, 0);
+                CDiskBlockPos pos(vBlockFiles.size(), 0);
                 if (!fs::exists(GetBlockPosFilename(pos, "blk"))) {
                     // No block files left to reindex
                     break;
                 }
-                FILE *file = OpenBlockFile(pos, true);
-                if (!file) {
-                    // This error is logged in OpenBlockFile
-                    break;
-                }
-                LogPrintf("Reindexing block file blk%05u.dat...\n",
-                          (unsigned int)nFile);
-                LoadExternalBlockFile(config, file, &pos);
-                nFile++;
+                vBlockFiles.push_back(GetBlockPosFilename(pos, "blk"));
             }
+            LoadExternalBlockFiles(config, vBlockFiles, true, nImportThreads);
             pblocktree->WriteReindexing(false);
             fReindex = false;
             LogPrintf("Reindexing finished\n");
@@ -1158,16 +1259,7 @@ void ThreadImport(const Config &config, std::vector<fs::path> vImportFiles) {
         }
 
         // -loadblock=
-        for (const fs::path &path : vImportFiles) {
-            FILE *file = fsbridge::fopen(path, "rb");
-            if (file) {
-                LogPrintf("Importing blocks file %s...\n", path.string());
-                LoadExternalBlockFile(config, file);
-            } else {
-                LogPrintf("Warning: Could not open blocks file %s\n",
-                          path.string());
-            }
-        }
+        LoadExternalBlockFiles(config, vImportFiles, false, nImportThreads);
 
         // scan for better chains in the block chain database, that are not yet
         // connected in the active best chain
@@ -1187,6 +1279,9 @@ void ThreadImport(const Config &config, std::vector<fs::path> vImportFiles) {
     } // End scope of CImportingNow
     if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
         LoadMempool(config);
+        if (!fRequestShutdown) {
+            StartMempoolJournal();
+        }
     }
     g_is_mempool_loaded = !fRequestShutdown;
 }
@@ -1449,11 +1544,46 @@ bool AppInitParameterInteraction(Config &config) {
                       gArgs.GetArg("-blocksdir", "").c_str()));
     }
 
+    // parse and validate enabled filter types
+    std::string blockfilterindex_value =
+        gArgs.GetArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    if (blockfilterindex_value == "" || blockfilterindex_value == "1") {
+        g_enabled_filter_types = AllBlockFilterTypes();
+    } else if (blockfilterindex_value != "0") {
+        const std::vector<std::string> names =
+            gArgs.GetArgs("-blockfilterindex");
+        for (const auto &name : names) {
+            BlockFilterType filter_type;
+            if (!BlockFilterTypeByName(name, filter_type)) {
+                return InitError(
+                    strprintf(_("Unknown -blockfilterindex value %s."), name));
+            }
+            g_enabled_filter_types.insert(filter_type);
+        }
+    }
+
     // if using block pruning, then disallow txindex
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
             return InitError(_("Prune mode is incompatible with -txindex."));
         }
+        if (!g_enabled_filter_types.empty()) {
+            return InitError(
+                _("Prune mode is incompatible with -blockfilterindex."));
+        }
+        // Rewinding the address index reads the blocks leaving the chain
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+            return InitError(_("Prune mode is incompatible with -addressindex."));
+        }
+        // The index is built from the undo data of every block
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+            return InitError(_("Prune mode is incompatible with -coinstatsindex."));
+        }
+    }
+
+    std::string dbProfileError;
+    if (!CheckDBProfileArgs(dbProfileError)) {
+        return InitError(dbProfileError);
     }
 
     // if space reserved for high priority transactions is misconfigured
@@ -1479,12 +1609,16 @@ bool AppInitParameterInteraction(Config &config) {
         gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
-    // Trim requested connection counts, to fit into system limitations
-    nMaxConnections =
-        std::max(std::min(nMaxConnections,
-                          (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS -
-                                MAX_ADDNODE_CONNECTIONS)),
-                 0);
+    // Trim requested connection counts, to fit into system limitations. Only
+    // select() is limited to FD_SETSIZE, the network threads are not.
+    if (!NetPoller::Available() ||
+        gArgs.GetArg("-netthreads", DEFAULT_NET_THREADS) < 0) {
+        nMaxConnections = std::max(
+            std::min(nMaxConnections,
+                     (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS -
+                           MAX_ADDNODE_CONNECTIONS)),
+            0);
+    }
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS +
                                    MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS) {
@@ -1630,6 +1764,7 @@ bool AppInitParameterInteraction(Config &config) {
     } else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS) {
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
     }
+    fCoinPrefetch = gArgs.GetBoolArg("-coinprefetch", DEFAULT_COIN_PREFETCH);
  
     
     // Configure excessive block size.
@@ -1760,6 +1895,15 @@ bool AppInitParameterInteraction(Config &config) {
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
     }
 
+    // Signal BIP 157 support, which needs the basic filters to be indexed.
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (g_enabled_filter_types.count(BlockFilterType::BASIC) != 1) {
+            return InitError(
+                _("Cannot set -peerblockfilters without -blockfilterindex."));
+        }
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
     // Signal Bitcoin Cash support.
     // TODO: remove some time after the hardfork when no longer needed
     // to differentiate the network nodes.
@@ -1875,6 +2019,14 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
     if (nScriptCheckThreads) {
         script_check_threads.reserve(nScriptCheckThreads - 1);
         for (int i = 0; i < nScriptCheckThreads - 1; i++) script_check_threads.emplace_back(&ThreadScriptCheck);
+        // Transactions for the mempool are checked on as many threads
+        tx_precheck_threads.reserve(nScriptCheckThreads - 1);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) tx_precheck_threads.emplace_back(&ThreadTxPreCheck);
+    }
+    if (nScriptCheckThreads && fCoinPrefetch) {
+        LogPrintf("Using %u threads for coin prefetch\n", nScriptCheckThreads);
+        coin_prefetch_threads.reserve(nScriptCheckThreads - 1);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++) coin_prefetch_threads.emplace_back(&ThreadCoinPrefetch);
     }
 
     
@@ -2068,6 +2220,31 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
                                       ? nMaxTxIndexCache << 20
                                       : 0);
     nTotalCache -= nTxIndexCache;
+    int64_t nAddrIndexCache = std::min(
+        nTotalCache / 8, gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)
+                             ? nMaxAddrIndexCache << 20
+                             : 0);
+    nTotalCache -= nAddrIndexCache;
+    int64_t nTimestampIndexCache = std::min(
+        nTotalCache / 8,
+        gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)
+            ? nMaxTimestampIndexCache << 20
+            : 0);
+    nTotalCache -= nTimestampIndexCache;
+    int64_t nCoinStatsIndexCache = std::min(
+        nTotalCache / 8,
+        gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)
+            ? nMaxCoinStatsIndexCache << 20
+            : 0);
+    nTotalCache -= nCoinStatsIndexCache;
+    int64_t filter_index_cache = 0;
+    if (!g_enabled_filter_types.empty()) {
+        size_t n_indexes = g_enabled_filter_types.size();
+        int64_t max_cache =
+            std::min(nTotalCache / 8, max_filter_index_cache << 20);
+        filter_index_cache = max_cache / n_indexes;
+        nTotalCache -= filter_index_cache * n_indexes;
+    }
     // use 25%-50% of the remainder for disk cache
     int64_t nCoinDBCache =
         std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23));
@@ -2076,6 +2253,11 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
     int64_t nRewardDBCache = nCoinDBCache;
     nTotalCache -= nCoinDBCache;
     nTotalCache -= nRewardDBCache;
+    // pending reward updates, at most half of what is left
+    nRewardsCacheUsage = std::min(
+        nTotalCache / 2,
+        std::max<int64_t>(0, gArgs.GetArg("-rewardscache", nDefaultRewardsCache)) << 20);
+    nTotalCache -= nRewardsCacheUsage;
     // the rest goes to in-memory cache
     nCoinCacheUsage = nTotalCache;
     int64_t nMempoolSizeMax =
@@ -2087,10 +2269,29 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
         LogPrintf("* Using %.1fMiB for transaction index database\n",
                   nTxIndexCache * (1.0 / 1024 / 1024));
     }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        LogPrintf("* Using %.1fMiB for address index database\n",
+                  nAddrIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+        LogPrintf("* Using %.1fMiB for timestamp index database\n",
+                  nTimestampIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        LogPrintf("* Using %.1fMiB for coin stats index database\n",
+                  nCoinStatsIndexCache * (1.0 / 1024 / 1024));
+    }
+    for (BlockFilterType filter_type : g_enabled_filter_types) {
+        LogPrintf("* Using %.1f MiB for %s block filter index database\n",
+                  filter_index_cache * (1.0 / 1024 / 1024),
+                  BlockFilterTypeName(filter_type));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n",
             nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for reward database\n",
             nRewardDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for in-memory reward updates\n",
+            nRewardsCacheUsage * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of "
               "unused mempool space)\n",
               nCoinCacheUsage * (1.0 / 1024 / 1024),
@@ -2113,6 +2314,8 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
                 pcoinsTip.reset();
                 pcoinsdbview.reset();
                 pcoinscatcher.reset();
+                prewards.reset();
+                prewardsTip.reset();
                 prewardsdb.reset();
                 pbudget.reset();
  
@@ -2152,12 +2355,6 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
                                        "Wrong datadir for network?"));
                 }
 
-                if (fAddressIndex != gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
-                    strLoadError = _("In order to activate address indexing (-addressindex) the current blockchain files (blocks & chainstate folders)" 
-				     " must be removed. DO NOT remove your 'wallets' folders or wallet.dat file");
-		    break;
-                }
-
 
                 // Check for changed -prune state.  What we are concerned about
                 // is a user who has pruned blocks in the past, but is now
@@ -2187,9 +2384,10 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
                 pcoinsdbview = std::make_unique<CCoinsViewDB>(nCoinDBCache, false, fReset || fReindexChainState);
               
                 prewardsdb = std::make_unique<CRewardsViewDB>("rewards",
-                                                  nCoinDBCache, false, fReset || fReindexChainState);
+                                                  nRewardDBCache, false, fReset || fReindexChainState);
+                prewardsTip = std::make_unique<CRewardsViewCache>(prewardsdb.get());
               
-                prewards = std::make_unique<CColdRewards>(chainparams.GetConsensus(), prewardsdb.get());
+                prewards = std::make_unique<CColdRewards>(chainparams.GetConsensus(), prewardsTip.get());
 
                 pbudget = std::make_unique<CBudget>(config);
                 
@@ -2218,6 +2416,25 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
    
                 bool is_coinsview_empty = fReset || fReindexChainState ||
                                           pcoinsTip->GetBestBlock().IsNull();
+                if (is_coinsview_empty && !fReset &&
+                    gArgs.IsArgSet("-loadsnapshot")) {
+                    uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+                    if (!LoadSnapshot(config,
+                                      gArgs.GetArg("-loadsnapshot", ""),
+                                      *pcoinsdbview, *prewardsdb,
+                                      strLoadError)) {
+                        break;
+                    }
+                    pcoinsTip = std::make_unique<CCoinsViewCache>(
+                        pcoinscatcher.get());
+                    // The reward candidates and totals were read from the
+                    // rewards database before the snapshot filled it
+                    {
+                        LOCK(cs_rewardsdb);
+                        prewards->LoadCandidatesFromDB();
+                    }
+                    is_coinsview_empty = false;
+                }
                 if (!is_coinsview_empty) {
                     // LoadChainTip sets chainActive based on pcoinsTip's best
                     // block
@@ -2326,11 +2543,48 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
 
 
     // Step 8: load indexers
+    if (pindexSnapshotBase &&
+        (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ||
+         gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ||
+         gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX) ||
+         gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX) ||
+         !g_enabled_filter_types.empty())) {
+        return InitError(_("Indexes need the blocks below the base of the "
+                           "UTXO snapshot the chainstate was loaded from"));
+    }
+
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         g_txindex = std::make_unique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
 
+    // The address index catches up with the chain in the background, so it
+    // can be turned on (or rebuilt) without -reindex. The mempool side of it
+    // follows the same setting.
+    fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    if (fAddressIndex) {
+        g_addrindex = std::make_unique<AddrIndex>(nAddrIndexCache, false, fReindex);
+        g_addrindex->Start();
+    } else if (!pblocktree->DropAddrIndex()) {
+        // Rows left in the block index database by earlier versions
+        return InitError(_("Error removing the former address index"));
+    }
+
+    if (gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+        g_timestampindex = std::make_unique<TimestampIndex>(nTimestampIndexCache, false, fReindex);
+        g_timestampindex->Start();
+    }
+
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        g_coin_stats_index = std::make_unique<CoinStatsIndex>(nCoinStatsIndexCache, false, fReindex);
+        g_coin_stats_index->Start();
+    }
+
+    for (const auto &filter_type : g_enabled_filter_types) {
+        InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
+        GetBlockFilterIndex(filter_type)->Start();
+    }
+
     // Step 9: load wallet
     if (!g_wallet_init_interface.Open(chainparams, walletPassphrase, words)) {
         return false;
@@ -2338,6 +2592,14 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
 
     // Step 10: data directory maintenance
 
+    // Like a pruned node, a node bootstrapped from a UTXO snapshot can't serve
+    // the whole chain
+    if (pindexSnapshotBase) {
+        LogPrintf("Unsetting NODE_NETWORK on a chainstate loaded from a UTXO "
+                  "snapshot\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+    }
+
     // if pruning, unset the service bit and perform the initial blockstore
     // prune after any wallet rescanning has taken place.
     if (fPruneMode) {
@@ -2438,6 +2700,8 @@ bool AppInitMain(Config &config, RPCServer& rpcServer,
         1000 * gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize =
         1000 * gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nNetThreads =
+        gArgs.GetArg("-netthreads", DEFAULT_NET_THREADS);
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
@@ -31,6 +31,8 @@ bool ShutdownRequested();
 void Interrupt();
 /** Interrupt all script checking threads once they're out of work */
 void InterruptThreadScriptCheck();
+void InterruptThreadCoinPrefetch();
+void InterruptThreadTxPreCheck();
 void Shutdown();
 //! Initialize the logging infrastructure
 void InitLogging();
@@ -0,0 +1,394 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempooljournal.h>
+
+#include <clientversion.h>
+#include <fs_util.h>
+#include <random.h>
+#include <streams.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <limits>
+
+//! Snapshots followed by a journal start with their id
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_JOURNAL = 1;
+static const uint64_t MEMPOOL_JOURNAL_VERSION = 1;
+
+//! How often the changes to the mempool are written to the journal
+static const int MEMPOOL_JOURNAL_FLUSH_MILLIS = 1000;
+//! Journals smaller than this are not compacted, however small the mempool
+static const uint64_t MEMPOOL_JOURNAL_MIN_COMPACT_SIZE = 16 << 20;
+
+static fs::path SnapshotPath() {
+    return GetDataDir() / "mempool.dat";
+}
+
+static fs::path JournalPath() {
+    return GetDataDir() / "mempool.journal";
+}
+
+/**
+ * Put the transactions spent by others in entries before them, keeping the
+ * order entries are in otherwise. The journal may have a child first: a
+ * block disconnected by a reorg puts its transactions back into the mempool
+ * after their children.
+ */
+static void SortParentsFirst(std::vector<CMempoolJournal::Entry> &entries) {
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < entries.size(); i++) {
+        mapIndex[entries[i].tx->GetId()] = i;
+    }
+
+    std::vector<CMempoolJournal::Entry> sorted;
+    sorted.reserve(entries.size());
+    std::vector<bool> vQueued(entries.size(), false);
+    // Entries waiting for their parents, with the next input to look at
+    std::vector<std::pair<size_t, size_t>> stack;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (vQueued[i]) {
+            continue;
+        }
+        vQueued[i] = true;
+        stack.emplace_back(i, 0);
+        while (!stack.empty()) {
+            const size_t nEntry = stack.back().first;
+            const CTransaction &tx = *entries[nEntry].tx;
+            if (stack.back().second < tx.vin.size()) {
+                const TxId &parent =
+                    tx.vin[stack.back().second++].prevout.GetTxId();
+                auto it = mapIndex.find(parent);
+                if (it != mapIndex.end() && !vQueued[it->second]) {
+                    vQueued[it->second] = true;
+                    stack.emplace_back(it->second, 0);
+                }
+                continue;
+            }
+            sorted.push_back(std::move(entries[nEntry]));
+            stack.pop_back();
+        }
+    }
+    entries.swap(sorted);
+}
+
+CMempoolJournal::CMempoolJournal(CTxMemPool &poolIn)
+    : pool(poolIn), nJournalSize(0), nSnapshotSize(0), fStop(false) {}
+
+CMempoolJournal::~CMempoolJournal() {
+    Stop();
+}
+
+bool CMempoolJournal::Read(std::vector<Entry> &entries,
+                           std::map<uint256, Amount> &mapDeltas) {
+    entries.clear();
+    mapDeltas.clear();
+    CAutoFile file(fsbridge::fopen(SnapshotPath(), "rb"), SER_DISK,
+                   CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf(
+            "Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    // Where each transaction still in the mempool is in entries
+    std::map<uint256, size_t> mapEntries;
+    uint64_t version;
+    uint64_t nId = 0;
+    try {
+        file >> version;
+        if (version != MEMPOOL_DUMP_VERSION &&
+            version != MEMPOOL_DUMP_VERSION_NO_JOURNAL) {
+            return false;
+        }
+        if (version == MEMPOOL_DUMP_VERSION) {
+            file >> nId;
+        }
+
+        uint64_t num;
+        file >> num;
+        while (num--) {
+            Entry entry;
+            Amount nFeeDelta;
+            file >> entry.tx >> entry.nTime >> nFeeDelta;
+            if (nFeeDelta != Amount::zero()) {
+                mapDeltas[entry.tx->GetId()] = nFeeDelta;
+            }
+            mapEntries[entry.tx->GetId()] = entries.size();
+            entries.push_back(std::move(entry));
+        }
+
+        std::map<uint256, Amount> mapOtherDeltas;
+        file >> mapOtherDeltas;
+        mapDeltas.insert(mapOtherDeltas.begin(), mapOtherDeltas.end());
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing "
+                  "anyway.\n",
+                  e.what());
+        return false;
+    }
+
+    CAutoFile journal(version == MEMPOOL_DUMP_VERSION
+                          ? fsbridge::fopen(JournalPath(), "rb")
+                          : nullptr,
+                      SER_DISK, CLIENT_VERSION);
+    size_t nRecords = 0;
+    try {
+        uint64_t nJournalVersion, nJournalId;
+        if (!journal.IsNull()) {
+            journal >> nJournalVersion >> nJournalId;
+        }
+        if (!journal.IsNull() && nJournalVersion == MEMPOOL_JOURNAL_VERSION &&
+            nJournalId == nId) {
+            while (true) {
+                const int c = fgetc(journal.Get());
+                if (c == EOF) {
+                    break;
+                }
+                ungetc(c, journal.Get());
+
+                Record record;
+                journal >> record;
+                nRecords++;
+                if (record.type == ADD) {
+                    const uint256 &txid = record.tx->GetId();
+                    if (mapEntries.count(txid)) {
+                        continue;
+                    }
+                    mapEntries[txid] = entries.size();
+                    entries.push_back({record.tx, record.nTime});
+                } else if (record.type == REMOVE) {
+                    auto it = mapEntries.find(record.txid);
+                    if (it != mapEntries.end()) {
+                        entries[it->second].tx.reset();
+                        mapEntries.erase(it);
+                    }
+                } else if (record.nDelta == Amount::zero()) {
+                    mapDeltas.erase(record.txid);
+                } else {
+                    mapDeltas[record.txid] = record.nDelta;
+                }
+            }
+        }
+    } catch (const std::exception &e) {
+        // The node stopped while writing the last records
+        LogPrintf("Mempool journal ends after %u records: %s\n", nRecords,
+                  e.what());
+    }
+
+    entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                 [](const Entry &entry) { return !entry.tx; }),
+                  entries.end());
+    SortParentsFirst(entries);
+    return true;
+}
+
+bool CMempoolJournal::Compact() {
+    int64_t start = GetTimeMicros();
+
+    LOCK(cs_file);
+    std::map<uint256, Amount> mapDeltas;
+    std::vector<TxMempoolInfo> vinfo;
+    const uint64_t nId = GetRand(std::numeric_limits<uint64_t>::max());
+    {
+        LOCK2(pool.cs, cs);
+        for (const auto &i : pool.mapDeltas) {
+            mapDeltas[i.first] = i.second.second;
+        }
+        vinfo = pool.infoAll();
+
+        // All of this is in the snapshot
+        vPending.clear();
+        mapDeltasWritten = mapDeltas;
+    }
+    // Until the new journal is open, changes wait in vPending
+    fileJournal.reset();
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        FILE *filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+        file << nId;
+
+        file << uint64_t(vinfo.size());
+        for (const auto &i : vinfo) {
+            file << *(i.tx);
+            file << int64_t(i.nTime);
+            file << i.nFeeDelta;
+            mapDeltas.erase(i.tx->GetId());
+        }
+
+        file << mapDeltas;
+        FileCommit(file.Get());
+        nSnapshotSize = ftell(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", SnapshotPath());
+
+        // A journal left over is for another snapshot, and can go
+        std::unique_ptr<CAutoFile> journal = std::make_unique<CAutoFile>(
+            fsbridge::fopen(JournalPath(), "wb"), SER_DISK, CLIENT_VERSION);
+        if (journal->IsNull()) {
+            return false;
+        }
+        *journal << MEMPOOL_JOURNAL_VERSION << nId;
+        FileCommit(journal->Get());
+        nJournalSize = ftell(journal->Get());
+        fileJournal = std::move(journal);
+
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n",
+                  (mid - start) / 1e6, (last - mid) / 1e6);
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+void CMempoolJournal::Start() {
+    assert(!thread.joinable());
+
+    // From now on changes are queued, and what came before goes into the
+    // snapshot
+    connAdded = pool.NotifyEntryAdded.connect(
+        [this](CTransactionRef tx) { TransactionAdded(tx); });
+    connRemoved = pool.NotifyEntryRemoved.connect(
+        [this](CTransactionRef tx, MemPoolRemovalReason) {
+            TransactionRemoved(tx);
+        });
+    Compact();
+
+    {
+        LOCK(mutexThread);
+        fStop = false;
+    }
+    thread = std::thread(
+        &TraceThread<std::function<void()>>, "mempool",
+        std::function<void()>(std::bind(&CMempoolJournal::ThreadWrite, this)));
+}
+
+void CMempoolJournal::Stop() {
+    if (!thread.joinable()) {
+        return;
+    }
+
+    connAdded.disconnect();
+    connRemoved.disconnect();
+    {
+        LOCK(mutexThread);
+        fStop = true;
+    }
+    condThread.notify_all();
+    thread.join();
+
+    Flush(true);
+    LOCK(cs_file);
+    fileJournal.reset();
+}
+
+bool CMempoolJournal::Flush(bool fCommit) {
+    LOCK(cs_file);
+    if (!fileJournal) {
+        // The last snapshot failed, and took what was queued since with it
+        return Compact();
+    }
+
+    std::vector<Record> records;
+    {
+        LOCK2(pool.cs, cs);
+        records.swap(vPending);
+
+        // Fee deltas change without notifications, write the ones that did
+        std::map<uint256, Amount> mapDeltas;
+        for (const auto &i : pool.mapDeltas) {
+            mapDeltas[i.first] = i.second.second;
+            auto it = mapDeltasWritten.find(i.first);
+            if (it == mapDeltasWritten.end() || it->second != i.second.second) {
+                records.push_back({DELTA, nullptr, 0, i.first, i.second.second});
+            }
+        }
+        for (const auto &i : mapDeltasWritten) {
+            if (!mapDeltas.count(i.first)) {
+                records.push_back({DELTA, nullptr, 0, i.first, Amount::zero()});
+            }
+        }
+        mapDeltasWritten.swap(mapDeltas);
+    }
+    if (records.empty()) {
+        return true;
+    }
+
+    try {
+        for (const Record &record : records) {
+            *fileJournal << record;
+        }
+        if (fflush(fileJournal->Get()) != 0) {
+            throw std::ios_base::failure("fflush failed");
+        }
+        if (fCommit) {
+            FileCommit(fileJournal->Get());
+        }
+        nJournalSize = ftell(fileJournal->Get());
+    } catch (const std::exception &e) {
+        LogPrintf("Failed to write to the mempool journal: %s\n", e.what());
+        // Start over from a snapshot on the next flush
+        fileJournal.reset();
+        return false;
+    }
+    return true;
+}
+
+void CMempoolJournal::TransactionAdded(const CTransactionRef &tx) {
+    // The pool holds cs and has the entry already
+    const TxMempoolInfo info = pool.info(tx->GetId());
+    LOCK(cs);
+    vPending.push_back(
+        {ADD, tx, info.tx ? info.nTime : GetTime(), uint256(), Amount::zero()});
+}
+
+void CMempoolJournal::TransactionRemoved(const CTransactionRef &tx) {
+    LOCK(cs);
+    vPending.push_back({REMOVE, nullptr, 0, tx->GetId(), Amount::zero()});
+}
+
+void CMempoolJournal::ThreadWrite() {
+    while (true) {
+        {
+            WAIT_LOCK(mutexThread, lock);
+            condThread.wait_for(
+                lock, std::chrono::milliseconds(MEMPOOL_JOURNAL_FLUSH_MILLIS),
+                [this] { return fStop; });
+            if (fStop) {
+                return;
+            }
+        }
+
+        Flush(true);
+
+        bool fCompact;
+        {
+            LOCK(cs_file);
+            fCompact = fileJournal &&
+                       nJournalSize > std::max(nSnapshotSize,
+                                               MEMPOOL_JOURNAL_MIN_COMPACT_SIZE);
+        }
+        if (fCompact) {
+            Compact();
+        }
+    }
+}
@@ -0,0 +1,130 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MEMPOOLJOURNAL_H
+#define BITCOIN_MEMPOOLJOURNAL_H
+
+#include <amount.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <sync.h>
+#include <txmempool.h>
+#include <uint256.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <ios>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class CAutoFile;
+
+/**
+ * Keeps the mempool on disk as a snapshot, mempool.dat, and a journal of the
+ * changes made to the mempool since, mempool.journal. The journal is only
+ * appended to, from a background thread, so nothing but the last changes has
+ * to be written at shutdown.
+ *
+ * Once the journal has grown larger than the snapshot, a new snapshot is
+ * written and the journal starts over. Each snapshot gets a new id, and a
+ * journal is only replayed over the snapshot with the same id.
+ */
+class CMempoolJournal {
+public:
+    //! A transaction to put back into the mempool, and when it entered it
+    struct Entry {
+        CTransactionRef tx;
+        int64_t nTime;
+    };
+
+    explicit CMempoolJournal(CTxMemPool &poolIn);
+    ~CMempoolJournal();
+
+    /**
+     * Read the snapshot and replay its journal over it. entries gets the
+     * transactions in the order they entered the mempool, but with parents
+     * before their children, mapDeltas the fee deltas, of transactions in the
+     * mempool or not.
+     */
+    static bool Read(std::vector<Entry> &entries,
+                     std::map<uint256, Amount> &mapDeltas);
+
+    //! Write a snapshot of the mempool, and start a new journal after it
+    bool Compact();
+
+    //! Follow the mempool, writing its changes to the journal in the background
+    void Start();
+    //! Stop following the mempool, once what is left is written
+    void Stop();
+
+    //! Write the changes queued so far to the journal
+    bool Flush(bool fCommit);
+
+private:
+    enum RecordType : uint8_t { ADD = 0, REMOVE = 1, DELTA = 2 };
+
+    struct Record {
+        uint8_t type;
+        CTransactionRef tx;
+        int64_t nTime;
+        uint256 txid;
+        Amount nDelta;
+
+        template <typename Stream> void Serialize(Stream &s) const {
+            s << type;
+            if (type == ADD) {
+                s << tx << nTime;
+            } else {
+                s << txid;
+                if (type == DELTA) {
+                    s << nDelta;
+                }
+            }
+        }
+
+        template <typename Stream> void Unserialize(Stream &s) {
+            s >> type;
+            if (type == ADD) {
+                s >> tx >> nTime;
+            } else if (type == REMOVE || type == DELTA) {
+                s >> txid;
+                if (type == DELTA) {
+                    s >> nDelta;
+                }
+            } else {
+                throw std::ios_base::failure("Unknown mempool journal record");
+            }
+        }
+    };
+
+    void TransactionAdded(const CTransactionRef &tx);
+    void TransactionRemoved(const CTransactionRef &tx);
+    void ThreadWrite();
+
+    CTxMemPool &pool;
+
+    //! Taken before pool.cs, serializes the writes to the files
+    CCriticalSection cs_file;
+    std::unique_ptr<CAutoFile> fileJournal GUARDED_BY(cs_file);
+    uint64_t nJournalSize GUARDED_BY(cs_file);
+    uint64_t nSnapshotSize GUARDED_BY(cs_file);
+
+    //! Taken after pool.cs, by the notifications of the mempool
+    CCriticalSection cs;
+    std::vector<Record> vPending GUARDED_BY(cs);
+    //! The fee deltas as the journal has them
+    std::map<uint256, Amount> mapDeltasWritten GUARDED_BY(cs);
+
+    boost::signals2::connection connAdded;
+    boost::signals2::connection connRemoved;
+
+    Mutex mutexThread;
+    std::condition_variable condThread;
+    bool fStop GUARDED_BY(mutexThread);
+    std::thread thread;
+};
+
+#endif // BITCOIN_MEMPOOLJOURNAL_H
@@ -6,6 +6,8 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include <indirectmap.h>
+#include <prevector.h>
+#include <openhashmap.h>
 
 #include <cstdlib>
 
@@ -145,6 +147,15 @@ static inline size_t IncrementalDynamicUsage(const indirectmap<X, Y> &m) {
     return MallocUsage(sizeof(stl_tree_node<std::pair<const X *, Y>>));
 }
 
+// openhashmap allocates its entries by chunks, and a table of slots
+
+template <typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const openhashmap<X, Y, Z> &m) {
+    return MallocUsage(m.ChunkBytes()) * m.ChunkCount() +
+           MallocUsage(m.ChunkVectorBytes()) + MallocUsage(m.TableBytes()) +
+           MallocUsage(m.FreeListBytes());
+}
+
 template <typename X>
 static inline size_t DynamicUsage(const std::unique_ptr<X> &p) {
     return p ? MallocUsage(sizeof(X)) : 0;
@@ -26,6 +26,7 @@
 #include <cstring>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -36,6 +37,7 @@
 #endif
 
 #include <cmath>
+#include <set>
 
 // Dump addresses to peers.dat and banlist.dat every 15 minutes (900s)
 #define DUMP_ADDRESSES_INTERVAL 900
@@ -78,6 +80,22 @@ enum BindFlags {
 
 const static std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
+// Milliseconds the socket handler waits for sockets, which is how often it
+// polls pnode->vSend and paused peers
+static const int SOCKET_WAIT_MILLIS = 50;
+// Reads from one socket before a net thread moves to the other ready peers
+static const int MAX_NET_THREAD_READS = 16;
+// Messages with more data than this left to receive get it read from the
+// socket straight into their buffer
+static const uint32_t MIN_RECV_IN_PLACE_SIZE = 16 * 1024;
+// Processed messages each peer keeps to receive into, the largest buffer kept
+// and the most buffer memory kept in all
+static const size_t MAX_RECV_POOL_MESSAGES = 16;
+static const size_t MAX_RECV_POOL_MESSAGE_SIZE = 64 * 1024;
+static const size_t MAX_RECV_POOL_BYTES = 256 * 1024;
+// Seconds without receiving anything after which a peer's pool is freed
+static const int64_t RECV_POOL_IDLE_SECONDS = 60;
+
 // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL;
 // SHA256("localhostnonce")[0:8]
@@ -455,6 +473,12 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest,
         CloseSocket(hSocket);
         return nullptr;
     }
+    if (vNetThreads.empty() && !IsSelectableSocket(hSocket)) {
+        LogPrintf("Cannot create connection: non-selectable socket created (fd "
+                  ">= FD_SETSIZE ?)\n");
+        CloseSocket(hSocket);
+        return nullptr;
+    }
 
     // Add node
     NodeId id = GetNewNodeId();
@@ -769,6 +793,37 @@ static bool IsOversizedMessage(const Config &config, const CNetMessage &msg) {
     return msg.hdr.IsOversized(config);
 }
 
+CNetMessage &CNode::GetRecvMsg(const Config &config) {
+    if (!vRecvMsg.empty() && !vRecvMsg.back().complete()) {
+        return vRecvMsg.back();
+    }
+    {
+        LOCK(cs_vRecvPool);
+        if (!vRecvPool.empty()) {
+            nRecvPoolBytes -= vRecvPool.front().vRecv.capacity();
+            vRecvMsg.splice(vRecvMsg.end(), vRecvPool, vRecvPool.begin());
+            return vRecvMsg.back();
+        }
+    }
+    vRecvMsg.emplace_back(config.GetChainParams().NetMagic(), SER_NETWORK,
+                          INIT_PROTO_VERSION);
+    return vRecvMsg.back();
+}
+
+void CNode::RecvMsgComplete(CNetMessage &msg, int64_t nTimeMicros) {
+    // Store received bytes per message command to prevent a memory DOS, only
+    // allow valid commands.
+    auto i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand.data());
+    if (i == mapRecvBytesPerMsgCmd.end()) {
+        i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    }
+
+    assert(i != mapRecvBytesPerMsgCmd.end());
+    i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
+
+    msg.nTime = nTimeMicros;
+}
+
 bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
                             uint32_t nBytes, bool &complete) {
     complete = false;
@@ -777,13 +832,8 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
     nLastRecv = nTimeMicros / 1000000;
     nRecvBytes += nBytes;
     while (nBytes > 0) {
-        // Get current incomplete message, or create a new one.
-        if (vRecvMsg.empty() || vRecvMsg.back().complete()) {
-            vRecvMsg.emplace_back(config.GetChainParams().NetMagic(),
-                                           SER_NETWORK, INIT_PROTO_VERSION);
-        }
-
-        CNetMessage &msg = vRecvMsg.back();
+        // Get current incomplete message, or a new one.
+        CNetMessage &msg = GetRecvMsg(config);
 
         // Absorb network data.
         int handled;
@@ -808,17 +858,7 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
         nBytes -= handled;
 
         if (msg.complete()) {
-            // Store received bytes per message command to prevent a memory DOS,
-            // only allow valid commands.
-            auto i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand.data());
-            if (i == mapRecvBytesPerMsgCmd.end()) {
-                i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
-            }
-
-            assert(i != mapRecvBytesPerMsgCmd.end());
-            i->second += msg.hdr.nMessageSize + CMessageHeader::HEADER_SIZE;
-
-            msg.nTime = nTimeMicros;
+            RecvMsgComplete(msg, nTimeMicros);
             complete = true;
         }
     }
@@ -826,6 +866,72 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
     return true;
 }
 
+char *CNode::GetRecvBuffer(uint32_t &nSize) {
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data ||
+        vRecvMsg.back().complete()) {
+        return nullptr;
+    }
+    CNetMessage &msg = vRecvMsg.back();
+    if (msg.hdr.nMessageSize - msg.nDataPos < MIN_RECV_IN_PLACE_SIZE) {
+        return nullptr;
+    }
+    return msg.GetDataBuffer(nSize);
+}
+
+void CNode::ReceiveMsgBytesInPlace(uint32_t nBytes, bool &complete) {
+    int64_t nTimeMicros = GetTimeMicros();
+    LOCK(cs_vRecv);
+    nLastRecv = nTimeMicros / 1000000;
+    nRecvBytes += nBytes;
+    CNetMessage &msg = vRecvMsg.back();
+    msg.DataReceived(nBytes);
+    complete = msg.complete();
+    if (complete) {
+        RecvMsgComplete(msg, nTimeMicros);
+    }
+}
+
+size_t CNode::QueueReceivedMessages(size_t nReceiveFloodSize) {
+    size_t nSizeAdded = 0;
+    auto it(vRecvMsg.begin());
+    for (; it != vRecvMsg.end(); ++it) {
+        if (!it->complete()) {
+            break;
+        }
+        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+    }
+    LOCK(cs_vProcessMsg);
+    vProcessMsg.splice(vProcessMsg.end(), vRecvMsg, vRecvMsg.begin(), it);
+    nProcessQueueSize += nSizeAdded;
+    fPauseRecv = nProcessQueueSize > nReceiveFloodSize;
+    return nSizeAdded;
+}
+
+void CNode::RecycleMessages(std::list<CNetMessage> &msgs) {
+    LOCK(cs_vRecvPool);
+    auto it = msgs.begin();
+    while (it != msgs.end() && vRecvPool.size() < MAX_RECV_POOL_MESSAGES) {
+        auto next = std::next(it);
+        it->Reset();
+        size_t nBytes = it->vRecv.capacity();
+        if (nBytes <= MAX_RECV_POOL_MESSAGE_SIZE &&
+            nRecvPoolBytes + nBytes <= MAX_RECV_POOL_BYTES) {
+            vRecvPool.splice(vRecvPool.end(), msgs, it);
+            nRecvPoolBytes += nBytes;
+        }
+        it = next;
+    }
+}
+
+void CNode::ReleaseRecvPool() {
+    std::list<CNetMessage> pool;
+    {
+        LOCK(cs_vRecvPool);
+        pool.swap(vRecvPool);
+        nRecvPoolBytes = 0;
+    }
+}
+
 void CNode::SetSendVersion(int nVersionIn) {
     // Send version may only be changed in the version message, and only one
     // version message is allowed per session. We can therefore treat this value
@@ -886,20 +992,51 @@ int CNetMessage::readHeader(const Config &config, const char *pch,
 }
 
 int CNetMessage::readData(const char *pch, uint32_t nBytes) {
-    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
-    unsigned int nCopy = std::min(nRemaining, nBytes);
+    uint32_t nSize;
+    char *pchData = GetDataBuffer(nSize);
+    uint32_t nCopy = std::min(nSize, nBytes);
+    if (nCopy == 0) {
+        return 0;
+    }
+
+    memcpy(pchData, pch, nCopy);
+    DataReceived(nCopy);
+
+    return nCopy;
+}
 
-    if (vRecv.size() < nDataPos + nCopy) {
+char *CNetMessage::GetDataBuffer(uint32_t &nSize) {
+    nSize = 0;
+    if (!in_data || complete()) {
+        return nullptr;
+    }
+
+    if (vRecv.size() == nDataPos) {
         // Allocate up to 256 KiB ahead, but never more than the total message
         // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + 256 * 1024));
     }
 
-    hasher.Write((const uint8_t *)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
-    nDataPos += nCopy;
+    nSize = vRecv.size() - nDataPos;
+    return &vRecv[nDataPos];
+}
 
-    return nCopy;
+void CNetMessage::DataReceived(uint32_t nBytes) {
+    assert(nDataPos + nBytes <= vRecv.size());
+    hasher.Write((const uint8_t *)&vRecv[nDataPos], nBytes);
+    nDataPos += nBytes;
+}
+
+void CNetMessage::Reset() {
+    hasher.Reset();
+    data_hash.SetNull();
+    in_data = false;
+    hdrbuf.clear();
+    hdrbuf.resize(24);
+    nHdrPos = 0;
+    vRecv.clear();
+    nDataPos = 0;
+    nTime = 0;
 }
 
 const uint256 &CNetMessage::GetMessageHash() const {
@@ -910,27 +1047,69 @@ const uint256 &CNetMessage::GetMessageHash() const {
     return data_hash;
 }
 
+#ifdef WIN32
+//! Buffers handed to one send() call, Windows sends them one at a time
+static const int MAX_SEND_CHUNKS = 1;
+#else
+//! Buffers handed to one sendmsg() call
+static const int MAX_SEND_CHUNKS = 64;
+#endif
+
 // requires LOCK(cs_vSend)
 size_t CConnman::SocketSendData(CNode *pnode) const {
     AssertLockHeld(pnode->cs_vSend);
     size_t nSentSize = 0;
-    size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+    while (!pnode->vSendMsg.empty()) {
+        // Gather what is left of the queued headers and payloads, so they go
+        // out in one call without being copied together
+        std::pair<const uint8_t *, size_t> chunks[MAX_SEND_CHUNKS];
+        int nChunks = 0;
+        size_t nToSend = 0;
+        size_t nSkip = pnode->nSendOffset;
+        auto addChunk = [&](const std::vector<uint8_t> &data) {
+            if (nSkip >= data.size()) {
+                nSkip -= data.size();
+                return;
+            }
+            chunks[nChunks++] = {data.data() + nSkip, data.size() - nSkip};
+            nToSend += data.size() - nSkip;
+            nSkip = 0;
+        };
+        for (const CNode::CSendMsg &msg : pnode->vSendMsg) {
+            if (nChunks + 2 > MAX_SEND_CHUNKS && nChunks > 0) {
+                break;
+            }
+            addChunk(msg.header);
+            if (nChunks < MAX_SEND_CHUNKS) {
+                addChunk(msg.msg->data);
+            }
+        }
+        assert(nChunks > 0);
 
+        int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET) {
                 break;
             }
 
+#ifdef WIN32
             nBytes = send(pnode->hSocket,
-                          reinterpret_cast<const char *>(data.data()) +
-                              pnode->nSendOffset,
-                          data.size() - pnode->nSendOffset,
-                          MSG_NOSIGNAL | MSG_DONTWAIT);
+                          reinterpret_cast<const char *>(chunks[0].first),
+                          chunks[0].second, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            struct iovec iov[MAX_SEND_CHUNKS];
+            for (int i = 0; i < nChunks; i++) {
+                iov[i].iov_base = const_cast<uint8_t *>(chunks[i].first);
+                iov[i].iov_len = chunks[i].second;
+            }
+            struct msghdr msgh = {};
+            msgh.msg_iov = iov;
+            msgh.msg_iovlen = nChunks;
+            nBytes = sendmsg(pnode->hSocket, &msgh,
+                             MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
 
         if (nBytes == 0) {
@@ -953,21 +1132,29 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
-        }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
+        // Drop the messages sent in full
+        size_t nLeft = nBytes;
+        while (nLeft > 0) {
+            const CNode::CSendMsg &msg = pnode->vSendMsg.front();
+            const size_t nRemaining = msg.size() - pnode->nSendOffset;
+            if (nLeft < nRemaining) {
+                pnode->nSendOffset += nLeft;
+                break;
+            }
+            nLeft -= nRemaining;
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= msg.size();
+            pnode->vSendMsg.pop_front();
+        }
         pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
-    }
 
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
-                          pnode->vSendMsg.begin() + nMsgCount);
+        if (size_t(nBytes) < nToSend) {
+            // could not send everything; stop sending more
+            break;
+        }
+    }
 
     if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
@@ -1183,7 +1370,7 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    if (vNetThreads.empty() && !IsSelectableSocket(hSocket)) {
         LogPrintf("connection from %s dropped: non-selectable socket\n",
                   addr.ToString());
         CloseSocket(hSocket);
@@ -1226,12 +1413,95 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+    AddToNetThread(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
+void CConnman::AddToNetThread(CNode *pnode) {
+    if (vNetThreads.empty()) {
+        return;
+    }
+    NetThread &netThread = *vNetThreads[pnode->GetId() % vNetThreads.size()];
+    LOCK(netThread.cs);
+    pnode->AddRef();
+    netThread.mapNodes.emplace(pnode->GetId(), pnode);
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket != INVALID_SOCKET &&
+        !netThread.poller.Add(pnode->hSocket, pnode->GetId())) {
+        LogPrintf("socket epoll error %s\n",
+                  NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+}
+
+void CConnman::RemoveFromNetThread(CNode *pnode) {
+    if (vNetThreads.empty()) {
+        return;
+    }
+    // Closing its socket already took the peer out of the epoll set
+    NetThread &netThread = *vNetThreads[pnode->GetId() % vNetThreads.size()];
+    LOCK(netThread.cs);
+    if (netThread.mapNodes.erase(pnode->GetId())) {
+        pnode->Release();
+    }
+}
+
+int CConnman::SocketRecvData(CNode *pnode) {
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    // The data of large messages is received in place, there is no need to
+    // go through pchBuf and have it copied
+    uint32_t nSize = sizeof(pchBuf);
+    char *pchRecv = pnode->GetRecvBuffer(nSize);
+    const bool fInPlace = pchRecv != nullptr;
+    if (!fInPlace) {
+        pchRecv = pchBuf;
+        nSize = sizeof(pchBuf);
+    }
+    int32_t nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET) {
+            return -1;
+        }
+        nBytes = recv(pnode->hSocket, pchRecv, nSize, MSG_DONTWAIT);
+    }
+    if (nBytes > 0) {
+        bool notify = false;
+        if (fInPlace) {
+            pnode->ReceiveMsgBytesInPlace(nBytes, notify);
+        } else if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes, notify)) {
+            pnode->CloseSocketDisconnect();
+        }
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            pnode->QueueReceivedMessages(nReceiveFloodSize);
+            WakeMessageHandler();
+        }
+    } else if (nBytes == 0) {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed\n");
+        }
+        pnode->CloseSocketDisconnect();
+    } else if (nBytes < 0) {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE &&
+            nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
+            if (!pnode->fDisconnect) {
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            }
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return nBytes;
+}
+
 void CConnman::ThreadSocketHandler() {
     unsigned int nPrevNodeCount = 0;
     while (!interruptNet) {
@@ -1266,6 +1536,7 @@ void CConnman::ThreadSocketHandler() {
 
                     // close socket and cleanup
                     pnode->CloseSocketDisconnect();
+                    RemoveFromNetThread(pnode);
 
                     // hold in disconnected pool until all refs are released
                     pnode->Release();
@@ -1314,7 +1585,7 @@ void CConnman::ThreadSocketHandler() {
         struct timeval timeout;
         timeout.tv_sec = 0;
         // Frequency to poll pnode->vSend
-        timeout.tv_usec = 50000;
+        timeout.tv_usec = SOCKET_WAIT_MILLIS * 1000;
 
         fd_set fdsetRecv;
         fd_set fdsetSend;
@@ -1331,7 +1602,9 @@ void CConnman::ThreadSocketHandler() {
             have_fds = true;
         }
 
-        {
+        // The net threads serve the peer sockets when there are any, this
+        // thread then only waits for new connections
+        if (vNetThreads.empty()) {
             LOCK(cs_vNodes);
             for (CNode *pnode : vNodes) {
                 // Implement the following logic:
@@ -1431,68 +1704,14 @@ void CConnman::ThreadSocketHandler() {
                 if (pnode->hSocket == INVALID_SOCKET) {
                     continue;
                 }
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                if (vNetThreads.empty()) {
+                    recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
+                    sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
+                    errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+                }
             }
             if (recvSet || errorSet) {
-                // typical socket buffer is 8K-64K
-                char pchBuf[0x10000];
-                int32_t nBytes = 0;
-                {
-                    LOCK(pnode->cs_hSocket);
-                    if (pnode->hSocket == INVALID_SOCKET) {
-                        continue;
-                    }
-                    nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf),
-                                  MSG_DONTWAIT);
-                }
-                if (nBytes > 0) {
-                    bool notify = false;
-                    if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes,
-                                                notify)) {
-                        pnode->CloseSocketDisconnect();
-                    }
-                    RecordBytesRecv(nBytes);
-                    if (notify) {
-                        size_t nSizeAdded = 0;
-                        auto it(pnode->vRecvMsg.begin());
-                        for (; it != pnode->vRecvMsg.end(); ++it) {
-                            if (!it->complete()) {
-                                break;
-                            }
-                            nSizeAdded +=
-                                it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                        }
-                        {
-                            LOCK(pnode->cs_vProcessMsg);
-                            pnode->vProcessMsg.splice(
-                                pnode->vProcessMsg.end(), pnode->vRecvMsg,
-                                pnode->vRecvMsg.begin(), it);
-                            pnode->nProcessQueueSize += nSizeAdded;
-                            pnode->fPauseRecv =
-                                pnode->nProcessQueueSize > nReceiveFloodSize;
-                        }
-                        WakeMessageHandler();
-                    }
-                } else if (nBytes == 0) {
-                    // socket closed gracefully
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket closed\n");
-                    }
-                    pnode->CloseSocketDisconnect();
-                } else if (nBytes < 0) {
-                    // error
-                    int nErr = WSAGetLastError();
-                    if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE &&
-                        nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                        if (!pnode->fDisconnect) {
-                            LogPrintf("socket recv error %s\n",
-                                      NetworkErrorString(nErr));
-                        }
-                        pnode->CloseSocketDisconnect();
-                    }
-                }
+                SocketRecvData(pnode);
             }
 
             //
@@ -1541,6 +1760,9 @@ void CConnman::ThreadSocketHandler() {
                     pnode->fDisconnect = true;
                 }
             }
+            if (nTime - pnode->nLastRecv > RECV_POOL_IDLE_SECONDS) {
+                pnode->ReleaseRecvPool();
+            }
         }
         {
             LOCK(cs_vNodes);
@@ -1551,6 +1773,109 @@ void CConnman::ThreadSocketHandler() {
     }
 }
 
+void CConnman::ThreadNetIO(NetThread &netThread) {
+    std::vector<NetPoller::Event> events;
+    // Peers to read from without waiting for a new edge: paused, held back
+    // while they have data queued to send, or not read to the end yet
+    std::set<NodeId> setRecv;
+    bool fMoreToRead = false;
+    while (!interruptNet) {
+        if (!netThread.poller.Wait(events,
+                                   fMoreToRead ? 0 : SOCKET_WAIT_MILLIS)) {
+            LogPrintf("socket epoll error %s\n",
+                      NetworkErrorString(WSAGetLastError()));
+            if (!interruptNet.sleep_for(
+                    std::chrono::milliseconds(SOCKET_WAIT_MILLIS))) {
+                return;
+            }
+            continue;
+        }
+
+        std::set<NodeId> setSend;
+        for (const NetPoller::Event &event : events) {
+            if (event.fRecv || event.fError) {
+                setRecv.insert(event.key);
+            }
+            if (event.fSend) {
+                setSend.insert(event.key);
+            }
+        }
+
+        std::set<NodeId> setReady(setRecv);
+        setReady.insert(setSend.begin(), setSend.end());
+        std::vector<CNode *> vNodesCopy;
+        {
+            LOCK(netThread.cs);
+            for (NodeId id : setReady) {
+                auto it = netThread.mapNodes.find(id);
+                if (it == netThread.mapNodes.end()) {
+                    // Gone, its socket id may already be reused
+                    setRecv.erase(id);
+                    continue;
+                }
+                it->second->AddRef();
+                vNodesCopy.push_back(it->second);
+            }
+        }
+
+        fMoreToRead = false;
+        for (CNode *pnode : vNodesCopy) {
+            if (interruptNet) {
+                break;
+            }
+            const NodeId id = pnode->GetId();
+
+            //
+            // Send
+            //
+            bool fSendQueued;
+            {
+                LOCK(pnode->cs_vSend);
+                if (setSend.count(id)) {
+                    size_t nBytes = SocketSendData(pnode);
+                    if (nBytes) {
+                        RecordBytesSent(nBytes);
+                    }
+                }
+                fSendQueued = !pnode->vSendMsg.empty();
+            }
+
+            //
+            // Receive, until the socket would block as the edge only comes
+            // back after that. Like the select() loop this waits for the
+            // peer to take what is queued for it and for the message handler
+            // to catch up first.
+            //
+            if (!setRecv.count(id)) {
+                continue;
+            }
+            if (pnode->fDisconnect) {
+                setRecv.erase(id);
+                continue;
+            }
+            if (fSendQueued || pnode->fPauseRecv) {
+                continue;
+            }
+            int nBytes = 0;
+            for (int i = 0; i < MAX_NET_THREAD_READS; i++) {
+                nBytes = SocketRecvData(pnode);
+                if (nBytes <= 0 || pnode->fPauseRecv) {
+                    break;
+                }
+            }
+            if (nBytes <= 0) {
+                setRecv.erase(id);
+            } else if (!pnode->fPauseRecv) {
+                fMoreToRead = true;
+            }
+        }
+
+        for (CNode *pnode : vNodesCopy) {
+            pnode->Release();
+        }
+    }
+}
+
 void CConnman::WakeMessageHandler() {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
@@ -2136,6 +2461,7 @@ void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     }
 
     m_msgproc->InitializeNode(*config, pnode);
+    AddToNetThread(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -2155,6 +2481,8 @@ void CConnman::ThreadMessageHandler() {
 
         bool fMoreWork = false;
 
+        m_msgproc->PrepareMessages(*config, vNodesCopy);
+
         for (CNode *pnode : vNodesCopy) {
             if (pnode->fDisconnect) {
                 continue;
@@ -2494,6 +2822,35 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
         fMsgProcWake = false;
     }
 
+    // Serve the peer sockets from threads of their own with epoll, or else
+    // select() over them in the socket handler thread
+    vNetThreads.clear();
+    if (nNetThreads >= 0 && NetPoller::Available()) {
+        int nThreads = nNetThreads ? nNetThreads : GetNumCores();
+        nThreads = std::max(1, std::min(nThreads, MAX_NET_THREADS));
+        for (int i = 0; i < nThreads; i++) {
+            auto netThread = std::make_unique<NetThread>();
+            if (!netThread->poller.Open()) {
+                LogPrintf("Unable to use epoll (%s), serving peers with "
+                          "select()\n",
+                          NetworkErrorString(WSAGetLastError()));
+                vNetThreads.clear();
+                break;
+            }
+            vNetThreads.push_back(std::move(netThread));
+        }
+    }
+    for (auto &netThread : vNetThreads) {
+        netThread->thread = std::thread(
+            &TraceThread<std::function<void()>>, "netio",
+            std::function<void()>(std::bind(&CConnman::ThreadNetIO, this,
+                                            std::ref(*netThread))));
+    }
+    if (!vNetThreads.empty()) {
+        LogPrintf("Serving peers from %u network threads\n",
+                  vNetThreads.size());
+    }
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(
         &TraceThread<std::function<void()>>, "net",
@@ -2571,6 +2928,9 @@ void CConnman::Interrupt() {
 
     interruptNet();
     InterruptSocks5(true);
+    for (auto &netThread : vNetThreads) {
+        netThread->poller.Wake();
+    }
 
     if (semOutbound) {
         for (int i = 0; i < (nMaxOutbound + nMaxFeeler); i++) {
@@ -2601,6 +2961,11 @@ void CConnman::Stop() {
     if (threadSocketHandler.joinable()) {
         threadSocketHandler.join();
     }
+    for (auto &netThread : vNetThreads) {
+        if (netThread->thread.joinable()) {
+            netThread->thread.join();
+        }
+    }
 
     if (fAddressesInitialized) {
         DumpData();
@@ -2629,6 +2994,7 @@ void CConnman::Stop() {
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+    vNetThreads.clear();
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
@@ -2917,6 +3283,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
+    nRecvPoolBytes = 0;
 
     for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
@@ -2979,20 +3346,80 @@ bool CConnman::NodeFullyConnected(const CNode *pnode) {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
+CSharedNetMsgRef MakeSharedNetMsg(CSerializedNetMsg &&msg) {
+    auto shared = std::make_shared<CSharedNetMsg>();
+    shared->hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    shared->data = std::move(msg.data);
+    shared->command = std::move(msg.command);
+    return shared;
+}
+
+CSharedNetMsgRef CSharedNetMsgCache::Get(
+    const std::string &command, const uint256 &hash,
+    const std::function<CSerializedNetMsg()> &make) {
+    Key key(command, hash);
+    {
+        LOCK(cs);
+        auto it = mapMsgs.find(key);
+        if (it != mapMsgs.end()) {
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+    }
+
+    // Serialize without the lock, should two threads race the later one wins
+    CSharedNetMsgRef msg = MakeSharedNetMsg(make());
+    if (msg->data.size() > nMaxBytes) {
+        return msg;
+    }
+
+    LOCK(cs);
+    auto it = mapMsgs.find(key);
+    if (it != mapMsgs.end()) {
+        nBytes -= it->second->second->data.size();
+        lru.erase(it->second);
+        mapMsgs.erase(it);
+    }
+    lru.emplace_front(key, msg);
+    mapMsgs.emplace(key, lru.begin());
+    nBytes += msg->data.size();
+    while (lru.size() > nMaxEntries || nBytes > nMaxBytes) {
+        nBytes -= lru.back().second->data.size();
+        mapMsgs.erase(lru.back().first);
+        lru.pop_back();
+    }
+    return msg;
+}
+
+size_t CSharedNetMsgCache::size() const {
+    LOCK(cs);
+    return lru.size();
+}
+
+size_t CSharedNetMsgCache::DynamicMemoryUsage() const {
+    LOCK(cs);
+    return nBytes;
+}
+
 void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
-    size_t nMessageSize = msg.data.size();
+    PushMessage(pnode, MakeSharedNetMsg(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode *pnode, const CSharedNetMsgRef &msg) {
+    size_t nMessageSize = msg->data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",
-             SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
+             SanitizeString(msg->command.c_str()), nMessageSize,
+             pnode->GetId());
 
-    std::vector<uint8_t> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
-    CMessageHeader hdr(config->GetChainParams().NetMagic(), msg.command.c_str(),
-                       nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CNode::CSendMsg send;
+    send.header.reserve(CMessageHeader::HEADER_SIZE);
+    CMessageHeader hdr(config->GetChainParams().NetMagic(),
+                       msg->command.c_str(), nMessageSize);
+    memcpy(hdr.pchChecksum, msg->hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, send.header, 0, hdr};
+    send.msg = msg;
 
     size_t nBytesSent = 0;
     {
@@ -3000,16 +3427,13 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         bool optimisticSend(pnode->vSendMsg.empty());
 
         // log total amount of bytes per command
-        pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[msg->command] += nTotalSize;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
-        }
+        pnode->vSendMsg.push_back(std::move(send));
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true) {
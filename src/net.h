@@ -16,6 +16,7 @@
 #include <hash.h>
 #include <limitedmap.h>
 #include <netaddress.h>
+#include <netpoller.h>
 #include <protocol.h>
 #include <random.h>
 #include <streams.h>
@@ -28,6 +29,9 @@
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
+#include <functional>
+#include <list>
+#include <map>
 #include <memory>
 #include <thread>
 
@@ -65,6 +69,13 @@ static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 static const int MAX_OUTBOUND_CONNECTIONS = 8;
 /** Maximum number of addnode outgoing nodes */
 static const int MAX_ADDNODE_CONNECTIONS = 8;
+/**
+ * -netthreads default: serve the peer sockets with epoll, from one thread per
+ * core
+ */
+static const int DEFAULT_NET_THREADS = 0;
+/** Maximum number of threads serving the peer sockets */
+static const int MAX_NET_THREADS = 16;
 /** -listen default */
 static const bool DEFAULT_LISTEN = true;
 /** -upnp default */
@@ -118,6 +129,51 @@ struct CSerializedNetMsg {
     std::string command;
 };
 
+/**
+ * A serialized message and the hash its header checksum comes from, made
+ * once and shared by the send queues of all the peers it goes to.
+ */
+struct CSharedNetMsg {
+    std::vector<uint8_t> data;
+    std::string command;
+    uint256 hash;
+};
+typedef std::shared_ptr<const CSharedNetMsg> CSharedNetMsgRef;
+
+CSharedNetMsgRef MakeSharedNetMsg(CSerializedNetMsg &&msg);
+
+/**
+ * The messages relaying transactions and blocks serialized last, so that one
+ * sent to many peers is serialized once. Messages are keyed by command and by
+ * the hash of what they carry, which must decide their content. The least
+ * recently used ones go first once there are too many or they take too much
+ * memory.
+ */
+class CSharedNetMsgCache {
+public:
+    CSharedNetMsgCache(size_t nMaxEntriesIn, size_t nMaxBytesIn)
+        : nMaxEntries(nMaxEntriesIn), nMaxBytes(nMaxBytesIn), nBytes(0) {}
+
+    //! The message cached for command and hash, made with make() if needed
+    CSharedNetMsgRef Get(const std::string &command, const uint256 &hash,
+                         const std::function<CSerializedNetMsg()> &make);
+
+    size_t size() const;
+    size_t DynamicMemoryUsage() const;
+
+private:
+    typedef std::pair<std::string, uint256> Key;
+    typedef std::list<std::pair<Key, CSharedNetMsgRef>> List;
+
+    const size_t nMaxEntries;
+    const size_t nMaxBytes;
+    mutable CCriticalSection cs;
+    //! Most recently used first
+    List lru GUARDED_BY(cs);
+    std::map<Key, List::iterator> mapMsgs GUARDED_BY(cs);
+    size_t nBytes GUARDED_BY(cs);
+};
+
 class NetEventsInterface;
 class CConnman {
 public:
@@ -139,6 +195,7 @@ public:
         NetEventsInterface *m_msgproc = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        int nNetThreads = DEFAULT_NET_THREADS;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         std::vector<std::string> vSeedNodes;
@@ -161,6 +218,7 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        nNetThreads = connOptions.nNetThreads;
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -191,6 +249,8 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode *pnode)> func);
 
     void PushMessage(CNode *pnode, CSerializedNetMsg &&msg);
+    //! Queue a message that may be queued for other peers as well
+    void PushMessage(CNode *pnode, const CSharedNetMsgRef &msg);
 
     template <typename Callable> void ForEachNode(Callable &&func) {
         LOCK(cs_vNodes);
@@ -330,6 +390,19 @@ private:
             : socket(socket_), whitelisted(whitelisted_) {}
     };
 
+    /**
+     * A thread doing the socket I/O of a share of the peers, with epoll. Peers
+     * are given to one when they connect and stay with it, the socket handler
+     * thread still accepts connections and disconnects peers.
+     */
+    struct NetThread {
+        NetPoller poller;
+        std::thread thread;
+        CCriticalSection cs;
+        //! The peers served, each holding a reference
+        std::map<NodeId, CNode *> mapNodes GUARDED_BY(cs);
+    };
+
     bool BindListenPort(const CService &bindAddr, std::string &strError,
                         bool fWhitelisted = false);
     bool Bind(const CService &addr, unsigned int flags);
@@ -342,6 +415,7 @@ private:
     void ThreadMessageHandler();
     void AcceptConnection(const ListenSocket &hListenSocket);
     void ThreadSocketHandler();
+    void ThreadNetIO(NetThread &netThread);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress &ad) const;
@@ -361,6 +435,10 @@ private:
     NodeId GetNewNodeId();
 
     size_t SocketSendData(CNode *pnode) const;
+    int SocketRecvData(CNode *pnode);
+    //! Give a new peer to a net thread, if any, before it joins vNodes
+    void AddToNetThread(CNode *pnode);
+    void RemoveFromNetThread(CNode *pnode);
     //! check is the banlist has unwritten changes
     bool BannedSetIsDirty();
     //! set the "dirty" flag for the banlist
@@ -398,6 +476,10 @@ private:
 
     unsigned int nSendBufferMaxSize;
     unsigned int nReceiveFloodSize;
+    //! -netthreads: 0 for one per core, negative to select() over all peers
+    int nNetThreads;
+    //! Empty when the socket handler thread select()s over the peers itself
+    std::vector<std::unique_ptr<NetThread>> vNetThreads;
 
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive;
@@ -470,6 +552,8 @@ bool BindListenPort(const CService &bindAddr, std::string &strError,
  */
 class NetEventsInterface {
 public:
+    virtual void PrepareMessages(const Config &config,
+                                 const std::vector<CNode *> &nodes) = 0;
     virtual bool ProcessMessages(const Config &config, CNode *pnode,
                                  std::atomic<bool> &interrupt) = 0;
     virtual bool SendMessages(const Config &config, CNode *pnode,
@@ -620,6 +704,19 @@ public:
 
     int readHeader(const Config &config, const char *pch, uint32_t nBytes);
     int readData(const char *pch, uint32_t nBytes);
+
+    /**
+     * The part of the data buffer left to receive into, which the socket can
+     * be read into directly, or nullptr while the header is being read. The
+     * buffer grows by up to 256 KiB at a time rather than to the size the
+     * header announces.
+     */
+    char *GetDataBuffer(uint32_t &nSize);
+    //! Take in nBytes received into GetDataBuffer()
+    void DataReceived(uint32_t nBytes);
+
+    //! Make ready to receive a new message, keeping the data buffer
+    void Reset();
 };
 
 /** Information about a peer */
@@ -630,12 +727,20 @@ public:
     // socket
     std::atomic<ServiceFlags> nServices;
     SOCKET hSocket;
+    // A message queued to send: its header, then its payload, which other
+    // peers may share.
+    struct CSendMsg {
+        std::vector<uint8_t> header;
+        CSharedNetMsgRef msg;
+
+        size_t size() const { return header.size() + msg->data.size(); }
+    };
     // Total size of all vSendMsg entries.
     size_t nSendSize;
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset;
     uint64_t nSendBytes;
-    std::deque<std::vector<uint8_t>> vSendMsg;
+    std::deque<CSendMsg> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -644,6 +749,12 @@ public:
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
 
+    // Processed messages, with their buffers, to receive new ones into, and
+    // the capacity of those buffers
+    CCriticalSection cs_vRecvPool;
+    std::list<CNetMessage> vRecvPool;
+    size_t nRecvPoolBytes;
+
     CCriticalSection cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
@@ -774,6 +885,9 @@ private:
     // Used only by SocketHandler thread.
     std::list<CNetMessage> vRecvMsg;
 
+    CNetMessage &GetRecvMsg(const Config &config);
+    void RecvMsgComplete(CNetMessage &msg, int64_t nTimeMicros);
+
     mutable CCriticalSection cs_addrName;
     std::string addrName;
 
@@ -796,6 +910,31 @@ public:
     bool ReceiveMsgBytes(const Config &config, const char *pch, uint32_t nBytes,
                          bool &complete);
 
+    /**
+     * Where the socket can be read into directly, when a large message is
+     * being received: its data goes straight into the message buffer rather
+     * than through ReceiveMsgBytes(). Returns nullptr otherwise.
+     */
+    char *GetRecvBuffer(uint32_t &nSize);
+    //! Take in nBytes received into GetRecvBuffer()
+    void ReceiveMsgBytesInPlace(uint32_t nBytes, bool &complete);
+
+    /**
+     * Move the messages received in full to the process queue. Returns the
+     * number of bytes queued, receiving pauses once the queue holds more than
+     * nReceiveFloodSize.
+     */
+    size_t QueueReceivedMessages(size_t nReceiveFloodSize);
+
+    /**
+     * Give processed messages back to receive new ones into, saving the
+     * allocation of the message and of its buffer. Only a few are kept, none
+     * with a large buffer, and at most 256 KiB of buffers in all.
+     */
+    void RecycleMessages(std::list<CNetMessage> &msgs);
+    //! Free the recycled messages, once the peer has gone quiet
+    void ReleaseRecvPool();
+
     void SetRecvVersion(int nVersionIn) { nRecvVersion = nVersionIn; }
     int GetRecvVersion() const { return nRecvVersion; }
     void SetSendVersion(int nVersionIn);
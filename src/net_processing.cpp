@@ -5,6 +5,7 @@
 
 #include <net_processing.h>
 
+#include <limits>
 #include <memory>
 
 #include <addrman.h>
@@ -14,6 +15,7 @@
 #include <config.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <init.h>
 #include <merkleblock.h>
 #include <net.h>
@@ -84,6 +86,13 @@ static const int HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 // How many non standard orphan do we consider from a node before ignoring it.
 static const uint32_t MAX_NON_STANDARD_ORPHAN_PER_NODE = 5;
 
+/// Maximum number of compact filters that may be requested with one
+/// getcfilters. See BIP 157.
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/// Maximum number of cf hashes that may be requested with one getcfheaders.
+/// See BIP 157.
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+
 // Internal stuff
 namespace {
 /** Number of nodes with fSyncStarted. */
@@ -1022,11 +1031,25 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs>
     most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 
+//! Transactions and blocks kept serialized for relay
+static const size_t MAX_RELAY_MSG_CACHE_ENTRIES = 1024;
+static const size_t MAX_RELAY_MSG_CACHE_BYTES = 64 * 1024 * 1024;
+
+// The transactions and blocks being relayed, serialized once for all the
+// peers they go to. Their serialization doesn't depend on the peer's version,
+// so the txid or block hash decides the message.
+static CSharedNetMsgCache relayMsgCache(MAX_RELAY_MSG_CACHE_ENTRIES,
+                                        MAX_RELAY_MSG_CACHE_BYTES);
+
 void PeerLogicValidation::NewPoWValidBlock(
     const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
         std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    const CSharedNetMsgRef cmpctblockMsg = relayMsgCache.Get(
+        NetMsgType::CMPCTBLOCK, pblock->GetHash(), [&]() {
+            return msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock);
+        });
 
     LOCK(cs_main);
 
@@ -1045,11 +1068,10 @@ void PeerLogicValidation::NewPoWValidBlock(
         most_recent_compact_block = pcmpctblock;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
+    connman->ForEachNode([this, &cmpctblockMsg, pindex,
                           &hashBlock](CNode *pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
             return;
         }
@@ -1063,8 +1085,7 @@ void PeerLogicValidation::NewPoWValidBlock(
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n",
                      "PeerLogicValidation::NewPoWValidBlock",
                      hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, cmpctblockMsg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1329,10 +1350,38 @@ void static ProcessGetBlockData(const Config &config, CNode *pfrom,
     // Pruned nodes may have deleted the block, so check whether it's available
     // before trying to send.
     if (send && (mi->second->nStatus.hasData())) {
+        // If a peer is asking for old blocks, we're almost guaranteed they
+        // won't have a useful mempool to match against a compact block, and
+        // we don't feel like constructing the object for them, so instead
+        // we respond with the full, non-compact block.
+        const bool fRecent =
+            mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+        const bool fCompact = inv.type == MSG_CMPCT_BLOCK &&
+                              CanDirectFetch(consensusParams) && fRecent;
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block &&
             a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
+        } else if (inv.type == MSG_BLOCK ||
+                   (inv.type == MSG_CMPCT_BLOCK && !fCompact)) {
+            // Send the block as it is stored, without parsing it
+            auto readRawBlock = [&]() {
+                CSerializedNetMsg msg;
+                msg.command = NetMsgType::BLOCK;
+                if (!ReadRawBlockFromDisk(msg.data, (*mi).second,
+                                          config.GetChainParams().DiskMagic()))
+                    assert(!"cannot load block from disk");
+                return msg;
+            };
+            // Only blocks near the tip are asked for by many peers at once,
+            // old ones would just push them out of the cache
+            if (fRecent) {
+                connman->PushMessage(
+                    pfrom,
+                    relayMsgCache.Get(NetMsgType::BLOCK, inv.hash, readRawBlock));
+            } else {
+                connman->PushMessage(pfrom, readRawBlock());
+            }
         } else {
             // Send block from disk
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
@@ -1340,9 +1389,14 @@ void static ProcessGetBlockData(const Config &config, CNode *pfrom,
                 assert(!"cannot load block from disk");
             pblock = pblockRead;
         }
-        if (inv.type == MSG_BLOCK) {
-            connman->PushMessage(pfrom,
-                                 msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        if (!pblock) {
+            // Already sent from disk
+        } else if (inv.type == MSG_BLOCK ||
+                   (inv.type == MSG_CMPCT_BLOCK && !fCompact)) {
+            connman->PushMessage(
+                pfrom, relayMsgCache.Get(NetMsgType::BLOCK, inv.hash, [&]() {
+                    return msgMaker.Make(NetMsgType::BLOCK, *pblock);
+                }));
         } else if (inv.type == MSG_FILTERED_BLOCK) {
             bool sendMerkleBlock = false;
             CMerkleBlock merkleBlock;
@@ -1375,22 +1429,20 @@ void static ProcessGetBlockData(const Config &config, CNode *pfrom,
             // else
             // no response
         } else if (inv.type == MSG_CMPCT_BLOCK) {
-            // If a peer is asking for old blocks, we're almost guaranteed they
-            // won't have a useful mempool to match against a compact block, and
-            // we don't feel like constructing the object for them, so instead
-            // we respond with the full, non-compact block.
             int nSendFlags = 0;
-            if (CanDirectFetch(consensusParams) &&
-                mi->second->nHeight >=
-                    chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+            if (a_recent_compact_block && pblock == a_recent_block) {
+                connman->PushMessage(
+                    pfrom,
+                    relayMsgCache.Get(NetMsgType::CMPCTBLOCK, inv.hash, [&]() {
+                        return msgMaker.Make(nSendFlags,
+                                             NetMsgType::CMPCTBLOCK,
+                                             *a_recent_compact_block);
+                    }));
+            } else {
                 CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
                 connman->PushMessage(
                     pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
                                          cmpctblock));
-            } else {
-                connman->PushMessage(
-                    pfrom,
-                    msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
             }
         }
 
@@ -1437,8 +1489,10 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
             int nSendFlags = 0;
             if (mi != mapRelay.end()) {
                 connman->PushMessage(
-                    pfrom,
-                    msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
+                    pfrom, relayMsgCache.Get(NetMsgType::TX, inv.hash, [&]() {
+                        return msgMaker.Make(nSendFlags, NetMsgType::TX,
+                                             *mi->second);
+                    }));
                 push = true;
             } else if (pfrom->timeLastMempoolReq) {
                 auto txinfo = g_mempool.info(inv.hash);
@@ -1448,7 +1502,10 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
                 if (txinfo.tx && txinfo.nTime <= pfrom->timeLastMempoolReq) {
                     connman->PushMessage(
                         pfrom,
-                        msgMaker.Make(nSendFlags, NetMsgType::TX, *txinfo.tx));
+                        relayMsgCache.Get(NetMsgType::TX, inv.hash, [&]() {
+                            return msgMaker.Make(nSendFlags, NetMsgType::TX,
+                                                 *txinfo.tx);
+                        }));
                     push = true;
                 }
             }
@@ -1775,6 +1832,251 @@ static bool ProcessHeadersMessage(const Config &config, CNode *pfrom,
     return true;
 }
 
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   filter_type     The filter type the request is for. Must be
+ *                              basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to
+ *                              request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the
+ *                              request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be
+ *                              serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode *pfrom,
+                                      const CChainParams &chain_params,
+                                      BlockFilterType filter_type,
+                                      uint32_t start_height,
+                                      const uint256 &stop_hash,
+                                      uint32_t max_height_diff,
+                                      const CBlockIndex *&stop_index,
+                                      BlockFilterIndex *&filter_index) {
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET,
+                 "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and the peer would be allowed to
+        // fetch it.
+        if (!stop_index ||
+            !BlockRequestAllowed(stop_index, chain_params.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET,
+                 "peer %d sent invalid getcfilters/getcfheaders with "
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET,
+                 "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1,
+                 max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n",
+                 BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode *pfrom, CDataStream &vRecv,
+                               const CChainParams &chain_params,
+                               CConnman *connman) {
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type =
+        static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex *stop_index;
+    BlockFilterIndex *filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type,
+                                   start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index,
+                                   filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET,
+                 "Failed to find block filter in index: filter_type=%s, "
+                 "start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height,
+                 stop_hash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto &filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode *pfrom, CDataStream &vRecv,
+                                const CChainParams &chain_params,
+                                CConnman *connman) {
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type =
+        static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex *stop_index;
+    BlockFilterIndex *filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type,
+                                   start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index,
+                                   filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex *const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET,
+                     "Failed to find block filter header in index: "
+                     "filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type),
+                     prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index,
+                                             filter_hashes)) {
+        LogPrint(BCLog::NET,
+                 "Failed to find block filter hashes in index: "
+                 "filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height,
+                 stop_hash.ToString());
+        return;
+    }
+
+    connman->PushMessage(
+        pfrom, CNetMsgMaker(pfrom->GetSendVersion())
+                   .Make(NetMsgType::CFHEADERS, filter_type_ser,
+                         stop_index->GetBlockHash(), prev_header,
+                         filter_hashes));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode *pfrom, CDataStream &vRecv,
+                                const CChainParams &chain_params,
+                                CConnman *connman) {
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type =
+        static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex *stop_index;
+    BlockFilterIndex *filter_index;
+    if (!PrepareBlockFilterRequest(
+            pfrom, chain_params, filter_type, /*start_height=*/0, stop_hash,
+            /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+            stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex *block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET,
+                     "Failed to find block filter header in index: "
+                     "filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type),
+                     block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion())
+                                    .Make(NetMsgType::CFCHECKPT,
+                                          filter_type_ser,
+                                          stop_index->GetBlockHash(), headers));
+}
+
 static bool ProcessMessage(const Config &config, CNode *pfrom,
                            const std::string &strCommand, CDataStream &vRecv,
                            int64_t nTimeReceived, CConnman *connman,
@@ -3278,6 +3580,18 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         }
     }
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, chainparams, connman);
+    }
+
     else if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown
         // Command message would be undesirable as we transmit it ourselves.
@@ -3327,6 +3641,68 @@ static bool SendRejectsAndCheckIfBanned(CNode *pnode, CConnman *connman) {
     return false;
 }
 
+void PeerLogicValidation::PrepareMessages(const Config &config,
+                                          const std::vector<CNode *> &nodes) {
+    std::vector<CTransactionRef> txs;
+    std::set<TxId> setTxIds;
+    for (CNode *pnode : nodes) {
+        // Only the message ProcessMessages takes next, when it would take one
+        if (pnode->fDisconnect || pnode->fPauseSend ||
+            !pnode->fSuccessfullyConnected || !pnode->vRecvGetData.empty()) {
+            continue;
+        }
+        if (!fRelayTxes &&
+            (!pnode->fWhitelisted ||
+             !gArgs.GetBoolArg("-whitelistrelay", DEFAULT_WHITELISTRELAY))) {
+            continue;
+        }
+
+        // Only this thread takes messages off the list, so this one stays
+        const CNetMessage *msg;
+        {
+            LOCK(pnode->cs_vProcessMsg);
+            if (pnode->vProcessMsg.empty()) {
+                continue;
+            }
+            msg = &pnode->vProcessMsg.front();
+        }
+        if (msg->hdr.GetCommand() != NetMsgType::TX) {
+            continue;
+        }
+
+        CTransactionRef ptx;
+        try {
+            CDataStream vRecv(msg->vRecv);
+            vRecv.SetVersion(pnode->GetRecvVersion());
+            vRecv >> ptx;
+        } catch (const std::exception &) {
+            // ProcessMessages deals with it
+            continue;
+        }
+        if (setTxIds.insert(ptx->GetId()).second) {
+            txs.push_back(std::move(ptx));
+        }
+    }
+
+    {
+        LOCK(cs_main);
+        std::vector<CTransactionRef> vNew;
+        for (CTransactionRef &ptx : txs) {
+            if (!AlreadyHave(CInv(MSG_TX, ptx->GetId()))) {
+                vNew.push_back(std::move(ptx));
+            }
+        }
+        txs.swap(vNew);
+    }
+    if (txs.empty()) {
+        return;
+    }
+
+    // AcceptToMemoryPool gives the outcome when the messages are processed
+    std::vector<CValidationState> states;
+    PreCheckMempoolTransactions(config, g_mempool, txs, states);
+}
+
 bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
                                           std::atomic<bool> &interruptMsgProc) {
     const CChainParams &chainparams = config.GetChainParams();
@@ -3359,6 +3735,12 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
     }
 
     std::list<CNetMessage> msgs;
+    // Hand the message back to the peer to receive into once done with it
+    struct RecycleOnExit {
+        CNode *pnode;
+        std::list<CNetMessage> &msgs;
+        ~RecycleOnExit() { pnode->RecycleMessages(msgs); }
+    } recycle{pfrom, msgs};
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty()) {
@@ -3918,12 +4300,15 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                     LOCK(cs_most_recent_block);
                     if (pBestIndex) {
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(
-                                                                 *most_recent_block);
                             connman->PushMessage(
-                                                 pto,
-                                                 msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                                               cmpctblock));
+                                pto, relayMsgCache.Get(
+                                         NetMsgType::CMPCTBLOCK,
+                                         most_recent_block_hash, [&]() {
+                                             return msgMaker.Make(
+                                                 nSendFlags,
+                                                 NetMsgType::CMPCTBLOCK,
+                                                 *most_recent_compact_block);
+                                         }));
                             fGotBlockFromCache = true;
                         }
                     }
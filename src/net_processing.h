@@ -26,6 +26,8 @@ static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
  * reconstruction.
  */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
+/** Default for -peerblockfilters, serving BIP 157 filters to peers */
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 /**
  * Headers download timeout expressed in microseconds.
  * Timeout = base + per_header * (expected number of headers)
@@ -81,6 +83,13 @@ public:
     void InitializeNode(const Config &config, CNode *pnode) override;
     void FinalizeNode(const Config &config, NodeId nodeid,
                       bool &fUpdateConnectionTime) override;
+    /**
+     * Get a head start on the messages the nodes are about to have processed,
+     * for all of them at once: the transactions among them are checked in
+     * parallel, without cs_main, before they are processed one at a time.
+     */
+    void PrepareMessages(const Config &config,
+                         const std::vector<CNode *> &nodes) override;
     /**
      * Process protocol messages received from a given node.
      */
@@ -214,6 +214,28 @@ enum SOCKS5Atyp : uint8_t {
     IPV6 = 0x04,
 };
 
+/**
+ * Wait up to nTimeout milliseconds for a socket to become readable, or
+ * writable. Returns like select() does. With poll() the socket may be
+ * numbered beyond FD_SETSIZE.
+ */
+static int WaitForSocket(const SOCKET &hSocket, bool fWrite,
+                         int64_t nTimeout) {
+#ifdef USE_POLL
+    struct pollfd pollfd = {};
+    pollfd.fd = hSocket;
+    pollfd.events = fWrite ? POLLOUT : POLLIN;
+    return poll(&pollfd, 1, nTimeout);
+#else
+    struct timeval timeout = MillisToTimeval(nTimeout);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(hSocket, &fdset);
+    return select(hSocket + 1, fWrite ? nullptr : &fdset,
+                  fWrite ? &fdset : nullptr, nullptr, &timeout);
+#endif
+}
+
 /** Status codes that can be returned by InterruptibleRecv */
 enum class IntrRecvError {
     OK,
@@ -255,15 +277,13 @@ static IntrRecvError InterruptibleRecv(uint8_t *data, size_t len, int timeout,
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
                 nErr == WSAEINVAL) {
+#ifndef USE_POLL
                 if (!IsSelectableSocket(hSocket)) {
                     return IntrRecvError::NetworkError;
                 }
-                struct timeval tval =
-                    MillisToTimeval(std::min(endTime - curTime, maxWait));
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(hSocket, &fdset);
-                int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+#endif
+                int nRet = WaitForSocket(hSocket, false,
+                                         std::min(endTime - curTime, maxWait));
                 if (nRet == SOCKET_ERROR) {
                     return IntrRecvError::NetworkError;
                 }
@@ -470,12 +490,14 @@ SOCKET CreateSocket(const CService &addrConnect) {
         return INVALID_SOCKET;
     }
 
+#ifndef USE_POLL
     if (!IsSelectableSocket(hSocket)) {
         CloseSocket(hSocket);
         LogPrintf("Cannot create connection: non-selectable socket created (fd "
                   ">= FD_SETSIZE ?)\n");
         return INVALID_SOCKET;
     }
+#endif
 
 #ifdef SO_NOSIGPIPE
     int set = 1;
@@ -516,11 +538,7 @@ bool ConnectSocketDirectly(const CService &addrConnect, const SOCKET &hSocket,
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
             nErr == WSAEINVAL) {
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+            int nRet = WaitForSocket(hSocket, true, nTimeout);
             if (nRet == 0) {
                 LogPrint(BCLog::NET, "connection to %s timeout\n",
                          addrConnect.ToString());
@@ -0,0 +1,124 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <netpoller.h>
+
+#include <cassert>
+#include <cerrno>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+//! Events returned by one epoll_wait call
+static const int MAX_POLL_EVENTS = 256;
+
+NetPoller::NetPoller() : nPollFd(-1), nWakeFd(-1) {}
+
+NetPoller::~NetPoller() {
+    if (nWakeFd >= 0) {
+        close(nWakeFd);
+    }
+    if (nPollFd >= 0) {
+        close(nPollFd);
+    }
+}
+
+bool NetPoller::Available() {
+#ifdef HAVE_SYS_EPOLL_H
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool NetPoller::Open() {
+#ifdef HAVE_SYS_EPOLL_H
+    if (IsOpen()) {
+        return true;
+    }
+    nPollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (nPollFd < 0) {
+        return false;
+    }
+    nWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event event = {};
+    // Level-triggered, it stays ready until the next Wait() reads it
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_KEY;
+    if (nWakeFd < 0 ||
+        epoll_ctl(nPollFd, EPOLL_CTL_ADD, nWakeFd, &event) != 0) {
+        if (nWakeFd >= 0) {
+            close(nWakeFd);
+            nWakeFd = -1;
+        }
+        close(nPollFd);
+        nPollFd = -1;
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool NetPoller::Add(SOCKET hSocket, uint64_t key) {
+#ifdef HAVE_SYS_EPOLL_H
+    assert(key != WAKE_KEY);
+    struct epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = key;
+    return IsOpen() &&
+           epoll_ctl(nPollFd, EPOLL_CTL_ADD, hSocket, &event) == 0;
+#else
+    return false;
+#endif
+}
+
+bool NetPoller::Wait(std::vector<Event> &events, int nTimeout) {
+    events.clear();
+#ifdef HAVE_SYS_EPOLL_H
+    if (!IsOpen()) {
+        return false;
+    }
+    struct epoll_event ready[MAX_POLL_EVENTS];
+    int nReady = epoll_wait(nPollFd, ready, MAX_POLL_EVENTS, nTimeout);
+    if (nReady < 0) {
+        return errno == EINTR;
+    }
+    events.reserve(nReady);
+    for (int i = 0; i < nReady; i++) {
+        if (ready[i].data.u64 == WAKE_KEY) {
+            uint64_t count;
+            if (read(nWakeFd, &count, sizeof(count)) < 0) {
+                // Already reset by another reader
+            }
+            continue;
+        }
+        Event event;
+        event.key = ready[i].data.u64;
+        event.fRecv = ready[i].events & (EPOLLIN | EPOLLRDHUP);
+        event.fSend = ready[i].events & EPOLLOUT;
+        event.fError = ready[i].events & (EPOLLERR | EPOLLHUP);
+        events.push_back(event);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void NetPoller::Wake() {
+#ifdef HAVE_SYS_EPOLL_H
+    const uint64_t one = 1;
+    if (nWakeFd >= 0 && write(nWakeFd, &one, sizeof(one)) < 0) {
+        // The counter is saturated, a wakeup is pending anyway
+    }
+#endif
+}
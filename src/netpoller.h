@@ -0,0 +1,70 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETPOLLER_H
+#define BITCOIN_NETPOLLER_H
+
+#include <compat.h>
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * Edge-triggered readiness notification for a set of sockets, backed by
+ * epoll. Each socket is registered once under a caller chosen key, and Wait()
+ * only reports the sockets whose state changed, so its cost doesn't grow with
+ * the number of sockets registered. A socket is forgotten when it is closed.
+ *
+ * As notifications are edge-triggered, a socket that was reported readable
+ * must be read until it would block (or writable, written to until it would
+ * block) before it gets reported again.
+ *
+ * Where epoll isn't available, Open() fails and the caller keeps to select().
+ */
+class NetPoller {
+public:
+    struct Event {
+        uint64_t key;
+        //! There is data to read, or the peer shut its side down
+        bool fRecv;
+        //! There is room in the send buffer again
+        bool fSend;
+        //! The socket got an error or hung up
+        bool fError;
+    };
+
+    NetPoller();
+    ~NetPoller();
+
+    NetPoller(const NetPoller &) = delete;
+    NetPoller &operator=(const NetPoller &) = delete;
+
+    //! Whether this platform has epoll
+    static bool Available();
+
+    bool Open();
+    bool IsOpen() const { return nPollFd >= 0; }
+
+    //! Watch a socket until it is closed; key must not be WAKE_KEY
+    bool Add(SOCKET hSocket, uint64_t key);
+
+    /**
+     * Wait up to nTimeout milliseconds (0 doesn't block) for sockets to get
+     * ready, or for Wake(). Returns false on error, events otherwise holds the
+     * sockets that got ready, if any.
+     */
+    bool Wait(std::vector<Event> &events, int nTimeout);
+
+    //! Make the current or next Wait() return, from any thread
+    void Wake();
+
+    static const uint64_t WAKE_KEY = ~uint64_t(0);
+
+private:
+    int nPollFd;
+    //! eventfd registered with the others, written to by Wake()
+    int nWakeFd;
+};
+
+#endif // BITCOIN_NETPOLLER_H
@@ -0,0 +1,375 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_OPENHASHMAP_H
+#define BITCOIN_OPENHASHMAP_H
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map with open addressing, for maps with many small entries such as the
+ * coins cache.
+ *
+ * Entries are constructed in place in fixed size chunks of an arena and never
+ * move : pointers, references and iterators to an entry stay valid until it is
+ * erased, like with std::unordered_map. Erased entries are reused by the next
+ * insertions. The table itself only holds 8 bytes per slot (32 bits of the
+ * hash and the index of the entry), it is probed linearly and deletions shift
+ * the following slots back, so lookups mostly touch one cache line of the
+ * table and then the entry.
+ *
+ * Compared to std::unordered_map there is no allocation per entry, and clear()
+ * releases the arena a chunk at a time.
+ *
+ * Iteration follows the order of the entries in the arena. Erasing an entry
+ * doesn't invalidate the iterators to the other entries, an entry inserted
+ * while iterating may or may not be visited.
+ */
+template <typename K, typename V, typename Hash> class openhashmap {
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+    //! Number of entries of a chunk of the arena.
+    static const size_t CHUNK_ENTRIES = 128;
+
+private:
+    struct Chunk {
+        struct alignas(value_type) Storage {
+            unsigned char data[sizeof(value_type)];
+        };
+        Storage entries[CHUNK_ENTRIES];
+        uint64_t live[CHUNK_ENTRIES / 64] = {};
+    };
+
+    struct Slot {
+        uint32_t hash;
+        //! Index of the entry + 1, 0 for an empty slot.
+        uint32_t entry;
+    };
+
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    std::vector<Slot> m_slots;
+    //! Erased entries, to be reused.
+    std::vector<uint32_t> m_free;
+    //! Entries ever used in the arena, entries past this one are unused.
+    uint32_t m_used = 0;
+    size_t m_size = 0;
+    Hash m_hash;
+
+    static uint32_t Hash32(size_t h) { return uint32_t(h); }
+
+    size_t Mask() const { return m_slots.size() - 1; }
+
+    bool IsLive(uint32_t idx) const {
+        const Chunk &chunk = *m_chunks[idx / CHUNK_ENTRIES];
+        const size_t pos = idx % CHUNK_ENTRIES;
+        return (chunk.live[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    void SetLive(uint32_t idx, bool live) {
+        Chunk &chunk = *m_chunks[idx / CHUNK_ENTRIES];
+        const size_t pos = idx % CHUNK_ENTRIES;
+        if (live) {
+            chunk.live[pos / 64] |= uint64_t(1) << (pos % 64);
+        } else {
+            chunk.live[pos / 64] &= ~(uint64_t(1) << (pos % 64));
+        }
+    }
+
+    value_type *Entry(uint32_t idx) const {
+        return reinterpret_cast<value_type *>(
+            m_chunks[idx / CHUNK_ENTRIES]->entries[idx % CHUNK_ENTRIES].data);
+    }
+
+    //! Index of the first live entry at or after idx, m_used if none.
+    uint32_t NextLive(uint32_t idx) const {
+        while (idx < m_used && !IsLive(idx)) {
+            idx++;
+        }
+        return idx;
+    }
+
+    //! Slot of key, or the empty slot ending its probe sequence.
+    size_t FindSlot(const K &key, uint32_t hash) const {
+        const size_t mask = Mask();
+        for (size_t i = hash & mask;; i = (i + 1) & mask) {
+            const Slot &slot = m_slots[i];
+            if (slot.entry == 0 ||
+                (slot.hash == hash && Entry(slot.entry - 1)->first == key)) {
+                return i;
+            }
+        }
+    }
+
+    void Rehash(size_t capacity) {
+        std::vector<Slot> slots(capacity, Slot{0, 0});
+        const size_t mask = capacity - 1;
+        for (const Slot &slot : m_slots) {
+            if (slot.entry == 0) {
+                continue;
+            }
+            size_t i = slot.hash & mask;
+            while (slots[i].entry != 0) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+        m_slots.swap(slots);
+    }
+
+    //! Keep the load factor under 3/4 after one more insertion.
+    void Reserve() {
+        if (m_slots.empty()) {
+            Rehash(16);
+        } else if ((m_size + 1) * 4 > m_slots.size() * 3) {
+            Rehash(m_slots.size() * 2);
+        }
+    }
+
+    uint32_t AllocateEntry() {
+        if (!m_free.empty()) {
+            const uint32_t idx = m_free.back();
+            m_free.pop_back();
+            return idx;
+        }
+        assert(m_used < std::numeric_limits<uint32_t>::max());
+        if (m_used == m_chunks.size() * CHUNK_ENTRIES) {
+            m_chunks.emplace_back(new Chunk());
+        }
+        return m_used++;
+    }
+
+    //! Remove slot i from the table, shifting back the slots probed after it.
+    void EraseSlot(size_t i) {
+        const size_t mask = Mask();
+        for (size_t j = (i + 1) & mask; m_slots[j].entry != 0;
+             j = (j + 1) & mask) {
+            const size_t home = m_slots[j].hash & mask;
+            // Slot j stays if its home is cyclically in (i, j].
+            if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) {
+                continue;
+            }
+            m_slots[i] = m_slots[j];
+            i = j;
+        }
+        m_slots[i] = Slot{0, 0};
+    }
+
+    template <bool Const> class iterator_base {
+        typedef typename std::conditional<Const, const openhashmap *,
+                                          openhashmap *>::type map_pointer;
+
+        map_pointer m_map;
+        uint32_t m_idx;
+
+        friend class openhashmap;
+        template <bool> friend class iterator_base;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename openhashmap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const value_type *,
+                                          value_type *>::type pointer;
+        typedef typename std::conditional<Const, const value_type &,
+                                          value_type &>::type reference;
+
+        iterator_base() : m_map(nullptr), m_idx(0) {}
+        iterator_base(map_pointer map, uint32_t idx) : m_map(map), m_idx(idx) {}
+        // Conversion from iterator to const_iterator.
+        template <bool C, typename = typename std::enable_if<Const && !C>::type>
+        iterator_base(const iterator_base<C> &it)
+            : m_map(it.m_map), m_idx(it.m_idx) {}
+
+        reference operator*() const { return *m_map->Entry(m_idx); }
+        pointer operator->() const { return m_map->Entry(m_idx); }
+
+        iterator_base &operator++() {
+            m_idx = m_map->NextLive(m_idx + 1);
+            return *this;
+        }
+        iterator_base operator++(int) {
+            iterator_base copy(*this);
+            ++(*this);
+            return copy;
+        }
+
+        bool operator==(const iterator_base &it) const {
+            return m_idx == it.m_idx;
+        }
+        bool operator!=(const iterator_base &it) const {
+            return m_idx != it.m_idx;
+        }
+    };
+
+public:
+    typedef iterator_base<false> iterator;
+    typedef iterator_base<true> const_iterator;
+
+    openhashmap() {}
+    ~openhashmap() { clear(); }
+
+    openhashmap(const openhashmap &) = delete;
+    openhashmap &operator=(const openhashmap &) = delete;
+
+    iterator begin() { return iterator(this, NextLive(0)); }
+    iterator end() { return iterator(this, m_used); }
+    const_iterator begin() const { return const_iterator(this, NextLive(0)); }
+    const_iterator end() const { return const_iterator(this, m_used); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    iterator find(const K &key) {
+        if (m_size == 0) {
+            return end();
+        }
+        const Slot &slot = m_slots[FindSlot(key, Hash32(m_hash(key)))];
+        return slot.entry == 0 ? end() : iterator(this, slot.entry - 1);
+    }
+
+    const_iterator find(const K &key) const {
+        return const_cast<openhashmap *>(this)->find(key);
+    }
+
+    size_t count(const K &key) const { return find(key) != end(); }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(std::piecewise_construct_t pc,
+                                      std::tuple<const K &> key,
+                                      Args &&... args) {
+        Reserve();
+        const K &k = std::get<0>(key);
+        const uint32_t hash = Hash32(m_hash(k));
+        Slot &slot = m_slots[FindSlot(k, hash)];
+        if (slot.entry != 0) {
+            return std::make_pair(iterator(this, slot.entry - 1), false);
+        }
+        const uint32_t idx = AllocateEntry();
+        try {
+            new (Entry(idx)) value_type(pc, key, std::forward<Args>(args)...);
+        } catch (...) {
+            m_free.push_back(idx);
+            throw;
+        }
+        SetLive(idx, true);
+        slot = Slot{hash, idx + 1};
+        m_size++;
+        return std::make_pair(iterator(this, idx), true);
+    }
+
+    template <typename T>
+    std::pair<iterator, bool> emplace(const K &key, T &&value) {
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                       std::forward_as_tuple(std::forward<T>(value)));
+    }
+
+    V &operator[](const K &key) {
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                       std::forward_as_tuple())
+            .first->second;
+    }
+
+    void erase(const_iterator it) {
+        const uint32_t idx = it.m_idx;
+        value_type *entry = Entry(idx);
+        EraseSlot(FindSlot(entry->first, Hash32(m_hash(entry->first))));
+        entry->~value_type();
+        SetLive(idx, false);
+        m_free.push_back(idx);
+        m_size--;
+    }
+
+    size_t erase(const K &key) {
+        const_iterator it = find(key);
+        if (it == end()) {
+            return 0;
+        }
+        erase(it);
+        return 1;
+    }
+
+    /**
+     * Destroy every entry and release the arena and the table. The arena is
+     * released a chunk at a time, not an entry at a time.
+     */
+    void clear() {
+        for (uint32_t idx = NextLive(0); idx < m_used;
+             idx = NextLive(idx + 1)) {
+            Entry(idx)->~value_type();
+        }
+        std::vector<std::unique_ptr<Chunk>>().swap(m_chunks);
+        std::vector<Slot>().swap(m_slots);
+        std::vector<uint32_t>().swap(m_free);
+        m_used = 0;
+        m_size = 0;
+    }
+
+    /**
+     * Move the entries to an arena and a table sized for them, giving back
+     * the memory of the erased entries. Unlike the other operations, this
+     * invalidates the iterators and references to every entry.
+     */
+    void shrink_to_fit() {
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        chunks.swap(m_chunks);
+        const uint32_t used = m_used;
+        const size_t size = m_size;
+        std::vector<Slot>().swap(m_slots);
+        std::vector<uint32_t>().swap(m_free);
+        m_used = 0;
+        m_size = 0;
+        if (size == 0) {
+            return;
+        }
+
+        size_t capacity = 16;
+        while (size * 4 > capacity * 3) {
+            capacity *= 2;
+        }
+        m_slots.assign(capacity, Slot{0, 0});
+        m_chunks.reserve((size + CHUNK_ENTRIES - 1) / CHUNK_ENTRIES);
+        for (uint32_t idx = 0; idx < used; idx++) {
+            std::unique_ptr<Chunk> &chunk = chunks[idx / CHUNK_ENTRIES];
+            const size_t pos = idx % CHUNK_ENTRIES;
+            if ((chunk->live[pos / 64] >> (pos % 64)) & 1) {
+                value_type *entry =
+                    reinterpret_cast<value_type *>(chunk->entries[pos].data);
+                emplace(std::piecewise_construct,
+                        std::forward_as_tuple(entry->first),
+                        std::forward_as_tuple(std::move(entry->second)));
+                entry->~value_type();
+            }
+            // Release the old chunks as soon as they are moved.
+            if (pos == CHUNK_ENTRIES - 1 || idx == used - 1) {
+                chunk.reset();
+            }
+        }
+    }
+
+    //! Sizes of the heap allocations, for memusage::DynamicUsage.
+    size_t ChunkBytes() const { return sizeof(Chunk); }
+    size_t ChunkCount() const { return m_chunks.size(); }
+    size_t ChunkVectorBytes() const {
+        return m_chunks.capacity() * sizeof(std::unique_ptr<Chunk>);
+    }
+    size_t TableBytes() const { return m_slots.capacity() * sizeof(Slot); }
+    size_t FreeListBytes() const { return m_free.capacity() * sizeof(uint32_t); }
+};
+
+#endif // BITCOIN_OPENHASHMAP_H
@@ -8,6 +8,8 @@
 #include <secp256k1_recovery.h>
 #include <secp256k1_schnorr.h>
 
+#include <algorithm>
+
 namespace {
 /* Global secp256k1_context object used for verification. */
 secp256k1_context *secp256k1_context_verify = nullptr;
@@ -212,6 +214,46 @@ bool CPubKey::VerifySchnorr(const uint256 &hash,
                                     hash.begin(), &pubkey);
 }
 
+bool CSchnorrBatch::Add(const CPubKey &pubkey, const uint256 &hash,
+                        const std::vector<uint8_t> &vchSig) {
+    if (!pubkey.IsValid() || vchSig.size() != 64) {
+        return false;
+    }
+
+    entries.emplace_back();
+    Entry &entry = entries.back();
+    entry.pubkey = pubkey;
+    entry.hash = hash;
+    std::copy(vchSig.begin(), vchSig.end(), entry.sig);
+    return true;
+}
+
+bool CSchnorrBatch::Verify() const {
+    if (entries.empty()) {
+        return true;
+    }
+
+    std::vector<secp256k1_pubkey> pubkeys(entries.size());
+    std::vector<const uint8_t *> sigs(entries.size());
+    std::vector<const uint8_t *> hashes(entries.size());
+    std::vector<const secp256k1_pubkey *> pubkeyPtrs(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        const Entry &entry = entries[i];
+        if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkeys[i],
+                                       entry.pubkey.begin(),
+                                       entry.pubkey.size())) {
+            return false;
+        }
+        sigs[i] = entry.sig;
+        hashes[i] = entry.hash.begin();
+        pubkeyPtrs[i] = &pubkeys[i];
+    }
+
+    return secp256k1_schnorr_verify_batch(secp256k1_context_verify,
+                                          sigs.data(), hashes.data(),
+                                          pubkeyPtrs.data(), entries.size());
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash,
                              const std::vector<uint8_t> &vchSig) {
     if (vchSig.size() != 65) {
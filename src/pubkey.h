@@ -176,6 +176,36 @@ public:
                 const ChainCode &cc) const;
 };
 
+/**
+ * Schnorr signatures which are verified together, see
+ * secp256k1_schnorr_verify_batch. This is faster than verifying them one by
+ * one, but doesn't tell which signature is invalid.
+ */
+class CSchnorrBatch {
+private:
+    struct Entry {
+        CPubKey pubkey;
+        uint256 hash;
+        uint8_t sig[64];
+    };
+    std::vector<Entry> entries;
+
+public:
+    /**
+     * Add a Schnorr signature (=64 bytes) to the batch. Returns false, and
+     * doesn't add it, if the signature can't be valid.
+     */
+    bool Add(const CPubKey &pubkey, const uint256 &hash,
+             const std::vector<uint8_t> &vchSig);
+
+    //! Verify the whole batch, true if every signature in it is valid.
+    bool Verify() const;
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    void clear() { entries.clear(); }
+};
+
 struct CExtPubKey {
     uint8_t nDepth;
     uint8_t vchFingerprint[4];
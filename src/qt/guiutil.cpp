@@ -938,6 +938,9 @@ QString formatServicesStr(quint64 mask) {
                 case NODE_XTHIN:
                     strList.append("XTHIN");
                     break;
+                case NODE_COMPACT_FILTERS:
+                    strList.append("COMPACT_FILTERS");
+                    break;
                 case NODE_NETWORK_LIMITED:
                     strList.append("LIMITED");
                     break;
@@ -8,6 +8,7 @@
 #include <config.h>
 #include <core_io.h>
 #include <httpserver.h>
+#include <index/blockfilterindex.h>
 #include <index/txindex.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
@@ -27,6 +28,8 @@
 
 // Allow a max of 15 outpoints to be queried at once.
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15;
+// Allow a max of 2000 headers or filter headers to be queried at once.
+static const size_t MAX_REST_HEADERS_RESULTS = 2000;
 
 enum class RetFormat {
     UNDEF,
@@ -230,7 +233,6 @@ static bool rest_block(const Config &config, HTTPRequest *req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
     }
 
-    CBlock block;
     CBlockIndex *pblockindex = nullptr;
     CBlockIndex *tip = nullptr;
     {
@@ -241,38 +243,38 @@ static bool rest_block(const Config &config, HTTPRequest *req,
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
         }
 
-        pblockindex = mapBlockIndex[hash];
         if (fHavePruned && !pblockindex->nStatus.hasData() &&
             pblockindex->nTx > 0) {
             return RESTERR(req, HTTP_NOT_FOUND,
                            hashStr + " not available (pruned data)");
         }
-
-        if (!ReadBlockFromDisk(block, pblockindex, config)) {
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-        }
     }
 
-    CDataStream ssBlock(SER_NETWORK,
-                        PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
-
     switch (rf) {
-        case RetFormat::BINARY: {
-            std::string binaryBlock = ssBlock.str();
-            req->WriteHeader("Content-Type", "application/octet-stream");
-            req->WriteReply(HTTP_OK, binaryBlock);
-            return true;
-        }
-
+        case RetFormat::BINARY:
         case RetFormat::HEX: {
-            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
-            req->WriteHeader("Content-Type", "text/plain");
-            req->WriteReply(HTTP_OK, strHex);
+            // Blocks are stored the way they are sent, no need to parse them
+            std::vector<uint8_t> rawBlock;
+            if (!ReadRawBlockFromDisk(rawBlock, pblockindex,
+                                      config.GetChainParams().DiskMagic())) {
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            }
+            if (rf == RetFormat::BINARY) {
+                req->WriteHeader("Content-Type", "application/octet-stream");
+                req->WriteReply(HTTP_OK, std::string(rawBlock.begin(),
+                                                     rawBlock.end()));
+            } else {
+                req->WriteHeader("Content-Type", "text/plain");
+                req->WriteReply(HTTP_OK, HexStr(rawBlock) + "\n");
+            }
             return true;
         }
 
         case RetFormat::JSON: {
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pblockindex, config)) {
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            }
             UniValue objBlock =
                 blockToJSON(block, tip, pblockindex, showTxDetails);
             std::string strJSON = objBlock.write() + "\n";
@@ -303,6 +305,229 @@ static bool rest_block_notxdetails(Config &config, HTTPRequest *req,
     return rest_block(config, req, strURIPart, false);
 }
 
+static bool rest_filter_header(Config &config, HTTPRequest *req,
+                               const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    std::vector<std::string> uri_parts;
+    Split(uri_parts, param, "/");
+    if (uri_parts.size() != 3) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Invalid URI format. Expected "
+                       "/rest/blockfilterheaders/<filtertype>/<count>/"
+                       "<blockhash>.<ext>");
+    }
+
+    uint256 block_hash;
+    if (!ParseHashStr(uri_parts[2], block_hash)) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + uri_parts[2]);
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(uri_parts[0], filtertype)) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Unknown filtertype " + uri_parts[0]);
+    }
+
+    BlockFilterIndex *index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Index is not enabled for filtertype " + uri_parts[0]);
+    }
+
+    long count = strtol(uri_parts[1].c_str(), nullptr, 10);
+    if (count < 1 || size_t(count) > MAX_REST_HEADERS_RESULTS) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       strprintf("Header count out of acceptable range "
+                                 "(1-%u): %s",
+                                 MAX_REST_HEADERS_RESULTS, uri_parts[1]));
+    }
+
+    std::vector<const CBlockIndex *> headers;
+    headers.reserve(count);
+    {
+        LOCK(cs_main);
+        const CBlockIndex *pindex = LookupBlockIndex(block_hash);
+        while (pindex != nullptr && chainActive.Contains(pindex)) {
+            headers.push_back(pindex);
+            if (headers.size() == size_t(count)) {
+                break;
+            }
+            pindex = chainActive.Next(pindex);
+        }
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    std::vector<uint256> filter_headers;
+    filter_headers.reserve(count);
+    for (const CBlockIndex *pindex : headers) {
+        uint256 filter_header;
+        if (!index->LookupFilterHeader(pindex, filter_header)) {
+            std::string errmsg = "Filter not found.";
+
+            if (!index_ready) {
+                errmsg += " Block filters are still in the process of being "
+                          "indexed.";
+            } else {
+                errmsg += " This error is unexpected and indicates index "
+                          "corruption.";
+            }
+
+            return RESTERR(req, HTTP_NOT_FOUND, errmsg);
+        }
+        filter_headers.push_back(filter_header);
+    }
+
+    switch (rf) {
+        case RetFormat::BINARY: {
+            CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+            for (const uint256 &header : filter_headers) {
+                ssHeader << header;
+            }
+
+            std::string binaryHeader = ssHeader.str();
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, binaryHeader);
+            return true;
+        }
+        case RetFormat::HEX: {
+            CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+            for (const uint256 &header : filter_headers) {
+                ssHeader << header;
+            }
+
+            std::string strHex =
+                HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+            return true;
+        }
+        case RetFormat::JSON: {
+            UniValue jsonHeaders(UniValue::VARR);
+            for (const uint256 &header : filter_headers) {
+                jsonHeaders.push_back(header.GetHex());
+            }
+
+            std::string strJSON = jsonHeaders.write() + "\n";
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strJSON);
+            return true;
+        }
+        default: {
+            return RESTERR(req, HTTP_NOT_FOUND,
+                           "output format not found (available: " +
+                               AvailableDataFormatsString() + ")");
+        }
+    }
+}
+
+static bool rest_block_filter(Config &config, HTTPRequest *req,
+                              const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // request is sent over URI scheme
+    // /rest/blockfilter/filtertype/blockhash
+    std::vector<std::string> uri_parts;
+    Split(uri_parts, param, "/");
+    if (uri_parts.size() != 2) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Invalid URI format. Expected "
+                       "/rest/blockfilter/<filtertype>/<blockhash>");
+    }
+
+    uint256 block_hash;
+    if (!ParseHashStr(uri_parts[1], block_hash)) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + uri_parts[1]);
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(uri_parts[0], filtertype)) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Unknown filtertype " + uri_parts[0]);
+    }
+
+    BlockFilterIndex *index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       "Index is not enabled for filtertype " + uri_parts[0]);
+    }
+
+    const CBlockIndex *block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            return RESTERR(req, HTTP_NOT_FOUND, uri_parts[1] + " not found");
+        }
+        block_was_connected = block_index->IsValid(BlockValidity::SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    if (!index->LookupFilter(block_index, filter)) {
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            errmsg +=
+                " Block filters are still in the process of being indexed.";
+        } else {
+            errmsg +=
+                " This error is unexpected and indicates index corruption.";
+        }
+
+        return RESTERR(req, HTTP_NOT_FOUND, errmsg);
+    }
+
+    switch (rf) {
+        case RetFormat::BINARY: {
+            CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+            ssResp << filter;
+
+            std::string binaryResp = ssResp.str();
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, binaryResp);
+            return true;
+        }
+        case RetFormat::HEX: {
+            CDataStream ssResp(SER_NETWORK, PROTOCOL_VERSION);
+            ssResp << filter;
+
+            std::string strHex = HexStr(ssResp.begin(), ssResp.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+            return true;
+        }
+        case RetFormat::JSON: {
+            UniValue ret(UniValue::VOBJ);
+            ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+            std::string strJSON = ret.write() + "\n";
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strJSON);
+            return true;
+        }
+        default: {
+            return RESTERR(req, HTTP_NOT_FOUND,
+                           "output format not found (available: " +
+                               AvailableDataFormatsString() + ")");
+        }
+    }
+}
+
 static bool rest_chaininfo(Config &config, HTTPRequest *req,
                            const std::string &strURIPart) {
     if (!CheckWarmup(req)) {
@@ -683,6 +908,8 @@ static const struct {
 } uri_prefixes[] = {
     {"/rest/tx/", rest_tx},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
+    {"/rest/blockfilter/", rest_block_filter},
+    {"/rest/blockfilterheaders/", rest_filter_header},
     {"/rest/block/", rest_block_extended},
     {"/rest/chaininfo", rest_chaininfo},
     {"/rest/mempool/info", rest_mempool_info},
@@ -10,10 +10,15 @@
 #include <chainparams.h>
 #include <checkpoints.h>
 #include <coins.h>
+#include <coinstats.h>
 #include <config.h>
 #include <consensus/validation.h>
 #include <core_io.h>
+#include <fs_util.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
+#include <index/timestampindex.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
@@ -21,6 +26,7 @@
 #include <script/script_error.h>
 #include <script/sign.h>
 #include <script/standard.h>
+#include <snapshot.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -893,18 +899,19 @@ UniValue getblockhashes(const JSONRPCRequest& request)
         }
     }
 
-    std::vector<std::pair<uint256, unsigned int> > blockHashes;
+    std::vector<std::pair<uint256, uint32_t> > blockHashes;
     
-    if (fActiveOnly)
-        LOCK(cs_main);
-    
-    if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
+    if (!g_timestampindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Timestamp index not enabled (-timestampindex)");
+    }
+    g_timestampindex->BlockUntilSyncedToCurrentChain();
+    if (!g_timestampindex->FindBlockHashes(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
 
     UniValue result(UniValue::VARR);
     
-    for (std::vector<std::pair<uint256, unsigned int> >::const_iterator it=blockHashes.begin(); it!=blockHashes.end(); it++) {
+    for (std::vector<std::pair<uint256, uint32_t> >::const_iterator it=blockHashes.begin(); it!=blockHashes.end(); it++) {
         if (fLogicalTS) {
             UniValue item(UniValue::VOBJ);
             item.push_back(Pair("blockhash", it->first.GetHex()));
@@ -1228,80 +1235,6 @@ static UniValue getblock(const Config &config, const JSONRPCRequest &request) {
     return blockToJSON(block, chainActive.Tip(), pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats {
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    Amount nTotalAmount;
-
-    CCoinsStats()
-        : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0),
-          nDiskSize(0), nTotalAmount() {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter &ss, const uint256 &hash,
-                       const std::map<uint32_t, Coin> &outputs) {
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.GetHeight() * 2 +
-                 outputs.begin()->second.IsCoinBase());
-    stats.nTransactions++;
-    for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.GetTxOut().scriptPubKey;
-        ss << VARINT(output.second.GetTxOut().nValue.toInt());
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.GetTxOut().nValue;
-        stats.nBogoSize +=
-            32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ +
-            8 /* amount */ + 2 /* scriptPubKey len */ +
-            output.second.GetTxOut().scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats) {
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        interruption_point(ShutdownRequested());
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.GetTxId() != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.GetTxId();
-            outputs[key.GetN()] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 static UniValue pruneblockchain(const Config &config,
                                 const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 1) {
@@ -1368,43 +1301,137 @@ static UniValue pruneblockchain(const Config &config,
 
 static UniValue gettxoutsetinfo(const Config &config,
                                 const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() != 0) {
+    if (request.fHelp || request.params.size() > 3) {
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height use_index )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time without the coin stats index "
+            "(-coinstatsindex).\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"      (string, optional, "
+            "default=hash_serialized) Which UTXO set hash should be "
+            "calculated: \"hash_serialized\" (full scan only), \"ecmh\" or "
+            "\"none\"\n"
+            "2. hash_or_height   (string or numeric, optional) The block hash "
+            "or height of the target block, only with the coin stats index\n"
+            "3. use_index        (boolean, optional, default=true) Use the "
+            "coin stats index where it is available\n"
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"height\":n,     (numeric) The block height (index) of the "
+            "returned statistics\n"
+            "  \"bestblock\": \"hex\",   (string) The hash of the block at "
+            "which these statistics are calculated\n"
+            "  \"transactions\": n,      (numeric) The number of transactions "
+            "(not available with the index)\n"
             "  \"txouts\": n,            (numeric) The number of output "
             "transactions\n"
             "  \"bogosize\": n,          (numeric) A database-independent "
             "metric for UTXO set size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The serialized hash "
+            "(only with hash_type hash_serialized)\n"
+            "  \"ecmh\": \"hash\",        (string) The ECMH commitment to the "
+            "set (only with hash_type ecmh)\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the "
-            "chainstate on disk\n"
+            "chainstate on disk (not available with the index)\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
+            "  \"total_unspendable_amount\": x.xxx (numeric) The total amount "
+            "sent to unspendable outputs (only with the index)\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("gettxoutsetinfo", "") +
-            HelpExampleRpc("gettxoutsetinfo", ""));
+            HelpExampleCli("gettxoutsetinfo", "\"none\"") +
+            HelpExampleCli("gettxoutsetinfo", "\"none\" 1000") +
+            HelpExampleCli(
+                "gettxoutsetinfo",
+                "\"ecmh\" '\"00000000c937983704a73af28acdec37b049d214adbda81d7"
+                "e2a3dd146f6ed09\"'") +
+            HelpExampleRpc("gettxoutsetinfo", "") +
+            HelpExampleRpc("gettxoutsetinfo", "\"none\", 1000"));
     }
 
     UniValue ret(UniValue::VOBJ);
 
+    CoinStatsHashType hash_type = CoinStatsHashType::HASH_SERIALIZED;
+    if (!request.params[0].isNull() &&
+        !CoinStatsHashTypeFromName(request.params[0].get_str(), hash_type)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           strprintf("%s is not a valid hash_type",
+                                     request.params[0].get_str()));
+    }
+    const bool index_requested =
+        request.params[2].isNull() || request.params[2].get_bool();
+
+    const CBlockIndex *pindex = nullptr;
+    if (!request.params[1].isNull()) {
+        if (!g_coin_stats_index) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Querying specific block heights requires "
+                               "coinstatsindex");
+        }
+        if (!index_requested) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Querying specific block heights requires "
+                               "use_index");
+        }
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "hash_serialized hash type cannot be queried "
+                               "for a specific block");
+        }
+
+        LOCK(cs_main);
+        if (request.params[1].isNum()) {
+            const int height = request.params[1].get_int();
+            if (height < 0 || height > chainActive.Height()) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER,
+                                   "Block height out of range");
+            }
+            pindex = chainActive[height];
+        } else {
+            pindex = LookupBlockIndex(ParseHashV(request.params[1],
+                                                 "hash_or_height"));
+            if (!pindex) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                                   "Block not found");
+            }
+        }
+    }
+
+    if (g_coin_stats_index && index_requested) {
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+    }
+    if (!pindex) {
+        FlushStateToDisk();
+    }
+
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+    if (GetUTXOStats(pcoinsdbview.get(), stats, hash_type, pindex,
+                     index_requested)) {
         ret.pushKV("height", int64_t(stats.nHeight));
         ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", int64_t(stats.nTransactions));
+        if (!stats.index_used) {
+            ret.pushKV("transactions", int64_t(stats.nTransactions));
+        }
         ret.pushKV("txouts", int64_t(stats.nTransactionOutputs));
         ret.pushKV("bogosize", int64_t(stats.nBogoSize));
-        ret.pushKV("hash_serialized", stats.hashSerialized.GetHex());
-        ret.pushKV("disk_size", stats.nDiskSize);
+        if (hash_type == CoinStatsHashType::HASH_SERIALIZED) {
+            ret.pushKV("hash_serialized", stats.hashSerialized.GetHex());
+        } else if (hash_type == CoinStatsHashType::ECMH) {
+            ret.pushKV("ecmh", stats.hashSerialized.GetHex());
+        }
+        if (!stats.index_used) {
+            ret.pushKV("disk_size", stats.nDiskSize);
+        }
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+        if (stats.index_used) {
+            ret.pushKV("total_unspendable_amount",
+                       ValueFromAmount(stats.nTotalUnspendableAmount));
+        }
+    } else if (pindex) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR,
+                           "Unable to read UTXO set, the coin stats index may "
+                           "still be syncing");
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
@@ -1572,6 +1599,10 @@ UniValue getblockchaininfo(const Config &config,
             HelpExampleRpc("getblockchaininfo", ""));
     }
 
+    if (g_coin_stats_index) {
+        g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+    }
+
     LOCK(cs_main);
 
     const CBlockIndex *tip = chainActive.Tip();
@@ -1588,9 +1619,17 @@ UniValue getblockchaininfo(const Config &config,
     obj.pushKV("chainwork", tip->nChainWork.GetHex());
     //    obj.pushKV("size_on_disk", CalculateCurrentUsage());
 
+    // The coin stats index has the supply at the tip without flushing and
+    // scanning the chainstate
     CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+    bool fStats =
+        g_coin_stats_index && g_coin_stats_index->LookUpStats(tip, stats);
+    if (!fStats) {
+        FlushStateToDisk();
+        fStats = GetUTXOStats(pcoinsdbview.get(), stats,
+                              CoinStatsHashType::NONE);
+    }
+    if (fStats) {
       obj.pushKV("coinsupply", ValueFromAmount(stats.nTotalAmount));
     }
  
@@ -2137,119 +2176,248 @@ static UniValue getrewardinfo(const Config &config, const JSONRPCRequest &reques
                                  "  \"count\"  (string) The total number of viable reward utxos\n"
                                  "  \"payouts\"  (string) The total number of time that rewards were paid out for current set\n"
                                  "  \"ratio\"  (string) % of coin supply in reward utxos (truncated to integer)\n"
+                                 "  \"Total Coins issued\"  (numeric) Mining, budget and cold rewards paid to date. Unlike\n"
+                                 "                       the UTXO set total, it does not go down when coins are burned\n"
                                  "}\n"
                                  "\nExamples:\n"
                                  + HelpExampleCli("getrewardinfo","")
                                  + HelpExampleRpc("getrewardinfo",""));
     
 
-    std::vector<CRewardValue> rewards = prewards->GetOrderedRewards();
-    UniValue result(UniValue::VOBJ);
+    // Running totals, kept up to date by block connect/disconnect
+    CRewardStats stats = prewards->GetStats();
+    if (!stats.IsKnown()) {
+        // Rewards DB from an older version : compute the totals from the chainstate once
+        if (g_coin_stats_index) {
+            g_coin_stats_index->BlockUntilSyncedToCurrentChain();
+        }
+        LOCK(cs_main);
+        stats = prewards->GetStats();
+        if (!stats.IsKnown()) {
+            CCoinsStats coinstats;
+            if (!g_coin_stats_index || !g_coin_stats_index->LookUpStats(chainActive.Tip(), coinstats)) {
+                FlushStateToDisk();
+                if (!GetUTXOStats(pcoinsdbview.get(), coinstats, CoinStatsHashType::NONE)) {
+                    throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+                }
+            }
 
-    Amount sum;
-    int count=0;
-    int total_payouts=0;
-    for (auto& val : rewards) {
-      if (val.IsActive()) {
-        sum = sum + val.GetValue();
-        count++;
-        total_payouts += val.GetPayCount();
-      }
+            Amount nMiningRewards;
+            Amount nSuperBlockRewards;
+            CBudget bud(config);
+            auto Params = config.GetChainParams().GetConsensus();
+            for (int i=1;i<=coinstats.nHeight;i++) {
+                Amount nBlockSubsidy = GetBlockSubsidy(i, Params);
+                nMiningRewards += nBlockSubsidy;
+                if (bud.IsSuperBlock(i)) {
+                    nSuperBlockRewards += bud.CalculateSuperBlockRewards(i, nBlockSubsidy);
+                }
+            }
+            Amount nCold = coinstats.nTotalAmount - nMiningRewards - nSuperBlockRewards;
+            prewards->SeedStats(coinstats.nHeight, nMiningRewards, nSuperBlockRewards, nCold);
+            stats = prewards->GetStats();
+        }
     }
 
     UniValue reply(UniValue::VOBJ);
-    reply.pushKV("Current number of viable rewards", count);
-    reply.pushKV("Number of reward payouts to date (for current set of utxos)", total_payouts);
-
-    int nHeight = chainActive.Height();
-
-    Amount nMiningRewards;
-    Amount nSuperBlockRewards;
-
-    CBudget bud(config);
-
-    auto Params = config.GetChainParams().GetConsensus();
-    for (int i=1;i<nHeight;i++) {
-      Amount nBlockSubsidy = GetBlockSubsidy(i, Params);
-      nMiningRewards += nBlockSubsidy;
-      if (bud.IsSuperBlock(i)) {
-        Amount BudgetValue = bud.CalculateSuperBlockRewards(i, nBlockSubsidy);
-        nSuperBlockRewards += BudgetValue;
-      }
-    }
-
-    double ratio=0;
-    Amount nTotalSupply(1); // 1 to avoid divide by 0 if GetUTXOStats fails
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
-      nTotalSupply = stats.nTotalAmount;
-      reply.pushKV("Total Coin supply", ValueFromAmount(nTotalSupply));
-    }
-    
-
-    Amount nCold = stats.nTotalAmount;
-    nCold -= nMiningRewards;
-    nCold -= nSuperBlockRewards;
-    reply.pushKV("Total Mining Rewards", ValueFromAmount(nMiningRewards));
-    reply.pushKV("Total Budget Rewards", ValueFromAmount(nSuperBlockRewards));
-    reply.pushKV("Total Cold Rewards paid", ValueFromAmount(nCold));
-    reply.pushKV("Coin Amount in cold reward utxos", ValueFromAmount(sum));
-    ratio = int(100.0*double(sum.toInt())/nTotalSupply.toInt());
+    reply.pushKV("Current number of viable rewards", stats.nCount);
+    reply.pushKV("Number of reward payouts to date (for current set of utxos)", stats.nPayouts);
+
+    Amount nTotalSupply = stats.GetTotalSupply();
+    if (nTotalSupply <= Amount()) nTotalSupply = Amount::min_amount(); // avoid divide by 0 before the 1st block
+
+    double ratio = int(100.0*double(stats.nSum.toInt())/nTotalSupply.toInt());
+    reply.pushKV("Total Coins issued", ValueFromAmount(stats.GetTotalSupply()));
+    reply.pushKV("Total Mining Rewards", ValueFromAmount(stats.nMiningRewards));
+    reply.pushKV("Total Budget Rewards", ValueFromAmount(stats.nBudgetRewards));
+    reply.pushKV("Total Cold Rewards paid", ValueFromAmount(stats.nColdRewards));
+    reply.pushKV("Coin Amount in cold reward utxos", ValueFromAmount(stats.nSum));
     reply.pushKV("% of coins in cold reward utxos", ratio);
-    reply.pushKV("Mining Rewards as % of Total Coins", AmountAsPercent(nMiningRewards,nTotalSupply));
-    reply.pushKV("Budget Rewards as % of Total Coins", AmountAsPercent(nSuperBlockRewards,nTotalSupply));
-    reply.pushKV("Cold Rewards as % of Total Coins", AmountAsPercent(nCold,nTotalSupply));
-    reply.pushKV("Number of Blocks processed", (int)nHeight);
+    reply.pushKV("Mining Rewards as % of Total Coins", AmountAsPercent(stats.nMiningRewards,nTotalSupply));
+    reply.pushKV("Budget Rewards as % of Total Coins", AmountAsPercent(stats.nBudgetRewards,nTotalSupply));
+    reply.pushKV("Cold Rewards as % of Total Coins", AmountAsPercent(stats.nColdRewards,nTotalSupply));
+    reply.pushKV("Number of Blocks processed", stats.nHeight);
 
-  
     return reply;
 }
 
 static UniValue getrewards(const Config &config, const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() != 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
         throw std::runtime_error(
-                                 "getrewards \"filename\"\n"
+                                 "getrewards \"filename\" ( \"format\" )\n"
                                  "\nDump all of the valid reward UTXO values into a server-side file.\n"
-                                 "{\nArguments"
+                                 "\nArguments:\n"
                                  "1. \"filename\"    (string, required) The filename with path (either absolute or relative to devaultd)\n"
+                                 "2. \"format\"      (string, optional, default=\"text\") \"text\" for one line per reward, or \"binary\" for\n"
+                                 "                  a compact file (version, count, then compressed rewards)\n"
+                                 "\nResult:\n"
+                                 "{\n"
+                                 "  \"filename\" : \"xxx\",   (string) The absolute path of the file\n"
+                                 "  \"count\" : n           (numeric) The number of rewards written\n"
+                                 "}\n"
                                  "\nExamples:\n"
-                                 + HelpExampleCli("getrewards","")
-                                 + HelpExampleRpc("getrewards",""));
-    
+                                 + HelpExampleCli("getrewards","\"rewards.dat\" \"binary\"")
+                                 + HelpExampleRpc("getrewards","\"rewards.dat\", \"binary\""));
 
-    std::vector<CRewardValue> rewards = prewards->GetOrderedRewards();
-    UniValue result(UniValue::VOBJ);
+    bool fBinary = false;
+    if (!request.params[1].isNull()) {
+        const std::string format = request.params[1].get_str();
+        if (format == "binary") {
+            fBinary = true;
+        } else if (format != "text") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown format, use text or binary");
+        }
+    }
 
     fs::path filepath = request.params[0].get_str();
     filepath = fs::absolute(filepath);
-    
-    std::ofstream file;
-    file.open(filepath.string().c_str());
-    if (!file.is_open()) {
+
+    // Streamed from the DB cursor, cs_main keeps the rewards consistent while writing
+    uint64_t nWritten = 0;
+    bool fOk;
+    {
+        LOCK(cs_main);
+        fOk = prewards->DumpRewards(filepath, fBinary, nWritten);
+    }
+    if (!fOk) {
         throw JSONRPCError(RPC_INVALID_PARAMETER,
-                           "Cannot open getrewards dump file");
-    }
-
-    for (auto& val : rewards) {
-        file << "Value " << val.GetValue().ToString() << " ";
-        file << "active "<<  val.IsActive() << " ";
-        file << "creationHeight " << val.GetCreationHeight() << " ";
-        file << "OldHeight " << val.GetOldHeight() << " ";
-        file << "Height " << val.GetHeight() << " ";
-        file << "addr " << GetAddrFromTxOut(val.GetTxOut()) << " ";
-        file << "payCount " << val.GetPayCount() << "\n";
-    }   
-    file.close();
+                           "Cannot write getrewards dump file");
+    }
 
     UniValue reply(UniValue::VOBJ);
     reply.pushKV("filename", filepath.string());
+    reply.pushKV("count", nWritten);
 
     return reply;
 }
 
+static UniValue RewardToJSON(const COutPoint &outpoint, CRewardValue &val, int64_t nMinBlocks) {
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("txid", outpoint.GetTxId().GetHex());
+    entry.pushKV("vout", (int)outpoint.GetN());
+    entry.pushKV("address", GetAddrFromTxOut(val.GetTxOut()));
+    entry.pushKV("value", ValueFromAmount(val.GetValue()));
+    entry.pushKV("active", val.IsActive());
+    entry.pushKV("creationheight", (int)val.GetCreationHeight());
+    entry.pushKV("height", (int)val.GetHeight());
+    entry.pushKV("paycount", (int)val.GetPayCount());
+    if (val.IsActive()) entry.pushKV("eligibleheight", val.GetHeight() + nMinBlocks + 1);
+    return entry;
+}
 
+// listrewards cursors are the hex of the serialized key of the next entry
+template <typename T> static std::string EncodeRewardsCursor(const T &key) {
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << key;
+    return HexStr(ss.begin(), ss.end());
+}
 
+template <typename T> static void DecodeRewardsCursor(const std::string &str, T &key) {
+    if (!IsHex(str)) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    CDataStream ss(ParseHex(str), SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ss >> key;
+    } catch (const std::exception &) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+}
+
+static UniValue listrewards(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 4)
+        throw std::runtime_error(
+                                 "listrewards ( \"cursor\" limit activeonly \"sort\" )\n"
+                                 "\nReturns one page of the reward UTXOs.\n"
+                                 "\nArguments:\n"
+                                 "1. \"cursor\"      (string, optional) The \"next\" value of a previous call, start from the beginning if empty\n"
+                                 "2. limit         (numeric, optional, default=100) The maximum number of rewards returned (1-1000)\n"
+                                 "3. activeonly    (boolean, optional, default=false) Only return the rewards that can still be paid\n"
+                                 "4. \"sort\"        (string, optional, default=\"outpoint\") \"outpoint\" for DB order, or \"eligible\" for\n"
+                                 "                  next eligible height (only active rewards)\n"
+                                 "\nResult:\n"
+                                 "{\n"
+                                 "  \"rewards\" : [\n"
+                                 "    {\n"
+                                 "      \"txid\" : \"hash\",          (string) The transaction id\n"
+                                 "      \"vout\" : n,               (numeric) The output number\n"
+                                 "      \"address\" : \"address\",    (string) The address\n"
+                                 "      \"value\" : x.xxx,          (numeric) The output value\n"
+                                 "      \"active\" : true|false,    (boolean) If the reward can still be paid\n"
+                                 "      \"creationheight\" : n,     (numeric) Height of the output\n"
+                                 "      \"height\" : n,             (numeric) Height of the last payment (or creation)\n"
+                                 "      \"paycount\" : n,           (numeric) Number of payments\n"
+                                 "      \"eligibleheight\" : n      (numeric) First height a payment is possible (active only)\n"
+                                 "    }\n"
+                                 "    ,...\n"
+                                 "  ],\n"
+                                 "  \"next\" : \"cursor\"            (string) Cursor of the next page, only if there are more rewards\n"
+                                 "}\n"
+                                 "\nExamples:\n"
+                                 + HelpExampleCli("listrewards","")
+                                 + HelpExampleCli("listrewards","\"\" 50 true \"eligible\"")
+                                 + HelpExampleRpc("listrewards","\"\", 50, true, \"eligible\""));
+
+    const std::string cursor = request.params[0].isNull() ? "" : request.params[0].get_str();
+    int limit = 100;
+    if (!request.params[1].isNull()) {
+        limit = request.params[1].get_int();
+        if (limit < 1 || limit > 1000) throw JSONRPCError(RPC_INVALID_PARAMETER, "limit must be between 1 and 1000");
+    }
+    const bool fActiveOnly = request.params[2].isNull() ? false : request.params[2].get_bool();
+    bool fByEligible = false;
+    if (!request.params[3].isNull()) {
+        const std::string sort = request.params[3].get_str();
+        if (sort == "eligible") {
+            fByEligible = true;
+        } else if (sort != "outpoint") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown sort, use outpoint or eligible");
+        }
+    }
+
+    const int64_t nMinBlocks = config.GetChainParams().GetConsensus().nMinRewardBlocks;
+    UniValue rewards(UniValue::VARR);
+    std::string next;
+
+    // Only one page is read, so memory use doesn't depend on the number of rewards
+    LOCK(cs_main);
+    if (fByEligible) {
+        // The candidate index is ordered by last paid height, so by eligible height
+        CRewardCandidate start(0, Amount(), COutPoint());
+        if (!cursor.empty()) DecodeRewardsCursor(cursor, start);
+        prewards->ForEachCandidate(
+            [&](const CRewardCandidate &candidate) {
+                if ((int)rewards.size() == limit) {
+                    next = EncodeRewardsCursor(candidate);
+                    return false;
+                }
+                CRewardValue val;
+                if (prewards->GetReward(candidate.outpoint, val)) {
+                    rewards.push_back(RewardToJSON(candidate.outpoint, val, nMinBlocks));
+                }
+                return true;
+            },
+            cursor.empty() ? nullptr : &start);
+    } else {
+        COutPoint start;
+        if (!cursor.empty()) DecodeRewardsCursor(cursor, start);
+        prewards->ForEachReward(
+            [&](const COutPoint &outpoint, CRewardValue &val) {
+                if (fActiveOnly && !val.IsActive()) return true;
+                if ((int)rewards.size() == limit) {
+                    next = EncodeRewardsCursor(outpoint);
+                    return false;
+                }
+                rewards.push_back(RewardToJSON(outpoint, val, nMinBlocks));
+                return true;
+            },
+            cursor.empty() ? nullptr : &start);
+    }
+
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("rewards", rewards);
+    if (!next.empty()) reply.pushKV("next", next);
+
+    return reply;
+}
 
 static UniValue savemempool(const Config &config,
                             const JSONRPCRequest &request) {
@@ -2273,6 +2441,169 @@ static UniValue savemempool(const Config &config,
     return NullUniValue;
 }
 
+static UniValue dumptxoutset(const Config &config,
+                             const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the UTXO set and the rewards database at the chain tip "
+            "to a snapshot file,\nwhich -loadsnapshot can bootstrap a node "
+            "from once it is pinned\nin the chain parameters. No snapshot "
+            "is pinned yet.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, either "
+            "absolute or relative to the data directory.\n"
+            "              It must not exist yet.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"coins_written\" : n,        (numeric) The number of coins "
+            "written\n"
+            "  \"rewards_written\" : n,      (numeric) The number of rewards "
+            "written\n"
+            "  \"base_hash\" : \"hash\",       (string) The hash of the block "
+            "the snapshot was taken at\n"
+            "  \"base_height\" : n,          (numeric) The height of that "
+            "block\n"
+            "  \"nchaintx\" : n,             (numeric) The number of "
+            "transactions up to that block\n"
+            "  \"snapshot_hash\" : \"hash\",   (string) The hash of the "
+            "snapshot content, to pin with nchaintx\n"
+            "  \"path\" : \"xxx\"             (string) The absolute path of "
+            "the file\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("dumptxoutset", "\"utxo.dat\"") +
+            HelpExampleRpc("dumptxoutset", "\"utxo.dat\""));
+    }
+
+    fs::path path = request.params[0].get_str();
+    if (path.is_relative()) {
+        path = GetDataDir() / path;
+    }
+    // Written under another name until complete
+    const fs::path temppath = path.string() + ".incomplete";
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           path.string() + " already exists");
+    }
+
+    FILE *filestr = fsbridge::fopen(temppath, "wb");
+    if (!filestr) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Cannot open " + temppath.string());
+    }
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata metadata;
+    if (!DumpSnapshot(config.GetChainParams(), file, metadata)) {
+        file.fclose();
+        fs::remove(temppath);
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to write the snapshot");
+    }
+    FileCommit(file.Get());
+    file.fclose();
+    RenameOver(temppath, path);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_written", metadata.nCoins);
+    result.pushKV("rewards_written", metadata.nRewards);
+    result.pushKV("base_hash", metadata.hashBaseBlock.GetHex());
+    result.pushKV("base_height", metadata.nHeight);
+    {
+        LOCK(cs_main);
+        result.pushKV(
+            "nchaintx",
+            int64_t(LookupBlockIndex(metadata.hashBaseBlock)->nChainTx));
+    }
+    result.pushKV("snapshot_hash", metadata.hashSnapshot.GetHex());
+    result.pushKV("path", path.string());
+    return result;
+}
+
+static UniValue getblockfilter(const Config &config,
+                               const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"   (string, required) The hash of the block\n"
+            "2. \"filtertype\"  (string, optional, default=basic) The type "
+            "name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : (string) the hex-encoded filter data\n"
+            "  \"header\" : (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter",
+                           "\"00000000c937983704a73af28acdec37b049d214adbda81d7"
+                           "e2a3dd146f6ed09\" \"basic\"") +
+            HelpExampleRpc("getblockfilter",
+                           "\"00000000c937983704a73af28acdec37b049d214adbda81d7"
+                           "e2a3dd146f6ed09\", \"basic\""));
+    }
+
+    const uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex *index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Index is not enabled for filtertype " +
+                               filtertype_name);
+    }
+
+    const CBlockIndex *block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_was_connected = block_index->IsValid(BlockValidity::SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg +=
+                " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg +=
+                " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 // clang-format off
 static const ContextFreeRPCCommand commands[] = {
     //  category            name                      actor (function)        argNames
@@ -2289,6 +2620,7 @@ static const ContextFreeRPCCommand commands[] = {
     { "blockchain",         "getblockhash",           getblockhash,           {"height"} },
     { "blockchain",         "getdifficulties",        getdifficulties,        {"height"} },
     { "blockchain",         "getblockheader",         getblockheader,         {"blockhash","verbose"} },
+    { "blockchain",         "getblockfilter",         getblockfilter,         {"blockhash", "filtertype"} },
     { "blockchain",         "getchaintips",           getchaintips,           {} },
     { "blockchain",         "getdifficulty",          getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    getmempoolancestors,    {"txid","verbose"} },
@@ -2297,14 +2629,16 @@ static const ContextFreeRPCCommand commands[] = {
     { "blockchain",         "getmempoolinfo",         getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        {"hash_type", "hash_or_height", "use_index"} },
     { "blockchain",         "pruneblockchain",        pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            savemempool,            {} },
+    { "blockchain",         "dumptxoutset",           dumptxoutset,           {"path"} },
     { "blockchain",         "verifychain",            verifychain,            {"checklevel","nblocks"} },
     { "blockchain",         "preciousblock",          preciousblock,          {"blockhash"} },
     { "blockchain",         "preciousblock",          preciousblock,          {"blockhash"} },
     
-    { "rewards",         "getrewards",             getrewards,             {} },
+    { "rewards",         "getrewards",             getrewards,             {"filename","format"} },
+    { "rewards",         "listrewards",            listrewards,            {"cursor","limit","activeonly","sort"} },
     { "rewards",         "getrewardinfo",          getrewardinfo,          {} },
 
     /* Not shown in help */
@@ -33,6 +33,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"generatetoaddress", 2, "maxtries"},
     {"getnetworkhashps", 0, "nblocks"},
     {"getnetworkhashps", 1, "height"},
+    {"listrewards", 1, "limit"},
+    {"listrewards", 2, "activeonly"},
     {"sendtoaddress", 1, "amount"},
     {"sendtoaddress", 4, "subtractfeefromamount"},
     {"settxfee", 0, "amount"},
@@ -52,15 +54,17 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"getbalance", 1, "minconf"},
     {"getbalance", 2, "include_watchonly"},
     {"getblockhash", 0, "height"},
+    {"gettxoutsetinfo", 1, "hash_or_height"},
+    {"gettxoutsetinfo", 2, "use_index"},
     {"getdifficulties", 1, "height"},
     {"getaddressbalance", 1, "address"},
+    {"getaddresstxids", 1, "options"},
+    {"getaddressdeltas", 1, "options"},
 #ifdef EXTRA_INDEXES    
     {"getblockhashes", 0 , "high"},
     {"getblockhashes", 1, "low"},
     {"getblockhashes", 2, "options" },
     {"getspentinfo", 0, "txid_index"},
-    {"getaddresstxids", 0, "addresses"},
-    {"getaddressdeltas", 0, "addresses"},
     {"getaddressutxos", 0, "addresses"},
     {"getaddressmempool", 0, "addresses"},
 #endif    
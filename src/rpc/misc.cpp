@@ -9,7 +9,9 @@
 #include <clientversion.h>
 #include <config.h>
 #include <chain.h>
+#include <dbwrapper.h>
 #include <dstencode.h>
+#include <index/addrindex.h>
 #include <init.h>
 #include <net.h>
 #include <netbase.h>
@@ -17,6 +19,7 @@
 #include <rpc/server.h>
 #include <timedata.h>
 #include <txmempool.h>
+#include <streams.h>
 #include <util.h>
 #include <utilstrencodings.h>
 #include <validation.h>
@@ -345,6 +348,54 @@ static UniValue getmemoryinfo(const Config &config,
     }
 }
 
+static UniValue getdbstats(const Config &config,
+                           const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getdbstats\n"
+            "Returns the storage engine statistics of the open databases.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",        (string) Name of the database "
+            "for -dbprofile\n"
+            "    \"path\": \"xxxx\",        (string) Where it is stored\n"
+            "    \"profile\": \"xxxx\",     (string) The storage engine "
+            "profile it was opened with\n"
+            "    \"properties\": {         (json object) Properties reported "
+            "by RocksDB or LevelDB, numbers where they are one\n"
+            "      \"property\": xxxxx,\n"
+            "      ...\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getdbstats", "") +
+            HelpExampleRpc("getdbstats", ""));
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const DBStats &stats : GetDBStats()) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("name", stats.name);
+        obj.pushKV("path", stats.path);
+        obj.pushKV("profile", stats.profile);
+        UniValue properties(UniValue::VOBJ);
+        for (const auto &property : stats.properties) {
+            int64_t n;
+            if (ParseInt64(property.second, &n)) {
+                properties.pushKV(property.first, n);
+            } else {
+                properties.pushKV(property.first, property.second);
+            }
+        }
+        obj.pushKV("properties", properties);
+        result.push_back(obj);
+    }
+    return result;
+}
+
 static UniValue echo(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp) {
         throw std::runtime_error(
@@ -454,6 +505,17 @@ UniValue getaddressmempool(const JSONRPCRequest& request)
     return result;
 }
 
+// The address index is built in the background, only answer once it caught up
+static AddrIndex &GetSyncedAddrIndex() {
+    if (!g_addrindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled (-addressindex)");
+    }
+    if (!g_addrindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is still being built, try again later");
+    }
+    return *g_addrindex;
+}
+
 static UniValue getaddressbalance(const Config &config, const JSONRPCRequest &request) {
   
   if (request.fHelp || request.params.size() != 1)
@@ -465,6 +527,7 @@ static UniValue getaddressbalance(const Config &config, const JSONRPCRequest &re
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"txcount\"  (numeric) The number of transactions involving the address\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance","\"devault:qpzfppqqg5sk6ck8c624tk7vgxeuafaq9uumff5u2u\"")
@@ -477,31 +540,187 @@ static UniValue getaddressbalance(const Config &config, const JSONRPCRequest &re
        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
    }
 
-   std::vector<std::pair<CAddrIndexKey, Amount> > addressIndex;
-
-   if (!GetAddrIndex(address, addressIndex)) {
-       throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-   }
-   
-   Amount balance;
-   Amount received;
-   
-   for (const auto& it : addressIndex) {
-       if (it.second > Amount()) {
-           received += it.second;
-       }
-       balance += it.second;
-   }
+   // Single read of the running totals of the address, none means no rows
+   CAddrBalance totals;
+   GetSyncedAddrIndex().FindAddrBalance(GetAddrIndexHash(GetScriptForDestination(dest)), totals);
    
    UniValue result(UniValue::VOBJ);
-   result.push_back(Pair("balance", ValueFromAmount(balance)));
-   result.push_back(Pair("received", ValueFromAmount(received)));
+   result.push_back(Pair("balance", ValueFromAmount(totals.balance)));
+   result.push_back(Pair("received", ValueFromAmount(totals.received)));
+   result.push_back(Pair("txcount", totals.nTxCount));
    
    return result;
 
 }
 
 
+static const std::string ADDRINDEX_OPTIONS_HELP =
+    "2. options        (json object, optional)\n"
+    "   {\n"
+    "     \"start\" : n,       (numeric, optional) First block height\n"
+    "     \"end\" : n,         (numeric, optional) Last block height\n"
+    "     \"order\" : \"asc\",   (string, optional, default=\"asc\") \"asc\" or \"desc\" by height\n"
+    "     \"limit\" : n,       (numeric, optional, default=100) Page size (1-1000)\n"
+    "     \"offset\" : n,      (numeric, optional, default=0) Number of entries skipped\n"
+    "     \"cursor\" : \"hex\"   (string, optional) The \"next\" value of a previous call\n"
+    "   }\n";
+
+// Address and paging options shared by getaddresstxids and getaddressdeltas
+static CAddrIndexQuery ParseAddrIndexQuery(const Config &config, const JSONRPCRequest &request, bool fDistinctTx) {
+    CTxDestination dest = DecodeDestination(request.params[0].get_str(), config.GetChainParams());
+    if (!IsValidDestination(dest)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    CAddrIndexQuery query(GetAddrIndexHash(GetScriptForDestination(dest)));
+    query.fDistinctTx = fDistinctTx;
+    query.nLimit = 100;
+    if (request.params[1].isNull()) return query;
+
+    const UniValue &options = request.params[1].get_obj();
+    RPCTypeCheckObj(options,
+                    {
+                        {"start", UniValueType(UniValue::VNUM)},
+                        {"end", UniValueType(UniValue::VNUM)},
+                        {"order", UniValueType(UniValue::VSTR)},
+                        {"limit", UniValueType(UniValue::VNUM)},
+                        {"offset", UniValueType(UniValue::VNUM)},
+                        {"cursor", UniValueType(UniValue::VSTR)},
+                    },
+                    true, true);
+    if (!options["start"].isNull()) query.nStartHeight = options["start"].get_int();
+    if (!options["end"].isNull()) query.nEndHeight = options["end"].get_int();
+    if (query.nStartHeight < 0 || query.nEndHeight < 0 ||
+        (query.nEndHeight > 0 && query.nEndHeight < query.nStartHeight)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range");
+    }
+    if (!options["order"].isNull()) {
+        const std::string order = options["order"].get_str();
+        if (order == "desc") {
+            query.fDescending = true;
+        } else if (order != "asc") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown order, use asc or desc");
+        }
+    }
+    if (!options["limit"].isNull()) {
+        const int limit = options["limit"].get_int();
+        if (limit < 1 || limit > 1000) throw JSONRPCError(RPC_INVALID_PARAMETER, "limit must be between 1 and 1000");
+        query.nLimit = limit;
+    }
+    if (!options["offset"].isNull()) {
+        const int offset = options["offset"].get_int();
+        if (offset < 0) throw JSONRPCError(RPC_INVALID_PARAMETER, "offset must be positive");
+        query.nOffset = offset;
+    }
+    if (!options["cursor"].isNull()) {
+        const std::string cursor = options["cursor"].get_str();
+        if (!IsHex(cursor)) throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        CDataStream ss(ParseHex(cursor), SER_NETWORK, PROTOCOL_VERSION);
+        try {
+            ss >> query.cursor;
+        } catch (const std::exception &) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        if (query.cursor.hashBytes != query.hashBytes) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor doesn't match the address");
+        }
+        query.fHasCursor = true;
+    }
+    return query;
+}
+
+// Read one page, only the rows of the page (and the offset) are visited
+static CAddrIndexPage ReadAddrIndexPage(const CAddrIndexQuery &query, UniValue &result) {
+    CAddrIndexPage page;
+    if (!GetSyncedAddrIndex().FindAddrIndex(query, page)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    if (page.fMore) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << page.next;
+        result.push_back(Pair("next", HexStr(ss.begin(), ss.end())));
+    }
+    return page;
+}
+
+static UniValue getaddresstxids(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getaddresstxids \"address\" ( options )\n"
+            "\nReturns one page of the transaction ids of an address (requires addressindex to be enabled).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The address\n"
+            + ADDRINDEX_OPTIONS_HELP +
+            "\nResult:\n"
+            "{\n"
+            "  \"txids\" : [\"txid\",...],  (array of string) The transaction ids in block order\n"
+            "  \"next\" : \"cursor\"         (string) Cursor of the next page, only if there are more transactions\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "\"devault:qpzfppqqg5sk6ck8c624tk7vgxeuafaq9uumff5u2u\"")
+            + HelpExampleCli("getaddresstxids", "\"devault:qpzfppqqg5sk6ck8c624tk7vgxeuafaq9uumff5u2u\" '{\"order\":\"desc\",\"limit\":10}'")
+            + HelpExampleRpc("getaddresstxids", "\"devault:qpzfppqqg5sk6ck8c624tk7vgxeuafaq9uumff5u2u\", {\"order\":\"desc\",\"limit\":10}"));
+
+    // Offset and limit count transactions, the rows of a transaction are never split
+    const CAddrIndexQuery query = ParseAddrIndexQuery(config, request, true);
+    UniValue result(UniValue::VOBJ);
+    const CAddrIndexPage page = ReadAddrIndexPage(query, result);
+
+    UniValue txids(UniValue::VARR);
+    uint256 lastTx;
+    for (const auto &row : page.rows) {
+        if (txids.size() > 0 && row.first.txhash == lastTx) continue;
+        lastTx = row.first.txhash;
+        txids.push_back(lastTx.GetHex());
+    }
+    result.push_back(Pair("txids", txids));
+    return result;
+}
+
+static UniValue getaddressdeltas(const Config &config, const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getaddressdeltas \"address\" ( options )\n"
+            "\nReturns one page of the balance changes of an address (requires addressindex to be enabled).\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The address\n"
+            + ADDRINDEX_OPTIONS_HELP +
+            "\nResult:\n"
+            "{\n"
+            "  \"deltas\" : [\n"
+            "    {\n"
+            "      \"amount\" : x.xxx,     (numeric) The balance change, negative when spending\n"
+            "      \"txid\" : \"hash\",      (string) The transaction id\n"
+            "      \"index\" : n,          (numeric) The input or output number\n"
+            "      \"blockindex\" : n,     (numeric) The position of the transaction in the block\n"
+            "      \"height\" : n          (numeric) The block height\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"next\" : \"cursor\"        (string) Cursor of the next page, only if there are more deltas\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "\"devault:qpzfppqqg5sk6ck8c624tk7vgxeuafaq9uumff5u2u\"")
+            + HelpExampleCli("getaddressdeltas", "\"devault:qpzfppqqg5sk6ck8c624tk7vgxeuafaq9uumff5u2u\" '{\"start\":1000,\"end\":2000}'")
+            + HelpExampleRpc("getaddressdeltas", "\"devault:qpzfppqqg5sk6ck8c624tk7vgxeuafaq9uumff5u2u\", {\"start\":1000,\"end\":2000}"));
+
+    const CAddrIndexQuery query = ParseAddrIndexQuery(config, request, false);
+    UniValue result(UniValue::VOBJ);
+    const CAddrIndexPage page = ReadAddrIndexPage(query, result);
+
+    UniValue deltas(UniValue::VARR);
+    for (const auto &row : page.rows) {
+        UniValue delta(UniValue::VOBJ);
+        delta.push_back(Pair("amount", ValueFromAmount(row.second)));
+        delta.push_back(Pair("txid", row.first.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)row.first.index));
+        delta.push_back(Pair("blockindex", (int)row.first.txindex));
+        delta.push_back(Pair("height", row.first.blockHeight));
+        deltas.push_back(delta);
+    }
+    result.push_back(Pair("deltas", deltas));
+    return result;
+}
 
 
 // clang-format off
@@ -512,10 +731,13 @@ static const ContextFreeRPCCommand commands[] = {
     { "control",            "getinfo",                getinfo,                {} }, /* uses wallet if enabled */
 #endif
     { "control",            "getmemoryinfo",          getmemoryinfo,          {"mode"} },
+    { "control",            "getdbstats",             getdbstats,             {} },
     { "util",               "verifymessage",          verifymessage,          {"address","signature","message"} },
     { "util",               "signmessagewithprivkey", signmessagewithprivkey, {"privkey","message"} },
     /* Address index */
     { "addressindex",       "getaddressbalance",      getaddressbalance,      {} },
+    { "addressindex",       "getaddresstxids",        getaddresstxids,        {"address","options"} },
+    { "addressindex",       "getaddressdeltas",       getaddressdeltas,       {"address","options"} },
 
     /* Not shown in help */
     { "hidden",             "setmocktime",            setmocktime,            {"timestamp"}},
@@ -1321,6 +1321,11 @@ static UniValue sendrawtransaction(const Config &config,
         nMaxRawTxFee = Amount::zero();
     }
 
+    // Check the scripts before taking cs_main, AcceptToMemoryPool finds them
+    // in the script cache
+    std::vector<CValidationState> states;
+    PreCheckMempoolTransactions(config, g_mempool, {tx}, states);
+
     { // cs_main scope
         LOCK(cs_main);
         CCoinsViewCache &view = *pcoinsTip;
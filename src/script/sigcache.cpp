@@ -98,6 +98,18 @@ public:
  * signatureCache could be made local to VerifySignature.
  */
 static CSignatureCache signatureCache;
+
+/**
+ * The signatures collected on a thread while its batch is open, with the
+ * cache entries to store once they are verified.
+ */
+struct CSignatureBatch {
+    bool open = false;
+    CSchnorrBatch sigs;
+    std::vector<uint256> entries;
+};
+
+static thread_local CSignatureBatch signatureBatch;
 } // namespace
 
 // To be called once in AppInitMain/BasicTestingSetup to initialize the
@@ -144,8 +156,42 @@ bool CachingTransactionSignatureChecker::IsCached(
 bool CachingTransactionSignatureChecker::VerifySignature(
     const std::vector<uint8_t> &vchSig, const CPubKey &pubkey,
     const uint256 &sighash, uint32_t flags) const {
+    // Assumed valid until the batch is closed, see OpenSignatureBatch.
+    if (signatureBatch.open && (flags & SCRIPT_ENABLE_SCHNORR) &&
+        (flags & SCRIPT_VERIFY_NULLFAIL) && vchSig.size() == 64) {
+        uint256 entry;
+        signatureCache.ComputeEntry(entry, vchSig, pubkey, sighash, flags);
+        if (signatureCache.Get(entry, !store)) {
+            return true;
+        }
+        if (!signatureBatch.sigs.Add(pubkey, sighash, vchSig)) {
+            return false;
+        }
+        if (store) {
+            signatureBatch.entries.push_back(entry);
+        }
+        return true;
+    }
+
     return RunMemoizedCheck(vchSig, pubkey, sighash, flags, store, [&] {
         return TransactionSignatureChecker::VerifySignature(vchSig, pubkey,
                                                             sighash, flags);
     });
 }
+
+void OpenSignatureBatch() {
+    signatureBatch.open = true;
+}
+
+bool CloseSignatureBatch() {
+    signatureBatch.open = false;
+    const bool fOk = signatureBatch.sigs.Verify();
+    if (fOk) {
+        for (uint256 &entry : signatureBatch.entries) {
+            signatureCache.Set(entry);
+        }
+    }
+    signatureBatch.sigs.clear();
+    signatureBatch.entries.clear();
+    return fOk;
+}
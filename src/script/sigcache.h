@@ -63,4 +63,15 @@ public:
 
 void InitSignatureCache();
 
+/**
+ * While a signature batch is open on a thread, the Schnorr signatures checked
+ * there by CachingTransactionSignatureChecker under SCRIPT_VERIFY_NULLFAIL
+ * are collected and assumed valid: an invalid one would fail the script
+ * anyway. CloseSignatureBatch verifies them all at once, and returns whether
+ * they are all valid. If not, the scripts must be verified again with no
+ * batch open to know which one fails.
+ */
+void OpenSignatureBatch();
+bool CloseSignatureBatch();
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -23,6 +23,28 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorr_verify(
   const secp256k1_pubkey *pubkey
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4);
 
+/**
+ * Verify a batch of signatures created by secp256k1_schnorr_sign at once,
+ * which is faster than verifying them one by one.
+ * Returns: 1: all the signatures are correct
+ *          0: at least one signature is incorrect, which one is not told
+ * Args:    ctx:       a secp256k1 context object, initialized for verification.
+ * In:      sig64:     array of pointers to the 64-byte signatures being
+ *                     verified (cannot be NULL)
+ *          msg32:     array of pointers to the 32-byte message hashes being
+ *                     verified (cannot be NULL)
+ *          pubkeys:   array of pointers to the public keys to verify with
+ *                     (cannot be NULL)
+ *          n:         number of signatures, 0 is a valid batch
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorr_verify_batch(
+  const secp256k1_context* ctx,
+  const unsigned char *const *sig64,
+  const unsigned char *const *msg32,
+  const secp256k1_pubkey *const *pubkeys,
+  size_t n
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4);
+
 /**
  * Create a signature using a custom EC-Schnorr-SHA256 construction. It
  * produces non-malleable 64-byte signatures which support batch validation,
@@ -100,6 +100,29 @@ static void benchmark_schnorr_verify(void* arg) {
         data->sig[data->siglen - 3] ^= ((i >> 16) & 0xFF);
     }
 }
+
+#define BATCH_SIZE 100
+
+static void benchmark_schnorr_verify_batch(void* arg) {
+    int i, j;
+    benchmark_verify_t* data = (benchmark_verify_t*)arg;
+    secp256k1_pubkey pubkey;
+    const unsigned char *sigs[BATCH_SIZE];
+    const unsigned char *msgs[BATCH_SIZE];
+    const secp256k1_pubkey *pubkeys[BATCH_SIZE];
+
+    CHECK(secp256k1_ec_pubkey_parse(data->ctx, &pubkey, data->pubkey, data->pubkeylen) == 1);
+    for (j = 0; j < BATCH_SIZE; j++) {
+        sigs[j] = data->sig;
+        msgs[j] = data->msg;
+        pubkeys[j] = &pubkey;
+    }
+    for (i = 0; i < 20000 / BATCH_SIZE; i++) {
+        CHECK(secp256k1_schnorr_verify_batch(data->ctx, sigs, msgs, pubkeys, BATCH_SIZE) == 1);
+    }
+}
+
+#undef BATCH_SIZE
 #endif
 
 int main(void) {
@@ -133,6 +156,7 @@ int main(void) {
     CHECK(secp256k1_schnorr_sign(data.ctx, data.sig, data.msg, data.key, NULL, NULL));
     data.siglen = 64;
     run_benchmark("schnorr_verify", benchmark_schnorr_verify, NULL, NULL, &data, 10, 20000);
+    run_benchmark("schnorr_verify_batch", benchmark_schnorr_verify_batch, NULL, NULL, &data, 10, 20000);
 #endif
 
     secp256k1_context_destroy(data.ctx);
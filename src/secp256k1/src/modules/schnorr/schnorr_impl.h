@@ -129,6 +129,187 @@ static int secp256k1_schnorr_compute_e(
     return !overflow & !secp256k1_scalar_is_zero(e);
 }
 
+/**
+ * Batch verification, using option 2 above for n signatures at once.
+ *
+ *   Each equation R_i + e_i * P_i - s_i * G == 0 is multiplied by a scalar
+ *   a_i, where a_0 = 1 and the others are 128-bit values derived from a hash
+ *   of the whole batch, so that the errors of invalid signatures cannot cancel
+ *   out. The batch is valid if
+ *     sum(a_i * R_i) + sum(a_i * e_i * P_i) - sum(a_i * s_i) * G
+ *   is infinity, which is computed with Strauss' algorithm: all the points
+ *   share a single chain of doublings.
+ *
+ *   A valid batch means that every signature is valid, except with negligible
+ *   probability. An invalid batch contains at least one invalid signature.
+ */
+static int secp256k1_schnorr_sig_verify_batch(
+    const secp256k1_ecmult_context* ctx,
+    const secp256k1_callback* cb,
+    const unsigned char *const *sig64,
+    const unsigned char *const *msg32,
+    secp256k1_ge *pubkeys,
+    size_t n
+) {
+    const size_t table_size = ECMULT_TABLE_SIZE(WINDOW_A);
+    /* R_i is point 2 * i and P_i is point 2 * i + 1. */
+    const size_t points = 2 * n;
+    secp256k1_gej *prej;
+    secp256k1_fe *zr;
+    secp256k1_fe *zlast;
+    secp256k1_ge *pre;
+    int *wnaf;
+    int *bits;
+    secp256k1_sha256 sha;
+    unsigned char seed[32];
+    unsigned char buf[36];
+    secp256k1_scalar sg;
+    int wnaf_g[256];
+    int bits_g;
+    int max_bits;
+    secp256k1_gej r;
+    secp256k1_ge tmpa;
+    size_t i, k;
+    int b;
+    int ret = 0;
+
+    if (n == 0) {
+        return 1;
+    }
+
+    /* Derive the seed of the multipliers from the whole batch. */
+    secp256k1_sha256_initialize(&sha);
+    for (i = 0; i < n; i++) {
+        size_t size;
+        if (secp256k1_ge_is_infinity(&pubkeys[i])) {
+            return 0;
+        }
+        secp256k1_sha256_write(&sha, sig64[i], 64);
+        secp256k1_sha256_write(&sha, msg32[i], 32);
+        secp256k1_eckey_pubkey_serialize(&pubkeys[i], buf, &size, 1);
+        secp256k1_sha256_write(&sha, buf, 33);
+    }
+    secp256k1_sha256_finalize(&sha, seed);
+
+    prej = (secp256k1_gej *)checked_malloc(cb, sizeof(secp256k1_gej) * points * table_size);
+    zr = (secp256k1_fe *)checked_malloc(cb, sizeof(secp256k1_fe) * points * table_size);
+    zlast = (secp256k1_fe *)checked_malloc(cb, sizeof(secp256k1_fe) * points * 2);
+    pre = (secp256k1_ge *)checked_malloc(cb, sizeof(secp256k1_ge) * points * table_size);
+    wnaf = (int *)checked_malloc(cb, sizeof(int) * points * 256);
+    bits = (int *)checked_malloc(cb, sizeof(int) * points);
+
+    secp256k1_scalar_set_int(&sg, 0);
+    max_bits = 0;
+    for (i = 0; i < n; i++) {
+        secp256k1_scalar a, e, s, ae;
+        secp256k1_fe Rx;
+        secp256k1_ge R;
+        secp256k1_gej Rj, Pj;
+        int overflow = 0;
+
+        /* Extract s and R, which must be on the curve. */
+        secp256k1_scalar_set_b32(&s, sig64[i] + 32, &overflow);
+        if (overflow) {
+            break;
+        }
+        if (!secp256k1_fe_set_b32(&Rx, sig64[i])) {
+            break;
+        }
+        if (!secp256k1_ge_set_xquad(&R, &Rx)) {
+            break;
+        }
+
+        secp256k1_schnorr_compute_e(&e, sig64[i], &pubkeys[i], msg32[i]);
+
+        /* a_0 = 1, a_i = the low 128 bits of Hash(seed || i) */
+        if (i == 0) {
+            secp256k1_scalar_set_int(&a, 1);
+        } else {
+            memcpy(buf, seed, 32);
+            buf[32] = i;
+            buf[33] = i >> 8;
+            buf[34] = i >> 16;
+            buf[35] = i >> 24;
+            secp256k1_sha256_initialize(&sha);
+            secp256k1_sha256_write(&sha, buf, 36);
+            secp256k1_sha256_finalize(&sha, buf);
+            memset(buf, 0, 16);
+            secp256k1_scalar_set_b32(&a, buf, NULL);
+        }
+
+        secp256k1_scalar_mul(&ae, &a, &e);
+        secp256k1_scalar_mul(&s, &a, &s);
+        secp256k1_scalar_add(&sg, &sg, &s);
+
+        bits[2 * i] = secp256k1_ecmult_wnaf(wnaf + 2 * i * 256, 256, &a, WINDOW_A);
+        bits[2 * i + 1] = secp256k1_ecmult_wnaf(wnaf + (2 * i + 1) * 256, 256, &ae, WINDOW_A);
+        for (k = 2 * i; k <= 2 * i + 1; k++) {
+            if (bits[k] > max_bits) {
+                max_bits = bits[k];
+            }
+        }
+
+        /* Odd multiples of both points, still in jacobian coordinates. */
+        secp256k1_gej_set_ge(&Rj, &R);
+        secp256k1_gej_set_ge(&Pj, &pubkeys[i]);
+        secp256k1_ecmult_odd_multiples_table(table_size, prej + 2 * i * table_size, zr + 2 * i * table_size, &Rj);
+        secp256k1_ecmult_odd_multiples_table(table_size, prej + (2 * i + 1) * table_size, zr + (2 * i + 1) * table_size, &Pj);
+    }
+
+    /* All the signatures were parsed. */
+    if (i == n) {
+        /* Only the last z coordinate of each table is known, the others follow
+         * from the z ratios. Invert all the last ones at once, and bring every
+         * table to affine coordinates. */
+        for (k = 0; k < points; k++) {
+            zlast[k] = prej[(k + 1) * table_size - 1].z;
+        }
+        secp256k1_fe_inv_all_var(zlast + points, zlast, points);
+        for (k = 0; k < points; k++) {
+            secp256k1_fe zi = zlast[points + k];
+            size_t j = table_size - 1;
+            secp256k1_ge_set_gej_zinv(&pre[k * table_size + j], &prej[k * table_size + j], &zi);
+            while (j > 0) {
+                secp256k1_fe_mul(&zi, &zi, &zr[k * table_size + j]);
+                j--;
+                secp256k1_ge_set_gej_zinv(&pre[k * table_size + j], &prej[k * table_size + j], &zi);
+            }
+        }
+
+        secp256k1_scalar_negate(&sg, &sg);
+        bits_g = secp256k1_ecmult_wnaf(wnaf_g, 256, &sg, WINDOW_G);
+        if (bits_g > max_bits) {
+            max_bits = bits_g;
+        }
+
+        secp256k1_gej_set_infinity(&r);
+        for (b = max_bits - 1; b >= 0; b--) {
+            int m;
+            secp256k1_gej_double_var(&r, &r, NULL);
+            for (k = 0; k < points; k++) {
+                if (b < bits[k] && (m = wnaf[k * 256 + b])) {
+                    ECMULT_TABLE_GET_GE(&tmpa, pre + k * table_size, m, WINDOW_A);
+                    secp256k1_gej_add_ge_var(&r, &r, &tmpa, NULL);
+                }
+            }
+            if (b < bits_g && (m = wnaf_g[b])) {
+                ECMULT_TABLE_GET_GE_STORAGE(&tmpa, *ctx->pre_g, m, WINDOW_G);
+                secp256k1_gej_add_ge_var(&r, &r, &tmpa, NULL);
+            }
+        }
+
+        ret = secp256k1_gej_is_infinity(&r);
+    }
+
+    free(prej);
+    free(zr);
+    free(zlast);
+    free(pre);
+    free(wnaf);
+    free(bits);
+    return ret;
+}
+
 static int secp256k1_schnorr_sig_sign(
     const secp256k1_ecmult_gen_context* ctx,
     unsigned char *sig64,
@@ -76,6 +76,66 @@ void test_schnorr_sign_verify(void) {
     }
 }
 
+void test_schnorr_verify_batch(void) {
+    unsigned char msg32[SIG_COUNT][32];
+    unsigned char sig64[SIG_COUNT][64];
+    secp256k1_pubkey pubkey[SIG_COUNT];
+    const unsigned char *sigs[SIG_COUNT];
+    const unsigned char *msgs[SIG_COUNT];
+    const secp256k1_pubkey *pubkeys[SIG_COUNT];
+    int i, j;
+
+    for (i = 0; i < SIG_COUNT; i++) {
+        unsigned char privkey[32];
+        secp256k1_scalar key;
+        random_scalar_order_test(&key);
+        secp256k1_scalar_get_b32(privkey, &key);
+        secp256k1_rand256_test(msg32[i]);
+        CHECK(secp256k1_ec_pubkey_create(ctx, &pubkey[i], privkey) == 1);
+        CHECK(secp256k1_schnorr_sign(ctx, sig64[i], msg32[i], privkey, NULL, NULL) == 1);
+        sigs[i] = sig64[i];
+        msgs[i] = msg32[i];
+        pubkeys[i] = &pubkey[i];
+    }
+
+    /* Every prefix of the batch is valid, including the empty one. */
+    for (i = 0; i <= SIG_COUNT; i++) {
+        CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, i) == 1);
+    }
+
+    /* A single invalid signature invalidates the batch, wherever it is. */
+    for (j = 0; j < count; j++) {
+        int idx = secp256k1_rand_int(SIG_COUNT);
+        int pos = secp256k1_rand_bits(6);
+        int mod = 1 + secp256k1_rand_int(255);
+        sig64[idx][pos] ^= mod;
+        CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, SIG_COUNT) == 0);
+        sig64[idx][pos] ^= mod;
+
+        msg32[idx][pos % 32] ^= mod;
+        CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, SIG_COUNT) == 0);
+        msg32[idx][pos % 32] ^= mod;
+    }
+
+    /* Signatures of another key. */
+    pubkeys[0] = &pubkey[1];
+    CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, SIG_COUNT) == 0);
+    pubkeys[0] = &pubkey[0];
+
+    /* Swapping the messages of two signatures makes both invalid. */
+    msgs[0] = msg32[1];
+    msgs[1] = msg32[0];
+    CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, SIG_COUNT) == 0);
+    msgs[0] = msg32[0];
+    msgs[1] = msg32[1];
+
+    /* The same signature can appear more than once. */
+    sigs[1] = sigs[0];
+    msgs[1] = msgs[0];
+    pubkeys[1] = pubkeys[0];
+    CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, SIG_COUNT) == 1);
+}
+
 #undef SIG_COUNT
 
 void run_schnorr_compact_test(void) {
@@ -516,6 +576,7 @@ void run_schnorr_tests(void) {
     }
 
     test_schnorr_sign_verify();
+    test_schnorr_verify_batch();
     run_schnorr_compact_test();
 }
 
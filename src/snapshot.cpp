@@ -0,0 +1,319 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <snapshot.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <devault/rewardsview.h>
+#include <hash.h>
+#include <init.h> // for ShutdownRequested
+#include <streams.h>
+#include <txdb.h>
+#include <util.h>
+#include <validation.h>
+
+#include <memory>
+#include <vector>
+
+//! Coins or rewards written to the databases at once while loading
+static const size_t SNAPSHOT_LOAD_BATCH = 100000;
+
+bool DumpSnapshot(const CChainParams &params, CAutoFile &file,
+                  SnapshotMetadata &metadata) {
+    std::unique_ptr<CCoinsViewCursor> pcoins;
+    std::unique_ptr<CRewardsViewDBCursor> prewardsCursor;
+    std::vector<std::pair<uint32_t, COutPoint>> vHeights;
+    CRewardStats stats;
+    bool fHaveStats;
+    const CBlockIndex *pindexBase;
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+        pindexBase = chainActive.Tip();
+        if (pcoinsdbview->GetBestBlock() != pindexBase->GetBlockHash()) {
+            return error("%s: the chainstate is not at the tip", __func__);
+        }
+        pcoins.reset(pcoinsdbview->Cursor());
+        prewardsCursor.reset(prewardsdb->Cursor());
+        if (!prewardsdb->GetRewardHeights(vHeights)) {
+            return error("%s: unable to read the reward heights", __func__);
+        }
+        fHaveStats = prewardsdb->GetStats(stats);
+    }
+
+    metadata = SnapshotMetadata();
+    metadata.netMagic = params.NetMagic();
+    metadata.hashBaseBlock = pindexBase->GetBlockHash();
+    metadata.nHeight = pindexBase->nHeight;
+    // Counts and hash are filled in once the rest is written
+    file << metadata;
+
+    for (int nHeight = 1; nHeight <= pindexBase->nHeight; nHeight++) {
+        file << pindexBase->GetAncestor(nHeight)->GetBlockHeader();
+    }
+
+    CHashWriter hasher(file.GetType(), file.GetVersion());
+    for (; pcoins->Valid(); pcoins->Next()) {
+        if (ShutdownRequested()) {
+            return error("%s: interrupted", __func__);
+        }
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcoins->GetKey(outpoint) || !pcoins->GetValue(coin)) {
+            return error("%s: unable to read coin", __func__);
+        }
+        file << outpoint << coin;
+        hasher << outpoint << coin;
+        metadata.nCoins++;
+    }
+
+    for (; prewardsCursor->Valid(); prewardsCursor->Next()) {
+        COutPoint outpoint;
+        CRewardValue reward;
+        if (!prewardsCursor->GetKey(outpoint) ||
+            !prewardsCursor->GetValue(reward)) {
+            return error("%s: unable to read reward", __func__);
+        }
+        file << outpoint << reward;
+        hasher << outpoint << reward;
+        metadata.nRewards++;
+    }
+
+    for (const auto &it : vHeights) {
+        file << it.first << it.second;
+        hasher << it.first << it.second;
+    }
+    metadata.nRewardHeights = vHeights.size();
+
+    file << fHaveStats;
+    hasher << fHaveStats;
+    if (fHaveStats) {
+        file << stats;
+        hasher << stats;
+    }
+    metadata.hashSnapshot = hasher.GetHash();
+
+    if (fseek(file.Get(), 0, SEEK_SET) != 0) {
+        return error("%s: unable to rewrite the header", __func__);
+    }
+    file << metadata;
+    return true;
+}
+
+bool ReadSnapshotMetadata(const CChainParams &params, CAutoFile &file,
+                          SnapshotMetadata &metadata, std::string &error) {
+    file >> metadata;
+    if (metadata.nVersion != SnapshotMetadata::CURRENT_VERSION) {
+        error = strprintf(_("Unsupported UTXO snapshot version %d"),
+                          metadata.nVersion);
+        return false;
+    }
+    if (metadata.netMagic != params.NetMagic()) {
+        error = _("The UTXO snapshot is for another network");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read the coins and rewards of a snapshot and return their hash. They are
+ * only written when the databases are given, which the caller does on a
+ * second pass once the hash is known to be right.
+ */
+static bool ReadSnapshotPass(CAutoFile &file, const SnapshotMetadata &metadata,
+                             CCoinsViewDB *pcoinsdb,
+                             CRewardsViewDB *prewardsdb, uint256 &hash,
+                             std::string &error) {
+    CHashVerifier<CAutoFile> verifier(&file);
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    if (pcoinsdb) {
+        coins.reserve(
+            std::min<uint64_t>(metadata.nCoins, SNAPSHOT_LOAD_BATCH));
+    }
+    for (uint64_t i = 0; i < metadata.nCoins; i++) {
+        COutPoint outpoint;
+        Coin coin;
+        verifier >> outpoint >> coin;
+        if (!pcoinsdb) {
+            // Interrupting is only safe before anything is written
+            if (i % SNAPSHOT_LOAD_BATCH == 0 && ShutdownRequested()) {
+                error = _("UTXO snapshot loading interrupted");
+                return false;
+            }
+            continue;
+        }
+        coins.emplace_back(outpoint, std::move(coin));
+        if (coins.size() == SNAPSHOT_LOAD_BATCH || i + 1 == metadata.nCoins) {
+            if (!pcoinsdb->BulkWrite(coins, metadata.hashBaseBlock)) {
+                error = _("Failed to write to the coin database");
+                return false;
+            }
+            coins.clear();
+        }
+    }
+
+    std::vector<std::pair<COutPoint, CRewardValue>> rewards;
+    for (uint64_t i = 0; i < metadata.nRewards; i++) {
+        COutPoint outpoint;
+        CRewardValue reward;
+        verifier >> outpoint >> reward;
+        if (!prewardsdb) {
+            continue;
+        }
+        rewards.emplace_back(outpoint, reward);
+        if (rewards.size() == SNAPSHOT_LOAD_BATCH || i + 1 == metadata.nRewards) {
+            if (!prewardsdb->Add(rewards)) {
+                error = _("Failed to write to the rewards database");
+                return false;
+            }
+            rewards.clear();
+        }
+    }
+
+    std::vector<std::pair<uint32_t, COutPoint>> vHeights;
+    for (uint64_t i = 0; i < metadata.nRewardHeights; i++) {
+        uint32_t nHeight;
+        COutPoint outpoint;
+        verifier >> nHeight >> outpoint;
+        vHeights.emplace_back(nHeight, outpoint);
+    }
+    bool fHaveStats;
+    CRewardStats stats;
+    verifier >> fHaveStats;
+    if (fHaveStats) {
+        verifier >> stats;
+    }
+    if (prewardsdb && (!prewardsdb->AddRewardHeights(vHeights) ||
+                       (fHaveStats && !prewardsdb->PutStats(stats)))) {
+        error = _("Failed to write to the rewards database");
+        return false;
+    }
+
+    hash = verifier.GetHash();
+    return true;
+}
+
+bool ReadSnapshotState(CAutoFile &file, const SnapshotMetadata &metadata,
+                       CCoinsViewDB &coinsdb, CRewardsViewDB &rewardsdb,
+                       std::string &error) {
+    std::unique_ptr<CCoinsViewCursor> pcoins(coinsdb.Cursor());
+    std::unique_ptr<CRewardsViewDBCursor> prewardsCursor(rewardsdb.Cursor());
+    if (!pcoins->GetBestBlock().IsNull() || pcoins->Valid() ||
+        prewardsCursor->Valid()) {
+        error = _("A UTXO snapshot can only be loaded into an empty "
+                  "chainstate");
+        return false;
+    }
+
+    // A snapshot which doesn't match its hash must not leave anything in the
+    // databases, so it is read twice
+    const long nStatePos = ftell(file.Get());
+    if (nStatePos < 0) {
+        error = _("Unable to read the UTXO snapshot");
+        return false;
+    }
+    uint256 hash;
+    if (!ReadSnapshotPass(file, metadata, nullptr, nullptr, hash, error)) {
+        return false;
+    }
+    if (hash != metadata.hashSnapshot) {
+        error = _("The content of the UTXO snapshot does not match its hash");
+        return false;
+    }
+    if (fseek(file.Get(), nStatePos, SEEK_SET) != 0) {
+        error = _("Unable to read the UTXO snapshot");
+        return false;
+    }
+    return ReadSnapshotPass(file, metadata, &coinsdb, &rewardsdb, hash, error);
+}
+
+bool LoadSnapshot(const Config &config, const fs::path &path,
+                  CCoinsViewDB &coinsdb, CRewardsViewDB &rewardsdb,
+                  std::string &error) {
+    const CChainParams &params = config.GetChainParams();
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        error = strprintf(_("Unable to open UTXO snapshot %s"), path.string());
+        return false;
+    }
+
+    try {
+        SnapshotMetadata metadata;
+        if (!ReadSnapshotMetadata(params, file, metadata, error)) {
+            return false;
+        }
+
+        // The pinned hash is what makes the snapshot trusted, check it before
+        // anything gets written
+        auto it = params.Assumeutxo().find(metadata.hashBaseBlock);
+        if (it == params.Assumeutxo().end()) {
+            error = strprintf(_("No UTXO snapshot is pinned at block %s"),
+                              metadata.hashBaseBlock.ToString());
+            return false;
+        }
+        if (it->second.hashSnapshot != metadata.hashSnapshot) {
+            error = _("The UTXO snapshot does not have the pinned hash");
+            return false;
+        }
+
+        LogPrintf("Loading UTXO snapshot at block %s (height %d): %u coins, "
+                  "%u rewards\n",
+                  metadata.hashBaseBlock.ToString(), metadata.nHeight,
+                  metadata.nCoins, metadata.nRewards);
+        int64_t nStart = GetTimeMillis();
+
+        // The headers get the usual checks, proof of work included
+        uint256 hashPrev = params.GetConsensus().hashGenesisBlock;
+        std::vector<CBlockHeader> headers;
+        for (int32_t nHeight = 1; nHeight <= metadata.nHeight; nHeight++) {
+            CBlockHeader header;
+            file >> header;
+            if (header.hashPrevBlock != hashPrev) {
+                error = _("The headers of the UTXO snapshot are not a chain");
+                return false;
+            }
+            hashPrev = header.GetHash();
+            headers.push_back(header);
+            if (headers.size() == MAX_HEADERS_RESULTS ||
+                nHeight == metadata.nHeight) {
+                CValidationState state;
+                if (!AcceptSnapshotHeaders(config, headers, state)) {
+                    error = strprintf(
+                        _("Invalid block header in the UTXO snapshot: %s"),
+                        FormatStateMessage(state));
+                    return false;
+                }
+                headers.clear();
+            }
+        }
+        if (hashPrev != metadata.hashBaseBlock) {
+            error = _("The headers of the UTXO snapshot do not end at its "
+                      "base block");
+            return false;
+        }
+
+        if (!ReadSnapshotState(file, metadata, coinsdb, rewardsdb, error)) {
+            return false;
+        }
+
+        // Only now that it is complete does the chainstate start at the base
+        CCoinsMap empty;
+        if (!SetSnapshotBase(config, metadata.hashBaseBlock) ||
+            !rewardsdb.Flush() ||
+            !coinsdb.BatchWrite(empty, metadata.hashBaseBlock, true)) {
+            error = _("Failed to write the UTXO snapshot base");
+            return false;
+        }
+
+        LogPrintf("Loaded UTXO snapshot in %dms\n", GetTimeMillis() - nStart);
+    } catch (const std::exception &e) {
+        error = strprintf(_("Error reading UTXO snapshot: %s"), e.what());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SNAPSHOT_H
+#define BITCOIN_SNAPSHOT_H
+
+#include <fs.h>
+#include <protocol.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <string>
+
+class CAutoFile;
+class CChainParams;
+class CCoinsViewDB;
+class CRewardsViewDB;
+class Config;
+
+/**
+ * Header of a UTXO snapshot file, as written by dumptxoutset and read by
+ * -loadsnapshot. It is followed by the block headers from height 1 up to the
+ * base block, then by the coins and the rewards database in key order, which
+ * hashSnapshot commits to.
+ */
+class SnapshotMetadata {
+public:
+    static const uint16_t CURRENT_VERSION = 1;
+
+    uint16_t nVersion;
+    //! Network the snapshot was taken on
+    CMessageHeader::MessageMagic netMagic;
+    uint256 hashBaseBlock;
+    int32_t nHeight;
+    uint64_t nCoins;
+    uint64_t nRewards;
+    uint64_t nRewardHeights;
+    uint256 hashSnapshot;
+
+    SnapshotMetadata()
+        : nVersion(CURRENT_VERSION), netMagic(), nHeight(0), nCoins(0),
+          nRewards(0), nRewardHeights(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nVersion);
+        READWRITE(FLATDATA(netMagic));
+        READWRITE(hashBaseBlock);
+        READWRITE(nHeight);
+        READWRITE(nCoins);
+        READWRITE(nRewards);
+        READWRITE(nRewardHeights);
+        READWRITE(hashSnapshot);
+    }
+};
+
+/**
+ * Write the chainstate and the rewards database at the active tip to file,
+ * after flushing them. cs_main is only held while the database iterators are
+ * opened, the rest is streamed from that view of the databases.
+ */
+bool DumpSnapshot(const CChainParams &params, CAutoFile &file,
+                  SnapshotMetadata &metadata);
+
+/** Read the header of a snapshot file and check it is for this network. */
+bool ReadSnapshotMetadata(const CChainParams &params, CAutoFile &file,
+                          SnapshotMetadata &metadata, std::string &error);
+
+/**
+ * Read the coins and rewards of a snapshot, which follow its block headers,
+ * into empty databases. They come in key order and are written in large
+ * batches, which the databases ingest without rewriting much. The file is
+ * read twice, so that nothing is written unless they hash to
+ * metadata.hashSnapshot; the coins database has no best block until the
+ * caller sets it.
+ */
+bool ReadSnapshotState(CAutoFile &file, const SnapshotMetadata &metadata,
+                       CCoinsViewDB &coinsdb, CRewardsViewDB &rewardsdb,
+                       std::string &error);
+
+/**
+ * Load a snapshot pinned in the chain parameters into the empty chainstate
+ * and rewards databases (-loadsnapshot), and make its base block the start of
+ * the chain.
+ */
+bool LoadSnapshot(const Config &config, const fs::path &path,
+                  CCoinsViewDB &coinsdb, CRewardsViewDB &rewardsdb,
+                  std::string &error);
+
+#endif // BITCOIN_SNAPSHOT_H
@@ -0,0 +1,233 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addrindex.h>
+#include <index/addrindex.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(addrindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(addrindex_key_order) {
+    AddrIndex::DB db(1 << 20, true);
+
+    uint160 hashA = GetAddrIndexHash(CScript() << OP_TRUE);
+    uint160 hashB = GetAddrIndexHash(CScript() << OP_FALSE);
+    uint256 txid = InsecureRand256();
+
+    // Heights are big endian so 256 has to come after 1
+    std::vector<std::pair<CAddrIndexKey, Amount>> rows = {
+        {CAddrIndexKey(hashA, 256, 1, txid, 0, false), 5 * COIN},
+        {CAddrIndexKey(hashA, 1, 1, txid, 0, false), 3 * COIN},
+        {CAddrIndexKey(hashB, 2, 1, txid, 1, false), 7 * COIN},
+    };
+    BOOST_CHECK(db.WriteAddrIndex(rows));
+
+    std::vector<std::pair<CAddrIndexKey, Amount>> read;
+    BOOST_CHECK(db.ReadAddrIndex(hashA, read));
+    BOOST_CHECK_EQUAL(read.size(), 2);
+    BOOST_CHECK_EQUAL(read[0].first.blockHeight, 1);
+    BOOST_CHECK_EQUAL(read[1].first.blockHeight, 256);
+
+    read.clear();
+    BOOST_CHECK(db.ReadAddrIndex(hashA, read, 100, 300));
+    BOOST_CHECK_EQUAL(read.size(), 1);
+    BOOST_CHECK(read[0].second == 5 * COIN);
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_balance) {
+    AddrIndex::DB db(1 << 20, true);
+
+    uint160 hash = GetAddrIndexHash(CScript() << OP_TRUE);
+    uint256 txid1 = InsecureRand256();
+    uint256 txid2 = InsecureRand256();
+
+    CAddrBalance balance;
+    BOOST_CHECK(!db.ReadAddrBalance(hash, balance));
+    BOOST_CHECK(balance.IsNull());
+
+    // Received 10 in 2 outputs of one tx
+    std::vector<std::pair<CAddrIndexKey, Amount>> block1 = {
+        {CAddrIndexKey(hash, 1, 1, txid1, 0, false), 4 * COIN},
+        {CAddrIndexKey(hash, 1, 1, txid1, 1, false), 6 * COIN},
+    };
+    BOOST_CHECK(db.WriteAddrIndex(block1));
+    // Spent 4 of it
+    std::vector<std::pair<CAddrIndexKey, Amount>> block2 = {
+        {CAddrIndexKey(hash, 2, 1, txid2, 0, true), -4 * COIN},
+    };
+    BOOST_CHECK(db.WriteAddrIndex(block2));
+
+    BOOST_CHECK(db.ReadAddrBalance(hash, balance));
+    BOOST_CHECK(balance.balance == 6 * COIN);
+    BOOST_CHECK(balance.received == 10 * COIN);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 2);
+
+    // Disconnecting takes the block out again
+    BOOST_CHECK(db.EraseAddrIndex(block2));
+    BOOST_CHECK(db.ReadAddrBalance(hash, balance));
+    BOOST_CHECK(balance.balance == 10 * COIN);
+    BOOST_CHECK_EQUAL(balance.nTxCount, 1);
+
+    BOOST_CHECK(db.EraseAddrIndex(block1));
+    BOOST_CHECK(!db.ReadAddrBalance(hash, balance));
+    std::vector<std::pair<CAddrIndexKey, Amount>> read;
+    BOOST_CHECK(db.ReadAddrIndex(hash, read));
+    BOOST_CHECK(read.empty());
+}
+
+BOOST_AUTO_TEST_CASE(addrindex_paging) {
+    AddrIndex::DB db(1 << 20, true);
+
+    uint160 hashA = GetAddrIndexHash(CScript() << OP_TRUE);
+    uint160 hashB = GetAddrIndexHash(CScript() << OP_FALSE);
+
+    // 5 blocks with one tx of 2 outputs for each address
+    std::vector<std::pair<CAddrIndexKey, Amount>> rows;
+    std::vector<uint256> txids;
+    for (int h = 1; h <= 5; h++) {
+        uint256 txid = InsecureRand256();
+        txids.push_back(txid);
+        for (uint32_t n = 0; n < 2; n++) {
+            rows.emplace_back(CAddrIndexKey(hashA, h, 1, txid, n, false), h * COIN);
+            rows.emplace_back(CAddrIndexKey(hashB, h, 1, txid, n, false), h * COIN);
+        }
+    }
+    BOOST_CHECK(db.WriteAddrIndex(rows));
+
+    // Whichever address sorts last, both directions stay within the address
+    for (const uint160 &hash : {hashA, hashB}) {
+        CAddrIndexQuery query(hash);
+        query.nLimit = 3;
+        std::vector<std::pair<CAddrIndexKey, Amount>> all;
+        CAddrIndexPage page;
+        do {
+            BOOST_CHECK(db.ReadAddrIndex(query, page));
+            BOOST_CHECK(page.rows.size() <= 3);
+            all.insert(all.end(), page.rows.begin(), page.rows.end());
+            query.fHasCursor = true;
+            query.cursor = page.next;
+        } while (page.fMore);
+        BOOST_CHECK_EQUAL(all.size(), 10);
+        for (size_t i = 0; i < all.size(); i++) {
+            BOOST_CHECK(all[i].first.hashBytes == hash);
+            BOOST_CHECK_EQUAL(all[i].first.blockHeight, int(i / 2) + 1);
+        }
+
+        query = CAddrIndexQuery(hash);
+        query.fDescending = true;
+        query.nLimit = 4;
+        BOOST_CHECK(db.ReadAddrIndex(query, page));
+        BOOST_CHECK_EQUAL(page.rows.size(), 4);
+        BOOST_CHECK(page.fMore);
+        BOOST_CHECK_EQUAL(page.rows[0].first.blockHeight, 5);
+        BOOST_CHECK_EQUAL(page.rows[0].first.index, 1);
+        BOOST_CHECK_EQUAL(page.rows[3].first.blockHeight, 4);
+        query.fHasCursor = true;
+        query.cursor = page.next;
+        query.nLimit = 0;
+        BOOST_CHECK(db.ReadAddrIndex(query, page));
+        BOOST_CHECK_EQUAL(page.rows.size(), 6);
+        BOOST_CHECK(!page.fMore);
+        BOOST_CHECK_EQUAL(page.rows[0].first.blockHeight, 3);
+        BOOST_CHECK_EQUAL(page.rows[5].first.blockHeight, 1);
+        BOOST_CHECK(page.rows[5].first.hashBytes == hash);
+    }
+
+    // Height bounds in reverse order, with an offset
+    CAddrIndexQuery query(hashA);
+    query.fDescending = true;
+    query.nStartHeight = 2;
+    query.nEndHeight = 4;
+    query.nOffset = 1;
+    CAddrIndexPage page;
+    BOOST_CHECK(db.ReadAddrIndex(query, page));
+    BOOST_CHECK_EQUAL(page.rows.size(), 5);
+    BOOST_CHECK_EQUAL(page.rows[0].first.blockHeight, 4);
+    BOOST_CHECK_EQUAL(page.rows[0].first.index, 0);
+    BOOST_CHECK_EQUAL(page.rows[4].first.blockHeight, 2);
+
+    // Counting transactions, a page holds both rows of each tx
+    query = CAddrIndexQuery(hashA);
+    query.fDistinctTx = true;
+    query.nOffset = 1;
+    query.nLimit = 2;
+    BOOST_CHECK(db.ReadAddrIndex(query, page));
+    BOOST_CHECK_EQUAL(page.rows.size(), 4);
+    BOOST_CHECK(page.rows[0].first.txhash == txids[1]);
+    BOOST_CHECK(page.rows[3].first.txhash == txids[2]);
+    BOOST_CHECK(page.fMore);
+    BOOST_CHECK(page.next.txhash == txids[3]);
+    BOOST_CHECK_EQUAL(page.next.index, 0);
+
+    // A cursor of another address is refused
+    query.fHasCursor = true;
+    query.cursor = CAddrIndexKey(hashB, 1, 1, txids[0], 0, false);
+    BOOST_CHECK(!db.ReadAddrIndex(query, page));
+}
+
+BOOST_FIXTURE_TEST_CASE(addrindex_initial_sync, TestChain100Setup) {
+    AddrIndex addrindex(1 << 20, true);
+
+    const CScript &script = coinbaseTxns[0].vout[0].scriptPubKey;
+    const uint160 hash = GetAddrIndexHash(script);
+
+    // Nothing is indexed before the index is started
+    CAddrBalance balance;
+    BOOST_CHECK(!addrindex.FindAddrBalance(hash, balance));
+    BOOST_CHECK(!addrindex.BlockUntilSyncedToCurrentChain());
+
+    addrindex.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!addrindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Every coinbase paid the same script
+    Amount received;
+    uint64_t nTxCount = 0;
+    for (const auto &txn : coinbaseTxns) {
+        bool fPaid = false;
+        for (const auto &out : txn.vout) {
+            if (out.scriptPubKey != script) continue;
+            received += out.nValue;
+            fPaid = true;
+        }
+        if (fPaid) nTxCount++;
+    }
+    BOOST_CHECK(addrindex.FindAddrBalance(hash, balance));
+    BOOST_CHECK(balance.received == received);
+    BOOST_CHECK(balance.balance == received);
+    BOOST_CHECK_EQUAL(balance.nTxCount, nTxCount);
+
+    CAddrIndexQuery query(hash);
+    query.fDescending = true;
+    query.nLimit = 1;
+    CAddrIndexPage page;
+    BOOST_CHECK(addrindex.FindAddrIndex(query, page));
+    BOOST_CHECK_EQUAL(page.rows.size(), 1);
+    BOOST_CHECK(page.rows[0].first.txhash == coinbaseTxns.back().GetHash());
+
+    // New blocks are indexed from the validation interface
+    std::vector<CMutableTransaction> no_txns;
+    const CBlock &block = CreateAndProcessBlock(no_txns, script);
+    BOOST_CHECK(addrindex.BlockUntilSyncedToCurrentChain());
+    BOOST_CHECK(addrindex.FindAddrIndex(query, page));
+    BOOST_CHECK(page.rows[0].first.txhash == block.vtx[0]->GetHash());
+    BOOST_CHECK(addrindex.FindAddrBalance(hash, balance));
+    BOOST_CHECK_EQUAL(balance.nTxCount, nTxCount + 1);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    addrindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -20,6 +20,42 @@
 #include <random.h>
 #include <unordered_set>
 
+// Checks which only fail once their batch is closed, like script checks with
+// Schnorr signatures. Outside of the test suite, so that CCheckBatch can be
+// specialized for them.
+struct BatchedCheck {
+    static thread_local bool fBatchOpen;
+    static thread_local bool fBatchFailed;
+    static std::atomic<size_t> nUnbatched;
+    bool fails{false};
+    BatchedCheck() {}
+    explicit BatchedCheck(bool failsIn) : fails(failsIn) {}
+    bool operator()() {
+        if (fBatchOpen) {
+            fBatchFailed |= fails;
+            return true;
+        }
+        nUnbatched++;
+        return !fails;
+    }
+    void swap(BatchedCheck &x) { std::swap(fails, x.fails); }
+};
+thread_local bool BatchedCheck::fBatchOpen{false};
+thread_local bool BatchedCheck::fBatchFailed{false};
+std::atomic<size_t> BatchedCheck::nUnbatched{0};
+
+template <> struct CCheckBatch<BatchedCheck> {
+    static constexpr uint32_t MAX_CHECKS = 16;
+    static void Open() {
+        BatchedCheck::fBatchOpen = true;
+        BatchedCheck::fBatchFailed = false;
+    }
+    static bool Close() {
+        BatchedCheck::fBatchOpen = false;
+        return !BatchedCheck::fBatchFailed;
+    }
+};
+
 // BasicTestingSetup not sufficient because nScriptCheckThreads is not set
 // otherwise.
 BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, TestingSetup)
@@ -122,6 +158,7 @@ typedef CCheckQueue<FailingCheck> Failing_Queue;
 typedef CCheckQueue<UniqueCheck> Unique_Queue;
 typedef CCheckQueue<MemoryCheck> Memory_Queue;
 typedef CCheckQueue<FrozenCleanupCheck> FrozenCleanup_Queue;
+typedef CCheckQueue<BatchedCheck> Batched_Queue;
 
 /** This test case checks that the CCheckQueue works properly
  * with each specified size_t Checks pushed.
@@ -248,6 +285,39 @@ BOOST_AUTO_TEST_CASE(test_CheckQueue_Recovers_From_Failure) {
     for (auto&& thread : tg) thread.join();
 }
 
+// Test that the failure of a batch is found, by running its checks again
+// one at a time, and only its checks.
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Batches) {
+    auto queue =
+        std::unique_ptr<Batched_Queue>(new Batched_Queue{QUEUE_BATCH_SIZE});
+    std::vector<std::thread> tg;
+    for (auto x = 0; x < nScriptCheckThreads; ++x) {
+        tg.emplace_back(std::thread([&] { queue->Thread(); }));
+    }
+
+    for (auto times = 0; times < 100; ++times) {
+        const bool fails = InsecureRandBool();
+        BatchedCheck::nUnbatched = 0;
+        {
+            CCheckQueueControl<BatchedCheck> control(queue.get());
+            std::vector<BatchedCheck> vChecks(1000);
+            if (fails) {
+                vChecks[InsecureRandRange(vChecks.size())].fails = true;
+            }
+            control.Add(vChecks);
+            BOOST_REQUIRE(control.Wait() != fails);
+        }
+        if (fails) {
+            BOOST_CHECK(BatchedCheck::nUnbatched > 0);
+            BOOST_CHECK(BatchedCheck::nUnbatched <= 16);
+        } else {
+            BOOST_CHECK(BatchedCheck::nUnbatched == 0);
+        }
+    }
+    queue->Interrupt();
+    for (auto&& thread : tg) thread.join();
+}
+
 // Test that unique checks are actually all called individually, rather than
 // just one check being called repeatedly. Test that checks are not called
 // more than once as well
@@ -421,4 +491,93 @@ BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks) {
         for (auto&& thread : tg) thread.join();
     }
 }
+
+/** Test the deque from one thread, growing well past its first array */
+BOOST_AUTO_TEST_CASE(test_CheckDeque_Single_Thread) {
+    CCheckDeque deque;
+    uint64_t range;
+    uint32_t begin, end;
+    BOOST_CHECK(deque.Empty());
+    BOOST_CHECK(!deque.Pop(range));
+    BOOST_CHECK(!deque.Steal(range));
+
+    CCheckDeque::Unpack(CCheckDeque::Pack(7, 1u << 31), begin, end);
+    BOOST_CHECK_EQUAL(begin, 7);
+    BOOST_CHECK_EQUAL(end, 1u << 31);
+
+    // Stealing while pushing moves the top, so the ranges copied on each
+    // resize don't start at the first slot
+    const uint32_t nRanges = 1000;
+    uint32_t nStolen = 0;
+    for (uint32_t i = 0; i < nRanges; i++) {
+        deque.Push(CCheckDeque::Pack(i, i + 1));
+        if (i % 3 == 0) {
+            BOOST_REQUIRE(deque.Steal(range));
+            CCheckDeque::Unpack(range, begin, end);
+            BOOST_CHECK_EQUAL(begin, nStolen++);
+        }
+    }
+    BOOST_CHECK(!deque.Empty());
+
+    // The owner takes the last pushed first
+    uint32_t nNext = nRanges;
+    while (deque.Pop(range)) {
+        CCheckDeque::Unpack(range, begin, end);
+        BOOST_CHECK_EQUAL(begin, --nNext);
+        BOOST_CHECK_EQUAL(end, begin + 1);
+    }
+    BOOST_CHECK_EQUAL(nNext, nStolen);
+    BOOST_CHECK(deque.Empty());
+    BOOST_CHECK(!deque.Steal(range));
+}
+
+/** Test that thieves racing the owner get every range exactly once */
+BOOST_AUTO_TEST_CASE(test_CheckDeque_Steal_Race) {
+    CCheckDeque deque;
+    const uint32_t nRanges = 100000;
+    std::vector<std::atomic<int>> taken(nRanges);
+    std::atomic<bool> fDone{false};
+    auto take = [&](uint64_t range) {
+        uint32_t begin, end;
+        CCheckDeque::Unpack(range, begin, end);
+        ++taken[begin];
+    };
+
+    std::vector<std::thread> tg;
+    for (int x = 0; x < 3; x++) {
+        tg.emplace_back([&] {
+            uint64_t range;
+            while (true) {
+                // Only stop on a failed steal after the owner is done
+                const bool fFinished = fDone;
+                if (deque.Steal(range)) {
+                    take(range);
+                } else if (fFinished) {
+                    break;
+                }
+            }
+        });
+    }
+
+    // The owner pops some while pushing, and the deque grows under the
+    // thieves
+    uint64_t range;
+    for (uint32_t i = 0; i < nRanges; i++) {
+        deque.Push(CCheckDeque::Pack(i, i + 1));
+        if (i % 4 == 0 && deque.Pop(range)) take(range);
+    }
+    while (deque.Pop(range)) {
+        take(range);
+    }
+    fDone = true;
+    for (auto &&thread : tg) thread.join();
+
+    BOOST_CHECK(deque.Empty());
+    size_t nWrong = 0;
+    for (const auto &n : taken) {
+        nWrong += n != 1;
+    }
+    BOOST_CHECK_EQUAL(nWrong, 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
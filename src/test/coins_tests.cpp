@@ -54,7 +54,8 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override {
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    bool erase) override {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty
@@ -65,7 +66,11 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            if (erase) {
+                mapCoins.erase(it++);
+            } else {
+                ++it;
+            }
         }
         if (!hashBlock.IsNull()) {
             hashBestBlock_ = hashBlock;
@@ -206,11 +211,18 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test) {
             }
         }
 
-        // Every 100 iterations, flush an intermediate cache
+        // Every 100 iterations, flush an intermediate cache, or sync it and
+        // evict some of its coins
         if (InsecureRandRange(100) == 0) {
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (InsecureRandBool()) {
+                    stack[flushIndex]->Flush();
+                } else {
+                    stack[flushIndex]->Sync();
+                    stack[flushIndex]->Trim(InsecureRandRange(
+                        stack[flushIndex]->DynamicMemoryUsage() + 1));
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -615,7 +627,7 @@ void GetCoinMapEntry(const CCoinsMap &map, Amount &value, char &flags) {
 void WriteCoinViewEntry(CCoinsView &view, const Amount value, char flags) {
     CCoinsMap map;
     InsertCoinMapEntry(map, value, flags);
-    view.BatchWrite(map, {});
+    view.BatchWrite(map, {}, true);
 }
 
 class SingleEntryCacheTest {
@@ -684,6 +696,39 @@ BOOST_AUTO_TEST_CASE(coin_access) {
     CheckAccessCoin(VALUE1, VALUE2, VALUE2, DIRTY | FRESH, DIRTY | FRESH);
 }
 
+void CheckPrefetchCoin(const Amount cache_value, const Amount expected_value,
+                       char cache_flags, char expected_flags) {
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    Coin coin;
+    SetCoinValue(VALUE1, coin);
+    test.cache.AddPrefetchedCoin(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    Amount result_value;
+    char result_flags;
+    GetCoinMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(coin_prefetch) {
+    /* Check AddPrefetchedCoin behavior, adding the coin VALUE1 read from the
+     * base view to a cache, which keeps any entry it has already.
+     *
+     *                 Cache   Result  Cache        Result
+     *                 Value   Value   Flags        Flags
+     */
+    CheckPrefetchCoin(ABSENT, VALUE1, NO_ENTRY, 0);
+    CheckPrefetchCoin(PRUNED, PRUNED, 0, 0);
+    CheckPrefetchCoin(PRUNED, PRUNED, FRESH, FRESH);
+    CheckPrefetchCoin(PRUNED, PRUNED, DIRTY, DIRTY);
+    CheckPrefetchCoin(PRUNED, PRUNED, DIRTY | FRESH, DIRTY | FRESH);
+    CheckPrefetchCoin(VALUE2, VALUE2, 0, 0);
+    CheckPrefetchCoin(VALUE2, VALUE2, FRESH, FRESH);
+    CheckPrefetchCoin(VALUE2, VALUE2, DIRTY, DIRTY);
+    CheckPrefetchCoin(VALUE2, VALUE2, DIRTY | FRESH, DIRTY | FRESH);
+}
+
 void CheckSpendCoin(Amount base_value, Amount cache_value,
                     Amount expected_value, char cache_flags,
                     char expected_flags) {
@@ -899,4 +944,63 @@ BOOST_AUTO_TEST_CASE(coin_write) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(coin_sync_trim) {
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    // One coin per block.
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 10; i++) {
+        outpoints.emplace_back(TxId(InsecureRand256()), 0);
+        cache.AddCoin(outpoints.back(),
+                      Coin(CTxOut(VALUE1, CScript()), i, false), false);
+        cache.SetBestBlock(InsecureRand256());
+    }
+
+    // Sync writes the coins and keeps them as clean entries.
+    BOOST_CHECK(cache.Sync());
+    for (const COutPoint &outpoint : outpoints) {
+        BOOST_CHECK(base.HaveCoin(outpoint));
+        auto it = cache.map().find(outpoint);
+        BOOST_CHECK(it != cache.map().end());
+        if (it != cache.map().end()) {
+            BOOST_CHECK_EQUAL(it->second.flags, 0);
+        }
+    }
+    cache.SelfTest();
+
+    // Spent coins are written and dropped.
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!base.HaveCoin(outpoints[0]));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[0]));
+    cache.SelfTest();
+
+    // Use the second coin again, and add a modified one.
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(!cache.AccessCoin(outpoints[1]).IsSpent());
+    const COutPoint dirty(TxId(InsecureRand256()), 0);
+    cache.AddCoin(dirty, Coin(CTxOut(VALUE2, CScript()), 10, false), false);
+
+    // The coldest coin goes first.
+    cache.Trim(cache.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[2]));
+    for (size_t i = 3; i < outpoints.size(); i++) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoints[i]));
+    }
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[1]));
+    cache.SelfTest();
+
+    // Modified coins are never evicted.
+    cache.Trim(0);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1);
+    BOOST_CHECK(cache.HaveCoinInCache(dirty));
+    cache.SelfTest();
+
+    // Evicted coins are read again from the base.
+    BOOST_CHECK(cache.HaveCoin(outpoints[2]));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(base.HaveCoin(dirty));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
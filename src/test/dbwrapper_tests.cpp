@@ -308,4 +308,44 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles) {
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    {
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, "addrindex");
+        BOOST_CHECK_EQUAL(dbw.GetStats().profile, "scan");
+
+        // Open databases are listed by getdbstats
+        int found = 0;
+        for (const DBStats &stats : GetDBStats()) {
+            found += stats.path == ph.string() && stats.name == "addrindex";
+        }
+        BOOST_CHECK_EQUAL(found, 1);
+    }
+    for (const DBStats &stats : GetDBStats()) {
+        BOOST_CHECK(stats.path != ph.string());
+    }
+
+    // Unnamed databases get the default profile
+    CDBWrapper unnamed(ph, (1 << 20), true);
+    BOOST_CHECK_EQUAL(unnamed.GetStats().profile, "default");
+
+    // -dbprofile overrides the profile of a database
+    std::string error;
+    gArgs.ForceSetMultiArg("-dbprofile", "addrindex:archive");
+    BOOST_CHECK(CheckDBProfileArgs(error));
+    {
+        CDBWrapper dbw(ph, (1 << 20), true, false, false, "addrindex");
+        BOOST_CHECK_EQUAL(dbw.GetStats().profile, "archive");
+    }
+    gArgs.ClearArg("-dbprofile");
+    gArgs.ClearArg("-dbprofile");
+  gArgs.ForceSetMultiArg("-dbprofile", "wallet:scan");
+    BOOST_CHECK(!CheckDBProfileArgs(error));
+    gArgs.ClearArg("-dbprofile");
+    gArgs.ClearArg("-dbprofile");
+  gArgs.ForceSetMultiArg("-dbprofile", "chainstate:fast");
+    BOOST_CHECK(!CheckDBProfileArgs(error));
+    gArgs.ClearArg("-dbprofile");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,128 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <config.h>
+
+#include <devault/rewardcandidates.h>
+#include <devault/rewards_calculation.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+
+// Reference selection, same as the full DB scan previously done in CColdRewards::FindReward
+static bool FindRewardByScan(const Consensus::Params &params, int Height,
+                             const std::map<COutPoint, CRewardValue> &rewards, COutPoint &minKey,
+                             Amount &selAmount) {
+    int minHeight = Height;
+    bool found = false;
+    for (const auto &it : rewards) {
+        CRewardValue the_reward = it.second;
+        if (!the_reward.IsActive()) continue;
+        int nHeight = the_reward.GetHeight();
+        if (nHeight > minHeight) continue;
+        int HeightDiff = Height - nHeight;
+        if (HeightDiff <= params.nMinRewardBlocks) continue;
+        Amount reward = CalculateReward(params, nHeight, HeightDiff, the_reward.GetValue());
+        if (reward < params.nMinReward) continue;
+        if (reward > params.nMaxReward) reward = params.nMaxReward;
+        if (nHeight < minHeight || reward > selAmount || (reward == selAmount && it.first < minKey)) {
+            selAmount = reward;
+            minHeight = nHeight;
+            minKey = it.first;
+        }
+        found = true;
+    }
+    return found;
+}
+
+BOOST_FIXTURE_TEST_SUITE(rewardcandidates_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(rewardcandidates_match_scan) {
+    DummyConfig config(CBaseChainParams::MAIN);
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+    const int month = params.nMinRewardBlocks;
+
+    std::map<COutPoint, CRewardValue> rewards;
+    CRewardCandidates candidates;
+
+    // Few distinct heights and balances so that ties on height and reward are common
+    for (int i = 0; i < 2000; i++) {
+        COutPoint outpoint(InsecureRand256(), InsecureRandRange(4));
+        uint32_t h = InsecureRandRange(24) * month / 4;
+        Amount balance = int64_t(1000 + 1000 * InsecureRandRange(20)) * COIN;
+        if (InsecureRandRange(10) == 0) balance = 100000000 * COIN; // capped at nMaxReward
+        CRewardValue val(CTxOut(balance, CScript()), h, h, h);
+        if (InsecureRandRange(5) == 0) val.SetActive(false);
+        rewards[outpoint] = val;
+        candidates.Add(outpoint, val);
+    }
+
+    for (int Height = month; Height < 8 * month; Height += month / 8) {
+        COutPoint refKey, key;
+        Amount refAmount, amount;
+        bool refFound = FindRewardByScan(params, Height, rewards, refKey, refAmount);
+        bool found = candidates.Find(params, Height, params.nMinRewardBlocks, params.nMinReward, params.nMaxReward, key,
+                                     amount);
+        BOOST_CHECK_EQUAL(found, refFound);
+        if (found && refFound) {
+            BOOST_CHECK(key == refKey);
+            BOOST_CHECK_EQUAL(amount, refAmount);
+        }
+
+        // Pay out the winner the way UpdateRewardsDB does and keep both sides in sync
+        if (found) {
+            CRewardValue &val = rewards[key];
+            CRewardValue paid(val);
+            paid.SetOldHeight(paid.GetHeight());
+            paid.SetHeight(Height);
+            candidates.Remove(key, val);
+            candidates.Add(key, paid);
+            val = paid;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rewardcandidates_remove) {
+    DummyConfig config(CBaseChainParams::MAIN);
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+    const int Height = 4 * params.nMinRewardBlocks;
+
+    CRewardCandidates candidates;
+    COutPoint a(InsecureRand256(), 0);
+    COutPoint b(InsecureRand256(), 0);
+    CRewardValue older(CTxOut(20000 * COIN, CScript()), 1, 1, 1);
+    CRewardValue newer(CTxOut(20000 * COIN, CScript()), 2, 2, 2);
+    candidates.Add(a, older);
+    candidates.Add(b, newer);
+    BOOST_CHECK_EQUAL(candidates.Size(), 2);
+    BOOST_CHECK(candidates.GetSum() == 40000 * COIN);
+
+    COutPoint key;
+    Amount amount;
+    BOOST_CHECK(candidates.Find(params, Height, params.nMinRewardBlocks, params.nMinReward, params.nMaxReward, key,
+                                amount));
+    BOOST_CHECK(key == a);
+
+    // Spent (inactivated) rewards drop out
+    candidates.Remove(a, older);
+    BOOST_CHECK_EQUAL(candidates.Size(), 1);
+    BOOST_CHECK(candidates.GetSum() == 20000 * COIN);
+    BOOST_CHECK(candidates.Find(params, Height, params.nMinRewardBlocks, params.nMinReward, params.nMaxReward, key,
+                                amount));
+    BOOST_CHECK(key == b);
+
+    candidates.Remove(a, older);
+    BOOST_CHECK(candidates.GetSum() == 20000 * COIN);
+
+    // Inactive values are never candidates
+    older.SetActive(false);
+    candidates.Add(a, older);
+    BOOST_CHECK_EQUAL(candidates.Size(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
@@ -0,0 +1,230 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <clientversion.h>
+#include <chainparams.h>
+#include <devault/rewards.h>
+#include <devault/rewardsview.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+
+BOOST_FIXTURE_TEST_SUITE(rewardsview_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(rewardsview_cache_write_back) {
+    CRewardsViewDB db("rewards_cache_test", 1 << 20, true);
+    CRewardsViewCache cache(&db);
+
+    COutPoint a(InsecureRand256(), 0);
+    COutPoint b(InsecureRand256(), 1);
+    CRewardValue val(CTxOut(5000 * COIN, CScript() << OP_TRUE), 10, 10, 10);
+
+    // Writes stay in memory until Flush
+    BOOST_CHECK(cache.PutReward(a, val));
+    BOOST_CHECK(cache.HaveReward(a));
+    BOOST_CHECK(!db.HaveReward(a));
+    BOOST_CHECK(cache.DynamicMemoryUsage() > 0);
+
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.HaveReward(a));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+
+    // Reads come through from the DB, misses are cached too
+    CRewardValue read;
+    BOOST_CHECK(cache.GetReward(a, read));
+    BOOST_CHECK(read.GetHeight() == 10);
+    BOOST_CHECK(!cache.HaveReward(b));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2);
+
+    // Inactivation and erasure are only written on Flush
+    std::vector<std::pair<COutPoint, CRewardValue>> spent = {{a, val}};
+    cache.InActivate(spent);
+    BOOST_CHECK(cache.GetReward(a, read));
+    BOOST_CHECK(!read.IsActive());
+    BOOST_CHECK(db.GetReward(a, read));
+    BOOST_CHECK(read.IsActive());
+    cache.EraseReward(a);
+    BOOST_CHECK(!cache.HaveReward(a));
+    BOOST_CHECK(db.HaveReward(a));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!db.HaveReward(a));
+}
+
+BOOST_AUTO_TEST_CASE(rewardsview_cache_height_keys) {
+    CRewardsViewDB db("rewards_cache_test", 1 << 20, true);
+    CRewardsViewCache cache(&db);
+
+    COutPoint a(InsecureRand256(), 0);
+    CRewardValue val(CTxOut(5000 * COIN, CScript() << OP_TRUE), 10, 10, 20);
+
+    COutPoint key;
+    BOOST_CHECK(cache.PutPaidReward(a, val));
+    BOOST_CHECK(cache.GetRewardAtHeight(20, key));
+    BOOST_CHECK(key == a);
+    BOOST_CHECK(!db.GetRewardAtHeight(20, key));
+
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetRewardAtHeight(20, key));
+    BOOST_CHECK(key == a);
+
+    cache.EraseRewardAtHeight(20);
+    BOOST_CHECK(!cache.GetRewardAtHeight(20, key));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!db.GetRewardAtHeight(20, key));
+}
+
+BOOST_AUTO_TEST_CASE(rewardsview_cache_stats) {
+    CRewardsViewDB db("rewards_cache_test", 1 << 20, true);
+    CRewardsViewCache cache(&db);
+
+    CRewardStats stats;
+    BOOST_CHECK(!cache.GetStats(stats));
+    BOOST_CHECK(!stats.IsKnown());
+
+    stats.nHeight = 5;
+    stats.nMiningRewards = 500 * COIN;
+    stats.nBudgetRewards = 50 * COIN;
+    stats.nColdRewards = 5 * COIN;
+    stats.nCount = 3; // active totals are not stored
+    BOOST_CHECK(cache.PutStats(stats));
+    BOOST_CHECK(!db.GetStats(stats));
+
+    BOOST_CHECK(cache.Flush());
+    CRewardStats read;
+    BOOST_CHECK(db.GetStats(read));
+    BOOST_CHECK_EQUAL(read.nHeight, 5);
+    BOOST_CHECK(read.GetTotalSupply() == 555 * COIN);
+    BOOST_CHECK_EQUAL(read.nCount, 0);
+}
+
+BOOST_AUTO_TEST_CASE(rewardsview_cache_cursor) {
+    CRewardsViewDB db("rewards_cache_test", 1 << 20, true);
+    CRewardsViewCache cache(&db);
+
+    uint256 txid = InsecureRand256();
+    COutPoint a(txid, 0), b(txid, 1), c(txid, 5), d(txid, 200);
+    CRewardValue val(CTxOut(5000 * COIN, CScript() << OP_TRUE), 10, 10, 10);
+    CRewardValue paid(CTxOut(5000 * COIN, CScript() << OP_TRUE), 10, 10, 30);
+    BOOST_CHECK(db.PutReward(a, val));
+    BOOST_CHECK(db.PutReward(b, val));
+    BOOST_CHECK(db.PutReward(d, val));
+
+    // Unflushed writes and erasures show up in DB order, and the DB is left alone
+    BOOST_CHECK(cache.EraseReward(b));
+    BOOST_CHECK(cache.PutReward(c, val));
+    BOOST_CHECK(cache.PutReward(d, paid));
+    std::vector<COutPoint> expected = {a, c, d};
+    COutPoint key;
+    CRewardValue read;
+    std::unique_ptr<CRewardsViewDBCursor> pcursor(cache.Cursor());
+    for (const COutPoint &outpoint : expected) {
+        BOOST_CHECK(pcursor->Valid());
+        BOOST_CHECK(pcursor->GetKey(key));
+        BOOST_CHECK(key == outpoint);
+        BOOST_CHECK(pcursor->GetValue(read));
+        BOOST_CHECK_EQUAL(read.GetHeight(), (outpoint == d ? 30 : 10));
+        pcursor->Next();
+    }
+    BOOST_CHECK(!pcursor->Valid());
+    BOOST_CHECK(db.HaveReward(b));
+    BOOST_CHECK(!db.HaveReward(c));
+
+    // Cached keys read the same as the DB ones, from any start
+    pcursor.reset(cache.Cursor(b));
+    BOOST_CHECK(pcursor->GetKey(key));
+    BOOST_CHECK(key == c);
+    pcursor->Next();
+    COutPoint cachedKey;
+    BOOST_CHECK(pcursor->GetKey(cachedKey));
+    BOOST_CHECK(cache.Flush());
+    pcursor.reset(db.Cursor(d));
+    BOOST_CHECK(pcursor->GetKey(key));
+    BOOST_CHECK(key == cachedKey);
+}
+
+BOOST_AUTO_TEST_CASE(rewardsview_cursor_start) {
+    CRewardsViewDB db("rewards_cursor_test", 1 << 20, true);
+
+    // n >= 128 reads back as written
+    uint256 txid = InsecureRand256();
+    std::vector<COutPoint> keys = {COutPoint(txid, 0), COutPoint(txid, 200), COutPoint(txid, 1000)};
+    CRewardValue val(CTxOut(5000 * COIN, CScript() << OP_TRUE), 10, 10, 10);
+    for (const auto &key : keys) BOOST_CHECK(db.PutReward(key, val));
+
+    COutPoint key;
+    std::unique_ptr<CRewardsViewDBCursor> pcursor(db.Cursor(keys[1]));
+    for (size_t i = 1; i < keys.size(); i++) {
+        BOOST_CHECK(pcursor->Valid());
+        BOOST_CHECK(pcursor->GetKey(key));
+        BOOST_CHECK(key == keys[i]);
+        pcursor->Next();
+    }
+    BOOST_CHECK(!pcursor->Valid());
+
+    // Compact dump records round trip
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CRewardDumpRecord(keys[2], val);
+    CRewardDumpRecord record;
+    ss >> record;
+    BOOST_CHECK(record.outpoint == keys[2]);
+    BOOST_CHECK(record.reward.GetValue() == val.GetValue());
+    BOOST_CHECK(record.reward.txout.scriptPubKey == val.txout.scriptPubKey);
+    BOOST_CHECK_EQUAL(record.reward.GetHeight(), 10);
+    BOOST_CHECK(record.reward.IsActive());
+}
+
+BOOST_AUTO_TEST_CASE(rewardsview_candidates_reload) {
+    const Consensus::Params &params = Params().GetConsensus();
+    const int nHeight = params.nMinRewardBlocks + 100;
+    CRewardsViewDB db("rewards_candidates_test", 1 << 20, true);
+    CRewardsViewCache cache(&db);
+
+    // The oldest reward at n = 200, then equal ones at n = 1 and n = 256
+    uint256 txid = InsecureRand256();
+    COutPoint oldest(txid, 200), low(txid, 1), high(txid, 256);
+    CRewardValue oldestVal(CTxOut(100000 * COIN, CScript() << OP_1), 1, 1, 1);
+    CRewardValue lowVal(CTxOut(100000 * COIN, CScript() << OP_2), 2, 2, 2);
+    CRewardValue highVal(CTxOut(100000 * COIN, CScript() << OP_3), 2, 2, 2);
+    BOOST_CHECK(db.PutReward(oldest, oldestVal));
+    BOOST_CHECK(db.PutReward(low, lowVal));
+    BOOST_CHECK(db.PutReward(high, highVal));
+
+    // The candidates are indexed under the outpoints they were written under
+    CColdRewards rewards(params, &cache);
+    {
+        LOCK(cs_rewardsdb);
+        rewards.LoadCandidatesFromDB();
+    }
+    BOOST_CHECK_EQUAL(rewards.GetStats().nCount, 3);
+    std::vector<COutPoint> indexed;
+    rewards.ForEachCandidate([&](const CRewardCandidate &candidate) {
+        indexed.push_back(candidate.outpoint);
+        return true;
+    });
+    BOOST_REQUIRE_EQUAL(indexed.size(), 3U);
+    BOOST_CHECK(indexed[0] == oldest);
+    CTxOut out;
+    BOOST_CHECK(rewards.FindReward(params, nHeight, out));
+    BOOST_CHECK(out.scriptPubKey == oldestVal.txout.scriptPubKey);
+
+    // Spending it takes it out of the index
+    CMutableTransaction spend;
+    spend.vin.emplace_back(oldest);
+    spend.vout.emplace_back(COIN, CScript() << OP_TRUE);
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(spend));
+    BOOST_CHECK(rewards.UpdateWithBlock(block, nHeight));
+    BOOST_CHECK_EQUAL(rewards.GetStats().nCount, 2);
+
+    // Between equal rewards the tie-break is the key as the cursor used to
+    // read it, where n = 256 comes before n = 1
+    BOOST_CHECK(GetRewardTieBreakKey(high) < GetRewardTieBreakKey(low));
+    BOOST_CHECK(rewards.FindReward(params, nHeight, out));
+    BOOST_CHECK(out.scriptPubKey == highVal.txout.scriptPubKey);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
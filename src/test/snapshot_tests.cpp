@@ -0,0 +1,223 @@
+// Copyright (c) 2019 The DeVault developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coinstats.h>
+#include <devault/rewards.h>
+#include <devault/rewards_calculation.h>
+#include <devault/rewardsview.h>
+#include <fs_util.h>
+#include <snapshot.h>
+#include <streams.h>
+#include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(snapshot_tests, TestChain100Setup)
+
+//! Read up to the coins of a snapshot, checking the headers on the way
+static bool SkipToState(CAutoFile &file, SnapshotMetadata &metadata) {
+    std::string error;
+    if (!ReadSnapshotMetadata(Params(), file, metadata, error)) {
+        return false;
+    }
+    LOCK(cs_main);
+    for (int nHeight = 1; nHeight <= metadata.nHeight; nHeight++) {
+        CBlockHeader header;
+        file >> header;
+        if (header.GetHash() != chainActive[nHeight]->GetBlockHash()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_round_trip) {
+    COutPoint paid(InsecureRand256(), 0);
+    CRewardValue reward(CTxOut(5000 * COIN, CScript() << OP_TRUE), 10, 10, 20);
+    CRewardStats rewardStats;
+    rewardStats.nHeight = 100;
+    rewardStats.nColdRewards = 50 * COIN;
+    BOOST_CHECK(prewardsTip->PutPaidReward(paid, reward));
+    BOOST_CHECK(prewardsTip->PutStats(rewardStats));
+
+    const fs::path path = GetDataDir() / "snapshot.dat";
+    SnapshotMetadata written;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(DumpSnapshot(Params(), file, written));
+    }
+    BOOST_CHECK(written.hashBaseBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(written.nHeight, 100);
+    BOOST_CHECK(written.nCoins > 0);
+    BOOST_CHECK(written.nRewards >= 1);
+    BOOST_CHECK(written.nRewardHeights >= 1);
+
+    // The header was rewritten with the counts and the hash
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata metadata;
+    BOOST_REQUIRE(SkipToState(file, metadata));
+    BOOST_CHECK(metadata.hashSnapshot == written.hashSnapshot);
+    BOOST_CHECK_EQUAL(metadata.nCoins, written.nCoins);
+
+    CCoinsViewDB coinsdb(1 << 20, true);
+    CRewardsViewDB rewardsdb("rewards_snapshot_test", 1 << 20, true);
+    std::string error;
+    BOOST_REQUIRE(ReadSnapshotState(file, metadata, coinsdb, rewardsdb, error));
+
+    // Until it gets a best block the loaded chainstate isn't one
+    BOOST_CHECK(coinsdb.GetBestBlock().IsNull());
+    BOOST_CHECK(coinsdb.GetHeadBlocks().size() == 2);
+    CCoinsMap empty;
+    BOOST_CHECK(coinsdb.BatchWrite(empty, metadata.hashBaseBlock, true));
+
+    CCoinsStats expected, stats;
+    BOOST_REQUIRE(GetUTXOStats(pcoinsdbview.get(), expected,
+                               CoinStatsHashType::HASH_SERIALIZED, nullptr,
+                               false));
+    BOOST_REQUIRE(GetUTXOStats(&coinsdb, stats,
+                               CoinStatsHashType::HASH_SERIALIZED, nullptr,
+                               false));
+    BOOST_CHECK(stats.hashSerialized == expected.hashSerialized);
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, metadata.nCoins);
+
+    CRewardValue read;
+    COutPoint atHeight;
+    CRewardStats readStats;
+    BOOST_CHECK(rewardsdb.GetReward(paid, read));
+    BOOST_CHECK_EQUAL(read.GetHeight(), 20U);
+    BOOST_CHECK(rewardsdb.GetRewardAtHeight(20, atHeight));
+    BOOST_CHECK(atHeight == paid);
+    BOOST_CHECK(rewardsdb.GetStats(readStats));
+    BOOST_CHECK(readStats.nColdRewards == 50 * COIN);
+
+    // Only an empty chainstate can be loaded into
+    CAutoFile again(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(SkipToState(again, metadata));
+    BOOST_CHECK(!ReadSnapshotState(again, metadata, coinsdb, rewardsdb, error));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_rejects_tampering) {
+    // With a reward and totals, so that the last bytes are rewards data
+    CRewardStats rewardStats;
+    rewardStats.nHeight = 100;
+    rewardStats.nColdRewards = 50 * COIN;
+    BOOST_CHECK(prewardsTip->PutReward(
+        COutPoint(InsecureRand256(), 0),
+        CRewardValue(CTxOut(5000 * COIN, CScript() << OP_TRUE), 10, 10, 10)));
+    BOOST_CHECK(prewardsTip->PutStats(rewardStats));
+
+    const fs::path path = GetDataDir() / "snapshot.dat";
+    SnapshotMetadata written;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(DumpSnapshot(Params(), file, written));
+    }
+    std::vector<char> data(fs::file_size(path));
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        file.read(data.data(), data.size());
+    }
+
+    CCoinsViewDB coinsdb(1 << 20, true);
+    CRewardsViewDB rewardsdb("rewards_snapshot_test", 1 << 20, true);
+    SnapshotMetadata metadata;
+    std::string error;
+
+    // Change the txid of the first coin, then the reward totals at the end
+    const size_t nFirstCoin =
+        GetSerializeSize(written, SER_DISK, CLIENT_VERSION) +
+        written.nHeight *
+            GetSerializeSize(CBlockHeader(), SER_DISK, CLIENT_VERSION);
+    for (const size_t nPos : {nFirstCoin, data.size() - 1}) {
+        data[nPos] ^= 1;
+        const fs::path bad = GetDataDir() / "snapshot_bad.dat";
+        {
+            CAutoFile file(fsbridge::fopen(bad, "wb"), SER_DISK,
+                           CLIENT_VERSION);
+            file.write(data.data(), data.size());
+        }
+        data[nPos] ^= 1;
+
+        CAutoFile file(fsbridge::fopen(bad, "rb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(SkipToState(file, metadata));
+        BOOST_CHECK(
+            !ReadSnapshotState(file, metadata, coinsdb, rewardsdb, error));
+
+        // Nothing was written
+        std::unique_ptr<CCoinsViewCursor> pcoins(coinsdb.Cursor());
+        BOOST_CHECK(!pcoins->Valid());
+        BOOST_CHECK(coinsdb.GetHeadBlocks().empty());
+        std::unique_ptr<CRewardsViewDBCursor> prewardsCursor(
+            rewardsdb.Cursor());
+        BOOST_CHECK(!prewardsCursor->Valid());
+        CRewardStats stats;
+        BOOST_CHECK(!rewardsdb.GetStats(stats));
+    }
+
+    // So the good snapshot can still be loaded
+    CAutoFile good(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(SkipToState(good, metadata));
+    BOOST_CHECK(ReadSnapshotState(good, metadata, coinsdb, rewardsdb, error));
+
+    // Snapshots of another network are refused up front
+    const auto mainParams = CreateChainParams(CBaseChainParams::MAIN);
+    CAutoFile other(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(!ReadSnapshotMetadata(*mainParams, other, metadata, error));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_rewards_after_load) {
+    const Consensus::Params &params = Params().GetConsensus();
+    const int nHeight = params.nMinRewardBlocks + 100;
+    COutPoint outpoint(InsecureRand256(), 0);
+    CRewardValue reward(CTxOut(100000 * COIN, CScript() << OP_TRUE), 1, 1, 1);
+    BOOST_CHECK(prewardsTip->PutReward(outpoint, reward));
+
+    const fs::path path = GetDataDir() / "snapshot.dat";
+    SnapshotMetadata written;
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(DumpSnapshot(Params(), file, written));
+    }
+
+    // As on startup, the rewards are set up before the snapshot is loaded
+    CCoinsViewDB coinsdb(1 << 20, true);
+    CRewardsViewDB rewardsdb("rewards_snapshot_test", 1 << 20, true);
+    CRewardsViewCache rewardsTip(&rewardsdb);
+    CColdRewards rewards(params, &rewardsTip);
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    SnapshotMetadata metadata;
+    BOOST_REQUIRE(SkipToState(file, metadata));
+    std::string error;
+    BOOST_REQUIRE(ReadSnapshotState(file, metadata, coinsdb, rewardsdb, error));
+
+    // A block paying the reward
+    Amount expected = CalculateReward(params, 1, nHeight - 1, reward.GetValue());
+    BOOST_REQUIRE(expected >= params.nMinReward);
+    expected = std::min(expected, params.nMaxReward);
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.emplace_back(Amount(), CScript() << OP_TRUE);
+    coinbase.vout.push_back(rewards.GetPayment(reward, expected));
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+
+    Amount paid;
+    BOOST_CHECK_EQUAL(rewards.GetStats().nCount, 0);
+    BOOST_CHECK(!rewards.Validate(params, block, nHeight, paid));
+
+    {
+        LOCK(cs_rewardsdb);
+        rewards.LoadCandidatesFromDB();
+    }
+    BOOST_CHECK(rewards.GetStats().nCount >= 1);
+    BOOST_CHECK(rewards.Validate(params, block, nHeight, paid));
+    BOOST_CHECK(paid == expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -111,7 +111,8 @@ TestingSetup::TestingSetup(const std::string &chainName) : BasicTestingSetup(cha
   pcoinsdbview = std::make_unique<CCoinsViewDB>(1 << 23, true);
   pcoinsTip = std::make_unique<CCoinsViewCache>(pcoinsdbview.get());
   prewardsdb = std::make_unique<CRewardsViewDB>("rewards", 1 << 23, true);
-  prewards = std::make_unique<CColdRewards>(chainparams.GetConsensus(), prewardsdb.get());
+  prewardsTip = std::make_unique<CRewardsViewCache>(prewardsdb.get());
+  prewards = std::make_unique<CColdRewards>(chainparams.GetConsensus(), prewardsTip.get());
   pbudget = std::make_unique<CBudget>(config);
   if (!LoadGenesisBlock(chainparams)) { throw std::runtime_error("LoadGenesisBlock failed."); }
   {
@@ -121,6 +122,7 @@ TestingSetup::TestingSetup(const std::string &chainName) : BasicTestingSetup(cha
   nScriptCheckThreads = 3;
   for (int i = 0; i < nScriptCheckThreads - 1; i++) {
     threadGroup.emplace_back(std::thread(&ThreadScriptCheck));
+    threadGroup.emplace_back(std::thread(&ThreadTxPreCheck));
   }
 
   // Deterministic randomness for tests.
@@ -133,6 +135,7 @@ TestingSetup::~TestingSetup() {
   scheduler.interrupt(true);
   scheduler.stop();
   InterruptThreadScriptCheck();
+  InterruptThreadTxPreCheck();
   for (auto &&thread : threadGroup) if (thread.joinable()) thread.join();
   threadGroup.clear();
   
@@ -145,6 +148,7 @@ TestingSetup::~TestingSetup() {
   pcoinsdbview.reset();
   pblocktree.reset();
   prewards.reset();
+  prewardsTip.reset();
   prewardsdb.reset();
   fs::remove_all(pathTemp);
 }
@@ -432,4 +432,98 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup) {
     }
 }
 
+static CMutableTransaction SpendTx(const CTransaction &prev, const CKey &key,
+                                   const CScript &scriptPubKey,
+                                   const Amount nFee = 10 * CENT) {
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(prev.GetId(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = prev.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<uint8_t> vchSig;
+    uint256 hash =
+        SignatureHash(prev.vout[0].scriptPubKey, CTransaction(tx), 0,
+                      SigHashType().withForkId(), prev.vout[0].nValue);
+    BOOST_CHECK(key.SignECDSA(hash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(mempool_precheck, TestChain100Setup) {
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+    CKey otherKey;
+    otherKey.MakeNewKey();
+
+    // A spend, a spend signed with the wrong key, a child of the first one,
+    // a transaction with its input missing and a spend paying no fee
+    std::vector<CMutableTransaction> txs;
+    txs.push_back(
+        SpendTx(CTransaction(coinbaseTxns[0]), coinbaseKey, scriptPubKey));
+    txs.push_back(
+        SpendTx(CTransaction(coinbaseTxns[1]), otherKey, scriptPubKey));
+    txs.push_back(SpendTx(CTransaction(txs[0]), coinbaseKey, scriptPubKey));
+    CMutableTransaction orphan;
+    orphan.vin.resize(1);
+    orphan.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+    orphan.vout.emplace_back(COIN, scriptPubKey);
+    txs.push_back(orphan);
+    txs.push_back(SpendTx(CTransaction(coinbaseTxns[2]), coinbaseKey,
+                          scriptPubKey, Amount::zero()));
+
+    std::vector<CTransactionRef> refs;
+    for (const CMutableTransaction &tx : txs) {
+        refs.push_back(MakeTransactionRef(tx));
+    }
+    std::vector<CValidationState> states;
+    PreCheckMempoolTransactions(GetConfig(), g_mempool, refs, states);
+    BOOST_REQUIRE_EQUAL(states.size(), 5U);
+    BOOST_CHECK(states[0].IsValid());
+    BOOST_CHECK(!states[1].IsValid());
+    BOOST_CHECK(states[2].IsValid());
+    // Missing inputs are left to AcceptToMemoryPool
+    BOOST_CHECK(states[3].IsValid());
+    // The fee is checked before the scripts
+    BOOST_CHECK_EQUAL(states[4].GetRejectReason(), "min relay fee not met");
+    BOOST_CHECK_EQUAL(g_mempool.size(), 0U);
+
+    // The scripts which passed are cached with the mempool flags, the flags
+    // of the tip are left to AcceptToMemoryPool
+    uint32_t flags, blockFlags;
+    {
+        LOCK(cs_main);
+        flags = GetMempoolScriptFlags(GetConfig());
+        blockFlags = GetBlockScriptFlags(GetConfig(), chainActive.Tip());
+        for (size_t i = 0; i < refs.size(); i++) {
+            BOOST_CHECK_EQUAL(
+                IsKeyInScriptCache(GetScriptCacheKey(*refs[i], flags), false),
+                i == 0 || i == 2);
+            BOOST_CHECK(!IsKeyInScriptCache(
+                GetScriptCacheKey(*refs[i], blockFlags), false));
+        }
+    }
+
+    // The rest is done by AcceptToMemoryPool, which agrees
+    BOOST_CHECK(ToMemPool(txs[0]));
+    BOOST_CHECK(!ToMemPool(txs[1]));
+    BOOST_CHECK(ToMemPool(txs[2]));
+    BOOST_CHECK(!ToMemPool(txs[3]));
+    BOOST_CHECK_EQUAL(g_mempool.size(), 2U);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(IsKeyInScriptCache(GetScriptCacheKey(*refs[0], blockFlags),
+                                       false));
+        BOOST_CHECK(IsKeyInScriptCache(GetScriptCacheKey(*refs[2], blockFlags),
+                                       false));
+    }
+
+    // Transactions in the mempool already are left alone
+    PreCheckMempoolTransactions(GetConfig(), g_mempool, {refs[0]}, states);
+    BOOST_CHECK(states[0].IsValid());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,12 +6,16 @@
 #include <chainparams.h>
 #include <config.h>
 #include <consensus/consensus.h>
+#include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <script/standard.h>
+#include <streams.h>
 #include <test/test_bitcoin.h>
 #include <util.h>
 #include <fs_util.h>
 #include <validation.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <vector>
@@ -77,4 +81,183 @@ BOOST_AUTO_TEST_CASE(validation_load_external_block_file) {
     BOOST_CHECK_NO_THROW({ LoadExternalBlockFile(config, fp, 0); });
 }
 
+BOOST_AUTO_TEST_CASE(validation_load_external_block_files) {
+    const Config &config = GetConfig();
+    const CChainParams &chainparams = config.GetChainParams();
+
+    // Files of blocks without a known parent, with junk between them
+    std::vector<fs::path> files;
+    for (int i = 0; i < 3; i++) {
+        files.push_back(pathTemp / strprintf("vlebfs_test_%i", i));
+        CAutoFile outs(fsbridge::fopen(files.back(), "wb"), SER_DISK,
+                       CLIENT_VERSION);
+        for (int j = 0; j < 5; j++) {
+            CBlock block = makeLargeDummyBlock(100 * (j + 1));
+            unsigned int size =
+                GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            outs << FLATDATA(chainparams.DiskMagic()) << size << block;
+            outs << uint8_t(j);
+        }
+    }
+    files.push_back(pathTemp / "vlebfs_test_missing");
+
+    // They are all read, checked and skipped
+    BOOST_CHECK(!LoadExternalBlockFiles(config, files, false, 4));
+    BOOST_CHECK(!LoadExternalBlockFiles(config, files, false, 1));
+}
+
+BOOST_FIXTURE_TEST_CASE(validation_read_raw_block, TestChain100Setup) {
+    const Config &config = GetConfig();
+    const CMessageHeader::MessageMagic &magic =
+        config.GetChainParams().DiskMagic();
+    const CScript scriptPubKey =
+        GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+
+    for (int i = 0; i < 2; i++) {
+        const CBlockIndex *pindex;
+        {
+            LOCK(cs_main);
+            pindex = chainActive.Tip();
+        }
+
+        // The bytes on disk are the block as it is sent
+        CBlock block;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, pindex, config));
+        std::vector<uint8_t> expected;
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, expected, 0, block);
+        std::vector<uint8_t> raw;
+        BOOST_CHECK(ReadRawBlockFromDisk(raw, pindex, magic));
+        BOOST_CHECK(raw == expected);
+
+        // A block appended to the mapped file is found too
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+
+    // Block files of another network have another magic
+    const CBlockIndex *pgenesis;
+    {
+        LOCK(cs_main);
+        pgenesis = chainActive.Genesis();
+    }
+    const auto mainParams = CreateChainParams(CBaseChainParams::MAIN);
+    std::vector<uint8_t> raw;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw, pgenesis, mainParams->DiskMagic()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+/**
+ * Index the blocks as -reindex does, on a new chain which only has the genesis
+ * block: blk00000.dat holds the genesis block and the files after it hold the
+ * blocks, in the order of layout. Returns the hashes of the blocks in the order
+ * they were stored.
+ */
+static std::vector<uint256>
+ReindexBlocks(const std::vector<CBlock> &blocks,
+              const std::vector<std::vector<size_t>> &layout, int nThreads,
+              uint256 &hashTip) {
+    TestingSetup setup(CBaseChainParams::REGTEST);
+    const Config &config = GetConfig();
+    const CChainParams &chainparams = config.GetChainParams();
+
+    std::vector<fs::path> files{GetBlockPosFilename(CDiskBlockPos(0, 0), "blk")};
+    std::vector<CDiskBlockPos> vPos(blocks.size());
+    for (size_t nFile = 1; nFile <= layout.size(); nFile++) {
+        files.push_back(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+        CAutoFile outs(fsbridge::fopen(files.back(), "wb"), SER_DISK,
+                       CLIENT_VERSION);
+        unsigned int nPos = 0;
+        for (size_t i : layout[nFile - 1]) {
+            unsigned int size =
+                GetSerializeSize(blocks[i], SER_DISK, CLIENT_VERSION);
+            outs << FLATDATA(chainparams.DiskMagic()) << size << blocks[i];
+            // Junk between the blocks
+            outs << uint8_t(0);
+            nPos += CMessageHeader::MESSAGE_START_SIZE + sizeof(size);
+            vPos[i] = CDiskBlockPos(nFile, nPos);
+            nPos += size + 1;
+        }
+    }
+
+    BOOST_CHECK(LoadExternalBlockFiles(config, files, true, nThreads));
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(config, state));
+
+    LOCK(cs_main);
+    hashTip = chainActive.Tip()->GetBlockHash();
+
+    // Each block is indexed once, where it is in the files
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), blocks.size() + 1);
+    std::vector<const CBlockIndex *> vStored;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        auto it = mapBlockIndex.find(blocks[i].GetHash());
+        BOOST_REQUIRE(it != mapBlockIndex.end());
+        BOOST_CHECK(it->second->nStatus.hasData());
+        BOOST_CHECK(it->second->GetBlockPos() == vPos[i]);
+        vStored.push_back(it->second);
+    }
+
+    std::sort(vStored.begin(), vStored.end(),
+              [](const CBlockIndex *a, const CBlockIndex *b) {
+                  return a->nSequenceId < b->nSequenceId;
+              });
+    std::vector<uint256> stored;
+    for (const CBlockIndex *pindex : vStored) {
+        stored.push_back(pindex->GetBlockHash());
+    }
+    return stored;
+}
+
+// Each part of the test sets up its own chain, one after the other
+BOOST_AUTO_TEST_SUITE(validation_reindex_tests)
+
+BOOST_AUTO_TEST_CASE(validation_reindex_out_of_order) {
+    std::vector<CBlock> blocks;
+    uint256 hashMined;
+    {
+        TestChain100Setup setup;
+        const Config &config = GetConfig();
+        LOCK(cs_main);
+        for (int i = 1; i <= chainActive.Height(); i++) {
+            CBlock block;
+            BOOST_REQUIRE(ReadBlockFromDisk(block, chainActive[i], config));
+            blocks.push_back(block);
+        }
+        hashMined = chainActive.Tip()->GetBlockHash();
+    }
+    BOOST_REQUIRE_EQUAL(blocks.size(), 100U);
+
+    // Blocks 41 to 70 come before their parents, then blocks 1 to 40, then
+    // blocks 71 to 100 in reverse order
+    std::vector<std::vector<size_t>> layout(3);
+    for (size_t i = 40; i < 70; i++) {
+        layout[0].push_back(i);
+    }
+    for (size_t i = 0; i < 40; i++) {
+        layout[1].push_back(i);
+    }
+    for (size_t i = 100; i > 70; i--) {
+        layout[2].push_back(i - 1);
+    }
+
+    // Read by a single thread, a block is stored as soon as its parent is
+    uint256 hashSerial;
+    const std::vector<uint256> serial =
+        ReindexBlocks(blocks, layout, 1, hashSerial);
+    BOOST_CHECK(hashSerial == hashMined);
+    BOOST_REQUIRE_EQUAL(serial.size(), blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++) {
+        BOOST_CHECK(serial[i] == blocks[i].GetHash());
+    }
+
+    // More threads read the files at the same time, which doesn't change the
+    // order in which the blocks are stored
+    for (int nThreads : {2, 4, 8}) {
+        uint256 hashTip;
+        BOOST_CHECK(ReindexBlocks(blocks, layout, nThreads, hashTip) ==
+                    serial);
+        BOOST_CHECK(hashTip == hashSerial);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -9,14 +9,19 @@
 #include <serialize.h>
 #include <uint256.h>
 
+/**
+ * Timestamps are big endian so the rows sort by time, and a range of
+ * timestamps is a single seek.
+ */
 struct CTimestampIndexIteratorKey {
     uint32_t timestamp;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream> void Serialize(Stream &s) const {
+        ser_writedata32be(s, timestamp);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream &s, Operation ser_action) {
-        READWRITE(timestamp);
+    template <typename Stream> void Unserialize(Stream &s) {
+        timestamp = ser_readdata32be(s);
     }
 
     CTimestampIndexIteratorKey(uint32_t time) { timestamp = time; }
@@ -30,12 +35,14 @@ struct CTimestampIndexKey {
     uint32_t timestamp;
     uint256 blockHash;
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream> void Serialize(Stream &s) const {
+        ser_writedata32be(s, timestamp);
+        blockHash.Serialize(s);
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream &s, Operation ser_action) {
-        READWRITE(timestamp);
-        READWRITE(blockHash);
+    template <typename Stream> void Unserialize(Stream &s) {
+        timestamp = ser_readdata32be(s);
+        blockHash.Unserialize(s);
     }
 
     CTimestampIndexKey(uint32_t time, const uint256 &hash) {
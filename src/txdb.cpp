@@ -23,9 +23,10 @@ static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 
-static const char DB_ADDRESSINDEX = 'a';
-static const char DB_TIMESTAMPINDEX = 's';
-static const char DB_BLOCKHASHINDEX = 'z';
+// Address index layouts of earlier versions, see DropAddrIndex
+static const char DB_ADDRESSINDEX_LEGACY = 'a';
+static const char DB_ADDRESSINDEX = 'A';
+static const char DB_ADDRESSBALANCE = 'Y';
 //static const char DB_SPENTINDEX = 'p';
 //static const char DB_ADDRESSUNSPENTINDEX = 'u';
 
@@ -37,6 +38,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_SNAPSHOT_BASE = 'S';
 
 namespace {
 
@@ -64,7 +66,8 @@ struct CoinEntry {
 } // namespace
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe)
-    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) {}
+    : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true,
+         "chainstate") {}
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
     return db.Read(CoinEntry(&outpoint), coin);
@@ -88,7 +91,8 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                              bool erase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -139,7 +143,9 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             }
         }
     }
-    mapCoins.clear();
+    if (erase) {
+        mapCoins.clear();
+    }
 
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
@@ -155,6 +161,19 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+bool CCoinsViewDB::BulkWrite(const std::vector<std::pair<COutPoint, Coin>> &coins,
+                             const uint256 &hashBlock) {
+    CDBBatch batch(db);
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, uint256()});
+    for (const auto &it : coins) {
+        batch.Write(CoinEntry(&it.first), it.second);
+    }
+    LogPrint(BCLog::COINDB, "Writing snapshot batch of %.2f MiB\n",
+             batch.SizeEstimate() * (1.0 / 1048576.0));
+    return db.WriteBatch(batch);
+}
+
 size_t CCoinsViewDB::EstimateSize() const {
     return db.EstimateSize(DB_COIN, char(DB_COIN + 1));
 }
@@ -163,7 +182,7 @@ CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
     : CDBWrapper(gArgs.IsArgSet("-blocksdir")
                      ? GetDataDir() / "blocks" / "index"
                      : GetBlocksDir() / "index",
-                 nCacheSize, fMemory, fWipe) {}
+                 nCacheSize, fMemory, fWipe, false, "blockindex") {}
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
     return Read(std::make_pair(DB_BLOCK_FILES, nFile), info);
@@ -181,6 +200,14 @@ bool CBlockTreeDB::ReadReindexing(bool &fReindexing) {
     return true;
 }
 
+bool CBlockTreeDB::WriteSnapshotBase(const uint256 &hash) {
+    return Write(DB_SNAPSHOT_BASE, hash, true);
+}
+
+bool CBlockTreeDB::ReadSnapshotBase(uint256 &hash) {
+    return Read(DB_SNAPSHOT_BASE, hash);
+}
+
 bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
     return Read(DB_LAST_BLOCK, nFile);
 }
@@ -258,106 +285,51 @@ bool CBlockTreeDB::WriteBatchSync(
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::WriteAddrIndex(const std::vector<std::pair<CAddrIndexKey, Amount > >&vect) {
-    CDBBatch batch(*this);
-    for (const auto& it : vect) {
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it.first), it.second);
-    }
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::EraseAddrIndex(const std::vector<std::pair<CAddrIndexKey, Amount > >&vect) {
-    CDBBatch batch(*this);
-    for (const auto& it : vect) {
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it.first));
-    }
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadAddrIndex(const std::string& addr,
-                                 std::vector<std::pair<CAddrIndexKey, Amount> > &addressIndex,
-                                 int start, int end) {
-
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-  
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddrIndexIteratorHeightKey(addr,start)));
-    } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddrIndexIteratorKey(addr)));
-    }
-    
-    while (pcursor->Valid()) {
-        interruption_point(ShutdownRequested());
-        std::pair<char,CAddrIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX) {
-            if (key.second.addr == addr) {
-                if (end > 0 && key.second.blockHeight > end) {
-                    break;
-                }
-                Amount nValue;
-                if (pcursor->GetValue(nValue)) {
-                    addressIndex.emplace_back(key.second, nValue);
-                    pcursor->Next();
-                } else {
-                    return error("failed to get address index value");
-                }
-            } else {
-                // XXXX : Try break later
-                pcursor->Next();
-            }
-        } else {
-            break;
+// Erase all the rows of one key prefix, K being the key type of the rows.
+// The range is only compacted if there was something to erase, which is the
+// case once: this runs on every startup.
+template <typename K>
+static bool EraseKeyPrefix(CBlockTreeDB &db, char prefix, int64_t &count) {
+    const size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    std::pair<char, K> key;
+    int64_t nErased = 0;
+    for (pcursor->Seek(prefix); pcursor->Valid(); pcursor->Next()) {
+        if (ShutdownRequested()) return false;
+        if (!pcursor->GetKey(key) || key.first != prefix) break;
+        batch.Erase(key);
+        nErased++;
+        if (batch.SizeEstimate() > batch_size) {
+            db.WriteBatch(batch);
+            batch.Clear();
         }
     }
-    return true;
-}
-
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly,
-                                       std::vector<std::pair<uint256, unsigned int> > &hashes) {
-
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
-    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
-    
-    while (pcursor->Valid()) {
-        interruption_point(ShutdownRequested());
-        std::pair<char, CTimestampIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high) {
-            if (fActiveOnly) {
-                if (HashOnchainActive(key.second.blockHash)) {
-                    hashes.emplace_back(key.second.blockHash, key.second.timestamp);
-                }
-            } else {
-                hashes.emplace_back(key.second.blockHash, key.second.timestamp);
-            }
-            
-            pcursor->Next();
-        } else {
-            break;
-        }
+    if (nErased == 0) {
+        return true;
     }
-     
+    db.WriteBatch(batch);
+    db.CompactRange(prefix, char(prefix + 1));
+    count += nErased;
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
-
-    CTimestampBlockIndexValue lts;
-    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
+/**
+ * The address index used to be written here by ConnectBlock, it now has its
+ * own database (see index/addrindex.h) and is rebuilt there in the background.
+ */
+bool CBlockTreeDB::DropAddrIndex() {
+    int64_t count = 0;
+    if (!EraseKeyPrefix<CLegacyAddrIndexKey>(*this, DB_ADDRESSINDEX_LEGACY, count) ||
+        !EraseKeyPrefix<CAddrIndexKey>(*this, DB_ADDRESSINDEX, count) ||
+        !EraseKeyPrefix<uint160>(*this, DB_ADDRESSBALANCE, count)) {
         return false;
-    
-    ltimestamp = lts.ltimestamp;
+    }
+    if (count > 0) {
+        LogPrintf("Removed %d address index rows from the block index database\n", count);
+        // So that an older version doesn't take the index as complete
+        WriteFlag("addressindex", false);
+    }
     return true;
 }
 
@@ -24,6 +24,9 @@ class Config;
 
 //! No need to periodic flush if at least this much space still available.
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
+//! Share of its budget (percent) the coins cache keeps, the most recently used
+//! coins, when it is written because of its size.
+static constexpr int COINS_CACHE_KEEP_PERCENT = 50;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
@@ -39,6 +42,14 @@ static const int64_t nMaxBlockDBCache = 2;
 // a meaningful difference:
 // https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to the address index DB specific cache (MiB)
+static const int64_t nMaxAddrIndexCache = 1024;
+//! Max memory allocated to the timestamp index DB specific cache (MiB)
+static const int64_t nMaxTimestampIndexCache = 8;
+//! Max memory allocated to the coin stats index DB specific cache (MiB)
+static const int64_t nMaxCoinStatsIndexCache = 8;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -55,9 +66,16 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock,
+                    bool erase) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Write coins read from a UTXO snapshot of hashBlock, in key order. Until
+    //! the snapshot is complete the head blocks mark the database as being in
+    //! transition, so an interrupted load can't pass for a chainstate.
+    bool BulkWrite(const std::vector<std::pair<COutPoint, Coin>> &coins,
+                   const uint256 &hashBlock);
+
     //! Attempt to update from an older database format.
     //! Returns whether an error occurred.
     bool Upgrade();
@@ -98,18 +116,11 @@ public:
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
+    //! Base block of the UTXO snapshot the chainstate was loaded from
+    bool WriteSnapshotBase(const uint256 &hash);
+    bool ReadSnapshotBase(uint256 &hash);
 
-    bool WriteAddrIndex(const std::vector<std::pair<CAddrIndexKey, Amount> > &vect);
-    bool EraseAddrIndex(const std::vector<std::pair<CAddrIndexKey, Amount> > &vect);
-    bool ReadAddrIndex(const std::string& addr,
-                          std::vector<std::pair<CAddrIndexKey, Amount> > &addressIndex,
-                          int start = 0, int end = 0);
-
-    
-    bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
-    bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
-    bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
-    bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    bool DropAddrIndex();
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(
@@ -747,6 +747,7 @@ public:
 
     size_t DynamicMemoryUsage() const;
 
+    //! Fired with cs held, once the transaction is in the pool
     boost::signals2::signal<void(CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void(CTransactionRef, MemPoolRemovalReason)>
         NotifyEntryRemoved;
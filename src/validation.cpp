@@ -19,9 +19,12 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
+#include <flatfile.h>
 #include <hash.h>
 #include <index/txindex.h>
 #include <init.h>
+#include <mempooljournal.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <pow.h>
@@ -49,7 +52,9 @@
 #include <devault/budget.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <future>
+#include <mutex>
 #include <sstream>
 #include <thread>
 
@@ -70,10 +75,12 @@ CCriticalSection cs_main;
 BlockMap mapBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
+CBlockIndex *pindexSnapshotBase = nullptr;
 Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 int nScriptCheckThreads = 0;
+bool fCoinPrefetch = DEFAULT_COIN_PREFETCH;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fAddressIndex = false;
@@ -85,6 +92,7 @@ bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+size_t nRewardsCacheUsage = nDefaultRewardsCache << 20;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -208,7 +216,7 @@ std::unique_ptr<CBlockTreeDB> pblocktree;
 // DeVault:: Reward
 std::unique_ptr<CColdRewards> prewards;
 std::unique_ptr<CRewardsViewDB> prewardsdb;
-///std::unique_ptr<CCoinsViewCache> prewardsTip;
+std::unique_ptr<CRewardsViewCache> prewardsTip;
 
 std::unique_ptr<CBudget> pbudget;
 
@@ -224,9 +232,6 @@ static void FindFilesToPruneManual(std::set<int> &setFilesToPrune,
 static void FindFilesToPrune(std::set<int> &setFilesToPrune,
                              uint64_t nPruneAfterHeight);
 static FILE *OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
-static uint32_t GetBlockScriptFlags(const Config &config,
-                                    const CBlockIndex *pChainTip);
-
 bool TestLockPointValidity(const LockPoints *lp) {
     AssertLockHeld(cs_main);
     assert(lp);
@@ -357,6 +362,25 @@ static bool IsReplayProtectionEnabledForCurrentBlock(const Config &config) {
     return IsReplayProtectionEnabled(config, chainActive.Tip());
 }
 
+//! The script flags transactions entering the mempool are checked with
+uint32_t GetMempoolScriptFlags(const Config &config) {
+    AssertLockHeld(cs_main);
+
+    // Set extraFlags as a set of flags that needs to be activated.
+    uint32_t extraFlags = SCRIPT_VERIFY_NONE;
+    if (IsReplayProtectionEnabledForCurrentBlock(config)) {
+        extraFlags |= SCRIPT_ENABLE_REPLAY_PROTECTION;
+    }
+
+    if (IsGreatWallEnabledForCurrentBlock(config)) {
+        extraFlags |= SCRIPT_ENABLE_SCHNORR;
+        extraFlags |= SCRIPT_VERIFY_CHECKDATASIG_SIGOPS;
+    }
+
+    // Make sure whatever we need to activate is actually activated.
+    return STANDARD_SCRIPT_VERIFY_FLAGS | extraFlags;
+}
+
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
 // were somehow broken and returning the wrong scriptPubKeys
 static bool CheckInputsFromMempoolAndCache(
@@ -646,20 +670,7 @@ static bool AcceptToMemoryPoolWorker(
                              "too-long-mempool-chain", false, errString);
         }
 
-        // Set extraFlags as a set of flags that needs to be activated.
-        uint32_t extraFlags = SCRIPT_VERIFY_NONE;
-        if (IsReplayProtectionEnabledForCurrentBlock(config)) {
-            extraFlags |= SCRIPT_ENABLE_REPLAY_PROTECTION;
-        }
-
-        if (IsGreatWallEnabledForCurrentBlock(config)) {
-            extraFlags |= SCRIPT_ENABLE_SCHNORR;
-            extraFlags |= SCRIPT_VERIFY_CHECKDATASIG_SIGOPS;
-        }
-
-        // Make sure whatever we need to activate is actually activated.
-        const uint32_t scriptVerifyFlags =
-            STANDARD_SCRIPT_VERIFY_FLAGS | extraFlags;
+        const uint32_t scriptVerifyFlags = GetMempoolScriptFlags(config);
 
         // Check against previous transactions. This is done last to help
         // prevent CPU exhaustion denial-of-service attacks.
@@ -774,18 +785,6 @@ bool HashOnchainActive(const uint256 &hash)
      return true;
 }
 
-bool GetAddrIndex(const std::string& addr,
-                  std::vector<std::pair<CAddrIndexKey, Amount> > &addressIndex, int start, int end)
-{
-    if (!fAddressIndex)
-        return error("address index not enabled");
-
-     if (!pblocktree->ReadAddrIndex(addr, addressIndex, start, end))
-        return error("unable to get txids for address");
-
-     return true;
-}
-
 
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is
@@ -914,6 +913,99 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
     return true;
 }
 
+/** Block files kept memory mapped for ReadRawBlockFromDisk */
+static const size_t MAX_MAPPED_BLOCK_FILES = sizeof(void *) == 8 ? 64 : 4;
+static FlatFileMap blockFileMap(MAX_MAPPED_BLOCK_FILES);
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block, const CDiskBlockPos &pos,
+                          const CMessageHeader::MessageMagic &messageStart) {
+    // The block is preceded by the network magic and its size
+    const unsigned int nHeaderSize = messageStart.size() + sizeof(uint32_t);
+    if (pos.IsNull() || pos.nPos < nHeaderSize) {
+        return error("%s: invalid block position %s", __func__,
+                     pos.ToString());
+    }
+    const size_t nHeaderPos = pos.nPos - nHeaderSize;
+    const fs::path path = GetBlockPosFilename(pos, "blk");
+
+    auto file = blockFileMap.Get(path, pos.nPos);
+    if (file) {
+        const uint8_t *header = file->data() + nHeaderPos;
+        if (memcmp(header, messageStart.data(), messageStart.size()) != 0) {
+            return error("%s: block magic mismatch at %s", __func__,
+                         pos.ToString());
+        }
+        const uint32_t nSize = ReadLE32(header + messageStart.size());
+        if (file->size() - pos.nPos < nSize) {
+            file = blockFileMap.Get(path, size_t(pos.nPos) + nSize);
+            if (!file) {
+                return error("%s: block at %s is past the end of the file",
+                             __func__, pos.ToString());
+            }
+        }
+        block.assign(file->data() + pos.nPos, file->data() + pos.nPos + nSize);
+        return true;
+    }
+
+    // The file could not be mapped, read it instead
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, nHeaderPos), true),
+                     SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenBlockFile failed for %s", __func__,
+                     pos.ToString());
+    }
+    try {
+        CMessageHeader::MessageMagic magic;
+        uint32_t nSize;
+        filein >> FLATDATA(magic) >> nSize;
+        if (magic != messageStart) {
+            return error("%s: block magic mismatch at %s", __func__,
+                         pos.ToString());
+        }
+        if (fs::file_size(path) - pos.nPos < nSize) {
+            return error("%s: block at %s is past the end of the file",
+                         __func__, pos.ToString());
+        }
+        block.resize(nSize);
+        filein.read(reinterpret_cast<char *>(block.data()), nSize);
+    } catch (const std::exception &e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(),
+                     pos.ToString());
+    }
+    return true;
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex,
+                          const CMessageHeader::MessageMagic &messageStart) {
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    if (!ReadRawBlockFromDisk(block, blockPos, messageStart)) {
+        return false;
+    }
+
+    // Only the header is parsed, to check this is the block asked for
+    CBlockHeader header;
+    try {
+        VectorReader(SER_DISK, CLIENT_VERSION, block, 0) >> header;
+    } catch (const std::exception &e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                     blockPos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash()) {
+        return error("ReadRawBlockFromDisk(std::vector<uint8_t>&, "
+                     "CBlockIndex*): GetHash() doesn't match index for %s at "
+                     "%s",
+                     pindex->ToString(), blockPos.ToString());
+    }
+
+    return true;
+}
+
 Amount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams) {
   // Peak currently happens 1 1/2 years out
   const int64_t nPeakHeight = 1.5*consensusParams.nBlocksPerYear;
@@ -1136,42 +1228,33 @@ bool CScriptCheck::operator()() {
                         &error);
 }
 
+void CCheckBatch<CScriptCheck>::Open() {
+    OpenSignatureBatch();
+}
+
+bool CCheckBatch<CScriptCheck>::Close() {
+    return CloseSignatureBatch();
+}
+
 int GetSpendHeight(const CCoinsViewCache &inputs) {
     LOCK(cs_main);
     CBlockIndex *pindexPrev = mapBlockIndex.find(inputs.GetBestBlock())->second;
     return pindexPrev->nHeight + 1;
 }
 
-bool CheckInputs(const CTransaction &tx, CValidationState &state,
-                 const CCoinsViewCache &inputs, bool fScriptChecks,
-                 const uint32_t flags, bool sigCacheStore,
-                 bool scriptCacheStore,
-                 const PrecomputedTransactionData &txdata,
-                 std::vector<CScriptCheck> *pvChecks) {
-    assert(!tx.IsCoinBase());
-
+/**
+ * Run the scripts of the inputs of tx, or push them onto pvChecks, without
+ * looking at the script execution cache.
+ */
+static bool CheckInputScripts(const CTransaction &tx, CValidationState &state,
+                              const CCoinsViewCache &inputs,
+                              const uint32_t flags, bool sigCacheStore,
+                              const PrecomputedTransactionData &txdata,
+                              std::vector<CScriptCheck> *pvChecks) {
     if (pvChecks) {
         pvChecks->reserve(tx.vin.size());
     }
 
-    // Skip script verification when connecting blocks under the assumedvalid
-    // block. Assuming the assumedvalid block is valid this is safe because
-    // block merkle hashes are still computed and checked, of course, if an
-    // assumed valid block is invalid due to false scriptSigs this optimization
-    // would allow an invalid chain to be accepted.
-    if (!fScriptChecks) {
-        return true;
-    }
-
-    // First check if script executions have been cached with the same flags.
-    // Note that this assumes that the inputs provided are correct (ie that the
-    // transaction hash which is in tx's prevouts properly commits to the
-    // scriptPubKey in the inputs view of that transaction).
-    uint256 hashCacheEntry = GetScriptCacheKey(tx, flags);
-    if (IsKeyInScriptCache(hashCacheEntry, !scriptCacheStore)) {
-        return true;
-    }
-
     for (size_t i = 0; i < tx.vin.size(); i++) {
         const COutPoint &prevout = tx.vin[i].prevout;
         const Coin &coin = inputs.AccessCoin(prevout);
@@ -1243,6 +1326,40 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
         }
     }
 
+    return true;
+}
+
+bool CheckInputs(const CTransaction &tx, CValidationState &state,
+                 const CCoinsViewCache &inputs, bool fScriptChecks,
+                 const uint32_t flags, bool sigCacheStore,
+                 bool scriptCacheStore,
+                 const PrecomputedTransactionData &txdata,
+                 std::vector<CScriptCheck> *pvChecks) {
+    assert(!tx.IsCoinBase());
+
+    // Skip script verification when connecting blocks under the assumedvalid
+    // block. Assuming the assumedvalid block is valid this is safe because
+    // block merkle hashes are still computed and checked, of course, if an
+    // assumed valid block is invalid due to false scriptSigs this optimization
+    // would allow an invalid chain to be accepted.
+    if (!fScriptChecks) {
+        return true;
+    }
+
+    // First check if script executions have been cached with the same flags.
+    // Note that this assumes that the inputs provided are correct (ie that the
+    // transaction hash which is in tx's prevouts properly commits to the
+    // scriptPubKey in the inputs view of that transaction).
+    uint256 hashCacheEntry = GetScriptCacheKey(tx, flags);
+    if (IsKeyInScriptCache(hashCacheEntry, !scriptCacheStore)) {
+        return true;
+    }
+
+    if (!CheckInputScripts(tx, state, inputs, flags, sigCacheStore, txdata,
+                           pvChecks)) {
+        return false;
+    }
+
     if (scriptCacheStore && !pvChecks) {
         // We executed all of the provided scripts, and were told to cache the
         // result. Do so now.
@@ -1284,7 +1401,9 @@ bool UndoWriteToDisk(const CBlockUndo &blockundo, CDiskBlockPos &pos,
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
         return error("%s: no undo data available", __func__);
@@ -1316,6 +1435,8 @@ static bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string &strMessage,
                const std::string &userMessage = "") {
@@ -1409,13 +1530,6 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
     // Undo databasing stuff for Rewards.
     if (!ignoreIndices && prewards) prewards->UndoBlock(block, pindex); // add a false here if we see issues possibly
     
-    // For fAddressIndex enabled
-    // Go through all outputs and add back to addressIndex 
-    // Go through all inputs and add the negative of the value to addressIndex
-    // At the End Erase all of those entries in the DB by passing to EraseAddressIndex
-
-    std::vector<std::pair<CAddrIndexKey, Amount> > addrIndex;
-    
     // First, restore inputs.
     for (size_t i = 1; i < block.vtx.size(); i++) {
         const CTransaction &tx = *(block.vtx[i]);
@@ -1425,15 +1539,6 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
             return DISCONNECT_FAILED;
         }
 
-        uint256 hash = tx.GetHash();
-
-        if (fAddressIndex) {
-            for (uint32_t k = tx.vout.size(); k-- > 0;) {
-                const CTxOut &out = tx.vout[k];
-                addrIndex.emplace_back(CAddrIndexKey(GetAddrFromTxOut(out),pindex->nHeight, i, hash, k, false), out.nValue);
-            }
-        }
-        
         for (size_t j = 0; j < tx.vin.size(); j++) {
             const COutPoint &out = tx.vin[j].prevout;
             const Coin &undo = txundo.vprevout[j];
@@ -1442,12 +1547,6 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
                 return DISCONNECT_FAILED;
             }
             fClean = fClean && res != DISCONNECT_UNCLEAN;
-
-            const CTxIn input = tx.vin[j];
-            if (fAddressIndex) {
-                const CTxOut &prevout = view.AccessCoin(tx.vin[j].prevout).GetTxOut();
-                addrIndex.emplace_back(CAddrIndexKey(GetAddrFromTxOut(prevout),pindex->nHeight, i, hash, j, true), -prevout.nValue);
-            }
         }
     }
 
@@ -1479,13 +1578,6 @@ DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
     // Move best block pointer to previous block.
     view.SetBestBlock(block.hashPrevBlock);
 
-    if (!ignoreIndices && (addrIndex.size() > 0)) { // only happens with fAddressIndex set
-        if (!pblocktree->EraseAddrIndex(addrIndex)) {
-            error("Failed to delete addr index");
-            return DISCONNECT_FAILED;
-        }
-    }
-
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -1550,6 +1642,247 @@ void ThreadScriptCheck() {
 
 void InterruptThreadScriptCheck() { scriptcheckqueue.Interrupt(); }
 
+/**
+ * Read of one input of a block from the coins database, done by the prefetch
+ * threads into a slot set aside by the thread connecting the block.
+ */
+class CCoinPrefetch {
+private:
+    const CCoinsView *view;
+    COutPoint outpoint;
+    Coin *coin;
+
+public:
+    CCoinPrefetch() : view(nullptr), coin(nullptr) {}
+    CCoinPrefetch(const CCoinsView *viewIn, const COutPoint &outpointIn,
+                  Coin *coinIn)
+        : view(viewIn), outpoint(outpointIn), coin(coinIn) {}
+
+    bool operator()() {
+        try {
+            if (!view->GetCoin(outpoint, *coin)) {
+                coin->Clear();
+            }
+        } catch (const std::runtime_error &e) {
+            // ConnectBlock reads it again, and handles the error
+            coin->Clear();
+        }
+        return true;
+    }
+
+    void swap(CCoinPrefetch &check) {
+        std::swap(view, check.view);
+        std::swap(outpoint, check.outpoint);
+        std::swap(coin, check.coin);
+    }
+};
+
+static CCheckQueue<CCoinPrefetch> coinprefetchqueue(128);
+
+void ThreadCoinPrefetch() {
+    RenameThread("devault-prefetch");
+    coinprefetchqueue.Thread();
+}
+
+void InterruptThreadCoinPrefetch() { coinprefetchqueue.Interrupt(); }
+
+bool CTxPreCheck::operator()() {
+    if (!CheckRegularTransaction(*tx, *state)) {
+        return true;
+    }
+
+    std::string reason;
+    if (fRequireStandard && !IsStandardTx(*tx, reason)) {
+        state->DoS(0, false, REJECT_NONSTANDARD, reason);
+        return true;
+    }
+
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+    for (size_t i = 0; i < tx->vin.size(); i++) {
+        view.AddCoin(tx->vin[i].prevout, std::move(coins[i]), false);
+    }
+
+    if (fRequireStandard && !AreInputsStandard(*tx, view)) {
+        state->Invalid(false, REJECT_NONSTANDARD,
+                       "bad-txns-nonstandard-inputs");
+        return true;
+    }
+
+    // The script execution cache needs cs_main: PreCheckMempoolTransactions
+    // fills it in once the checks are done. The check against the flags of
+    // the tip is left to AcceptToMemoryPool, which finds the signatures in
+    // the signature cache.
+    PrecomputedTransactionData txdata(*tx);
+    CheckInputScripts(*tx, *state, view, nFlags, sigCacheStore, txdata,
+                      nullptr);
+    return true;
+}
+
+static CCheckQueue<CTxPreCheck> txprecheckqueue(1);
+
+void ThreadTxPreCheck() {
+    RenameThread("devault-txcheck");
+    txprecheckqueue.Thread();
+}
+
+void InterruptThreadTxPreCheck() { txprecheckqueue.Interrupt(); }
+
+void PreCheckMempoolTransactions(const Config &config, CTxMemPool &pool,
+                                 const std::vector<CTransactionRef> &txs,
+                                 std::vector<CValidationState> &states) {
+    AssertLockNotHeld(cs_main);
+
+    states.assign(txs.size(), CValidationState());
+    std::vector<CTxPreCheck> checks;
+    std::vector<bool> vChecked(txs.size(), false);
+    // Coins the snapshot brought into the cache of the tip, which shouldn't
+    // stay there for transactions that won't make it
+    std::vector<std::vector<COutPoint>> vUncache(txs.size());
+    uint32_t flags;
+    {
+        LOCK2(cs_main, pool.cs);
+        flags = GetMempoolScriptFlags(config);
+        const CFeeRate minRelayFee = config.GetMinFeePerKB();
+        const CFeeRate mempoolMinFee = pool.GetMinFee(
+            gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        CCoinsViewCache view(&viewMemPool);
+        for (size_t i = 0; i < txs.size(); i++) {
+            const CTransaction &tx = *txs[i];
+            if (pool.exists(tx.GetId())) {
+                continue;
+            }
+
+            std::vector<Coin> coins;
+            coins.reserve(tx.vin.size());
+            for (const CTxIn &txin : tx.vin) {
+                if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                    vUncache[i].push_back(txin.prevout);
+                }
+                const Coin &coin = view.AccessCoin(txin.prevout);
+                if (coin.IsSpent()) {
+                    break;
+                }
+                coins.push_back(coin);
+            }
+            // Missing inputs are for AcceptToMemoryPool to report
+            if (coins.size() != tx.vin.size()) {
+                continue;
+            }
+
+            // The scripts are the expensive part, so they only run for
+            // transactions paying the fees AcceptToMemoryPool asks for first.
+            // Amounts out of range are for the checks to report.
+            Amount nValueIn = Amount::zero();
+            for (const Coin &coin : coins) {
+                nValueIn += coin.GetTxOut().nValue;
+                if (!MoneyRange(nValueIn)) {
+                    break;
+                }
+            }
+            Amount nValueOut = Amount::zero();
+            for (const CTxOut &txout : tx.vout) {
+                nValueOut += txout.nValue;
+                if (!MoneyRange(txout.nValue) || !MoneyRange(nValueOut)) {
+                    break;
+                }
+            }
+            if (MoneyRange(nValueIn) && MoneyRange(nValueOut)) {
+                Amount nModifiedFees = nValueIn - nValueOut;
+                double nPriorityDummy = 0;
+                pool.ApplyDeltas(tx.GetId(), nPriorityDummy, nModifiedFees);
+                const size_t nSize = tx.GetTotalSize();
+                if (nModifiedFees < mempoolMinFee.GetFee(nSize)) {
+                    states[i].DoS(0, false, REJECT_INSUFFICIENTFEE,
+                                  "mempool min fee not met");
+                    continue;
+                }
+                if (nModifiedFees < minRelayFee.GetFee(nSize)) {
+                    states[i].DoS(0, false, REJECT_INSUFFICIENTFEE,
+                                  "min relay fee not met");
+                    continue;
+                }
+            }
+
+            checks.emplace_back(txs[i], std::move(coins), flags, true,
+                                &states[i]);
+            vChecked[i] = true;
+            AddCoins(view, tx, MEMPOOL_HEIGHT, true);
+        }
+    }
+
+    // Without cs_main, ConnectBlock takes it before a check queue
+    {
+        CCheckQueueControl<CTxPreCheck> control(&txprecheckqueue);
+        control.Add(checks);
+        control.Wait();
+    }
+
+    LOCK(cs_main);
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (vChecked[i] && states[i].IsValid()) {
+            AddKeyInScriptCache(GetScriptCacheKey(*txs[i], flags));
+        } else {
+            for (const COutPoint &outpoint : vUncache[i]) {
+                pcoinsTip->Uncache(outpoint);
+            }
+        }
+    }
+}
+
+/**
+ * Warm the coins cache with the inputs of a block before connecting it, so
+ * that ConnectBlock finds them in memory instead of reading them one at a
+ * time. The reads are spread over the prefetch threads, the cache itself is
+ * only touched by the calling thread once they are done.
+ *
+ * This can't run ahead of the previous block : a flush in between could leave
+ * stale coins in the cache.
+ */
+static void PrefetchBlockCoins(const CBlock &block, CCoinsViewCache &cache,
+                               const CCoinsView &db) {
+    AssertLockHeld(cs_main);
+
+    // Outputs created in the block are found in the view ConnectBlock builds
+    std::set<TxId> block_txids;
+    for (const auto &tx : block.vtx) {
+        block_txids.insert(tx->GetId());
+    }
+
+    std::vector<COutPoint> outpoints;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        for (const CTxIn &txin : block.vtx[i]->vin) {
+            if (!block_txids.count(txin.prevout.GetTxId()) &&
+                !cache.HaveCoinInCache(txin.prevout)) {
+                outpoints.push_back(txin.prevout);
+            }
+        }
+    }
+    if (outpoints.empty()) {
+        return;
+    }
+
+    std::vector<Coin> coins(outpoints.size());
+    {
+        CCheckQueueControl<CCoinPrefetch> control(&coinprefetchqueue);
+        std::vector<CCoinPrefetch> reads;
+        reads.reserve(outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            reads.emplace_back(&db, outpoints[i], &coins[i]);
+        }
+        control.Add(reads);
+        control.Wait();
+    }
+
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        if (!coins[i].IsSpent()) {
+            cache.AddPrefetchedCoin(outpoints[i], std::move(coins[i]));
+        }
+    }
+}
+
 
 int32_t ComputeBlockVersion(const CBlockIndex *pindexPrev,
                             const Consensus::Params &params) {
@@ -1558,8 +1891,8 @@ int32_t ComputeBlockVersion(const CBlockIndex *pindexPrev,
 }
 
 // Returns the script flags which should be checked for a given block
-static uint32_t GetBlockScriptFlags(const Config &config,
-                                    const CBlockIndex *pChainTip) {
+uint32_t GetBlockScriptFlags(const Config &config,
+                             const CBlockIndex *pChainTip) {
     AssertLockHeld(cs_main);
     //const Consensus::Params &consensusParams = config.GetChainParams().GetConsensus();
 
@@ -1767,13 +2100,6 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
 
 
-    // For fAddressIndex enabled (ignoring coinbase)
-    // Go through all inputs and add the negative of the value to addressIndex 
-    // Go through all output and add the value to addressIndex
-    // At the End Write all of those entries to the DB by passing to WriteAddressIndex
-
-    std::vector<std::pair<CAddrIndexKey, Amount> > addrIndex;
-    
     for (const auto &ptx : block.vtx) {
         const CTransaction &tx = *ptx;
 
@@ -1790,18 +2116,8 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
         // In both cases, we get a more meaningful feedback out of it.
         AddCoins(view, tx, pindex->nHeight, true);
     }
-    int i=0;
     for (const auto &ptx : block.vtx) {
         const CTransaction &tx = *ptx;
-        const uint256 txhash = tx.GetHash();
-      
-        if (fAddressIndex) {
-          for (unsigned int k = 0; k < tx.vout.size(); k++) {
-            const CTxOut &out = tx.vout[k];
-            addrIndex.emplace_back(CAddrIndexKey(GetAddrFromTxOut(out), pindex->nHeight, i, txhash, k, false), out.nValue);
-          }
-        }
-      
         if (tx.IsCoinBase()) {
             continue;
         }
@@ -1836,17 +2152,6 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
                 REJECT_INVALID, "bad-txns-nonfinal");
         }
 
-
-        if (fAddressIndex) {
-            for (size_t j = 0; j < tx.vin.size(); j++) {
-                const CTxIn input = tx.vin[j];
-                const CTxOut &prevout = view.AccessCoin(tx.vin[j].prevout).GetTxOut();
-                addrIndex.emplace_back(CAddrIndexKey(GetAddrFromTxOut(prevout), pindex->nHeight, i, txhash, j, true), -prevout.nValue);
-            }
-            i++;
-        }
-
-
         // GetTransactionSigOpCount counts 2 types of sigops:
         // * legacy (always)
         // * p2sh (when P2SH enabled in flags and excludes coinbase)
@@ -1947,14 +2252,12 @@ static bool ConnectBlock(const Config &config, const CBlock &block,
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (addrIndex.size() > 0) {
-        if (!pblocktree->WriteAddrIndex(addrIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-    }
-  
     // DeVault:: Reward, update DB entry
     if (nColdReward > Amount()) prewards->UpdateRewardsDB(pindex->nHeight);
+    // and the running reward totals (not when re-checking blocks in VerifyDB)
+    if (!ignoreAddressIndex) {
+        prewards->ConnectBlockStats(pindex->nHeight, nBlockSubsidy, nBudgetReward, nColdReward);
+    }
 
     assert(pindex->phashBlock);
     // add this block to the view's block chain
@@ -2036,6 +2339,11 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
             // The cache is over the limit, we have to write now.
             bool fCacheCritical =
                 mode == FlushStateMode::IF_NEEDED && cacheSize > nTotalSpace;
+            // The rewards cache is over its own limit, it is only written
+            // together with the chainstate.
+            bool fRewardsCacheCritical =
+                mode == FlushStateMode::IF_NEEDED && prewardsTip &&
+                prewardsTip->DynamicMemoryUsage() > nRewardsCacheUsage;
             // It's been a while since we wrote the block index to disk. Do this
             // frequently, so we don't need to redownload after a crash.
             bool fPeriodicWrite =
@@ -2048,7 +2356,8 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
                 nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
             // Combine all conditions that result in a full cache flush.
             fDoFullFlush = (mode == FlushStateMode::ALWAYS) || fCacheLarge ||
-                           fCacheCritical || fPeriodicFlush || fFlushForPrune;
+                           fCacheCritical || fRewardsCacheCritical ||
+                           fPeriodicFlush || fFlushForPrune;
             // Write blocks and block index to disk.
             if (fDoFullFlush || fPeriodicWrite) {
                 // Depend on nMinDiskSpace to ensure we can write block index
@@ -2103,11 +2412,29 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
                     return state.Error("out of disk space");
                 }
 
+                // Flush the rewards ahead of the chainstate, so the coins
+                // best block never gets ahead of them.
+                if (prewardsTip && !prewardsTip->Flush()) {
+                    return AbortNode(state,
+                                     "Failed to write to rewards database");
+                }
+
                 // Flush the chainstate (which may refer to block index
-                // entries).
-                if (!pcoinsTip->Flush()) {
+                // entries). The coins stay cached, so that validation doesn't
+                // have to read them again, but if the cache has outgrown its
+                // budget the least recently used ones are evicted.
+                if (!pcoinsTip->Sync()) {
                     return AbortNode(state, "Failed to write to coin database");
                 }
+                if (fCacheLarge || fCacheCritical) {
+                    pcoinsTip->Trim(nTotalSpace * COINS_CACHE_KEEP_PERCENT /
+                                    100);
+                    LogPrint(BCLog::COINDB,
+                             "Kept %u coins (%.2f MiB) in the cache\n",
+                             pcoinsTip->GetCacheSize(),
+                             pcoinsTip->DynamicMemoryUsage() *
+                                 (1.0 / 1048576.0));
+                }
                 nLastFlush = nNow;
                 full_flush_completed = true;
             }
@@ -2245,6 +2572,7 @@ static bool DisconnectTip(const Config &config, CValidationState &state,
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2437,6 +2765,14 @@ static bool ConnectTip(const Config &config, CValidationState &state,
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n",
              (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    if (fCoinPrefetch && nScriptCheckThreads) {
+        PrefetchBlockCoins(blockConnecting, *pcoinsTip, *pcoinsdbview);
+        int64_t nTimePrefetched = GetTimeMicros();
+        nTimePrefetch += nTimePrefetched - nTime2;
+        LogPrint(BCLog::BENCH, "  - Prefetch coins: %.2fms [%.2fs]\n",
+                 (nTimePrefetched - nTime2) * MILLI, nTimePrefetch * MICRO);
+        nTime2 = nTimePrefetched;
+    }
     {
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(config, blockConnecting, state, pindexNew, view);
@@ -2472,6 +2808,13 @@ static bool ConnectTip(const Config &config, CValidationState &state,
         assert(flushed);
     }
 
+    // DeVault:: REWARDS, from the block already in memory and before the
+    // chainstate flush below
+    if (pindexNew->nHeight > 0 &&
+        !prewards->UpdateWithBlock(blockConnecting, pindexNew->nHeight)) {
+        return AbortNode(state, "Failed to write rewards");
+    }
+
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n",
@@ -2522,9 +2865,6 @@ static bool ConnectTip(const Config &config, CValidationState &state,
 
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
 
-    // DeVault:: REWARDS
-    if(pindexNew->nHeight > 0) prewards->UpdateWithBlock(config, pindexNew);
-    
     return true;
 }
 
@@ -3815,6 +4155,57 @@ bool ProcessNewBlockHeaders(const Config &config,
     return true;
 }
 
+bool AcceptSnapshotHeaders(const Config &config,
+                           const std::vector<CBlockHeader> &headers,
+                           CValidationState &state) {
+    LOCK(cs_main);
+    // Without an active chain the block tree can't be checked yet
+    const bool fCheck = fCheckBlockIndex;
+    fCheckBlockIndex = false;
+    bool fOk = true;
+    for (const CBlockHeader &header : headers) {
+        if (!AcceptBlockHeader(config, header, state, nullptr)) {
+            fOk = false;
+            break;
+        }
+    }
+    fCheckBlockIndex = fCheck;
+    return fOk;
+}
+
+bool SetSnapshotBase(const Config &config, const uint256 &hash) {
+    const MapAssumeutxo &pinned = config.GetChainParams().Assumeutxo();
+    auto it = pinned.find(hash);
+    if (it == pinned.end()) {
+        return error("%s: no snapshot is pinned at block %s", __func__,
+                     hash.ToString());
+    }
+
+    LOCK(cs_main);
+    CBlockIndex *pindex = LookupBlockIndex(hash);
+    if (!pindex) {
+        return error("%s: snapshot base %s is not in the block index",
+                     __func__, hash.ToString());
+    }
+
+    // Written first: the block index is patched from it on every start
+    if (!pblocktree->WriteSnapshotBase(hash)) {
+        return error("%s: failed to write to the block index database",
+                     __func__);
+    }
+
+    // The chain up to the base counts as processed and valid, so the blocks
+    // built on it can be linked and connected
+    pindex->nChainTx = it->second.nChainTx;
+    if (!pindex->IsValid(BlockValidity::SCRIPTS)) {
+        pindex->nStatus = pindex->nStatus.withValidity(BlockValidity::SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+    }
+    setBlockIndexCandidates.insert(pindex);
+    pindexSnapshotBase = pindex;
+    return true;
+}
+
 /**
  * Store block on disk. If dbp is non-nullptr, the file is known to already
  * reside on disk.
@@ -3880,6 +4271,13 @@ static bool AcceptBlock(const Config &config,
         return true;
     }
 
+    // The history below the base of a UTXO snapshot is not stored, that would
+    // unlink the chain built on it
+    if (pindexSnapshotBase &&
+        pindexSnapshotBase->GetAncestor(pindex->nHeight) == pindex) {
+        return true;
+    }
+
     // Compare block header timestamps and received times of the block and the
     // chaintip.  If they have the same chain height, use these diffs as a
     // tie-breaker, attempting to pick the more honestly-mined block.
@@ -4141,6 +4539,7 @@ void PruneOneBlockFile(const int fileNumber) {
 void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
     for (const int i : setFilesToPrune) {
         CDiskBlockPos pos(i, 0);
+        blockFileMap.Forget(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, i);
@@ -4356,6 +4755,27 @@ static bool LoadBlockIndexDB(const Config &config) {
         vSortedByHeight.emplace_back(pindex->nHeight, pindex);
     }
 
+    // The chain below the base of a UTXO snapshot has no block data, but is
+    // linked with the pinned transaction count
+    uint256 hashSnapshotBase;
+    uint64_t nSnapshotChainTx = 0;
+    if (pblocktree->ReadSnapshotBase(hashSnapshotBase)) {
+        const MapAssumeutxo &pinned = config.GetChainParams().Assumeutxo();
+        auto it = pinned.find(hashSnapshotBase);
+        auto mi = mapBlockIndex.find(hashSnapshotBase);
+        if (it == pinned.end() || mi == mapBlockIndex.end()) {
+            return error("%s: unknown UTXO snapshot base %s", __func__,
+                         hashSnapshotBase.ToString());
+        }
+        pindexSnapshotBase = mi->second;
+        nSnapshotChainTx = it->second.nChainTx;
+        if (!pindexSnapshotBase->IsValid(BlockValidity::SCRIPTS)) {
+            pindexSnapshotBase->nStatus =
+                pindexSnapshotBase->nStatus.withValidity(
+                    BlockValidity::SCRIPTS);
+        }
+    }
+
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
     for (const auto& item : vSortedByHeight) {
         CBlockIndex *pindex = item.second;
@@ -4378,6 +4798,8 @@ static bool LoadBlockIndexDB(const Config &config) {
             } else {
                 pindex->nChainTx = pindex->nTx;
             }
+        } else if (pindex == pindexSnapshotBase) {
+            pindex->nChainTx = nSnapshotChainTx;
         }
 
         if (!pindex->nStatus.hasFailed() && pindex->pprev &&
@@ -4464,10 +4886,6 @@ static bool LoadBlockIndexDB(const Config &config) {
     if (fReindexing) {
         fReindex = true;
     }
-
-    // Check whether we have an address index
-    pblocktree->ReadFlag("addressindex", fAddressIndex);
-    LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
     return true;
 }
 
@@ -4563,6 +4981,14 @@ bool CVerifyDB::VerifyDB(const Config &config, CCoinsView *coinsview,
             break;
         }
 
+        if (pindexSnapshotBase && !pindex->nStatus.hasData()) {
+            // Neither is there data below the base of a UTXO snapshot
+            LogPrintf("VerifyDB(): block verification stopping at height %d "
+                      "(snapshot base, no data)\n",
+                      pindex->nHeight);
+            break;
+        }
+
         CBlock block;
 
         // check level 0: read from disk
@@ -4855,6 +5281,8 @@ void UnloadBlockIndex() {
     pindexBestInvalid = nullptr;
     pindexBestParked = nullptr;
     pindexBestHeader = nullptr;
+    pindexSnapshotBase = nullptr;
+    blockFileMap.Clear();
     g_mempool.clear();
     mapBlocksUnlinked.clear();
     vinfoBlockFile.clear();
@@ -4892,11 +5320,6 @@ bool LoadBlockIndex(const Config &config) {
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -addressindex in the new database
-        fAddressIndex = gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
-        pblocktree->WriteFlag("addressindex", fAddressIndex);
-        LogPrintf("%s: address index %s\n", __func__, fAddressIndex ? "enabled" : "disabled");
-      
     }
     return true;
 }
@@ -4932,166 +5355,398 @@ bool LoadGenesisBlock(const CChainParams &chainparams) {
     return true;
 }
 
-bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
-                           CDiskBlockPos *dbp) {
-    // Map of disk positions for blocks with unknown parent (only used for
-    // reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+/**
+ * Scan a file for blocks, each preceded by the network magic and its size,
+ * and pass them in order to fn with their position in the file. Data that
+ * doesn't parse is skipped. Stops early if fn returns false. This takes over
+ * fileIn and closes it.
+ */
+template <typename Fn>
+static void ReadBlocksFromFile(const CChainParams &chainparams, FILE *fileIn,
+                               Fn fn) {
+    // This takes over fileIn and calls fclose() on it in the CBufferedFile
+    // destructor. Make sure we have at least 2*MAX_TX_SIZE space in there
+    // so any transaction can fit in the buffer.
+    CBufferedFile blkdat(fileIn, 2 * MAX_TX_SIZE, MAX_TX_SIZE + 8, SER_DISK,
+                         CLIENT_VERSION);
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        interruption_point(ShutdownRequested());
 
+        blkdat.SetPos(nRewind);
+        // Start one byte further next time, in case of failure.
+        nRewind++;
+        // Remove former limit.
+        blkdat.SetLimit();
+        unsigned int nSize = 0;
+        try {
+            // Locate a header.
+            uint8_t buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.DiskMagic()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> FLATDATA(buf);
+            if (memcmp(buf, std::begin(chainparams.DiskMagic()),
+                       CMessageHeader::MESSAGE_START_SIZE)) {
+                continue;
+            }
+
+            // Read size.
+            blkdat >> nSize;
+            if (nSize < 80) {
+                continue;
+            }
+        } catch (const std::exception &) {
+            // No valid block header found; don't complain.
+            break;
+        }
+
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            blkdat >> *pblock;
+            nRewind = blkdat.GetPos();
+
+            if (!fn(pblock, nBlockPos, nSize)) {
+                break;
+            }
+        } catch (const std::exception &e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
+                      e.what());
+        }
+    }
+}
+
+// Map of disk positions for blocks with unknown parent (only used for
+// reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/**
+ * Store a block read from a file of blocks, then the blocks found earlier
+ * that were waiting for it. dbp is where the block is when reindexing.
+ * Returns false if the import should stop.
+ */
+static bool ImportBlock(const Config &config,
+                        const std::shared_ptr<CBlock> &pblock,
+                        CDiskBlockPos *dbp, int &nLoaded) {
     const CChainParams &chainparams = config.GetChainParams();
+    const CBlock &block = *pblock;
 
-    int nLoaded = 0;
-    try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile
-        // destructor. Make sure we have at least 2*MAX_TX_SIZE space in there
-        // so any transaction can fit in the buffer.
-        CBufferedFile blkdat(fileIn, 2 * MAX_TX_SIZE, MAX_TX_SIZE + 8, SER_DISK,
-                             CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            interruption_point(ShutdownRequested());
+    // detect out of order blocks, and store them for later
+    uint256 hash = block.GetHash();
+    if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+        mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+        LogPrint(BCLog::REINDEX,
+                 "%s: Out of order block %s, parent %s not known\n", __func__,
+                 hash.ToString(), block.hashPrevBlock.ToString());
+        if (dbp) {
+            mapBlocksUnknownParent.insert(
+                std::make_pair(block.hashPrevBlock, *dbp));
+        }
+        return true;
+    }
 
-            blkdat.SetPos(nRewind);
-            // Start one byte further next time, in case of failure.
-            nRewind++;
-            // Remove former limit.
-            blkdat.SetLimit();
-            unsigned int nSize = 0;
-            try {
-                // Locate a header.
-                uint8_t buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.DiskMagic()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, std::begin(chainparams.DiskMagic()),
-                           CMessageHeader::MESSAGE_START_SIZE)) {
-                    continue;
-                }
+    // process in case the block isn't known yet
+    if (mapBlockIndex.count(hash) == 0 ||
+        !mapBlockIndex[hash]->nStatus.hasData()) {
+        LOCK(cs_main);
+        CValidationState state;
+        if (AcceptBlock(config, pblock, state, true, dbp, nullptr)) {
+            nLoaded++;
+        }
 
-                // Read size.
-                blkdat >> nSize;
-                if (nSize < 80) {
-                    continue;
+        if (state.IsError()) {
+            return false;
+        }
+    } else if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+               mapBlockIndex[hash]->nHeight % 1000 == 0) {
+        LogPrint(BCLog::REINDEX,
+                 "Block Import: already had block %s at height %d\n",
+                 hash.ToString(), mapBlockIndex[hash]->nHeight);
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(config, state)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator,
+                  std::multimap<uint256, CDiskBlockPos>::iterator>
+            range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            auto it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second, config)) {
+                LogPrint(BCLog::REINDEX,
+                         "%s: Processing out of order child %s of %s\n",
+                         __func__, pblockrecursive->GetHash().ToString(),
+                         head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (AcceptBlock(config, pblockrecursive, dummy, true,
+                                &it->second, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
                 }
-            } catch (const std::exception &) {
-                // No valid block header found; don't complain.
-                break;
             }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
 
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
+                           CDiskBlockPos *dbp) {
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    try {
+        ReadBlocksFromFile(
+            config.GetChainParams(), fileIn,
+            [&](const std::shared_ptr<CBlock> &pblock, uint64_t nBlockPos,
+                unsigned int nSize) {
                 if (dbp) {
                     dbp->nPos = nBlockPos;
                 }
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock &block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock &&
-                    mapBlockIndex.find(block.hashPrevBlock) ==
-                        mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX,
-                             "%s: Out of order block %s, parent %s not known\n",
-                             __func__, hash.ToString(),
-                             block.hashPrevBlock.ToString());
-                    if (dbp) {
-                        mapBlocksUnknownParent.insert(
-                            std::make_pair(block.hashPrevBlock, *dbp));
-                    }
-                    continue;
-                }
+                return ImportBlock(config, pblock, dbp, nLoaded);
+            });
+    } catch (const std::runtime_error &e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 ||
-                    !mapBlockIndex[hash]->nStatus.hasData()) {
-                    LOCK(cs_main);
-                    CValidationState state;
-                    if (AcceptBlock(config, pblock, state, true, dbp,
-                                    nullptr)) {
-                        nLoaded++;
-                    }
+    if (nLoaded > 0) {
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
+                  GetTimeMillis() - nStart);
+    }
 
-                    if (state.IsError()) {
-                        break;
+    return nLoaded > 0;
+}
+
+/**
+ * Serialized size of the blocks read ahead from each file by
+ * LoadExternalBlockFiles
+ */
+static const size_t MAX_IMPORT_QUEUE_BYTES = 32 * ONE_MEGABYTE;
+
+namespace {
+
+/** A block on its way through LoadExternalBlockFiles. */
+struct ImportedBlock {
+    std::shared_ptr<CBlock> pblock;
+    CDiskBlockPos pos;
+    unsigned int nSize;
+    //! Whether the context free checks were done, they may have failed
+    bool fChecked;
+};
+
+/** Blocks of one file, in the order they were read. */
+struct ImportFileQueue {
+    std::deque<std::shared_ptr<ImportedBlock>> blocks;
+    //! Serialized size of the blocks in the queue
+    size_t nBytes = 0;
+    bool fDone = false;
+};
+
+} // namespace
+
+bool LoadExternalBlockFiles(const Config &config,
+                            const std::vector<fs::path> &files,
+                            bool fReindexing, int nThreads) {
+    int64_t nStart = GetTimeMillis();
+    const CChainParams &chainparams = config.GetChainParams();
+
+    // Half the threads read and parse files, the others check blocks
+    const size_t nReaders = std::min<size_t>(
+        files.size(), std::max(1, nThreads / 2));
+    const int nCheckers = std::max(1, nThreads - int(nReaders));
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<ImportFileQueue> queues(files.size());
+    std::deque<std::shared_ptr<ImportedBlock>> toCheck;
+    size_t nNextFile = 0;
+    bool fStop = false;
+
+    auto reader = [&]() {
+        while (true) {
+            size_t nFile;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (fStop || nNextFile == files.size()) {
+                    return;
+                }
+                nFile = nNextFile++;
+            }
+            ImportFileQueue &queue = queues[nFile];
+            try {
+                FILE *file = fsbridge::fopen(files[nFile], "rb");
+                if (!file) {
+                    LogPrintf("Warning: Could not open blocks file %s\n",
+                              files[nFile].string());
+                } else {
+                    if (fReindexing) {
+                        LogPrintf("Reindexing block file blk%05u.dat...\n",
+                                  (unsigned int)nFile);
+                    } else {
+                        LogPrintf("Importing blocks file %s...\n",
+                                  files[nFile].string());
                     }
-                } else if (hash !=
-                               chainparams.GetConsensus().hashGenesisBlock &&
-                           mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(
-                        BCLog::REINDEX,
-                        "Block Import: already had block %s at height %d\n",
-                        hash.ToString(), mapBlockIndex[hash]->nHeight);
+                    ReadBlocksFromFile(
+                        chainparams, file,
+                        [&](const std::shared_ptr<CBlock> &pblock,
+                            uint64_t nBlockPos, unsigned int nSize) {
+                            auto item = std::make_shared<ImportedBlock>();
+                            item->pblock = pblock;
+                            if (fReindexing) {
+                                item->pos = CDiskBlockPos(nFile, nBlockPos);
+                            }
+                            item->nSize = nSize;
+                            item->fChecked = false;
+
+                            std::unique_lock<std::mutex> lock(mutex);
+                            // Only the file being stored is guaranteed to
+                            // make progress, the others wait their turn
+                            while (!fStop && !queue.blocks.empty() &&
+                                   queue.nBytes + nSize >
+                                       MAX_IMPORT_QUEUE_BYTES) {
+                                cond.wait(lock);
+                            }
+                            if (fStop) {
+                                return false;
+                            }
+                            queue.blocks.push_back(item);
+                            queue.nBytes += nSize;
+                            toCheck.push_back(item);
+                            cond.notify_all();
+                            return true;
+                        });
+                }
+            } catch (const thread_interrupted &) {
+            } catch (const std::runtime_error &e) {
+                AbortNode(std::string("System error: ") + e.what());
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            queue.fDone = true;
+            cond.notify_all();
+        }
+    };
+
+    auto checker = [&]() {
+        while (true) {
+            std::shared_ptr<ImportedBlock> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!fStop && toCheck.empty()) {
+                    cond.wait(lock);
                 }
+                if (fStop) {
+                    return;
+                }
+                item = std::move(toCheck.front());
+                toCheck.pop_front();
+            }
+            // AcceptBlock doesn't redo the checks once they passed. It finds
+            // out again why they failed, if they did.
+            CValidationState state;
+            CheckBlock(config, *item->pblock, state);
+            std::unique_lock<std::mutex> lock(mutex);
+            item->fChecked = true;
+            cond.notify_all();
+        }
+    };
 
-                // Activate the genesis block so normal node progress can
-                // continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(config, state)) {
-                        break;
-                    }
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nReaders; i++) {
+        threads.emplace_back(reader);
+    }
+    for (int i = 0; i < nCheckers; i++) {
+        threads.emplace_back(checker);
+    }
+
+    // Store the blocks in the order of the files, on this thread
+    int nLoaded = 0;
+    bool fAbort = false;
+    for (ImportFileQueue &queue : queues) {
+        while (true) {
+            std::shared_ptr<ImportedBlock> item;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                // Wait for the next block to be checked or the file to end
+                auto ready = [&]() {
+                    return queue.blocks.empty()
+                               ? queue.fDone
+                               : queue.blocks.front()->fChecked;
+                };
+                while (!ShutdownRequested() && !ready()) {
+                    cond.wait_for(lock, std::chrono::milliseconds(100));
                 }
+                if (ShutdownRequested()) {
+                    fAbort = true;
+                    break;
+                }
+                if (queue.blocks.empty()) {
+                    break;
+                }
+                item = std::move(queue.blocks.front());
+                queue.blocks.pop_front();
+                queue.nBytes -= item->nSize;
+                cond.notify_all();
+            }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this
-                // block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator,
-                              std::multimap<uint256, CDiskBlockPos>::iterator>
-                        range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        auto it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, config)) {
-                            LogPrint(
-                                BCLog::REINDEX,
-                                "%s: Processing out of order child %s of %s\n",
-                                __func__, pblockrecursive->GetHash().ToString(),
-                                head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(config, pblockrecursive, dummy,
-                                            true, &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
+            try {
+                if (!ImportBlock(config, item->pblock,
+                                 fReindexing ? &item->pos : nullptr,
+                                 nLoaded)) {
+                    fAbort = true;
+                    break;
                 }
             } catch (const std::exception &e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
                           e.what());
             }
         }
-    } catch (const std::runtime_error &e) {
-        AbortNode(std::string("System error: ") + e.what());
+        if (fAbort) {
+            break;
+        }
     }
 
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fStop = true;
+        cond.notify_all();
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    interruption_point(ShutdownRequested());
+
     if (nLoaded > 0) {
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
-                  GetTimeMillis() - nStart);
+        LogPrintf("Loaded %i blocks from %u files in %dms\n", nLoaded,
+                  files.size(), GetTimeMillis() - nStart);
     }
 
     return nLoaded > 0;
 }
 
 static void CheckBlockIndex(const Consensus::Params &consensusParams) {
-    if (!fCheckBlockIndex) {
+    // The tree below the base of a UTXO snapshot was never processed, which
+    // the checks below rule out
+    if (!fCheckBlockIndex || pindexSnapshotBase) {
         return;
     }
 
@@ -5418,16 +6073,17 @@ CBlockFileInfo *GetBlockFileInfo(size_t n) {
     return &vinfoBlockFile.at(n);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Transactions whose scripts are checked at once while loading the mempool
+static const size_t MEMPOOL_LOAD_BATCH = 1000;
+
+static CMempoolJournal mempoolJournal(g_mempool);
 
 bool LoadMempool(const Config &config) {
     int64_t nExpiryTimeout =
         gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
-    FILE *filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
-    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
-    if (file.IsNull()) {
-        LogPrintf(
-            "Failed to open mempool file from disk. Continuing anyway.\n");
+    std::vector<CMempoolJournal::Entry> entries;
+    std::map<uint256, Amount> mapDeltas;
+    if (!CMempoolJournal::Read(entries, mapDeltas)) {
         return false;
     }
 
@@ -5436,58 +6092,48 @@ bool LoadMempool(const Config &config) {
     int64_t failed = 0;
     int64_t nNow = GetTime();
 
-    try {
-        uint64_t version;
-        file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
-            return false;
+    double prioritydummy = 0;
+    for (const auto &i : mapDeltas) {
+        g_mempool.PrioritiseTransaction(i.first, prioritydummy, i.second);
+    }
+
+    auto expired = std::remove_if(
+        entries.begin(), entries.end(),
+        [&](const CMempoolJournal::Entry &entry) {
+            return entry.nTime + nExpiryTimeout <= nNow;
+        });
+    skipped = entries.end() - expired;
+    entries.erase(expired, entries.end());
+
+    for (size_t nBatch = 0; nBatch < entries.size();
+         nBatch += MEMPOOL_LOAD_BATCH) {
+        const auto begin = entries.cbegin() + nBatch;
+        const auto end =
+            entries.cbegin() +
+            std::min(entries.size(), nBatch + MEMPOOL_LOAD_BATCH);
+        interruption_point(ShutdownRequested());
+        std::vector<CTransactionRef> txs;
+        for (auto it = begin; it != end; ++it) {
+            txs.push_back(it->tx);
         }
+        std::vector<CValidationState> states;
+        PreCheckMempoolTransactions(config, g_mempool, txs, states);
 
-        uint64_t num;
-        file >> num;
-        double prioritydummy = 0;
-        while (num--) {
+        for (auto it = begin; it != end; ++it) {
             interruption_point(ShutdownRequested());
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            Amount amountdelta(nFeeDelta);
-            if (amountdelta != Amount::zero()) {
-                g_mempool.PrioritiseTransaction(tx->GetId(), prioritydummy,
-                                                amountdelta);
-            }
             CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(
-                    config, g_mempool, state, tx, true /* fLimitFree */,
-                    nullptr /* pfMissingInputs */, nTime,
-                    false /* fOverrideMempoolLimit */,
-                    Amount::zero() /* nAbsurdFee */, false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    ++failed;
-                }
+            LOCK(cs_main);
+            AcceptToMemoryPoolWithTime(
+                config, g_mempool, state, it->tx, true /* fLimitFree */,
+                nullptr /* pfMissingInputs */, it->nTime,
+                false /* fOverrideMempoolLimit */,
+                Amount::zero() /* nAbsurdFee */, false /* test_accept */);
+            if (state.IsValid()) {
+                ++count;
             } else {
-                ++skipped;
+                ++failed;
             }
         }
-        std::map<uint256, Amount> mapDeltas;
-        file >> mapDeltas;
-
-        for (const auto &i : mapDeltas) {
-            g_mempool.PrioritiseTransaction(i.first, prioritydummy, i.second);
-        }
-    } catch (const std::exception &e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing "
-                  "anyway.\n",
-                  e.what());
-        return false;
     }
 
     LogPrintf("Imported mempool transactions from disk: %i successes, %i "
@@ -5497,57 +6143,15 @@ bool LoadMempool(const Config &config) {
 }
 
 bool DumpMempool(void) {
-    int64_t start = GetTimeMicros();
-
-    std::map<uint256, Amount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
-
-    static Mutex dump_mutex;
-    LOCK(dump_mutex);
-
-    {
-        LOCK(g_mempool.cs);
-        for (const auto &i : g_mempool.mapDeltas) {
-            mapDeltas[i.first] = i.second.second;
-        }
-
-        vinfo = g_mempool.infoAll();
-    }
-
-    int64_t mid = GetTimeMicros();
-
-    try {
-        FILE *filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
-        if (!filestr) {
-            return false;
-        }
-
-        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
-
-        uint64_t version = MEMPOOL_DUMP_VERSION;
-        file << version;
+    return mempoolJournal.Compact();
+}
 
-        file << uint64_t(vinfo.size());
-        for (const auto &i : vinfo) {
-            file << *(i.tx);
-            file << int64_t(i.nTime);
-            file << i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetId());
-        }
+void StartMempoolJournal() {
+    mempoolJournal.Start();
+}
 
-        file << mapDeltas;
-        FileCommit(file.Get());
-        file.fclose();
-        RenameOver(GetDataDir() / "mempool.dat.new",
-                   GetDataDir() / "mempool.dat");
-        int64_t last = GetTimeMicros();
-        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n",
-                  (mid - start) * MICRO, (last - mid) * MICRO);
-    } catch (const std::exception &e) {
-        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
-        return false;
-    }
-    return true;
+void StopMempoolJournal() {
+    mempoolJournal.Stop();
 }
 
 //! Guess how far we are in the verification process at the given block index
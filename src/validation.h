@@ -12,9 +12,11 @@
 #include <amount.h>
 #include <blockfileinfo.h>
 #include <chain.h>
+#include <checkqueue.h>
 #include <coins.h>
 #include <consensus/consensus.h>
 #include <diskblockpos.h>
+#include <fs.h>
 #include <protocol.h> // For CMessageHeader::MessageMagic
 #include <script/script_error.h>
 #include <sync.h>
@@ -33,6 +35,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CChainParams;
 class CCoinsViewDB;
 class CConnman;
@@ -46,6 +49,7 @@ class CValidationState;
 class CBudget;
 class CColdRewards;
 class CRewardsViewDB;
+class CRewardsViewCache;
 
 struct CDiskBlockPos;
 struct ChainTxData;
@@ -95,6 +99,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -importthreads default (threads reading and checking blocks, 0 = auto) */
+static const int DEFAULT_IMPORT_THREADS = 0;
+/** Default for -coinprefetch, reading the inputs of blocks in parallel */
+static const bool DEFAULT_COIN_PREFETCH = true;
 /**
  * Number of blocks that can be requested at any given time from a single peer.
  */
@@ -174,6 +182,7 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const char *const DEFAULT_BLOCKFILTERINDEX = "0";
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
@@ -218,12 +227,14 @@ extern uint256 g_best_block;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+extern bool fCoinPrefetch;
 extern bool fAddressIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+extern size_t nRewardsCacheUsage;
 
 /**
  * A fee rate smaller than this is considered zero fee (for relaying, mining and
@@ -257,6 +268,12 @@ extern arith_uint256 nMinimumChainWork;
  */
 extern CBlockIndex *pindexBestHeader;
 
+/**
+ * Base block of the UTXO snapshot the chainstate was loaded from, if any. The
+ * blocks below it have no data and are never connected.
+ */
+extern CBlockIndex *pindexSnapshotBase;
+
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800;
 
@@ -351,6 +368,21 @@ bool ProcessNewBlockHeaders(const Config &config,
                             const CBlockIndex **ppindex = nullptr,
                             CBlockHeader *first_invalid = nullptr);
 
+/**
+ * Accept the header chain of a UTXO snapshot, before there is an active chain.
+ * Call without cs_main held.
+ */
+bool AcceptSnapshotHeaders(const Config &config,
+                           const std::vector<CBlockHeader> &headers,
+                           CValidationState &state);
+
+/**
+ * Make the block with the given hash the base of a UTXO snapshot, with the
+ * transaction count pinned in the chain parameters. The coins database must be
+ * loaded with the snapshot before the chain tip is.
+ */
+bool SetSnapshotBase(const Config &config, const uint256 &hash);
+
 /**
  * Check whether enough disk space is available for an incoming block.
  */
@@ -367,6 +399,17 @@ FILE *OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                            CDiskBlockPos *dbp = nullptr);
 
+/**
+ * Import blocks from several files, as LoadExternalBlockFile does for one.
+ * Worker threads read and parse the files and check the blocks, while the
+ * calling thread stores them in the order of the files. When reindexing, the
+ * files are the block files from blk00000.dat on, whose blocks are indexed
+ * where they are.
+ */
+bool LoadExternalBlockFiles(const Config &config,
+                            const std::vector<fs::path> &files,
+                            bool fReindexing, int nThreads);
+
 /**
  * Ensures we have a genesis block in the block tree, possibly writing one to
  * disk.
@@ -394,6 +437,16 @@ void UnloadBlockIndex();
  */
 void ThreadScriptCheck();
 
+/**
+ * Run an instance of the coin prefetch thread.
+ */
+void ThreadCoinPrefetch();
+
+/**
+ * Run an instance of the thread checking transactions for the mempool.
+ */
+void ThreadTxPreCheck();
+
 /**
  * Check whether we are doing an initial block download (synchronizing from disk
  * or network)
@@ -457,6 +510,34 @@ bool AcceptToMemoryPool(const Config &config, CTxMemPool &pool,
                         const Amount nAbsurdFee = Amount::zero(),
                         bool test_accept = false);
 
+/** The script flags AcceptToMemoryPool checks transactions with */
+uint32_t GetMempoolScriptFlags(const Config &config);
+
+/** The script flags the block on top of pChainTip is checked with */
+uint32_t GetBlockScriptFlags(const Config &config,
+                             const CBlockIndex *pChainTip);
+
+/**
+ * Check transactions about to be given to AcceptToMemoryPool as far as can be
+ * done without holding cs_main or the mempool lock, in parallel on the
+ * pre-check threads: the checks which don't depend on the chain, then their
+ * scripts against a snapshot of the coins they spend, outputs of the
+ * transactions before them in txs included. The locks are only held to take
+ * the snapshot.
+ *
+ * Transactions paying less than the minimum relay fee or the mempool minimum
+ * fee are refused before their scripts run. The scripts found valid under the
+ * mempool flags go in the script execution cache, under cs_main once all the
+ * checks are done, so that AcceptToMemoryPool, which still checks the rest
+ * and does the insertion, finds them there rather than running them with the
+ * locks held. states gets
+ * the outcome for each transaction; one which passed may still be refused by
+ * AcceptToMemoryPool, for missing inputs or conflicts in particular.
+ */
+void PreCheckMempoolTransactions(const Config &config, CTxMemPool &pool,
+                                 const std::vector<CTransactionRef> &txs,
+                                 std::vector<CValidationState> &states);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -557,11 +638,51 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
-bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
+/**
+ * Script checks verify their Schnorr signatures in batches, see
+ * OpenSignatureBatch. Batches of a few dozen signatures get most of the gain,
+ * and smaller ones spread the work better between the threads.
+ */
+template <> struct CCheckBatch<CScriptCheck> {
+    static constexpr uint32_t MAX_CHECKS = 64;
+    static void Open();
+    static bool Close();
+};
+
+/**
+ * Closure checking one transaction for the mempool, without cs_main, against
+ * the coins it spends: see PreCheckMempoolTransactions. The outcome goes to a
+ * state of the caller, and the check itself always succeeds so that one
+ * invalid transaction doesn't stop the others. It only uses the signature
+ * cache, which has its own lock, and leaves the script execution cache alone.
+ */
+class CTxPreCheck {
+private:
+    CTransactionRef tx;
+    std::vector<Coin> coins;
+    uint32_t nFlags;
+    bool sigCacheStore;
+    CValidationState *state;
+
+public:
+    CTxPreCheck() : nFlags(0), sigCacheStore(false), state(nullptr) {}
+    CTxPreCheck(const CTransactionRef &txIn, std::vector<Coin> coinsIn,
+                uint32_t nFlagsIn, bool sigCacheIn, CValidationState *stateIn)
+        : tx(txIn), coins(std::move(coinsIn)), nFlags(nFlagsIn),
+          sigCacheStore(sigCacheIn), state(stateIn) {}
+
+    bool operator()();
+
+    void swap(CTxPreCheck &check) {
+        tx.swap(check.tx);
+        coins.swap(check.coins);
+        std::swap(nFlags, check.nFlags);
+        std::swap(sigCacheStore, check.sigCacheStore);
+        std::swap(state, check.state);
+    }
+};
+
 bool HashOnchainActive(const uint256 &hash);
-bool GetAddrIndex(const std::string& addr,
-                  std::vector<std::pair<CAddrIndexKey, Amount> > &addressIndex,
-                  int start = 0, int end = 0);
 
 std::string GetAddr(const CTxOut& out);
 
@@ -570,6 +691,17 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
                        const Config &config);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Config &config);
+/**
+ * Read a block as it is serialized in its block file, for peers and REST
+ * clients. The block files are memory mapped, so serving a block only copies
+ * its bytes and doesn't parse it.
+ */
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block, const CDiskBlockPos &pos,
+                          const CMessageHeader::MessageMagic &messageStart);
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex,
+                          const CMessageHeader::MessageMagic &messageStart);
+bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -698,7 +830,7 @@ extern std::unique_ptr<CBlockTreeDB> pblocktree;
 extern std::unique_ptr<CRewardsViewDB> prewardsdb;
 extern std::unique_ptr<CColdRewards> prewards;
 extern std::unique_ptr<CBudget> pbudget;
-//extern std::unique_ptr<CCoinsViewCache> prewardsTip;
+extern std::unique_ptr<CRewardsViewCache> prewardsTip;
 
 
 /**
@@ -735,4 +867,10 @@ bool DumpMempool();
 /** Load the mempool from disk. */
 bool LoadMempool(const Config &config);
 
+/** Start writing the changes to the mempool to disk in the background. */
+void StartMempoolJournal();
+
+/** Write the last changes to the mempool to disk, and stop. */
+void StopMempoolJournal();
+
 #endif // BITCOIN_VALIDATION_H
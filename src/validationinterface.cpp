@@ -110,6 +110,11 @@ void RegisterValidationInterface(CValidationInterface *pwalletIn) {
 }
 
 void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
+    // Indexes are stopped on destruction, possibly once the signals are gone
+    // or without them ever being set up (unit tests).
+    if (!g_signals.m_internals) {
+        return;
+    }
     g_signals.m_internals->BlockChecked.disconnect(
         boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
     g_signals.m_internals->Broadcast.disconnect(boost::bind(
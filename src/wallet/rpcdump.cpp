@@ -1449,7 +1449,12 @@ static UniValue getmyrewardinfo(const Config &config, const JSONRPCRequest &requ
     const int nMaxYearIndex = config.GetChainParams().GetConsensus().nPerCentPerYear.size()-1;
 
     UniValue result(UniValue::VARR);
-    std::vector<CRewardValue> rewards = prewards->GetOrderedRewards();
+    std::vector<CRewardValue> rewards;
+    {
+        // Reading the rewards flushes pending updates of the rewards cache
+        LOCK(cs_main);
+        rewards = prewards->GetOrderedRewards();
+    }
   
     UniValue total(UniValue::VOBJ);
     total.push_back(Pair("Total Number of Rewards", (int)prewards->GetNumberOfCandidates()));